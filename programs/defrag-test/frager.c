@@ -68,7 +68,9 @@ unsigned long chunk_size = 32 * 1024;
 int is_random = 0;
 int verbose = 0;
 int do_refcount = 0;
-union log_handler w_log;
+int binary_log = 0;
+FILE *w_log;
+struct wu_log w_wu_log;
 
 pid_t *child_pid_list;
 
@@ -76,7 +78,10 @@ static int usage(void)
 {
 	fprintf(stdout, "frager <-n num_files_per_process> <-m num_processes> "
 		"<-l file_size> <-k chunk_size> <-o logfiles_place> <-r> <-v>"
-		" <-w work_place> [-R]\n");
+		" <-w work_place> [-R] [-b] [--seed seed]\n");
+	fprintf(stdout, "-b writes write records in binary log format.\n");
+	fprintf(stdout, "--seed replays the random choices of an earlier "
+		"run.\n");
 	fprintf(stdout, "Example:\n"
 			"       ./frager -n 10 -m 10 -l 104857600 -k 32768 -o "
 		"logs -w /storage\n");
@@ -125,7 +130,7 @@ int parse_opts(int argc, char **argv)
 	char c;
 
 	while (1) {
-		c = getopt(argc, argv, "n:m:w:hk:rRl:vo:");
+		c = getopt(argc, argv, "n:m:w:hk:rRl:vo:b");
 		if (c == -1)
 			break;
 
@@ -154,6 +159,9 @@ int parse_opts(int argc, char **argv)
 		case 'R':
 			do_refcount = 1;
 			break;
+		case 'b':
+			binary_log = 1;
+			break;
 		case 'v':
 			verbose = 1;
 			break;
@@ -175,6 +183,8 @@ int setup(int argc, char *argv[])
 	work_place = NULL;
 	is_random = 0;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -207,47 +217,6 @@ void teardown()
 		free(child_pid_list);
 }
 
-int write_at(int fd, const void *buf, size_t count, off_t offset)
-{
-	int ret;
-
-	size_t bytes_write;
-
-	ret = pwrite(fd, buf, count, offset);
-
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "write error %d: \"%s\"\n", ret, strerror(ret));
-		return -1;
-	}
-
-	bytes_write = ret;
-	while (bytes_write < count) {
-
-		ret = pwrite(fd, buf + bytes_write, count - bytes_write,
-			     offset + bytes_write);
-
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "write error %d: \"%s\"\n", ret,
-				strerror(ret));
-			return -1;
-		}
-
-		bytes_write += ret;
-	}
-
-	return 0;
-}
-
-unsigned long get_rand_ul(unsigned long min, unsigned long max)
-{
-	if (min == 0 && max == 0)
-		return 0;
-
-	return min + (rand() % (max - min + 1));
-}
-
 int reflink(const char *oldpath, const char *newpath)
 {
 	int fd, ret;
@@ -290,6 +259,7 @@ int append_write_file(char *file_name, char *logfile_name,
 	FILE *logfile = NULL;
 
 	num_chunks = (file_size + chunk_size - 1) / chunk_size;
+	w_wu_log.wl_fd = -1;
 
 	pattern = (char *)malloc(chunk_size);
 	write_order_map = (unsigned long *)malloc(num_chunks *
@@ -309,7 +279,7 @@ int append_write_file(char *file_name, char *logfile_name,
 
 		for (i = 1; i < num_chunks; i++) {
 again:
-			index = get_rand_ul(1, num_chunks - 1);
+			index = get_rand(1, num_chunks - 1);
 			if (!write_order_map[index])
 				write_order_map[index] = i;
 			else
@@ -326,11 +296,18 @@ again:
 		goto bail;
 	}
 
-	ret = open_logfile(&logfile, logfile_name, 0);
-	if (ret)
-		goto bail;
+	if (binary_log) {
+		ret = wu_log_create(&w_wu_log, logfile_name, chunk_size,
+				    file_size, 1);
+		if (ret)
+			goto bail;
+	} else {
+		ret = open_logfile(&logfile, logfile_name, 0);
+		if (ret)
+			goto bail;
 
-	w_log.stream_log = logfile;
+		w_log = logfile;
+	}
 
 	for (i = 0; i < num_chunks; i++) {		
 
@@ -353,7 +330,10 @@ again:
 		/*
 		 * writes the log records into local logfile.
 		 */
-		ret = log_write(&wu, w_log, 0);
+		if (binary_log)
+			ret = wu_log_write(&w_wu_log, &wu);
+		else
+			ret = log_write(&wu, w_log);
 		if (ret < 0)
 			goto bail;
 	}
@@ -368,8 +348,11 @@ bail:
 	if (fd > 0)
 		close(fd);
 
-	if (w_log.stream_log)
-		fclose(w_log.stream_log);
+	if (w_log)
+		fclose(w_log);
+
+	if (binary_log)
+		wu_log_close(&w_wu_log);
 
 	return ret;
 }
@@ -380,7 +363,6 @@ int write_files(unsigned long long files,
 {
 	int status = 0, ret = 0;
 	pid_t pid;
-	unsigned int seed;
 	unsigned long long i, j;
 	char path[PATH_MAX], log_path[PATH_MAX], ref_path[PATH_MAX];
 
@@ -395,10 +377,7 @@ int write_files(unsigned long long files,
 
 		if (pid == 0) {
 
-			if (is_random) {
-				seed = time(NULL) ^ getpid();
-				srandom(seed);
-			}
+			o2test_rand_stream(i + 1);
 
 			snprintf(path, PATH_MAX, "%s/%s-%d", dir, hostname,
 				 getpid());
@@ -33,6 +33,9 @@
 
 #include <ocfs2/ocfs2.h>
 
+#include "io_ops.h"
+#include "mpi_rand.h"
+
 #define HOSTNAME_MAX_SZ		100
 #define MPI_RET_SUCCESS		0
 #define MPI_RET_FAILED		1
@@ -84,7 +87,7 @@ static void root_printf(const char *fmt, ...)
 static void usage(void)
 {
        root_printf("Usage: multi_defrager [-s start] [-l len] [-t threshold] "
-		   "[-w working directory] [-r] [-v]\n");
+		   "[-w working directory] [-r] [-v] [--seed seed]\n");
 	MPI_Finalize();
 	exit(1);
 
@@ -168,11 +171,11 @@ static void setup(int argc, char *argv[], struct ocfs2_move_extents *range)
 
 	memset(range, 0, sizeof(*range));
 
+	MPI_Seed_Setup(&argc, argv);
+
 	if (parse_opts(argc, argv, range))
 		usage();
 
-	srand(getpid());
-
 	MPI_Barrier_Sync();
 
 	return;
@@ -201,49 +204,6 @@ static void should_exit(int ret)
 	}
 }
 
-unsigned long get_rand_ul(unsigned long min, unsigned long max)
-{
-	if (min == 0 && max == 0)
-		return 0;
-
-	return min + (rand() % (max - min + 1));
-}
-
-int open_file(const char *filename, int flags)
-{
-	int fd, ret = 0;
-
-	fd = open64(filename, flags, FILE_MODE);
-	if (fd < 0) {
-		ret = errno;
-		abort_printf("open file %s failed:%d:%s\n", filename,
-			     ret, strerror(ret));
-		return -1;
-	}
-
-	return fd;
-}
-
-int get_i_size(char *filename, unsigned long *size)
-{
-	struct stat stat;
-	int ret = 0, fd;
-
-	fd = open_file(filename, O_RDONLY);
-	if (fd)
-		return fd;
-
-	ret = fstat(fd, &stat);
-	if (ret == -1) {
-		ret = errno;
-		abort_printf("stat failure %d: %s\n", ret, strerror(ret));
-		return ret;
-	}
-
-	*size = (unsigned long) stat.st_size;
-	return ret;
-}
-
 static int defrag_file(char *file, struct ocfs2_move_extents *range)
 {
 	int fd = -1, ret = 0;
@@ -300,9 +260,9 @@ do_defrag:
 			ret = get_i_size(path, &i_size);
 			if (ret)
 				goto out;
-			range->me_start = get_rand_ul(0, range->me_start );
+			range->me_start = get_rand(0, range->me_start );
 			range->me_len =
-				get_rand_ul(range->me_threshold, i_size);
+				get_rand(range->me_threshold, i_size);
 		}
 
 		if (verbose)
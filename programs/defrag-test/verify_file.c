@@ -47,16 +47,39 @@
 
 #include "file_verify.h"
 
-char *filename = NULL, *logname = NULL;
+char *filename = NULL, *logname = NULL, *convname = NULL;
 unsigned long filesize = 0;
 unsigned long chunksize = 0;
-union log_handler r_log;
+FILE *r_log;
 int verbose = 0;
+int is_binary = 0;
+unsigned int num_threads = 1;
+unsigned long batch_size = 0;
+int listen_port = 0;
+int num_senders = 1;
+int table_mode = WU_TABLE_DENSE;
+char *spill_dir = NULL;
 
 static int usage(void)
 {
-	fprintf(stdout, "frager <-f file> <-o log> <-l filesize> "
-		"<-k chunksize> <-v>\n");
+	fprintf(stdout, "verify_file <-f file> <-o log> <-l filesize> "
+		"<-k chunksize> [-c binlog] [-t threads] [-b batchsize] "
+		"[-T table] [-S spilldir] <-v>\n");
+	fprintf(stdout, "verify_file <-f file> <-L port> [-n senders] "
+		"[-t threads] [-b batchsize] [-T table] [-S spilldir] "
+		"<-v>\n");
+	fprintf(stdout, "Binary logs are detected automatically, filesize "
+		"and chunksize default to the ones in their header.\n"
+		"-c converts a text log into binary log binlog and verifies "
+		"against the result.\n"
+		"-t splits verification across threads, each reading "
+		"batchsize bytes at a time.\n"
+		"-L receives write record streams from senders writers on "
+		"port instead of reading a log, merging them as they "
+		"arrive.\n"
+		"-T keeps the latest write records in a dense(default), "
+		"sparse or spill table, the spill one being a file under "
+		"spilldir(default /tmp).\n");
 	fprintf(stdout, "Example:\n"
 			"       ./verify_file -f /storage/testfile -o "
 		"logs/logfile -l 104857600 -k 32768\n");
@@ -68,7 +91,7 @@ int parse_opts(int argc, char **argv)
 	char c;
 
 	while (1) {
-		c = getopt(argc, argv, "f:o:l:hvk:");
+		c = getopt(argc, argv, "f:o:l:hvk:c:t:b:L:n:T:S:");
 		if (c == -1)
 			break;
 
@@ -81,9 +104,33 @@ int parse_opts(int argc, char **argv)
 			break;
 		case 'f':
 			filename = optarg;
+			break;
 		case 'o':
 			logname = optarg;
 			break;
+		case 'c':
+			convname = optarg;
+			break;
+		case 't':
+			num_threads = atol(optarg);
+			break;
+		case 'b':
+			batch_size = atol(optarg);
+			break;
+		case 'L':
+			listen_port = atoi(optarg);
+			break;
+		case 'n':
+			num_senders = atoi(optarg);
+			break;
+		case 'T':
+			table_mode = wu_table_parse_mode(optarg);
+			if (table_mode < 0)
+				return -1;
+			break;
+		case 'S':
+			spill_dir = optarg;
+			break;
 		case 'v':
 			verbose = 1;
 			break;
@@ -108,12 +155,28 @@ int setup(int argc, char *argv[])
 		usage();
 	}
 	
-	if ((!filename) || (!logname)) {
+	if ((!filename) || (!logname && !listen_port)) {
 		fprintf(stderr, "filename and logname is a mandatory"
 			" option.\n");
 		usage();
 	}
 
+	set_verify_parallel(num_threads, batch_size);
+	set_verify_table(table_mode, spill_dir);
+
+	if (listen_port) {
+		if (num_senders <= 0) {
+			fprintf(stderr, "senders should be positive.\n");
+			usage();
+		}
+		return 0;
+	}
+
+	if (is_wu_log(logname)) {
+		is_binary = 1;
+		return 0;
+	}
+
 	if ((!filesize) || (!chunksize)) {
 		fprintf(stderr, "filesize and chunksize is a mandatory "
 			"option.\n");
@@ -121,21 +184,71 @@ int setup(int argc, char *argv[])
 	}
 
 	ret = open_logfile(&logfile, logname, 1);
-	r_log.stream_log = logfile;
-	
+	r_log = logfile;
+	if (ret || !convname)
+		return ret;
+
+	ret = wu_log_convert(logfile, convname, chunksize, filesize);
+	fclose(logfile);
+	if (ret)
+		return ret;
+
+	logname = convname;
+	is_binary = 1;
+
+	return ret;
+}
+
+static int receive_and_verify(void)
+{
+	int ret, lsn_sock;
+	struct wu_table wt;
+	unsigned long records;
+
+	lsn_sock = wu_sink_listen(listen_port);
+	if (lsn_sock < 0)
+		return lsn_sock;
+
+	ret = wu_sink_receive(lsn_sock, num_senders, &wt, &records);
+	close(lsn_sock);
+	if (ret)
+		return ret;
+
+	if (verbose)
+		fprintf(stdout, "Received %lu write records from %d "
+			"senders.\n", records, num_senders);
+
+	ret = verify_file_wu_table(&wt, filename, verbose);
+	wu_table_free(&wt);
+
 	return ret;
 }
 
 int main(int argc, char *argv[])
 {
 	int ret = 0;
+	struct wu_log wl;
 
 	ret = setup(argc, argv);
 	if (ret)
 		return ret;
 
-	ret = verify_file(0, r_log.stream_log, NULL, filename, filesize,
-			  chunksize, verbose);
+	if (listen_port)
+		return receive_and_verify();
+
+	if (is_binary) {
+		ret = wu_log_map(&wl, logname);
+		if (ret)
+			return ret;
+
+		ret = verify_file_wu_log(&wl, filename, filesize, chunksize,
+					 verbose);
+		wu_log_unmap(&wl);
+
+		return ret;
+	}
+
+	ret = verify_file(r_log, filename, filesize, chunksize, verbose);
 
 	return ret;
 }
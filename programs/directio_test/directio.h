@@ -44,8 +44,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-#include <ocfs2/byteorder.h>
-#include "crc32table.h"
+#include "crc32.h"
+#include "io_ops.h"
+#include "ioq.h"
+#include "buf_pool.h"
+#include "file_prep.h"
+#include "wu_stream.h"
 
 #ifndef O_DIRECT
 #define O_DIRECT		040000 /* direct disk access hint */
@@ -64,9 +68,37 @@
 #define FIHL_TEST		0x00000004
 #define DSCV_TEST		0x00000008
 #define VERI_TEST		0x00000010
+#define SWEP_TEST		0x00000020
 
 #define HOSTNAME_LEN	256
 
+#define SWEEP_MAX_POINTS	16
+
+/*
+ * Queue depth and block size matrix for the async sweep, every engine
+ * runs every (bs, depth) point, writes first so reads find real data.
+ */
+struct sweep_opts {
+	int so_engines[IOQ_ENGINE_NUM];
+	int so_nr_engines;
+	unsigned long so_depths[SWEEP_MAX_POINTS];
+	int so_nr_depths;
+	unsigned long so_sizes[SWEEP_MAX_POINTS];
+	int so_nr_sizes;
+	unsigned long so_nr_ios;
+};
+
+/*
+ * How the original file gets prepared, batch_bytes of chunks per write
+ * and po_depth writes in flight, see prep_orig_file_in_batches().
+ */
+struct prep_opts {
+	size_t po_batch;
+	unsigned int po_depth;
+	int po_direct;
+	int po_report;
+};
+
 struct write_unit {
 	unsigned long wu_chunk_no;
 	unsigned long long wu_timestamp;
@@ -74,39 +106,25 @@ struct write_unit {
 	char wu_char;
 };
 
-union log_handler {
-	FILE *stream_log;
-	int socket_log;
-};
-
-union semun {
-	int val;                    /* value for SETVAL */
-	struct semid_ds *buf;       /* buffer for IPC_STAT, IPC_SET */
-	unsigned short int *array;  /* array for GETALL, SETALL */
-	struct seminfo *__buf;      /* buffer for IPC_INFO */
-};
-
-unsigned long get_rand_ul(unsigned long min, unsigned long max);
-
-int open_file(const char *filename, int flags);
-int get_i_size(char *filename, unsigned long *size);
-int read_at(int fd, void *buf, size_t count, off_t offset);
-int write_at(int fd, const void *buf, size_t count, off_t offset);
-
 void prep_rand_dest_write_unit(struct write_unit *wu, unsigned long chunk_no);
 int do_write_chunk(int fd, struct write_unit wu);
 int do_read_chunk(int fd, unsigned long chunk_no, struct write_unit *wu);
-int prep_orig_file_in_chunks(char *file_name, unsigned long filesize);
-int verify_file(int is_remote, FILE *logfile, struct write_unit *wus,
-		char *filename, unsigned long filesize);
-
-int init_sock(char *serv, int port);
-int set_semvalue(int sem_id, int val);
-int semaphore_init(int val);
-int semaphore_close(int sem_id);
-int semaphore_p(int sem_id);
-int semaphore_v(int sem_id);
+void prep_init_opts(struct prep_opts *po);
+int prep_orig_file(struct prep_opts *po, char *file_name,
+		   unsigned long filesize);
+int read_log(FILE *logfile, struct wu_table *wt);
+int verify_file(struct wu_table *wt, char *filename, unsigned long filesize);
 
 int open_logfile(FILE **logfile, const char *logname);
-int log_write(struct write_unit *wu, union log_handler log);
+int log_write(struct write_unit *wu, FILE *logfile);
+int log_stream_write(struct wu_stream *ws, struct write_unit *wu);
+
+void sweep_init_opts(struct sweep_opts *so);
+int sweep_parse_engines(struct sweep_opts *so, char *list);
+int sweep_parse_list(unsigned long *vals, int *nr, char *list);
+int sweep_check_opts(struct sweep_opts *so, unsigned long filesize);
+void sweep_print_header(FILE *fp);
+void sweep_print_row(FILE *fp, int engine, int write, unsigned long bs,
+		     unsigned long depth, unsigned long long bytes,
+		     double seconds, struct lat_hist *lat);
 #endif
@@ -9,6 +9,8 @@
  *   - Apend writes outside i_size.
  *   - Writes within holes.
  *   - Destructive test.
+ *   - Throughput/latency sweep over io engines, block sizes and
+ *     queue depths.
  *
  * XXX: This could easily be turned into an mpi program.
  *
@@ -26,9 +28,6 @@
 
 #include "directio.h"
 
-int open_rw_flags = FILE_RW_FLAGS;
-int open_ro_flags = FILE_RO_FLAGS;
-
 unsigned long file_size = 1024 * 1024;
 
 static char *test_mode;
@@ -37,13 +36,20 @@ static char workfile[PATH_MAX];
 static char log_path[PATH_MAX];
 static char lsnr_addr[HOSTNAME_LEN];
 
-static union log_handler log;
+static FILE *log_fp;
+static int listen_records;
+static struct wu_stream stream;
 
 static unsigned long port = 9999;
 static unsigned long num_children = 10;
 
 static pid_t *child_pid_list;
 
+static struct sweep_opts sweep;
+static FILE *sweep_fp;
+
+static struct prep_opts prep;
+
 int test_flags = 0x00000000;
 int verbose = 0;
 
@@ -53,7 +59,10 @@ static void usage(void)
 {
 	printf("Usage: directio_test [-p concurrent_process] "
 	       "[-l file_size] [-o logfile] <-w workfile>  -b -a -f "
-	       "[-d <-A listener_addres> <-P listen_port>] -v -V\n"
+	       "[-d <-A listener_addres> <-P listen_port>] -v "
+	       "[-V [-L <-P listen_port>]] "
+	       "[-Q [-e engines] [-q depths] [-s sizes] [-n nr_ios]] "
+	       "[-B prep_batch] [-D prep_depth] [-O] [-R] [--seed seed]\n"
 	       "file_size should be multiples of 512 bytes\n"
 	       "-v enable verbose mode."
 	       "-b enable basic directio test within i_size.\n"
@@ -61,7 +70,26 @@ static void usage(void)
 	       "-f enable fill hole test.\n"
 	       "-d enable destructive test, also need to specify the "
 	       "listener address and port\n"
-	       "-V enable verification test.\n\n");
+	       "-V enable verification test.\n"
+	       "-L makes -V receive the write records the destructive "
+	       "test's concurrent_process writers stream to listen_port "
+	       "instead of reading logfile, start it on another node "
+	       "first.\n"
+	       "-Q enable the io engine sweep, a CSV matrix of throughput, "
+	       "IOPS and latency goes to stdout or to the logfile.\n"
+	       "-e comma separated engines to sweep, out of sync, libaio "
+	       "and io_uring, all of them by default.\n"
+	       "-q comma separated queue depths, 1,2,4,8,16,32 by default, "
+	       "sync only runs at depth 1.\n"
+	       "-s comma separated block sizes, 4096,65536,1048576 by "
+	       "default.\n"
+	       "-n number of I/Os per sweep point, 4096 by default.\n"
+	       "-B bytes of chunks built per write while preparing the "
+	       "file, 4M by default.\n"
+	       "-D number of those writes kept in flight, 1 by default.\n"
+	       "-O prepare the file with O_DIRECT writes.\n"
+	       "-R report the throughput of preparing the file.\n"
+	       "--seed replays the random choices of an earlier run.\n\n");
 	exit(1);
 }
 
@@ -69,9 +97,12 @@ static int parse_opts(int argc, char **argv)
 {
 	char c;
 
+	sweep_init_opts(&sweep);
+	prep_init_opts(&prep);
+
 	while (1) {
 		c = getopt(argc, argv,
-			   "p:l:o:bafdVvw:h:A:P:");
+			   "p:l:o:bafdVLvw:h:A:P:Qe:q:s:n:B:D:OR");
 		if (c == -1)
 			break;
 
@@ -117,6 +148,43 @@ static int parse_opts(int argc, char **argv)
 			test_mode = "VERIFY";
 			num_tests++;
 			break;
+		case 'L':
+			listen_records = 1;
+			break;
+		case 'Q':
+			test_flags |= SWEP_TEST;
+			test_mode = "SWEEP";
+			num_tests++;
+			break;
+		case 'e':
+			if (sweep_parse_engines(&sweep, optarg))
+				return -EINVAL;
+			break;
+		case 'q':
+			if (sweep_parse_list(sweep.so_depths,
+					     &sweep.so_nr_depths, optarg))
+				return -EINVAL;
+			break;
+		case 's':
+			if (sweep_parse_list(sweep.so_sizes,
+					     &sweep.so_nr_sizes, optarg))
+				return -EINVAL;
+			break;
+		case 'n':
+			sweep.so_nr_ios = atol(optarg);
+			break;
+		case 'B':
+			prep.po_batch = atol(optarg);
+			break;
+		case 'D':
+			prep.po_depth = atol(optarg);
+			break;
+		case 'O':
+			prep.po_direct = 1;
+			break;
+		case 'R':
+			prep.po_report = 1;
+			break;
 		case 'v':
 			verbose = 1;
 			break;
@@ -142,6 +210,9 @@ static int parse_opts(int argc, char **argv)
 			return -EINVAL;
 	}
 
+	if (listen_records && !(test_flags & VERI_TEST))
+		return -EINVAL;
+
 	if ((file_size % DIRECTIO_SLICE) != 0) {
 		fprintf(stderr, "file size in destructive tests is expected to "
 			"be %d aligned, your file size %lu is not allowed.\n",
@@ -149,6 +220,11 @@ static int parse_opts(int argc, char **argv)
 		return -EINVAL;
 	}
 
+	if (test_flags & SWEP_TEST) {
+		if (sweep_check_opts(&sweep, file_size) || !sweep.so_nr_ios)
+			return -EINVAL;
+	}
+
 	if (!num_tests) {
 		fprintf(stdout, "You'd better specify at least one test.\n");
 		return 0;
@@ -164,28 +240,31 @@ static int parse_opts(int argc, char **argv)
 
 static int setup(int argc, char *argv[])
 {
-	int ret = 0, sockfd;
-	FILE *logfile = NULL;
+	int ret = 0;
+
+	o2test_seed_setup(&argc, argv, 0);
 
 	if (parse_opts(argc, argv))
 		usage();
 
-	if (test_flags & DSCV_TEST) {
-
-		sockfd = init_sock(lsnr_addr, port);
-		if (sockfd < 0) {
-			fprintf(stderr, "init socket failed.\n");
-			return sockfd;
-		}
-
-		log.socket_log = sockfd;	
-
-	} else {
-		ret = open_logfile(&logfile, log_path);
+	if (test_flags & SWEP_TEST) {
+		if (strcmp(log_path, "")) {
+			sweep_fp = fopen(log_path, "w");
+			if (!sweep_fp) {
+				ret = errno;
+				fprintf(stderr, "Error %d opening logfile: "
+					"%s\n", ret, strerror(ret));
+				return -EINVAL;
+			}
+		} else
+			sweep_fp = stdout;
+	} else if (!(test_flags & DSCV_TEST) && !listen_records) {
+		/*
+		 * Destructive writers and -L stream the write records.
+		 */
+		ret = open_logfile(&log_fp, log_path);
 		if (ret)
 			return ret;
-
-		log.stream_log = logfile;
 	}
 
 	child_pid_list = (pid_t *)malloc(sizeof(pid_t) * num_children);
@@ -197,12 +276,12 @@ static int teardown(void)
 {
 	int ret = 0;
 
-	if (test_flags & DSCV_TEST) {
-		if (log.socket_log)
-			close(log.socket_log);
+	if (test_flags & SWEP_TEST) {
+		if (sweep_fp && sweep_fp != stdout)
+			fclose(sweep_fp);
 	} else {
-		if (log.stream_log)
-			fclose(log.stream_log);
+		if (log_fp)
+			fclose(log_fp);
 	}
 
 	if (child_pid_list)
@@ -249,6 +328,17 @@ static void sigterm_handler()
 	kill(getpid(), SIGTERM);
 }
 
+/*
+ * Ends this child's record stream and gives the flushers of the others
+ * time to ship what they have queued, records still queued when the box
+ * goes down would fail the verification.
+ */
+static void drain_records(void)
+{
+	wu_stream_close(&stream);
+	usleep(2 * WU_STREAM_FLUSH_MS * 1000);
+}
+
 static int basic_test(void)
 {
 	pid_t pid;
@@ -267,7 +357,7 @@ static int basic_test(void)
 
 	if (test_flags & BASC_TEST) {
 		fprintf(stdout, "# Prepare file in %lu length.\n", file_size);
-		ret = prep_orig_file_in_chunks(workfile, file_size);
+		ret = prep_orig_file(&prep, workfile, file_size);
 		if (ret)
 			return ret;
 	}
@@ -306,7 +396,15 @@ static int basic_test(void)
 
 		if (pid == 0) {
 
-			srand(getpid());
+			o2test_rand_stream(i + 1);
+
+			if (test_flags & DSCV_TEST) {
+				ret = wu_stream_open(&stream, lsnr_addr, port,
+						     CHUNK_SIZE, file_size,
+						     0, 0);
+				if (ret)
+					goto child_bail;
+			}
 
 			for (j = 0; j < num_chunks; j++) {
 				if (verbose) 
@@ -322,7 +420,7 @@ static int basic_test(void)
 				if (test_flags & APPD_TEST)
 					chunk_no = j;
 				else
-					chunk_no = get_rand_ul(0, num_chunks - 1);
+					chunk_no = get_rand(0, num_chunks - 1);
 
 				prep_rand_dest_write_unit(&wu, chunk_no);
 
@@ -330,7 +428,10 @@ static int basic_test(void)
 				if (ret < 0)
 					goto child_bail;
 
-				ret = log_write(&wu, log);
+				if (test_flags & DSCV_TEST)
+					ret = log_stream_write(&stream, &wu);
+				else
+					ret = log_write(&wu, log_fp);
 				if (ret < 0)
 					goto child_bail;
 
@@ -349,7 +450,7 @@ static int basic_test(void)
 				 */
 
 				if ((j > 1) && (j < num_chunks - 1)) {
-					if (get_rand_ul(1, num_chunks) == num_chunks / 2) {
+					if (get_rand(1, num_chunks) == num_chunks / 2) {
 
 						if (semaphore_p(sem_id) < 0) {
 							ret = -1;
@@ -359,6 +460,7 @@ static int basic_test(void)
 						fprintf(stdout, "#%d process "
 							"tries to crash the "
 							"box.\n", getpid());
+						drain_records();
 						if (system("echo b>/proc/sysrq-trigger") < 0) {
 							fprintf(stderr, "#%d process "
 								"tries to enable sysrq-trigger "
@@ -376,6 +478,7 @@ static int basic_test(void)
 						fprintf(stdout, "#%d process "
 							"tries to crash the "
 							"box.\n", getpid());
+						drain_records();
 						if (system("echo b>/proc/sysrq-trigger") < 0) {
 							fprintf(stderr, "#%d process "
 								"tries to enable sysrq-trigger "
@@ -385,6 +488,11 @@ static int basic_test(void)
 				}
 			}
 child_bail:
+			if (test_flags & DSCV_TEST) {
+				if (wu_stream_close(&stream) < 0 && !ret)
+					ret = -1;
+			}
+
 			if (fd)
 				close(fd);
 
@@ -421,12 +529,113 @@ child_bail:
 
 static int verify_test(void)
 {
-	int ret = 0;
+	int ret = 0, lsn_sock;
+	unsigned long records;
+	struct wu_table wt;
+
+	if (listen_records) {
+		fprintf(stdout, "# Receive write records of %lu writers "
+			"on port %lu\n", num_children, port);
+		lsn_sock = wu_sink_listen(port);
+		if (lsn_sock < 0)
+			return lsn_sock;
+
+		set_sink_crash_wait(WU_SINK_CRASH_WAIT);
+		ret = wu_sink_receive(lsn_sock, num_children, &wt, &records);
+		close(lsn_sock);
+		if (ret)
+			return ret;
+
+		fprintf(stdout, "# Received %lu write records\n", records);
+		if (wt.wt_chunksize != CHUNK_SIZE) {
+			fprintf(stderr, "Writers log %u byte chunks, not %d.\n",
+				wt.wt_chunksize, CHUNK_SIZE);
+			ret = -EINVAL;
+			goto bail;
+		}
+		file_size = wt.wt_num_chunks * wt.wt_chunksize;
+	} else {
+		ret = verify_table_init(&wt, file_size, CHUNK_SIZE);
+		if (ret)
+			return ret;
 
-	ret = 
+		ret = read_log(log_fp, &wt);
+		if (ret)
+			goto bail;
+	}
 
 	fprintf(stdout, "# Verify file %s in chunks\n", workfile);
-	ret = verify_file(0, log.stream_log, NULL, workfile, file_size);
+	ret = verify_file(&wt, workfile, file_size);
+bail:
+	wu_table_free(&wt);
+
+	return ret;
+}
+
+/*
+ * Random O_DIRECT I/O over the whole file for every point of the
+ * engine x rw x block size x queue depth matrix, one CSV row each.
+ */
+static int sweep_test(void)
+{
+	int fd, ret = 0, e, w, s, q, engine;
+	struct ioq_job job;
+	struct ioq_result res;
+
+	open_rw_flags |= O_DIRECT;
+	open_ro_flags |= O_DIRECT;
+
+	fprintf(stdout, "# Prepare file in %lu length.\n", file_size);
+	ret = prep_orig_file(&prep, workfile, file_size);
+	if (ret)
+		return ret;
+
+	fd = open_file(workfile, open_rw_flags);
+	if (fd < 0)
+		return fd;
+
+	sweep_print_header(sweep_fp);
+
+	for (e = 0; e < sweep.so_nr_engines; e++) {
+		engine = sweep.so_engines[e];
+		if (!ioq_engine_supported(engine)) {
+			fprintf(stdout, "# %s is not supported here, "
+				"skipped.\n", ioq_engine_name(engine));
+			continue;
+		}
+
+		for (w = 1; w >= 0; w--) {
+			for (s = 0; s < sweep.so_nr_sizes; s++) {
+				for (q = 0; q < sweep.so_nr_depths; q++) {
+					if (engine == IOQ_ENGINE_SYNC &&
+					    sweep.so_depths[q] != 1)
+						continue;
+
+					memset(&job, 0, sizeof(job));
+					job.ij_fd = fd;
+					job.ij_engine = engine;
+					job.ij_write = w;
+					job.ij_depth = sweep.so_depths[q];
+					job.ij_bs = sweep.so_sizes[s];
+					job.ij_range = file_size;
+					job.ij_nr_ios = sweep.so_nr_ios;
+
+					ret = ioq_run(&job, &res);
+					if (ret)
+						goto bail;
+
+					sweep_print_row(sweep_fp, engine, w,
+							job.ij_bs, job.ij_depth,
+							res.ir_bytes,
+							res.ir_seconds,
+							&res.ir_lat);
+				}
+			}
+		}
+	}
+
+bail:
+	close(fd);
 
 	return ret;
 }
@@ -445,6 +654,10 @@ static int run_test(void)
 		ret = verify_test();
 		if (ret < 0)
 			return ret;
+	} else if (test_flags & SWEP_TEST) {
+		ret = sweep_test();
+		if (ret)
+			return ret;
 	} else {
 		ret = basic_test();
 		if (ret)
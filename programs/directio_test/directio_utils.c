@@ -17,205 +17,14 @@
 
 #include "directio.h"
 
-static char chunk_pattern[CHUNK_SIZE] __attribute__ ((aligned(DIRECTIO_SLICE)));
-
-extern int open_rw_flags;
-extern int open_ro_flags;
-
 extern int test_flags;
 extern int verbose;
 
-static uint32_t crc32_checksum(uint32_t crc, char *p, size_t len)
-{
-	const uint32_t      *b = (uint32_t *)p;
-	const uint32_t      *tab = crc32table_le;
-
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-# define DO_CRC(x) crc = tab[(crc ^ (x)) & 255] ^ (crc >> 8)
-#else
-# define DO_CRC(x) crc = tab[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
-#endif
-
-	crc = cpu_to_le32(crc);
-	/* Align it */
-	if (((long)b)&3 && len) {
-		do {
-			uint8_t *p = (uint8_t *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while ((--len) && ((long)b)&3);
-	}
-	if (len >= 4) {
-		/* load data 32 bits wide, xor data 32 bits wide. */
-		size_t save_len = len & 3;
-		len = len >> 2;
-		--b; /* use pre increment below(*++b) for speed */
-		do {
-			crc ^= *++b;
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-		} while (--len);
-		b++; /* point to next byte(s) */
-		len = save_len;
-	}
-	/* And the last few bytes */
-	if (len) {
-		do {
-			uint8_t *p = (uint8_t *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while (--len);
-	}
-
-	return le32_to_cpu(crc);
-#undef DO_CRC
-}
-
-unsigned long get_rand_ul(unsigned long min, unsigned long max)
-{
-	if (min == 0 && max == 0)
-		return 0;
-
-	return min + (rand() % (max - min + 1));
-}
-
-static char rand_char(void)
-{
-	return 'A' + (char) get_rand_ul(0, 25);
-}
-
-int open_file(const char *filename, int flags)
-{
-	int fd, ret = 0;
-
-	fd = open64(filename, flags, FILE_MODE);
-	if (fd < 0) {
-		ret = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n", filename, ret,
-			strerror(ret));
-		return -1;
-	}
-
-	return fd;
-}
-
-int get_i_size(char *filename, unsigned long *size)
-{
-	struct stat stat;
-	int ret = 0, fd;
-
-	fd = open_file(filename, open_ro_flags);
-	if (fd)
-		return fd;
-
-	ret = fstat(fd, &stat);
-	if (ret == -1) {
-		ret = errno;
-		fprintf(stderr, "stat failure %d: %s\n", ret, strerror(ret));
-		return ret;
-	}
-
-	*size = (unsigned long) stat.st_size;
-	return ret;
-}
-
-int read_at(int fd, void *buf, size_t count, off_t offset)
-{
-	int ret;
-	size_t bytes_read;
-
-	ret = pread(fd, buf, count, offset);
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "read error %d: \"%s\"\n", ret, strerror(ret));
-		return -1;
-	}
-
-	bytes_read = ret;
-	while (bytes_read < count) {
-
-		ret = pread(fd, buf + bytes_read, count - bytes_read, offset +
-			    bytes_read);
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "read error %d: \"%s\"\n", ret,
-				strerror(ret));
-			return -1;
-		}
-
-		bytes_read += ret;
-	}
-
-	return count;
-}
-
-int write_at(int fd, const void *buf, size_t count, off_t offset)
-{
-	int ret;
-	size_t bytes_write;
-
-	ret = pwrite(fd, buf, count, offset);
-
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "write error %d: \"%s\"\n", ret, strerror(ret));
-		return -1;
-	}
-
-	bytes_write = ret;
-	while (bytes_write < count) {
-
-		ret = pwrite(fd, buf + bytes_write, count - bytes_write,
-			     offset + bytes_write);
-
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "write error %d: \"%s\"\n", ret,
-				strerror(ret));
-			return -1;
-		}
-
-		bytes_write += ret;
-	}
-
-	return count;
-}
-
 static int fill_chunk_pattern(char *pattern, struct write_unit *wu)
 {
-	unsigned long offset = 0;
-	uint32_t checksum = 0;
-
-	memset(pattern, 0, CHUNK_SIZE);
-	offset = 0;
-
-	memmove(pattern , &wu->wu_chunk_no, sizeof(unsigned long));
-	offset += sizeof(unsigned long);
-	memmove(pattern + offset, &wu->wu_timestamp, sizeof(unsigned long long));
-	offset += sizeof(unsigned long long);
-
-	offset += sizeof(uint32_t);
-
-	memset(pattern + offset, wu->wu_char, CHUNK_SIZE - offset * 2);
-
-	checksum = crc32_checksum(~0, pattern + offset,
-				  (size_t)CHUNK_SIZE - offset * 2);
-
-	offset = CHUNK_SIZE - offset;
-
-	memmove(pattern + offset, &checksum, sizeof(uint32_t));
-	offset += sizeof(uint32_t);
-	memmove(pattern + offset, &wu->wu_timestamp,
-		sizeof(unsigned long long));
-	offset += sizeof(unsigned long long);
-	memmove(pattern + offset, &wu->wu_chunk_no, sizeof(unsigned long));
-
-	offset = sizeof(unsigned long) + sizeof(unsigned long long);
-	memmove(pattern + offset, &checksum, sizeof(uint32_t));
-
-	wu->wu_checksum = checksum;
+	wu->wu_checksum = chunk_fill_pattern(pattern, wu->wu_chunk_no,
+					     wu->wu_timestamp, wu->wu_char,
+					     CHUNK_SIZE);
 
 	return 0;
 }
@@ -282,12 +91,17 @@ int do_write_chunk(int fd, struct write_unit wu)
 	int ret;
 	size_t count = CHUNK_SIZE;
 	off_t offset = CHUNK_SIZE * wu.wu_chunk_no;
+	char *pattern;
+
+	pattern = (char *)o2test_dio_buf_get();
+	if (!pattern)
+		return -ENOMEM;
 
-	fill_chunk_pattern(chunk_pattern, &wu);
+	fill_chunk_pattern(pattern, &wu);
 
-	ret = write_at(fd, chunk_pattern, count, offset);
-	if (ret < 0)
-		return ret;
+	ret = write_at(fd, pattern, count, offset);
+
+	o2test_dio_buf_put(pattern);
 
 	return ret;
 }
@@ -297,85 +111,56 @@ int do_read_chunk(int fd, unsigned long chunk_no, struct write_unit *wu)
 	int ret;
 	size_t count = CHUNK_SIZE;
 	off_t offset = CHUNK_SIZE * chunk_no;
+	char *pattern;
+
+	pattern = (char *)o2test_dio_buf_get();
+	if (!pattern)
+		return -ENOMEM;
 
-	ret = read_at(fd, chunk_pattern, count, offset);
-	if (ret < 0)
-		return ret;
+	/* read_at() is 0 or -1, callers here want the bytes read */
+	ret = read_at(fd, pattern, count, offset);
+	if (!ret) {
+		dump_pattern(pattern, wu);
+		ret = count;
+	}
 
-	dump_pattern(chunk_pattern, wu);
+	o2test_dio_buf_put(pattern);
 
 	return ret;
 }
 
-int prep_orig_file_in_chunks(char *file_name, unsigned long filesize)
+void prep_init_opts(struct prep_opts *po)
 {
+	memset(po, 0, sizeof(*po));
+	po->po_batch = PREP_BATCH_SIZE;
+	po->po_depth = 1;
+}
 
-	int fd, ret, flags;
-	unsigned long offset = 0, chunk_no = 0;
-	static struct write_unit wu;
-
-	if ((CHUNK_SIZE % DIRECTIO_SLICE) != 0) {
-
-		fprintf(stderr, "chunk size in destructive tests is expected to "
-			"be %d aligned, your CHUNK_SIZE %d is not allowed.\n",
-			DIRECTIO_SLICE, CHUNK_SIZE);
-		return -EINVAL;
-	}
-
-	flags = FILE_RW_FLAGS;
-
-	fd = open_file(file_name, flags);
-	if (fd < 0)
-		return fd;
-
-	/*
-	 * Original file for desctrutive tests, it consists of chunks.
-	 * Each chunks consists of following parts:
-	 * chunkno + timestamp + checksum + random chars
-	 * + checksum + timestamp + chunkno
-	 *
-	*/
-	while (offset < filesize) {
-
-		prep_rand_dest_write_unit(&wu, chunk_no);
-
-		fill_chunk_pattern(chunk_pattern, &wu);
-
-		ret = do_write_chunk(fd, wu);
-		if (ret < 0)
-			return ret;
-
-		chunk_no++;
-		offset += CHUNK_SIZE;
-	}
+/* our chunks are laid out just like file_verify's, so it does the work */
+int prep_orig_file(struct prep_opts *po, char *file_name,
+		   unsigned long filesize)
+{
+	int flags = FILE_RW_FLAGS;
 
-	close(fd);
+	if (po->po_direct)
+		flags |= O_DIRECT;
 
-	return 0;
+	return prep_orig_file_in_batches(file_name, filesize, CHUNK_SIZE,
+					 flags, po->po_batch, po->po_depth,
+					 po->po_report);
 }
 
-int verify_file(int is_remote, FILE *logfile, struct write_unit *remote_wus,
-		char *filename, unsigned long filesize)
+/*
+ * Merges the write records of a text log into wt.
+ */
+int read_log(FILE *logfile, struct wu_table *wt)
 {
-	int fd = 0, ret = 0;
-	struct write_unit *wus, wu, ewu;
-	unsigned long num_chunks = filesize / CHUNK_SIZE;
-	unsigned long i, t_bytes = sizeof(struct write_unit) * num_chunks;
+	int ret;
+	unsigned long chunk_no;
+	struct wu_entry we;
 	char arg1[100], arg2[100], arg3[100], arg4[100];
 
-	memset(&wu, 0, sizeof(struct write_unit));
-	memset(&ewu, 0, sizeof(struct write_unit));
-
-	wus = (struct write_unit *)malloc(t_bytes);
-	memset(wus, 0, t_bytes);
-
-	if (is_remote) {
-		memcpy(wus, remote_wus, t_bytes);
-		goto verify_body;
-	}
-
-	for (i = 0; i < num_chunks; i++)
-		wus[i].wu_chunk_no = i;
+	memset(&we, 0, sizeof(struct wu_entry));
 
 	while (!feof(logfile)) {
 
@@ -384,34 +169,44 @@ int verify_file(int is_remote, FILE *logfile, struct write_unit *remote_wus,
 		if (ret != 4) {
 			fprintf(stderr, "input failure from write log, ret "
 				"%d, %d %s\n", ret, errno, strerror(errno));
-			ret = -EINVAL;
-			goto bail;
-		}
-
-		wu.wu_chunk_no = atol(arg1);
-		if (wu.wu_chunk_no > num_chunks) {
-			fprintf(stderr, "Chunkno grabed from write log"
-				"exceeds the filesize, you may probably"
-				" specify a too small filesize.\n");
 			return -EINVAL;
 		}
 
-		wu.wu_timestamp = atoll(arg2);
-		wu.wu_checksum = atoi(arg3);
-		wu.wu_char = arg4[0];
+		chunk_no = atol(arg1);
+		we.we_timestamp = atoll(arg2);
+		we.we_checksum = atoi(arg3);
+		we.we_char = arg4[0];
 
-		if (wu.wu_timestamp >= wus[wu.wu_chunk_no].wu_timestamp) {
-
-			memmove(&wus[wu.wu_chunk_no], &wu,
-				sizeof(struct write_unit));
-		}
+		ret = wu_table_merge_entry(wt, chunk_no, &we);
+		if (ret)
+			return ret;
 	}
 
-verify_body:
+	return 0;
+}
+
+int verify_file(struct wu_table *wt, char *filename, unsigned long filesize)
+{
+	int fd = 0, ret = 0;
+	struct write_unit rwu, wu, ewu;
+	struct wu_entry we;
+	unsigned long num_chunks = filesize / CHUNK_SIZE;
+	unsigned long i;
+	char *pattern = NULL;
+
+	memset(&wu, 0, sizeof(struct write_unit));
+	memset(&ewu, 0, sizeof(struct write_unit));
+
 	fd = open_file(filename, open_ro_flags);
 	if (fd < 0)
 		return fd;
 
+	pattern = (char *)o2test_dio_buf_get();
+	if (!pattern) {
+		ret = -ENOMEM;
+		goto bail;
+	}
+
 	for (i = 0; i < num_chunks; i++) {
 		/*
 		 * Verification consists of two following parts:
@@ -426,7 +221,7 @@ verify_body:
 		/*
 		 * verify pattern of chunks absent from write records.
 		 */
-		if (!wus[i].wu_timestamp) {
+		if (!wu_table_lookup_entry(wt, i, &we)) {
 
 			if (verbose)
 				fprintf(stdout, "  verifying #%lu chunk "
@@ -447,7 +242,7 @@ verify_body:
 			 * recalculate checksum
 			 */
 			memcpy(&ewu, &wu, sizeof(wu));
-                	fill_chunk_pattern(chunk_pattern, &ewu);
+                	fill_chunk_pattern(pattern, &ewu);
                 	if (wu.wu_checksum != ewu.wu_checksum) {
                 	        fprintf(stderr, "Checksum expected: %u Found: %u\n",
                 	                ewu.wu_checksum, wu.wu_checksum);
@@ -471,18 +266,23 @@ verify_body:
 			return -1;
 		}
 
-		fill_chunk_pattern(chunk_pattern, &wu);
+		rwu.wu_chunk_no = i;
+		rwu.wu_timestamp = we.we_timestamp;
+		rwu.wu_checksum = we.we_checksum;
+		rwu.wu_char = we.we_char;
+
+		fill_chunk_pattern(pattern, &wu);
 
-		if (!verify_chunk_pattern(chunk_pattern, &wus[i])) {
+		if (!verify_chunk_pattern(pattern, &rwu)) {
 
-			dump_pattern(chunk_pattern, &wu);
+			dump_pattern(pattern, &wu);
 			fprintf(stderr, "Inconsistent chunk found in file %s!\n"
 				"Expected:\tchunkno(%ld)\ttimestmp(%llu)\t"
 				"chksum(%d)\tchar(%c)\nFound   :\tchunkno"
 				"(%ld)\ttimestmp(%llu)\tchksum(%d)\tchar(%c)\n",
 				filename,
-				wus[i].wu_chunk_no, wus[i].wu_timestamp,
-				wus[i].wu_checksum, wus[i].wu_char,
+				rwu.wu_chunk_no, rwu.wu_timestamp,
+				rwu.wu_checksum, rwu.wu_char,
 				wu.wu_chunk_no, wu.wu_timestamp,
 				wu.wu_checksum, wu.wu_char);
 			ret = -1;
@@ -494,8 +294,7 @@ verify_body:
 	ret = 0;
 
 bail:
-	if (wus)
-		free(wus);
+	o2test_dio_buf_put(pattern);
 
 	if (fd)
 		close(fd);
@@ -503,147 +302,180 @@ bail:
 	return ret;
 }
 
-int init_sock(char *serv, int port)
+int open_logfile(FILE **logfile, const char *logname)
 {
-	int sockfd;
-	struct sockaddr_in servaddr;
-
-	sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	bzero(&servaddr, sizeof(struct sockaddr_in));
-	servaddr.sin_family = AF_INET;
-	servaddr.sin_port = htons(port);
-	inet_pton(AF_INET, serv, &servaddr.sin_addr);
+	if (test_flags & VERI_TEST) {
+		if (!logname)
+			*logfile = stdin;
+		else
+			*logfile = fopen(logname, "r");
+	} else {
+		if (!logname)
+			*logfile = stdout;
+		else *logfile = fopen(logname, "wa");
+		
+	}
 
-	connect(sockfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
+	if (!(*logfile)) {
+		fprintf(stderr, "Error %d opening logfile: %s\n", errno,
+			strerror(errno));
+		return -EINVAL;
+	}
 
-	return sockfd;
+	return 0;
 }
 
-int set_semvalue(int sem_id, int val)
+int log_write(struct write_unit *wu, FILE *logfile)
 {
-	union semun sem_union;
+	int fd;
 
-	sem_union.val = val;
-	if (semctl(sem_id, 0, SETVAL, sem_union) == -1) {
-		perror("semctl");
-		return -1;
-	}
+	fprintf(logfile, "%lu\t%llu\t%d\t%c\n", wu->wu_chunk_no,
+		wu->wu_timestamp, wu->wu_checksum, wu->wu_char);
+	fflush(logfile);
+	fd = fileno(logfile);
+	fsync(fd);
 
 	return 0;
 }
 
-int semaphore_init(int val)
+/*
+ * Queues the record on a stream to a remote verifier, blocks only when
+ * the stream falls behind.
+ */
+int log_stream_write(struct wu_stream *ws, struct write_unit *wu)
 {
-	int ret, sem_id;
-	key_t sem_key = IPC_PRIVATE;
-
-	/*get and init semaphore*/
-	sem_id = semget(sem_key, 1, 0766 | IPC_CREAT);
-	if (sem_id < 0) {
-		sem_id = errno;
-		fprintf(stderr, "semget failed, %s.\n", strerror(sem_id));
-		return -1;
-	}
+	struct wu_entry we;
 
-	ret = set_semvalue(sem_id, 1);
-	if (ret < 0) {
-		fprintf(stderr, "Set semaphore value failed!\n");
-		return ret;
-	}
+	memset(&we, 0, sizeof(struct wu_entry));
+	we.we_timestamp = wu->wu_timestamp;
+	we.we_checksum = wu->wu_checksum;
+	we.we_char = wu->wu_char;
 
-	return sem_id;
+	return wu_stream_write(ws, wu->wu_chunk_no, &we);
 }
 
-int semaphore_close(int sem_id)
+void sweep_init_opts(struct sweep_opts *so)
 {
-	int ret = 0;
-
-	ret = semctl(sem_id, 0, IPC_RMID);
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "semctl to close sem failed, %s.\n", strerror(ret));
-		return -1;
-	}
-
-	return ret;
+	memset(so, 0, sizeof(*so));
+	so->so_nr_ios = 4096;
 }
 
-int semaphore_p(int sem_id)
+int sweep_parse_engines(struct sweep_opts *so, char *list)
 {
-	struct sembuf sem_b;
-
-	sem_b.sem_num = 0;
-	sem_b.sem_op = -1; /* P() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_p failed\n");
-		return -1;
+	char *name, *save = NULL;
+	int engine;
+	unsigned int seen = 0;
+
+	so->so_nr_engines = 0;
+
+	for (name = strtok_r(list, ",", &save); name;
+	     name = strtok_r(NULL, ",", &save)) {
+		engine = ioq_parse_engine(name);
+		if (engine < 0)
+			return engine;
+
+		if (seen & (1 << engine)) {
+			fprintf(stderr, "engine %s listed twice\n", name);
+			return -EINVAL;
+		}
+		seen |= 1 << engine;
+
+		so->so_engines[so->so_nr_engines++] = engine;
 	}
 
 	return 0;
 }
 
-int semaphore_v(int sem_id)
+int sweep_parse_list(unsigned long *vals, int *nr, char *list)
 {
-	struct sembuf sem_b;
-
-	sem_b.sem_num = 0;
-	sem_b.sem_op = 1; /* V() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_v failed\n");
-		return -1;
+	char *tok, *end, *save = NULL;
+
+	*nr = 0;
+
+	for (tok = strtok_r(list, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (*nr == SWEEP_MAX_POINTS) {
+			fprintf(stderr, "at most %d sweep points allowed\n",
+				SWEEP_MAX_POINTS);
+			return -EINVAL;
+		}
+
+		vals[*nr] = strtoul(tok, &end, 0);
+		if (*end || !vals[*nr]) {
+			fprintf(stderr, "bad sweep point %s\n", tok);
+			return -EINVAL;
+		}
+
+		(*nr)++;
 	}
 
 	return 0;
 }
 
-int open_logfile(FILE **logfile, const char *logname)
+/*
+ * Fills in the default matrix for whatever wasn't given and checks
+ * every block size can go through O_DIRECT into a file of filesize.
+ */
+int sweep_check_opts(struct sweep_opts *so, unsigned long filesize)
 {
-	if (test_flags & VERI_TEST) {
-		if (!logname)
-			*logfile = stdin;
-		else
-			*logfile = fopen(logname, "r");
-	} else {
-		if (!logname)
-			*logfile = stdout;
-		else *logfile = fopen(logname, "wa");
-		
+	static const unsigned long def_depths[] = { 1, 2, 4, 8, 16, 32 };
+	static const unsigned long def_sizes[] = { 4096, 65536, 1048576 };
+	int i;
+
+	if (!so->so_nr_engines) {
+		for (i = 0; i < IOQ_ENGINE_NUM; i++)
+			so->so_engines[i] = i;
+		so->so_nr_engines = IOQ_ENGINE_NUM;
 	}
 
-	if (!(*logfile)) {
-		fprintf(stderr, "Error %d opening logfile: %s\n", errno,
-			strerror(errno));
-		return -EINVAL;
+	if (!so->so_nr_depths) {
+		for (i = 0; i < sizeof(def_depths) / sizeof(def_depths[0]); i++)
+			so->so_depths[i] = def_depths[i];
+		so->so_nr_depths = i;
 	}
 
-	return 0;
-}
+	if (!so->so_nr_sizes) {
+		for (i = 0; i < sizeof(def_sizes) / sizeof(def_sizes[0]); i++)
+			so->so_sizes[i] = def_sizes[i];
+		so->so_nr_sizes = i;
+	}
 
-int log_write(struct write_unit *wu, union log_handler log)
-{
-	int fd, ret = 0;
-	char log_rec[1024];
-
-	if (test_flags & DSCV_TEST) {
-		snprintf(log_rec, sizeof(log_rec), "%lu\t%llu\t%d\t%c\n",
-			 wu->wu_chunk_no, wu->wu_timestamp, wu->wu_checksum,
-			 wu->wu_char);
-		ret = write(log.socket_log, log_rec, strlen(log_rec) + 1);
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "write socket error:%d, %s\n",
-				ret , strerror(ret));
+	for (i = 0; i < so->so_nr_sizes; i++) {
+		if (so->so_sizes[i] % DIRECTIO_SLICE) {
+			fprintf(stderr, "sweep block size %lu is not %d "
+				"aligned.\n", so->so_sizes[i], DIRECTIO_SLICE);
+			return -EINVAL;
+		}
+
+		if (so->so_sizes[i] > filesize) {
+			fprintf(stderr, "sweep block size %lu exceeds the "
+				"file size %lu.\n", so->so_sizes[i], filesize);
 			return -EINVAL;
 		}
-	} else {
-		fprintf(log.stream_log, "%lu\t%llu\t%d\t%c\n", wu->wu_chunk_no,
-			wu->wu_timestamp, wu->wu_checksum, wu->wu_char);
-                fflush(log.stream_log);
-		fd = fileno(log.stream_log);
-		fsync(fd);
 	}
 
-	return ret;
+	return 0;
+}
+
+void sweep_print_header(FILE *fp)
+{
+	lat_hist_csv_header(fp, "engine,rw,bs,qd,MB/s,IOPS");
+	fflush(fp);
+}
+
+/* one row of the matrix, latencies in usecs */
+void sweep_print_row(FILE *fp, int engine, int write, unsigned long bs,
+		     unsigned long depth, unsigned long long bytes,
+		     double seconds, struct lat_hist *lat)
+{
+	char keys[128];
+
+	if (seconds <= 0)
+		seconds = 1e-6;
+
+	snprintf(keys, sizeof(keys), "%s,%s,%lu,%lu,%.1f,%.0f",
+		 ioq_engine_name(engine), write ? "write" : "read", bs, depth,
+		 bytes / seconds / (1024 * 1024), lat->lh_count / seconds);
+	lat_hist_csv_row(fp, keys, lat);
+	fflush(fp);
 }
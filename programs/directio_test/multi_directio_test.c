@@ -21,6 +21,8 @@
 
 #include "directio.h"
 #include <mpi.h>
+#include "mpi_rand.h"
+#include "mpi_lat_hist.h"
 
 #define MPI_RET_SUCCESS		0
 #define MPI_RET_FAILED		1
@@ -33,19 +35,35 @@ static int rank = -1, size = 0;
 
 int verbose = 0;
 int test_flags = 0x00000000;
-int open_rw_flags = FILE_RW_FLAGS;
-int open_ro_flags = FILE_RO_FLAGS;
 
 unsigned long file_size = 1024 * 1024;
 unsigned long num_chunks;
 unsigned long num_iterations = 1;
 
-struct write_unit *remote_wus = NULL;
+/*
+ * None-root ranks listen on lsn_sock for the write records of root
+ * rank, which keeps where they listen and a stream to each of them.
+ */
+static int lsn_sock = -1;
+static char *rank_hosts;
+static int *rank_ports;
+static struct wu_stream *rank_streams;
+
+static struct sweep_opts sweep;
+static struct prep_opts prep;
 
 static void usage(void)
 {
 	printf("usage: %s [-i <iters>] [-l <file_size>] [-w <workfile>] "
-	       "[-v]\n", prog);
+	       "[-v] [-Q [-e engines] [-q depths] [-s sizes] [-n nr_ios]] "
+	       "[-B prep_batch] [-D prep_depth] [-O] [-R] [--seed seed]\n"
+	       "-Q replaces the rounds with an io engine sweep, all ranks "
+	       "run every point at once and rank 0 prints the CSV matrix "
+	       "of the summed throughput, IOPS and latency.\n"
+	       "-B, -D, -O and -R are how rank 0 prepares the file: bytes "
+	       "of chunks per write, 4M by default, writes in flight, 1 "
+	       "by default, with O_DIRECT, and reporting the throughput.\n",
+	       prog);
 
 	MPI_Finalize();
 
@@ -85,9 +103,47 @@ static void MPI_Barrier_Sync(void)
 
 static int parse_opts(int argc, char **argv);
 
+static void setup_record_streams(void)
+{
+	int ret, port = 0;
+	char host[HOSTNAME_LEN];
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+
+	if (rank) {
+		lsn_sock = wu_sink_listen(0);
+		if (lsn_sock < 0)
+			abort_printf("wu_sink_listen failed: %d\n", lsn_sock);
+
+		if (getsockname(lsn_sock, (struct sockaddr *)&addr, &len) < 0)
+			abort_printf("getsockname failed: %d\n", errno);
+
+		port = ntohs(addr.sin_port);
+	} else {
+		rank_hosts = (char *)malloc(HOSTNAME_LEN * size);
+		rank_ports = (int *)malloc(sizeof(int) * size);
+		rank_streams = (struct wu_stream *)malloc(sizeof(struct
+							wu_stream) * size);
+		if (!rank_hosts || !rank_ports || !rank_streams)
+			abort_printf("no memory for write record streams\n");
+	}
+
+	memcpy(host, hostname, HOSTNAME_LEN - 1);
+	host[HOSTNAME_LEN - 1] = '\0';
+
+	ret = MPI_Gather(host, HOSTNAME_LEN, MPI_CHAR, rank_hosts,
+			 HOSTNAME_LEN, MPI_CHAR, 0, MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Gather failed: %d\n", ret);
+
+	ret = MPI_Gather(&port, 1, MPI_INT, rank_ports, 1, MPI_INT, 0,
+			 MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Gather failed: %d\n", ret);
+}
+
 static void setup(int argc, char *argv[])
 {
-	unsigned long i;
 	int ret;
 
 	ret = MPI_Init(&argc, &argv);
@@ -102,6 +158,8 @@ static void setup(int argc, char *argv[])
 	else
 		prog++;
 
+	MPI_Seed_Setup(&argc, argv);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -110,20 +168,11 @@ static void setup(int argc, char *argv[])
 	fflush(stderr);
 	fflush(stdout);
 
-	remote_wus = (struct write_unit *)malloc(sizeof(struct write_unit) *
-						 num_chunks);
-	memset(remote_wus, 0, sizeof(struct write_unit) * num_chunks);
-
-	for (i = 0; i < num_chunks; i++)
-		remote_wus[i].wu_chunk_no = i;
-
 	if (gethostname(hostname, PATH_MAX) < 0) {
 		perror("gethostname:");
 		exit(1);
 	}
 
-	srand(getpid());
-
 	ret = MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	if (ret != MPI_SUCCESS)
 		abort_printf("MPI_Comm_rank failed: %d\n", ret);
@@ -131,13 +180,25 @@ static void setup(int argc, char *argv[])
 	if (ret != MPI_SUCCESS)
 		abort_printf("MPI_Comm_size failed: %d\n", ret);
 
+	if (!(test_flags & SWEP_TEST))
+		setup_record_streams();
+
 	return;
 }
 
 static void teardown(int ret_type)
 {
-	if (remote_wus)
-		free(remote_wus);
+	if (lsn_sock >= 0)
+		close(lsn_sock);
+
+	if (rank_hosts)
+		free(rank_hosts);
+
+	if (rank_ports)
+		free(rank_ports);
+
+	if (rank_streams)
+		free(rank_streams);
 
 	if (ret_type == MPI_RET_SUCCESS) {
 		MPI_Finalize();
@@ -163,8 +224,11 @@ static int parse_opts(int argc, char **argv)
 {
 	int c;
 
+	sweep_init_opts(&sweep);
+	prep_init_opts(&prep);
+
 	while (1) {
-		c = getopt(argc, argv, "i:l:vw:");
+		c = getopt(argc, argv, "i:l:vw:Qe:q:s:n:B:D:OR");
 		if (c == -1)
 			break;
 
@@ -181,6 +245,38 @@ static int parse_opts(int argc, char **argv)
 		case 'v':
 			verbose = 1;
 			break;
+		case 'Q':
+			test_flags |= SWEP_TEST;
+			break;
+		case 'e':
+			if (sweep_parse_engines(&sweep, optarg))
+				return -EINVAL;
+			break;
+		case 'q':
+			if (sweep_parse_list(sweep.so_depths,
+					     &sweep.so_nr_depths, optarg))
+				return -EINVAL;
+			break;
+		case 's':
+			if (sweep_parse_list(sweep.so_sizes,
+					     &sweep.so_nr_sizes, optarg))
+				return -EINVAL;
+			break;
+		case 'n':
+			sweep.so_nr_ios = atol(optarg);
+			break;
+		case 'B':
+			prep.po_batch = atol(optarg);
+			break;
+		case 'D':
+			prep.po_depth = atol(optarg);
+			break;
+		case 'O':
+			prep.po_direct = 1;
+			break;
+		case 'R':
+			prep.po_report = 1;
+			break;
 		default:
 			return EINVAL;
 		}
@@ -195,17 +291,20 @@ static int parse_opts(int argc, char **argv)
 		return -EINVAL;
 	}
 
+	if (test_flags & SWEP_TEST) {
+		if (sweep_check_opts(&sweep, file_size) || !sweep.so_nr_ios)
+			return -EINVAL;
+	}
+
 	return 0;
 }
 
 static int one_round_run(int round_no)
 {
 	int ret = 0, fd = -1, j;
-	unsigned long i, chunk_no = 0;
+	unsigned long i, chunk_no = 0, records;
 	struct write_unit wu;
-
-	MPI_Request request;
-	MPI_Status  status;
+	struct wu_table wt;
 
 	/*
 	 * Root rank creates working file in chunks.
@@ -216,7 +315,7 @@ static int one_round_run(int round_no)
 		open_rw_flags |= O_DIRECT;
 		open_ro_flags |= O_DIRECT;
 
-		ret = prep_orig_file_in_chunks(workfile, file_size);
+		ret = prep_orig_file(&prep, workfile, file_size);
 		should_exit(ret);
 	}
 
@@ -234,32 +333,38 @@ static int one_round_run(int round_no)
 		open_rw_flags &= ~O_DIRECT;
 		open_ro_flags &= ~O_DIRECT;
 
-		ret = verify_file(1, NULL, remote_wus, workfile, file_size);
-		should_exit(fd);
+		ret = verify_table_init(&wt, file_size, CHUNK_SIZE);
+		should_exit(ret);
+
+		ret = verify_file(&wt, workfile, file_size);
+		wu_table_free(&wt);
+		should_exit(ret);
 	}
 
 	MPI_Barrier_Sync();
 
-	/*
-	 * Root ranks write chunks at random serially.
-	 */
-	for (i = 0; i < num_chunks; i++) {
-		
-		MPI_Barrier_Sync();
+	if (!rank) {
+
+		for (j = 1; j < size; j++) {
+			ret = wu_stream_open(&rank_streams[j],
+					     &rank_hosts[j * HOSTNAME_LEN],
+					     rank_ports[j], CHUNK_SIZE,
+					     file_size, 0, 0);
+			should_exit(ret);
+		}
+
 		/*
-		 * Root rank generates random write unit, then sends it to
-		 * rest of ranks in-memoery after O_DIRECT write into file.
+		 * Root rank writes chunks at random serially, and streams
+		 * the write unit of each O_DIRECT write to rest of ranks.
 		 */
-		if (!rank) {
+		for (i = 0; i < num_chunks; i++) {
 
-			chunk_no = get_rand_ul(0, num_chunks - 1);
+			chunk_no = get_rand(0, num_chunks - 1);
 			prep_rand_dest_write_unit(&wu, chunk_no);
 			rank_printf("Write #%lu chunk with char(%c)\n",
 				    chunk_no, wu.wu_char);
 			ret = do_write_chunk(fd, wu);
 			should_exit(ret);
-			
-			memcpy(&remote_wus[wu.wu_chunk_no], &wu, sizeof(wu));
 
 			for (j = 1; j < size; j++) {
 				if (verbose)
@@ -267,43 +372,32 @@ static int one_round_run(int round_no)
 						    "char(%c) to rank %d\n",
 						     wu.wu_chunk_no,
 						     wu.wu_char, j);
-				ret = MPI_Isend(&wu, sizeof(wu), MPI_BYTE, j,
-						1, MPI_COMM_WORLD, &request);
-				if (ret != MPI_SUCCESS)
-					abort_printf("MPI_Isend failed: %d\n",
-						     ret);
-				MPI_Wait(&request, &status);
-
-                        }
-		} else {
-
-			MPI_Irecv(&wu, sizeof(wu), MPI_BYTE, 0, 1,
-				  MPI_COMM_WORLD, &request);
-			MPI_Wait(&request, &status);
-
-			if (verbose)
-				rank_printf("Receive write unit #%lu chunk "
-					    "char(%c)\n", wu.wu_chunk_no, wu.wu_char);
-
-			if (wu.wu_timestamp >=
-				remote_wus[wu.wu_chunk_no].wu_timestamp)
-				memcpy(&remote_wus[wu.wu_chunk_no],
-				       &wu, sizeof(wu));
+				ret = log_stream_write(&rank_streams[j], &wu);
+				should_exit(ret);
+			}
 		}
 
-		MPI_Barrier_Sync();
+		for (j = 1; j < size; j++) {
+			ret = wu_stream_close(&rank_streams[j]);
+			should_exit(ret);
+		}
+	} else {
 
-		if (rank) {
+		ret = wu_sink_receive(lsn_sock, 1, &wt, &records);
+		should_exit(ret);
 
-			/*
-			 * All none-root ranks need to verify if O_DIRECT writes
-			 * from remote root node can be seen locally.
-			 */
-			rank_printf("Try to verify whole file in chunks.\n");
+		if (verbose)
+			rank_printf("Receive %lu write units\n", records);
 
-			ret = verify_file(1, NULL, remote_wus, workfile, file_size);
-			should_exit(ret);
-		}
+		/*
+		 * All none-root ranks need to verify if O_DIRECT writes
+		 * from remote root node can be seen locally.
+		 */
+		rank_printf("Try to verify whole file in chunks.\n");
+
+		ret = verify_file(&wt, workfile, file_size);
+		wu_table_free(&wt);
+		should_exit(ret);
 	}
 
 	MPI_Barrier_Sync();
@@ -314,11 +408,109 @@ static int one_round_run(int round_no)
 
 	return ret;
 }
+/*
+ * Every rank runs each point of the matrix against the shared file at
+ * the same time, rank 0 prints the sum over all ranks with the slowest
+ * rank's wall time, so the row is what the cluster got out of the fs.
+ */
+static int sweep_test(void)
+{
+	int fd, ret = 0, e, w, s, q, engine, supported, all_supported;
+	unsigned long long bytes;
+	double seconds;
+	struct ioq_job job;
+	struct ioq_result res;
+
+	open_rw_flags |= O_DIRECT;
+	open_ro_flags |= O_DIRECT;
+
+	if (!rank) {
+		rank_printf("Prepare file of %lu bytes\n", file_size);
+		ret = prep_orig_file(&prep, workfile, file_size);
+		should_exit(ret);
+	}
+
+	MPI_Barrier_Sync();
+
+	fd = open_file(workfile, open_rw_flags);
+	should_exit(fd);
+
+	if (!rank)
+		sweep_print_header(stdout);
+
+	for (e = 0; e < sweep.so_nr_engines; e++) {
+		engine = sweep.so_engines[e];
+
+		supported = ioq_engine_supported(engine);
+		ret = MPI_Allreduce(&supported, &all_supported, 1, MPI_INT,
+				    MPI_MIN, MPI_COMM_WORLD);
+		if (ret != MPI_SUCCESS)
+			abort_printf("MPI_Allreduce failed: %d\n", ret);
+
+		if (!all_supported) {
+			if (!rank)
+				printf("# %s is not supported on every node, "
+				       "skipped.\n", ioq_engine_name(engine));
+			continue;
+		}
+
+		for (w = 1; w >= 0; w--) {
+			for (s = 0; s < sweep.so_nr_sizes; s++) {
+				for (q = 0; q < sweep.so_nr_depths; q++) {
+					if (engine == IOQ_ENGINE_SYNC &&
+					    sweep.so_depths[q] != 1)
+						continue;
+
+					memset(&job, 0, sizeof(job));
+					job.ij_fd = fd;
+					job.ij_engine = engine;
+					job.ij_write = w;
+					job.ij_depth = sweep.so_depths[q];
+					job.ij_bs = sweep.so_sizes[s];
+					job.ij_range = file_size;
+					job.ij_nr_ios = sweep.so_nr_ios;
+
+					MPI_Barrier_Sync();
+
+					ret = ioq_run(&job, &res);
+					should_exit(ret);
+
+					ret = lat_hist_mpi_reduce(&res.ir_lat, 0,
+								  MPI_COMM_WORLD);
+					if (ret != MPI_SUCCESS)
+						abort_printf("MPI_Reduce failed: "
+							     "%d\n", ret);
+					MPI_Reduce(&res.ir_bytes, &bytes, 1,
+						   MPI_UNSIGNED_LONG_LONG,
+						   MPI_SUM, 0, MPI_COMM_WORLD);
+					MPI_Reduce(&res.ir_seconds, &seconds, 1,
+						   MPI_DOUBLE, MPI_MAX, 0,
+						   MPI_COMM_WORLD);
+
+					if (!rank)
+						sweep_print_row(stdout, engine,
+								w, job.ij_bs,
+								job.ij_depth,
+								bytes, seconds,
+								&res.ir_lat);
+				}
+			}
+		}
+	}
+
+	close(fd);
+
+	return ret;
+}
+
 static int test_runner(void)
 {
 	int i;
 	int ret = 0;
 
+	if (test_flags & SWEP_TEST)
+		return sweep_test();
+
 	for (i = 0; i < num_iterations; i++) {
 		if (rank == 0) {
 			printf("**************************************"
@@ -36,6 +36,9 @@
 #include <sys/wait.h>
 #include <stdlib.h>
 
+#include "op_lat.h"
+#include "rand_ops.h"
+
 #define DO_FSYNC
 
 #define PROGNAME "extend_and_write"
@@ -51,11 +54,12 @@ int count;
 static void Usage()
 {
 	printf("\nUsage: %s -h -f <filename> [-s <extend size>]"
-		" [-n <numwrites>]\n", PROGNAME);
+		" [-n <numwrites>] [--seed <seed>]\n", PROGNAME);
 	printf("will create and extend a file, n times.\n\n"
 		"<extend size> Size of the extend (Default=1024)\n"
 		"<numwrites> Number of writes to be performed "
-		"(Default=10240).\n");
+		"(Default=10240).\n"
+		"<seed> Replays the random choices of an earlier run.\n");
 	exit(1);
 }
 int main(int argc, char **argv)
@@ -69,6 +73,8 @@ int main(int argc, char **argv)
 //	off_t len = SZ;
 	int i, c;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (argc == 1) {
 		Usage();
 	}
@@ -123,7 +129,7 @@ int main(int argc, char **argv)
 	char buffer[off_t];
 	printf("%s: File will be %d bytes after this run\n",
 		PROGNAME, (2 * off_t * loops));
-	fd = open(filename, O_CREAT|O_TRUNC|O_RDWR|O_APPEND,
+	fd = timed_open(filename, O_CREAT|O_TRUNC|O_RDWR|O_APPEND,
 		S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
 	if (fd == -1) {
 		status = errno;
@@ -138,7 +144,7 @@ int main(int argc, char **argv)
 		printf("%s: Parent process starting.\n", PROGNAME);
 		memset(buffer, 'A', off_t);
 		for (i = 0; i < loops; i++) {
-			status = write(fd, buffer, off_t);
+			status = timed_write(fd, buffer, off_t);
 			if (status < 0) {
 				PRINTERR(status);
 				goto bail;
@@ -152,7 +158,7 @@ int main(int argc, char **argv)
 			}
 //			usleep(15);
 #ifdef DO_FSYNC
-			fsync(fd);
+			timed_fsync(fd);
 #endif
 		}
 		waitpid(pid, NULL, 0);
@@ -161,7 +167,7 @@ int main(int argc, char **argv)
 		printf("%s: Child process starting.\n", PROGNAME);
 		memset(buffer, 'B', off_t);
 		for (i = 0; i < loops; i++) {
-			status = write(fd, buffer, off_t);
+			status = timed_write(fd, buffer, off_t);
 			if (status < 0) {
 				PRINTERR(status);
 				goto bail;
@@ -175,7 +181,7 @@ int main(int argc, char **argv)
 			}
 //			usleep(15);
 #ifdef DO_FSYNC
-			fsync(fd);
+			timed_fsync(fd);
 #endif
 		}
 		printf("%s: Child process exiting.\n", PROGNAME);
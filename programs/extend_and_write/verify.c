@@ -6,6 +6,8 @@
 #include <errno.h>
 #include <string.h>
 
+#include "pattern_ops.h"
+
 #define PROGNAME "verify"
 #define PRINTERR(err)                                                         \
 	printf("[%d] Error %d (Line %d, Function \"%s\"): \"%s\"\n",	      \
@@ -20,15 +22,9 @@ int checkbuff(char buffer[], int size, char c);
 
 int checkbuff(char buffer[], int size, char c)
 {
-	int failed = 0;
-	int i;
+	struct pattern_desc pd = { PATTERN_CONST, (unsigned char)c };
 
-	for(i = 0; i < size; i++)
-		if (buffer[i] != c) {
-			failed = 1;
-			break;
-		}
-	return(failed);
+	return pattern_verify(&pd, buffer, size, 0) != size;
 }
 
 static void Usage()
@@ -0,0 +1,180 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * fh_threads.c
+ *
+ * Range locks and per-thread replay logs for the threaded modes of
+ * fill_holes and punch_holes.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fh_threads.h"
+
+/*
+ * The file is cut into 1M regions hashed onto a fixed set of locks.
+ * A write is never longer than MAX_WRITE_SIZE so it spans at most two
+ * regions, and two writes which overlap always share one of them.
+ */
+#define FH_REGION_SHIFT		20
+#define FH_NR_STRIPES		1024
+
+#define FH_LOG_INIT_RECS	4096
+
+static pthread_mutex_t fh_stripes[FH_NR_STRIPES];
+static uint64_t fh_seq;
+
+void fh_range_lock_init(void)
+{
+	int i;
+
+	for (i = 0; i < FH_NR_STRIPES; i++)
+		pthread_mutex_init(&fh_stripes[i], NULL);
+	fh_seq = 0;
+}
+
+static void fh_range_stripes(uint64_t offset, uint32_t len,
+			     unsigned int *first, unsigned int *last)
+{
+	unsigned int a, b;
+
+	a = (offset >> FH_REGION_SHIFT) % FH_NR_STRIPES;
+	b = ((offset + len - 1) >> FH_REGION_SHIFT) % FH_NR_STRIPES;
+
+	/* always take the lower stripe first */
+	*first = a < b ? a : b;
+	*last = a < b ? b : a;
+}
+
+/*
+ * Returns the sequence number of the write, taken under the lock so
+ * that it orders the write against every other one it overlaps.
+ */
+uint64_t fh_range_lock(uint64_t offset, uint32_t len)
+{
+	unsigned int first, last;
+
+	fh_range_stripes(offset, len, &first, &last);
+
+	pthread_mutex_lock(&fh_stripes[first]);
+	if (last != first)
+		pthread_mutex_lock(&fh_stripes[last]);
+
+	return __atomic_fetch_add(&fh_seq, 1, __ATOMIC_RELAXED);
+}
+
+void fh_range_unlock(uint64_t offset, uint32_t len)
+{
+	unsigned int first, last;
+
+	fh_range_stripes(offset, len, &first, &last);
+
+	if (last != first)
+		pthread_mutex_unlock(&fh_stripes[last]);
+	pthread_mutex_unlock(&fh_stripes[first]);
+}
+
+/* only ever touched by the thread owning the log */
+int fh_log_append(struct fh_log *log, uint64_t seq, struct fh_write_unit *wu)
+{
+	struct fh_log_rec *recs;
+	unsigned long nr;
+
+	if (log->l_nr == log->l_alloc) {
+		nr = log->l_alloc ? log->l_alloc * 2 : FH_LOG_INIT_RECS;
+		recs = realloc(log->l_recs, nr * sizeof(struct fh_log_rec));
+		if (!recs) {
+			fprintf(stderr, "Out of memory growing the log to "
+				"%lu records\n", nr);
+			return -ENOMEM;
+		}
+		log->l_recs = recs;
+		log->l_alloc = nr;
+	}
+
+	log->l_recs[log->l_nr].lr_seq = seq;
+	log->l_recs[log->l_nr].lr_wu = *wu;
+	log->l_nr++;
+
+	return 0;
+}
+
+void fh_log_free(struct fh_log *log)
+{
+	free(log->l_recs);
+	memset(log, 0, sizeof(*log));
+}
+
+/*
+ * Sequence numbers come from one counter and are all but dense, so
+ * rather than merge the logs each record is dropped straight into its
+ * slot. A slot left empty belongs to a write that never got logged,
+ * the run having been cut short by an error.
+ */
+int fh_log_merge(FILE *out, struct fh_log *logs, int nr_logs)
+{
+	struct fh_write_unit *slots;
+	struct fh_log_rec *rec;
+	uint64_t nr_slots = 0, i;
+	unsigned long j;
+	int n;
+
+	for (n = 0; n < nr_logs; n++) {
+		for (j = 0; j < logs[n].l_nr; j++) {
+			if (logs[n].l_recs[j].lr_seq >= nr_slots)
+				nr_slots = logs[n].l_recs[j].lr_seq + 1;
+		}
+	}
+
+	if (!nr_slots)
+		return 0;
+
+	slots = calloc(nr_slots, sizeof(struct fh_write_unit));
+	if (!slots) {
+		fprintf(stderr, "Out of memory merging %"PRIu64" log "
+			"records\n", nr_slots);
+		return -ENOMEM;
+	}
+
+	for (n = 0; n < nr_logs; n++) {
+		for (j = 0; j < logs[n].l_nr; j++) {
+			rec = &logs[n].l_recs[j];
+			slots[rec->lr_seq] = rec->lr_wu;
+		}
+	}
+
+	for (i = 0; i < nr_slots; i++) {
+		if (!slots[i].w_len)
+			continue;
+		fprintf(out, "%c\t%"PRIu64"\t%u\n", slots[i].w_char,
+			slots[i].w_offset, slots[i].w_len);
+	}
+
+	free(slots);
+
+	if (fflush(out)) {
+		fprintf(stderr, "Error %d writing the log: %s\n", errno,
+			strerror(errno));
+		return -EIO;
+	}
+
+	return 0;
+}
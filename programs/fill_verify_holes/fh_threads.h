@@ -0,0 +1,57 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * fh_threads.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef FH_THREADS_H
+#define FH_THREADS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "fill_holes.h"
+
+/*
+ * Support for running fill_holes and punch_holes with several writer
+ * threads against the one file.
+ *
+ * A writer takes the range lock covering its write before issuing it
+ * and gets its sequence number from fh_range_lock(), so two writes
+ * which overlap are numbered in the order they hit the file. Each
+ * writer appends to a log of its own, nothing is shared until
+ * fh_log_merge() lays every record out in sequence order and prints
+ * the usual replay log, which verify_holes takes as it always has.
+ */
+struct fh_log_rec {
+	uint64_t		lr_seq;
+	struct fh_write_unit	lr_wu;
+};
+
+struct fh_log {
+	struct fh_log_rec	*l_recs;
+	unsigned long		l_nr;
+	unsigned long		l_alloc;
+};
+
+void fh_range_lock_init(void);
+uint64_t fh_range_lock(uint64_t offset, uint32_t len);
+void fh_range_unlock(uint64_t offset, uint32_t len);
+
+int fh_log_append(struct fh_log *log, uint64_t seq,
+		  struct fh_write_unit *wu);
+void fh_log_free(struct fh_log *log);
+int fh_log_merge(FILE *out, struct fh_log *logs, int nr_logs);
+
+#endif
@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <sys/ioctl.h>
 #include <linux/fs.h>
+#include <pthread.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,12 +40,14 @@
 #include <assert.h>
 
 #include "fill_holes.h"
+#include "fh_threads.h"
 #include "reservations.h"
 #include "aio.h"
+#include "rand_ops.h"
 
 static void usage(void)
 {
-	printf("fill_holes [-f] [-m] [-b] [-u] [-a] [-d] [-i ITER] [-o LOGFILE] [-r REPLAYLOG] FILE SIZE\n"
+	printf("fill_holes [-f] [-m] [-b] [-u] [-a] [-d] [-t THREADS [-D]] [-i ITER] [-o LOGFILE] [-r REPLAYLOG] [--seed SEED] FILE SIZE\n"
 	       "FILE is a path to a file\n"
 	       "SIZE is in bytes is required only for regular files, even with a REPLAYLOG\n"
 	       "ITER defaults to 1000, unless REPLAYLOG is specified.\n"
@@ -55,7 +58,11 @@ static void usage(void)
 	       "-u will create an unwritten region instead of ftruncate\n"
 	       "-a will enable aio io mode\n"
 	       "-d will enable direct io mode\n"
-	       "REPLAYLOG is an optional file to generate values from\n\n"
+	       "-t will split ITER between THREADS concurrent writers\n"
+	       "-D gives each writer a disjoint slice of FILE, by default\n"
+	       "   their writes overlap (ignored with a REPLAYLOG)\n"
+	       "REPLAYLOG is an optional file to generate values from\n"
+	       "SEED replays the random values of an earlier run\n\n"
 	       "Regular files are truncated to zero and then truncated to SIZE.\n"
 	       "FILE will be truncated to zero, then truncated out to SIZE\n"
 	       "For each iteration, a character, offset and length will be\n"
@@ -66,7 +73,10 @@ static void usage(void)
 	       "the log can be replayed by a verification program, or given\n"
 	       "back to this software as a REPLAYLOG argument.\n"
 	       "For files larger than 2G, the utility limits the randomness to 2G chunks.\n"
-	       "It first writes randomly in the first 2G, then moves to the next 2G, etc.\n");
+	       "It first writes randomly in the first 2G, then moves to the next 2G, etc.\n"
+	       "Threaded runs write anywhere in their range and log each write\n"
+	       "once it has landed, in the order overlapping writes landed in.\n"
+	       "-f can't be used with -t.\n");
 	exit(0);
 }
 
@@ -89,6 +99,8 @@ static uint8_t enable_aio;
 static uint8_t use_mmap;
 static uint8_t use_dio;
 static uint8_t is_bdev;
+static uint8_t disjoint;
+static unsigned int nr_threads;
 
 static char *fname = NULL;
 static char *logname = NULL;
@@ -97,6 +109,20 @@ static FILE *logfile = NULL;
 static FILE *replaylogfile = NULL;
 static void *mapped;
 
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t replay_iter;
+
+struct fh_writer {
+	pthread_t	fw_thread;
+	unsigned int	fw_id;
+	int		fw_fd;
+	uint64_t	fw_start;
+	uint64_t	fw_size;
+	uint32_t	fw_iters;
+	struct fh_log	fw_log;
+	int		fw_ret;
+};
+
 int fh_get_device_size(const char *device, uint64_t *size)
 {
 	int	fd;
@@ -115,7 +141,7 @@ static int fh_parse_opts(int argc, char **argv)
 	int c, iter_specified = 0, ret, num_xtra_args;
 
 	while (1) {
-		c = getopt(argc, argv, "abdumfi:o:r:");
+		c = getopt(argc, argv, "abdumfDi:o:r:t:");
 		if (c == -1)
 			break;
 
@@ -138,6 +164,14 @@ static int fh_parse_opts(int argc, char **argv)
 		case 'f':
 			flush_output = 1;
 			break;
+		case 'D':
+			disjoint = 1;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			if (!nr_threads)
+				return EINVAL;
+			break;
 		case 'i':
 			max_iter = atoi(optarg);
 			iter_specified = 1;
@@ -182,6 +216,10 @@ static int fh_parse_opts(int argc, char **argv)
 	if (use_mmap && (file_size > TWO_GIGA_BYTE || is_bdev))
 		return EINVAL;
 
+	/* records are only logged once the threads are done */
+	if (nr_threads && flush_output)
+		return EINVAL;
+
 	return 0;
 }
 
@@ -307,7 +345,7 @@ static unsigned long fh_get_rand(unsigned long min, unsigned long max)
 	if (min == 0 && max == 0)
 		return 0;
 
-	return min + ((rand() % max) - min);
+	return min + ((o2test_rand() % max) - min);
 }
 
 static void fh_prep_rand_write_unit(struct fh_write_unit *wu)
@@ -370,7 +408,7 @@ static int fh_prep_write_unit(struct fh_write_unit *wu)
 	return 0;
 }
 
-int fh_do_write(int fd, struct fh_write_unit *wu)
+int fh_do_write(int fd, struct fh_write_unit *wu, char *buf)
 {
 	int ret, i;
 	struct o2test_aio o2a;
@@ -445,6 +483,178 @@ bail:
 	return ret;
 }
 
+/* like fh_prep_rand_write_unit(), within the writer's own range */
+static void fh_prep_thread_write_unit(struct fh_writer *fw,
+				      struct fh_write_unit *wu)
+{
+	uint64_t end = fw->fw_start + fw->fw_size;
+
+	wu->w_char = RAND_CHAR_START + (char) fh_get_rand(0, 52);
+
+again:
+	wu->w_offset = fw->fw_start + fh_get_rand(0, fw->fw_size);
+	if (use_dio)
+		wu->w_offset = ALIGN(wu->w_offset, 512);
+
+	wu->w_len = (unsigned int) fh_get_rand(1, MAX_WRITE_SIZE);
+	if (use_dio)
+		wu->w_len = ALIGN(wu->w_len, 512);
+
+	if (wu->w_offset >= end)
+		goto again;
+
+	if (wu->w_offset + wu->w_len > end)
+		wu->w_len = end - wu->w_offset;
+
+	if (wu->w_len == 0 || (use_dio && wu->w_len < 512))
+		goto again;
+
+	assert(wu->w_char >= RAND_CHAR_START && wu->w_char <= 'z');
+	assert(wu->w_len <= MAX_WRITE_SIZE);
+}
+
+/* 0 with the next record in wu, 1 once the replay log is used up */
+static int fh_next_replay_unit(struct fh_write_unit *wu)
+{
+	int ret = 1;
+
+	pthread_mutex_lock(&replay_lock);
+	if (replay_iter < max_iter && !fh_replay_eof()) {
+		ret = fh_prep_write_unit(wu);
+		if (!ret)
+			replay_iter++;
+	}
+	pthread_mutex_unlock(&replay_lock);
+
+	return ret;
+}
+
+static void *fh_writer_thread(void *arg)
+{
+	struct fh_writer *fw = (struct fh_writer *)arg;
+	struct fh_write_unit wu;
+	uint64_t seq;
+	void *wbuf = NULL;
+	uint32_t i;
+	int ret;
+
+	o2test_rand_stream(fw->fw_id + 1);
+
+	ret = posix_memalign(&wbuf, 512, MAX_WRITE_SIZE);
+	if (ret) {
+		fprintf(stderr, "malloc error %d: \"%s\"\n", ret,
+			strerror(ret));
+		fw->fw_ret = -ret;
+		return NULL;
+	}
+
+	for (i = 0; ; i++) {
+		if (replaylogfile) {
+			ret = fh_next_replay_unit(&wu);
+			if (ret)
+				break;
+		} else {
+			if (i == fw->fw_iters)
+				break;
+			fh_prep_thread_write_unit(fw, &wu);
+		}
+
+		seq = fh_range_lock(wu.w_offset, wu.w_len);
+		ret = fh_do_write(fw->fw_fd, &wu, (char *)wbuf);
+		fh_range_unlock(wu.w_offset, wu.w_len);
+
+		/* a failed write is logged too, as in the unthreaded run */
+		if (fh_log_append(&fw->fw_log, seq, &wu))
+			ret = -1;
+		if (ret)
+			break;
+	}
+
+	fw->fw_ret = ret > 0 ? 0 : ret;
+	free(wbuf);
+
+	return NULL;
+}
+
+static int fh_run_writers(int fd)
+{
+	struct fh_writer *writers, *fw;
+	struct fh_log *logs;
+	uint64_t slice = 0;
+	unsigned int i, started;
+	int ret = 0;
+
+	writers = (struct fh_writer *)calloc(nr_threads, sizeof(*writers));
+	logs = (struct fh_log *)calloc(nr_threads, sizeof(*logs));
+	if (!writers || !logs) {
+		fprintf(stderr, "Out of memory setting up %u writers\n",
+			nr_threads);
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	if (disjoint && !replaylogfile) {
+		slice = file_size / nr_threads;
+		if (use_dio)
+			slice &= ~511ULL;
+		if (!slice) {
+			fprintf(stderr, "SIZE %"PRIu64" is too small for %u "
+				"disjoint writers\n", file_size, nr_threads);
+			ret = -EINVAL;
+			goto bail;
+		}
+	}
+
+	fh_range_lock_init();
+
+	for (i = 0; i < nr_threads; i++) {
+		fw = &writers[i];
+		fw->fw_id = i;
+		fw->fw_fd = fd;
+		fw->fw_iters = max_iter / nr_threads +
+			(i < max_iter % nr_threads);
+		if (slice) {
+			fw->fw_start = i * slice;
+			fw->fw_size = (i == nr_threads - 1) ?
+				file_size - fw->fw_start : slice;
+		} else {
+			fw->fw_start = 0;
+			fw->fw_size = file_size;
+		}
+	}
+
+	for (started = 0; started < nr_threads; started++) {
+		ret = pthread_create(&writers[started].fw_thread, NULL,
+				     fh_writer_thread, &writers[started]);
+		if (ret) {
+			fprintf(stderr, "pthread_create error %d: \"%s\"\n",
+				ret, strerror(ret));
+			ret = -ret;
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(writers[i].fw_thread, NULL);
+		if (writers[i].fw_ret && !ret)
+			ret = writers[i].fw_ret;
+		logs[i] = writers[i].fw_log;
+	}
+
+	/* whatever made it to the file gets logged, error or not */
+	if (fh_log_merge(logfile, logs, started) && !ret)
+		ret = -EIO;
+
+	for (i = 0; i < started; i++)
+		fh_log_free(&logs[i]);
+
+bail:
+	free(writers);
+	free(logs);
+
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
 	int ret, i, fd;
@@ -452,6 +662,8 @@ int main(int argc, char **argv)
 	void *vbuf = NULL;
 	uint64_t num_chunks;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (argc < 3) {
 		usage();
 		return 1;
@@ -483,7 +695,11 @@ int main(int argc, char **argv)
 	if (ret)
 		return 1;
 
-	srand(getpid());
+	if (nr_threads) {
+		ret = fh_run_writers(fd);
+		free(vbuf);
+		return ret ? 1 : 0;
+	}
 
 	if (file_size > TWO_GIGA_BYTE) {
 		num_chunks = file_size / TWO_GIGA_BYTE;
@@ -502,7 +718,7 @@ int main(int argc, char **argv)
 		fprintf(stdout, "%6d. %c %"PRIu64", %"PRIu32"\n", i, wu.w_char,
 			wu.w_offset, wu.w_len);
 #endif
-		ret = fh_do_write(fd, &wu);
+		ret = fh_do_write(fd, &wu, buf);
 		if (ret)
 			return 1;
 	}
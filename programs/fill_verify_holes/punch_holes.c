@@ -30,6 +30,7 @@
 #include <inttypes.h>
 #include <linux/types.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,12 +38,14 @@
 #include <assert.h>
 
 #include "fill_holes.h"
+#include "fh_threads.h"
 #include "reservations.h"
 #include "aio.h"
+#include "rand_ops.h"
 
 static void usage(void)
 {
-	printf("punch_holes [-f] [-u] [-a] [-i ITER] [-o LOGFILE] [-r REPLAYLOG] FILE SIZE\n"
+	printf("punch_holes [-f] [-u] [-a] [-t THREADS [-D]] [-i ITER] [-o LOGFILE] [-r REPLAYLOG] [--seed SEED] FILE SIZE\n"
 	       "FILE is a path to a file\n"
 	       "SIZE is in bytes and must always be specified, even with a REPLAYLOG\n"
 	       "ITER defaults to 1000, unless REPLAYLOG is specified.\n"
@@ -50,7 +53,11 @@ static void usage(void)
 	       "-f will result in logfile being flushed after every write\n"
 	       "-u will create an unwritten region instead of ftruncate\n"
 	       "-a will enable aio mode during writes\n"
-	       "REPLAYLOG is an optional file to generate values from\n\n"
+	       "-t will split the punching between THREADS concurrent threads\n"
+	       "-D gives each thread a disjoint slice of FILE, by default\n"
+	       "   their holes overlap (ignored with a REPLAYLOG)\n"
+	       "REPLAYLOG is an optional file to generate values from\n"
+	       "SEED replays the random values of an earlier run\n\n"
 	       "FILE will be truncated to zero, then truncated out to SIZE\n"
 	       "A random series of characters will be written into the\n"
 	       "file range. After the entire file has been populated a series\n"
@@ -59,7 +66,9 @@ static void usage(void)
 	       "the replay log, whichever comes first.\n"
 	       "The exact patterns written (and punched) will be logged such that\n"
 	       "the log can be replayed by a verification program, or given\n"
-	       "back to this software as a REPLAYLOG argument\n");
+	       "back to this software as a REPLAYLOG argument\n"
+	       "Threaded runs log each hole once it has been punched, in the\n"
+	       "order overlapping holes were punched in. -f can't be used with -t.\n");
 
 	exit(0);
 }
@@ -77,13 +86,29 @@ static char *replaylogname = NULL;
 static unsigned long file_size;
 static FILE *logfile = NULL;
 static FILE *replaylogfile = NULL;
+static unsigned int nr_threads = 0;
+static unsigned int disjoint = 0;
+
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int replay_iter;
+
+struct ph_puncher {
+	pthread_t	pp_thread;
+	unsigned int	pp_id;
+	int		pp_fd;
+	uint64_t	pp_start;
+	uint64_t	pp_size;
+	unsigned int	pp_iters;
+	struct fh_log	pp_log;
+	int		pp_ret;
+};
 
 static int ph_parse_opts(int argc, char **argv)
 {
 	int c, iter_specified = 0;
 
 	while (1) {
-		c = getopt(argc, argv, "aufi:o:r:");
+		c = getopt(argc, argv, "aufDi:o:r:t:");
 		if (c == -1)
 			break;
 
@@ -97,6 +122,14 @@ static int ph_parse_opts(int argc, char **argv)
 		case 'a':
 			enable_aio = 1;
 			break;
+		case 'D':
+			disjoint = 1;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			if (!nr_threads)
+				return EINVAL;
+			break;
 		case 'i':
 			max_iter = atoi(optarg);
 			iter_specified = 1;
@@ -124,6 +157,10 @@ static int ph_parse_opts(int argc, char **argv)
 	fname = argv[optind];
 	file_size = atol(argv[optind+1]);
 
+	/* records are only logged once the threads are done */
+	if (nr_threads && flush_output)
+		return EINVAL;
+
 	return 0;
 }
 
@@ -168,7 +205,7 @@ static unsigned long ph_get_rand(unsigned long min, unsigned long max)
 	if (min == 0 && max == 0)
 		return 0;
 
-	return min + ((rand() % max) - min);
+	return min + ((o2test_rand() % max) - min);
 }
 
 static void ph_prep_rand_write_unit(struct fh_write_unit *wu)
@@ -384,18 +421,168 @@ static int ph_open_logfile(void)
 	return 0;
 }
 
+static void ph_prep_thread_write_unit(struct ph_puncher *pp,
+				      struct fh_write_unit *wu)
+{
+again:
+	wu->w_offset = pp->pp_start + ph_get_rand(0, pp->pp_size);
+	wu->w_len = (unsigned int) ph_get_rand(1, MAX_WRITE_SIZE);
+
+	if (wu->w_offset + wu->w_len > pp->pp_start + pp->pp_size)
+		wu->w_len = pp->pp_start + pp->pp_size - wu->w_offset;
+
+	/* sometimes the random number might work out like this */
+	if (wu->w_len == 0)
+		goto again;
+
+	assert(wu->w_len <= MAX_WRITE_SIZE);
+}
+
+/* 0 with the next record in wu, 1 once the replay log is used up */
+static int ph_next_replay_unit(struct fh_write_unit *wu)
+{
+	int ret = 1;
+
+	pthread_mutex_lock(&replay_lock);
+	if (replay_iter < max_iter && !ph_replay_eof()) {
+		ret = ph_prep_write_unit(wu);
+		if (!ret)
+			replay_iter++;
+	}
+	pthread_mutex_unlock(&replay_lock);
+
+	return ret;
+}
+
+static void *ph_puncher_thread(void *arg)
+{
+	struct ph_puncher *pp = (struct ph_puncher *)arg;
+	struct fh_write_unit wu;
+	uint64_t seq;
+	unsigned int i;
+	int ret = 0;
+
+	o2test_rand_stream(pp->pp_id + 1);
+
+	for (i = 0; ; i++) {
+		if (replaylogfile) {
+			ret = ph_next_replay_unit(&wu);
+			if (ret)
+				break;
+		} else {
+			if (i == pp->pp_iters)
+				break;
+			ph_prep_thread_write_unit(pp, &wu);
+		}
+
+		wu.w_char = MAGIC_HOLE_CHAR;
+
+		seq = fh_range_lock(wu.w_offset, wu.w_len);
+		ret = ph_punch_hole(pp->pp_fd, &wu);
+		fh_range_unlock(wu.w_offset, wu.w_len);
+
+		/* a failed punch is logged too, as in the unthreaded run */
+		if (fh_log_append(&pp->pp_log, seq, &wu))
+			ret = -1;
+		if (ret)
+			break;
+	}
+
+	pp->pp_ret = ret > 0 ? 0 : ret;
+
+	return NULL;
+}
+
+static int ph_run_punchers(int fd)
+{
+	struct ph_puncher *punchers, *pp;
+	struct fh_log *logs;
+	uint64_t slice = 0;
+	unsigned int i, started;
+	int ret = 0;
+
+	punchers = (struct ph_puncher *)calloc(nr_threads, sizeof(*punchers));
+	logs = (struct fh_log *)calloc(nr_threads, sizeof(*logs));
+	if (!punchers || !logs) {
+		fprintf(stderr, "Out of memory setting up %u threads\n",
+			nr_threads);
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	if (disjoint && !replaylogfile) {
+		slice = file_size / nr_threads;
+		if (!slice) {
+			fprintf(stderr, "SIZE %lu is too small for %u "
+				"disjoint threads\n", file_size, nr_threads);
+			ret = -EINVAL;
+			goto bail;
+		}
+	}
+
+	/* the prep writes are in the log already, fresh numbers from here */
+	fh_range_lock_init();
+
+	for (i = 0; i < nr_threads; i++) {
+		pp = &punchers[i];
+		pp->pp_id = i;
+		pp->pp_fd = fd;
+		pp->pp_iters = max_iter / nr_threads +
+			(i < max_iter % nr_threads);
+		if (slice) {
+			pp->pp_start = i * slice;
+			pp->pp_size = (i == nr_threads - 1) ?
+				file_size - pp->pp_start : slice;
+		} else {
+			pp->pp_start = 0;
+			pp->pp_size = file_size;
+		}
+	}
+
+	for (started = 0; started < nr_threads; started++) {
+		ret = pthread_create(&punchers[started].pp_thread, NULL,
+				     ph_puncher_thread, &punchers[started]);
+		if (ret) {
+			fprintf(stderr, "pthread_create error %d: \"%s\"\n",
+				ret, strerror(ret));
+			ret = -ret;
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(punchers[i].pp_thread, NULL);
+		if (punchers[i].pp_ret && !ret)
+			ret = punchers[i].pp_ret;
+		logs[i] = punchers[i].pp_log;
+	}
+
+	/* whatever was punched gets logged, error or not */
+	if (fh_log_merge(logfile, logs, started) && !ret)
+		ret = -EIO;
+
+	for (i = 0; i < started; i++)
+		fh_log_free(&logs[i]);
+
+bail:
+	free(punchers);
+	free(logs);
+
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
 	int ret, i, fd;
 	struct fh_write_unit wu;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (argc < 3) {
 		usage();
 		return 1;
 	}
 
-	srand(getpid());
-
 	ret = ph_parse_opts(argc, argv);
 	if (ret) {
 		usage();
@@ -414,6 +601,9 @@ int main(int argc, char **argv)
 	if (fd == -1)
 		return 1;
 
+	if (nr_threads)
+		return ph_run_punchers(fd) ? 1 : 0;
+
 	for(i = 0; (i < max_iter) && !ph_replay_eof(); i++) {
 		ret = ph_prep_write_unit(&wu);
 		if (ret)
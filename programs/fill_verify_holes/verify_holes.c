@@ -42,13 +42,38 @@
 
 struct rb_root	chunk_root = RB_ROOT;
 
+/*
+ * The file as the log says it should look: disjoint intervals sorted
+ * by offset, each one filled with a single char, '\0' for holes.
+ * Lengths are 64 bits since neighbouring writes of the same char get
+ * merged into one interval.
+ */
 struct file_chunk {
-	struct fh_write_unit	fc_write;
+	uint64_t		fc_offset;
+	uint64_t		fc_len;
+	char			fc_char;
 	struct rb_node		fc_node;
+	struct file_chunk	*fc_next_free;
+};
+
+/*
+ * Chunks come out of slabs and go back onto a free list, replaying a
+ * log of millions of records would otherwise be millions of mallocs.
+ */
+#define VH_CHUNKS_PER_SLAB	4096
+
+struct chunk_slab {
+	struct chunk_slab	*cs_next;
+	struct file_chunk	cs_chunks[VH_CHUNKS_PER_SLAB];
 };
 
-static struct file_chunk *init_chunk = NULL;
-static char buf[MAX_WRITE_SIZE];
+static struct chunk_slab *chunk_slabs;
+static unsigned int slab_used = VH_CHUNKS_PER_SLAB;
+static struct file_chunk *free_chunks;
+
+/* verification reads the file this much at a time */
+#define VH_READ_SIZE		(4 * 1024 * 1024)
+
 static int verbose = 0;
 
 static void vh_usage(void)
@@ -104,267 +129,445 @@ static int vh_get_i_size(int fd, unsigned long *size)
 
 static struct file_chunk *vh_alloc_chunk(void)
 {
-	struct file_chunk *f = calloc(1, sizeof(*init_chunk));
-	if (!f) {
-		fprintf(stderr, "malloc error.\n");
-		exit(1);
+	struct file_chunk *f;
+	struct chunk_slab *slab;
+
+	if (free_chunks) {
+		f = free_chunks;
+		free_chunks = f->fc_next_free;
+	} else {
+		if (slab_used == VH_CHUNKS_PER_SLAB) {
+			slab = malloc(sizeof(*slab));
+			if (!slab) {
+				fprintf(stderr, "malloc error.\n");
+				exit(1);
+			}
+
+			slab->cs_next = chunk_slabs;
+			chunk_slabs = slab;
+			slab_used = 0;
+		}
+
+		f = &chunk_slabs->cs_chunks[slab_used++];
 	}
 
+	memset(f, 0, sizeof(*f));
+
 	return f;
 }
 
-static void vh_print_extent(const char *pre, FILE *where, struct fh_write_unit *wu)
+static void vh_free_chunk(struct file_chunk *f)
+{
+	f->fc_next_free = free_chunks;
+	free_chunks = f;
+}
+
+static void vh_print_extent(const char *pre, FILE *where,
+			    struct file_chunk *chunk)
 {
 	char ch[3] = "\\0\0";
 
-	if (wu->w_char != '\0') {
-		ch[0] = wu->w_char;
+	if (chunk->fc_char != '\0') {
+		ch[0] = chunk->fc_char;
 		ch[1] = '\0';
 	}
 
-	fprintf(where, "%s: {%s, %"PRIu64", %u} (%"PRIu64")\n", pre, ch,
-		wu->w_offset, wu->w_len, wu->w_offset + wu->w_len);
+	fprintf(where, "%s: {%s, %"PRIu64", %"PRIu64"} (%"PRIu64")\n", pre,
+		ch, chunk->fc_offset, chunk->fc_len,
+		chunk->fc_offset + chunk->fc_len);
 }
 
-static int recurse_level = 0;
+static inline uint64_t vh_chunk_end(struct file_chunk *chunk)
+{
+	return chunk->fc_offset + chunk->fc_len;
+}
 
-static void vh_insert_chunk(struct file_chunk *chunk)
+/* the first chunk which ends after off, NULL if there is none */
+static struct rb_node *vh_lookup(uint64_t off)
 {
-	struct rb_node **p;
-	struct rb_node *parent;
+	struct rb_node *n = chunk_root.rb_node, *found = NULL;
 	struct file_chunk *tmp;
-	unsigned long off = chunk->fc_write.w_offset;
-	unsigned int len = chunk->fc_write.w_len;
-	unsigned long end = off + len;
-
-	/*
-	 * This function should never recurse more than once - the
-	 * second insert (if called) should _always_ be to a region
-	 * which has been pre-cleared
-	 */
-	recurse_level++;
-	if (recurse_level > 2) {
-		fprintf(stderr, "Recursion level too high\n");
-		abort();
-	}
-
-restart_search:
-#ifdef DEBUG_INSERT
-	vh_print_extent("insert chunk", stdout, &chunk->fc_write);
-#endif
-	p = &chunk_root.rb_node;
-	parent = NULL;
-
-	while(*p) {
-		unsigned long tmpoff;
-		unsigned int tmplen;
-		unsigned long tmpend;
-		struct fh_write_unit *wu;
-		parent = *p;
-
-		tmp = rb_entry(parent, struct file_chunk, fc_node);
 
-		wu = &tmp->fc_write;
-		tmpoff = wu->w_offset;
-		tmplen = wu->w_len;
-		tmpend = tmpoff + tmplen;
+	while (n) {
+		tmp = rb_entry(n, struct file_chunk, fc_node);
 
-		if (off <= tmpoff && end >= tmpend) {
-#ifdef DEBUG_INSERT
-			printf("Fully encompasses another extent\n");
-			vh_print_extent("extent found", stdout, wu);
-#endif
+		if (vh_chunk_end(tmp) > off) {
+			found = n;
+			n = n->rb_left;
+		} else
+			n = n->rb_right;
+	}
 
-			/* We fully encompass this extent */
-			rb_erase(&tmp->fc_node, &chunk_root);
-			free(tmp);
+	return found;
+}
 
-			goto restart_search;
-		} else if (off > tmpoff && end < tmpend) {
-			struct file_chunk *tmp2 = vh_alloc_chunk();
-			char tmpch = wu->w_char;
-			/* We are in the middle of this extent */
-#ifdef DEBUG_INSERT
-			printf("Split existing extent\n");
-			vh_print_extent("extent found", stdout, wu);
-#endif
+/* only ever called for a range nothing else in the tree overlaps */
+static void vh_link_chunk(struct file_chunk *chunk)
+{
+	struct rb_node **p = &chunk_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct file_chunk *tmp;
 
-			rb_erase(&tmp->fc_node, &chunk_root);
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct file_chunk, fc_node);
 
-			wu->w_len = off - tmpoff;
+		if (chunk->fc_offset < tmp->fc_offset)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
 
-			vh_insert_chunk(tmp);
+	rb_link_node(&chunk->fc_node, parent, p);
+	rb_insert_color(&chunk->fc_node, &chunk_root);
+}
 
-			wu = &tmp2->fc_write;
+/*
+ * Later writes win: whatever the new range covers is trimmed off, or
+ * split around it, in one walk from the first chunk it touches. The
+ * range then either extends a neighbour holding the same char or
+ * goes in as a chunk of its own, and a following neighbour with the
+ * same char is folded into it.
+ */
+static void vh_insert_write(char ch, uint64_t off, uint64_t len)
+{
+	uint64_t end = off + len, tmpoff, tmpend;
+	struct rb_node *node, *next;
+	struct file_chunk *tmp, *right, *chunk = NULL;
 
-			wu->w_offset = end;
-			wu->w_len = tmpend - wu->w_offset;
-			wu->w_char = tmpch;
+	if (!len)
+		return;
 
-			vh_insert_chunk(tmp2);
-			goto restart_search;
-		} else if (off <= tmpoff && end <= tmpend && end > tmpoff) {
-			/* We straddle the left side of this extent */
 #ifdef DEBUG_INSERT
-			printf("Left straddle existing extent\n");
-			vh_print_extent("extent found", stdout, wu);
+	printf("insert: {%c, %"PRIu64", %"PRIu64"}\n", ch ? ch : '0', off,
+	       len);
 #endif
 
-			rb_erase(&tmp->fc_node, &chunk_root);
+	node = vh_lookup(off);
+	while (node) {
+		tmp = rb_entry(node, struct file_chunk, fc_node);
+		tmpoff = tmp->fc_offset;
+		tmpend = vh_chunk_end(tmp);
 
-			wu->w_offset = end;
-			wu->w_len = tmpend - wu->w_offset;
+		if (tmpoff >= end)
+			break;
 
-			vh_insert_chunk(tmp);
-			goto restart_search;
-		} else if (off > tmpoff && off < tmpend && end >= tmpend) {
-#ifdef DEBUG_INSERT
-			printf("Right straddle existing extent\n");
-			vh_print_extent("extent found", stdout, wu);
-#endif
+		next = rb_next(node);
+
+		if (tmpoff < off && tmpend > end) {
+			/* We are in the middle of this extent */
+			tmp->fc_len = off - tmpoff;
 
+			right = vh_alloc_chunk();
+			right->fc_char = tmp->fc_char;
+			right->fc_offset = end;
+			right->fc_len = tmpend - end;
+			vh_link_chunk(right);
+			break;
+		} else if (tmpoff < off) {
 			/* We straddle the right side of this extent */
-			rb_erase(&tmp->fc_node, &chunk_root);
+			tmp->fc_len = off - tmpoff;
+		} else if (tmpend > end) {
+			/* We straddle the left side of this extent */
+			tmp->fc_offset = end;
+			tmp->fc_len = tmpend - end;
+		} else {
+			/* We fully encompass this extent */
+			rb_erase(node, &chunk_root);
+			vh_free_chunk(tmp);
+		}
 
-			wu->w_len = off - tmpoff;
+		node = next;
+	}
 
-			vh_insert_chunk(tmp);
-			goto restart_search;
-		} else if (off < tmpoff)
-			p = &(*p)->rb_left;
-		else
-			p = &(*p)->rb_right;
+	if (off) {
+		node = vh_lookup(off - 1);
+		if (node) {
+			tmp = rb_entry(node, struct file_chunk, fc_node);
+			if (vh_chunk_end(tmp) == off && tmp->fc_char == ch) {
+				tmp->fc_len += len;
+				chunk = tmp;
+			}
+		}
 	}
 
-	rb_link_node(&chunk->fc_node, parent, p);
-	rb_insert_color(&chunk->fc_node, &chunk_root);
+	if (!chunk) {
+		chunk = vh_alloc_chunk();
+		chunk->fc_char = ch;
+		chunk->fc_offset = off;
+		chunk->fc_len = len;
+		vh_link_chunk(chunk);
+	}
 
-	recurse_level--;
+	node = rb_next(&chunk->fc_node);
+	if (node) {
+		tmp = rb_entry(node, struct file_chunk, fc_node);
+		if (tmp->fc_offset == end && tmp->fc_char == ch) {
+			chunk->fc_len += tmp->fc_len;
+			rb_erase(node, &chunk_root);
+			vh_free_chunk(tmp);
+		}
+	}
 }
 
 static void vh_init_tree(unsigned long file_size)
 {
-	init_chunk = vh_alloc_chunk();
-
-	init_chunk->fc_write.w_char = '\0';
-	init_chunk->fc_write.w_len = file_size;
-	init_chunk->fc_write.w_offset = 0;
-
-	vh_insert_chunk(init_chunk);
+	vh_insert_write('\0', 0, file_size);
 }
 
+/*
+ * Parses the whole log out of one mapping, fscanf() a line at a time
+ * is what made replaying big logs slow. Lines are "%c\t%llu\t%u\n" as
+ * fill_holes and punch_holes write them.
+ */
 static int vh_read_log(FILE *logfile)
 {
-	int ret;
+	struct stat st;
 	unsigned int line = 0;
-	struct file_chunk *chunk;
-	struct fh_write_unit *wu;
+	char *map, *p, *end, *next, ch;
+	uint64_t off, len;
+	int fd = fileno(logfile), ret = 0;
 
-	while (1) {
-		chunk = vh_alloc_chunk();
-		wu = &chunk->fc_write;
-
-		ret = fscanf(logfile, "%c\t%"PRIu64"\t%u\n", &wu->w_char,
-			     &wu->w_offset, &wu->w_len);
-		if (ret == 3) {
-			if (wu->w_char == MAGIC_HOLE_CHAR)
-				wu->w_char = '\0';
-			vh_insert_chunk(chunk);
-			line++;
-			continue;
-		}
+	if (fstat(fd, &st)) {
+		ret = errno;
+		fprintf(stderr, "stat failure %d: %s\n", ret, strerror(ret));
+		return ret;
+	}
+
+	if (!st.st_size)
+		return 0;
 
-		if (ret == EOF)
-			return 0;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		ret = errno;
+		fprintf(stderr, "mmap failure %d: %s\n", ret, strerror(ret));
+		return ret;
+	}
 
-		fprintf(stderr, "input failure at log file line %u\n", line);
-		ret = EINVAL;
-		break;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	p = map;
+	end = map + st.st_size;
+
+	while (p < end) {
+		ch = *p++;
+
+		while (p < end && (*p == '\t' || *p == ' '))
+			p++;
+		off = 0;
+		for (next = p; next < end && *next >= '0' && *next <= '9';
+		     next++)
+			off = off * 10 + (*next - '0');
+		if (next == p)
+			goto bad_line;
+
+		p = next;
+		while (p < end && (*p == '\t' || *p == ' '))
+			p++;
+		len = 0;
+		for (next = p; next < end && *next >= '0' && *next <= '9';
+		     next++)
+			len = len * 10 + (*next - '0');
+		if (next == p)
+			goto bad_line;
+
+		p = next;
+		while (p < end && (*p == '\n' || *p == '\r' || *p == ' ' ||
+				   *p == '\t'))
+			p++;
+
+		if (ch == MAGIC_HOLE_CHAR)
+			ch = '\0';
+		vh_insert_write(ch, off, len);
+		line++;
 	}
 
+	goto out;
+
+bad_line:
+	fprintf(stderr, "input failure at log file line %u\n", line);
+	ret = EINVAL;
+out:
+	munmap(map, st.st_size);
+
 	return ret;
 }
 
-static int vh_check_chunk(struct fh_write_unit *wu, int fd)
+static void vh_report_failure(struct file_chunk *chunk, uint64_t pos,
+			      char found)
 {
-	unsigned int len = wu->w_len;
-	unsigned int ret;
-	uint64_t off = wu->w_offset;
-	int i;
-
 	if (verbose)
-		vh_print_extent("check chunk", stdout, wu);
+		fprintf(stdout, "Failure. %"PRIu64" bytes into the file we "
+			"expected 0x%x but got 0x%x\n", pos, chunk->fc_char,
+			found);
 
-	while (len) {
-		unsigned int count;
+	vh_print_extent("Verify failed", stderr, chunk);
+}
 
-		count = len;
-		if (len > MAX_WRITE_SIZE)
-			count = MAX_WRITE_SIZE;
+/* index of the first byte in buf which isn't ch, or len */
+static size_t vh_first_mismatch(const char *buf, char ch, size_t len)
+{
+	size_t i;
 
-		ret = pread(fd, buf, count, off);
-		if (ret == -1) {
-			ret = errno;
-			fprintf(stderr, "read error %d: %s\n",
-				ret, strerror(ret));
-			return ret;
-		}
+	/* all equal to ch if the first one is and the rest equal it */
+	if (!len || (buf[0] == ch && !memcmp(buf, buf + 1, len - 1)))
+		return len;
 
-		if (ret == 0) {
-			fprintf(stderr, "premature end of file\n");
-			return EINVAL;
+	for (i = 0; i < len; i++)
+		if (buf[i] != ch)
+			break;
+
+	return i;
+}
+
+/*
+ * Checks [off, off + len) of the file against the chunks, starting
+ * from *cursor and leaving it on the last chunk looked at. data is
+ * what was read, NULL for a range SEEK_DATA says is a hole.
+ */
+static int vh_check_range(struct rb_node **cursor, uint64_t off,
+			  uint64_t len, const char *data)
+{
+	struct file_chunk *chunk;
+	uint64_t end = off + len, n;
+	size_t bad;
+
+	while (off < end && *cursor) {
+		chunk = rb_entry(*cursor, struct file_chunk, fc_node);
+
+		if (vh_chunk_end(chunk) <= off) {
+			*cursor = rb_next(*cursor);
+			if (verbose && *cursor)
+				vh_print_extent("check chunk", stdout,
+						rb_entry(*cursor,
+							 struct file_chunk,
+							 fc_node));
+			continue;
 		}
 
-		if (ret != count) {
-			fprintf(stderr, "short read. asked %u, read %u\n",
-				count, ret);
-			return EINVAL;
+		/* nothing was logged for a gap, nothing to hold it to */
+		if (chunk->fc_offset > off) {
+			n = chunk->fc_offset - off;
+			if (n > end - off)
+				n = end - off;
+			if (data)
+				data += n;
+			off += n;
+			continue;
 		}
 
-		for(i = 0; i < count; i++) {
-			if (buf[i] != wu->w_char) {
-				if (verbose) {
-					unsigned long pos;
-
-					pos = wu->w_offset +
-						(unsigned long)(wu->w_len - len + i);
-					fprintf(stdout, "Failure. %lu bytes "
-						"into the file we expected "
-						"0x%x but got 0x%x\n", pos,
-						wu->w_char, buf[i]);
-				}
+		n = vh_chunk_end(chunk) - off;
+		if (n > end - off)
+			n = end - off;
+
+		if (data) {
+			bad = vh_first_mismatch(data, chunk->fc_char, n);
+			if (bad < n) {
+				vh_report_failure(chunk, off + bad, data[bad]);
 				return 1;
 			}
+			data += n;
+		} else if (chunk->fc_char != '\0') {
+			vh_report_failure(chunk, off, '\0');
+			return 1;
 		}
 
-		len -= count;
-		off += count;
+		off += n;
 	}
 
 	return 0;
 }
 
-static int vh_check_file(int fd)
+/*
+ * Iterate over the file, looking for zeros where holes should be, and
+ * the right characters where holes were filled. Data is read in big
+ * contiguous pieces, ranges the fs reports as holes aren't read at
+ * all since they can only hold zeros.
+ */
+static int vh_check_file(int fd, unsigned long size)
 {
-	int ret;
-	struct rb_node *node;
-	struct file_chunk *chunk;
+	struct rb_node *cursor = rb_first(&chunk_root);
+	uint64_t pos = 0, count;
+	off_t data, hole;
+	ssize_t ret;
+	char *buf;
+	size_t done;
+
+	if (verbose && cursor)
+		vh_print_extent("check chunk", stdout,
+				rb_entry(cursor, struct file_chunk, fc_node));
+
+	buf = malloc(VH_READ_SIZE);
+	if (!buf) {
+		fprintf(stderr, "malloc error.\n");
+		return ENOMEM;
+	}
 
-	node = rb_first(&chunk_root);
-	while (node) {
-		chunk = rb_entry(node, struct file_chunk, fc_node);
+	while (pos < size) {
+		data = lseek(fd, pos, SEEK_DATA);
+		/* ENXIO is a hole up to eof, any other error no support */
+		if (data < 0)
+			data = (errno == ENXIO) ? size : pos;
+		if (data > size)
+			data = size;
+
+		if (data > pos) {
+			if (vh_check_range(&cursor, pos, data - pos, NULL))
+				goto fail;
+			pos = data;
+			continue;
+		}
 
-		ret = vh_check_chunk(&chunk->fc_write, fd);
-		if (ret) {
-			vh_print_extent("Verify failed", stderr,
-				     &chunk->fc_write);
-			return EINVAL;
+		hole = lseek(fd, pos, SEEK_HOLE);
+		if (hole <= pos || hole > size)
+			hole = size;
+
+		count = hole - pos;
+		if (count > VH_READ_SIZE)
+			count = VH_READ_SIZE;
+
+		for (done = 0; done < count; done += ret) {
+			ret = pread(fd, buf + done, count - done, pos + done);
+			if (ret == -1) {
+				if (errno == EINTR) {
+					ret = 0;
+					continue;
+				}
+				ret = errno;
+				fprintf(stderr, "read error %d: %s\n",
+					(int)ret, strerror(ret));
+				goto fail;
+			}
+
+			if (ret == 0) {
+				fprintf(stderr, "premature end of file\n");
+				goto fail;
+			}
 		}
 
-		node = rb_next(node);
+		if (vh_check_range(&cursor, pos, count, buf))
+			goto fail;
+
+		pos += count;
+	}
+
+	/* a write logged past i_size means the file lost its tail */
+	cursor = vh_lookup(size);
+	if (cursor) {
+		vh_print_extent("Verify failed", stderr,
+				rb_entry(cursor, struct file_chunk, fc_node));
+		fprintf(stderr, "premature end of file\n");
+		goto fail;
 	}
 
+	free(buf);
+
 	return 0;
+
+fail:
+	free(buf);
+
+	return EINVAL;
 }
 
 static int vh_parse_opts(int argc, char **argv, char **logname, char **fname)
@@ -430,7 +633,7 @@ int main(int argc, char **argv)
 	 * Iterate over the file, looking for zeros where holes should
 	 * be, and the right characters where holes were filled.
 	 */
-	ret = vh_check_file(fd);
+	ret = vh_check_file(fd, size);
 	if (ret)
 		return 1;
 
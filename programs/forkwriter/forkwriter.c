@@ -46,6 +46,9 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 
+#include "op_lat.h"
+#include "rand_ops.h"
+
 #define DEFAULT_SLEEP 50000
 #define DEFAULT_LOOPS 100
 #define DEFAULT_PROCS 2
@@ -109,14 +112,14 @@ static int do_child(char *logfile, int loop, int proc, unsigned long usec)
 	len = snprintf(buffer, BUFSZ, "%s %s:"LOG_FORMAT" %d.\n", 
 		       hostname, timebuf, LOG_ARGS, getpid());
 
-	fd = open(filename, OPEN_FLAGS, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	fd = timed_open(filename, OPEN_FLAGS, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
 	if (fd == -1) {
 		PRINTERR(errno);
 		goto bail;
 	}
 
 	for (i = 0; i < NUM_WRITES; i++) {
-		written = write(fd, buffer, len);
+		written = timed_write(fd, buffer, len);
 		if (written == -1) {
 			PRINTERR(errno);
 			goto bail;
@@ -151,13 +154,16 @@ int main(int argc, char **argv)
 	pid_t pid;
 	pid_t *pids = NULL;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if ((argc < 2) || (argc > 5) || (strcmp(argv[1],"-h") == 0)) {
-		printf("usage: %s file [loops] [procs] [sleep]\n\n",
-		       basename(argv[0]));
+		printf("usage: %s [--seed seed] file [loops] [procs] "
+		       "[sleep]\n\n", basename(argv[0]));
 		printf("\tfile:\tname used to generate the logfile created\n"
 		       "\tloops:\tnumber of times the processes will be forked (%d)\n"
 		       "\tprocs:\tnumber of processes forked in each loop (%d)\n"
-		       "\tsleep:\tms in between each write (%d)\n",
+		       "\tsleep:\tms in between each write (%d)\n"
+		       "\t--seed:\treplays the random choices of an earlier run\n",
 		       DEFAULT_LOOPS, DEFAULT_PROCS, DEFAULT_SLEEP);
 		return(0);
 	}
@@ -44,6 +44,9 @@
 #include <libaio.h>
 #endif
 
+#include "pattern_ops.h"
+#include "rand_ops.h"
+
 #define NUMPRINTCOLUMNS 32	/* # columns of data to print on each line */
 
 /*
@@ -86,7 +89,6 @@ int	fd;				/* fd for our test file */
 
 off_t		file_size = 0;
 off_t		biggest = 0;
-char		state[256];
 unsigned long	testcalls = 0;		/* calls to function "test" */
 
 unsigned long	simulatedopcount = 0;	/* -b flag */
@@ -108,7 +110,7 @@ long	monitorend = -1;		/* -m flag */
 int	lite = 0;			/* -L flag */
 long	numops = -1;			/* -N flag */
 int	randomoplen = 1;		/* -O flag disables it */
-int	seed = 1;			/* -S flag */
+unsigned long	seed;			/* -S flag or --seed */
 int     mapped_writes = 1;              /* -W flag disables */
 int 	mapped_reads = 1;		/* -R flag disables it */
 int	fsxgoodfd = 0;
@@ -332,10 +334,14 @@ check_buffers(unsigned offset, unsigned size)
 	unsigned op = 0;
 	unsigned bad = 0;
 
-	if (bcmp(good_buf + offset, temp_buf, size) != 0) {
+	i = buf_mismatch(good_buf + offset, temp_buf, size);
+	if (i < size) {
 		prt("READ BAD DATA: offset = 0x%x, size = 0x%x, fname = %s\n",
 		    offset, size, fname);
 		prt("OFFSET\tGOOD\tBAD\tRANGE\n");
+		/* nothing to report before the first bad byte */
+		offset += i;
+		size -= i;
 		while (size > 0) {
 			c = good_buf[offset];
 			t = temp_buf[i];
@@ -737,12 +743,20 @@ docloseopen(void)
 }
 
 
+/* 31 bits like random(), the close probability below depends on it */
+static inline unsigned long
+fsx_random(void)
+{
+	return o2test_rand() >> 33;
+}
+
+
 void
 test(void)
 {
 	unsigned long	offset;
 	unsigned long	size = maxoplen;
-	unsigned long	rv = random();
+	unsigned long	rv = fsx_random();
 	unsigned long	op = rv % (3 + !lite + mapped_writes);
 
         /* turn off the map read if necessary */
@@ -772,14 +786,14 @@ test(void)
 	 * MAPWRITE:    op = 3 or 4
 	 */
 	if (lite ? 0 : op == 3 && (style & 1) == 0) /* vanilla truncate? */
-		dotruncate(random() % maxfilelen);
+		dotruncate(fsx_random() % maxfilelen);
 	else {
 		if (randomoplen)
-			size = random() % (maxoplen+1);
+			size = fsx_random() % (maxoplen+1);
 		if (lite ? 0 : op == 3)
 			dotruncate(size);
 		else {
-			offset = random();
+			offset = fsx_random();
 			if (op == 1 || op == (lite ? 3 : 4)) {
 				offset %= maxfilelen;
 				if (offset + size > maxfilelen)
@@ -824,7 +838,7 @@ void
 usage(void)
 {
 	fprintf(stdout, "usage: %s",
-		"fsx [-dnqALOWZ] [-b opnum] [-c Prob] [-l flen] [-m start:end] [-o oplen] [-p progressinterval] [-r readbdy] [-s style] [-t truncbdy] [-w writebdy] [-D startingop] [-N numops] [-P dirpath] [-S seed] fname\n\
+		"fsx [-dnqALOWZ] [-b opnum] [-c Prob] [-l flen] [-m start:end] [-o oplen] [-p progressinterval] [-r readbdy] [-s style] [-t truncbdy] [-w writebdy] [-D startingop] [-N numops] [-P dirpath] [-S seed] [--seed seed] fname\n\
 	-b opnum: beginning operation number (default 1)\n\
 	-c P: 1 in P chance of file close+open at each op (default infinity)\n\
 	-d: debug output for all operations\n\
@@ -844,7 +858,8 @@ usage(void)
 	-N numops: total # operations to do (default infinity)\n\
 	-O: use oplen (see -o flag) for every op (default random)\n\
 	-P: save .fsxlog and .fsxgood files in dirpath (default ./)\n\
-	-S seed: for random # generator (default 1) 0 gets timestamp\n\
+	-S seed: for random # generator, same as --seed, 0 gets timestamp\n\
+		(default a new one, printed at start)\n\
 	-W: mapped write operations DISabled\n\
         -R: read() system calls only (mapped reads disabled)\n\
         -Z: O_DIRECT (use -R, -W, -r and -w too)\n\
@@ -962,7 +977,8 @@ int aio_rw(int rw, int fd, char *buf, unsigned len, unsigned offset)
 int
 main(int argc, char **argv)
 {
-	int	i, style, ch;
+	int	style, ch;
+	long	s;
 	char	*endp;
 	char goodfile[1024];
 	char logfile[1024];
@@ -972,6 +988,8 @@ main(int argc, char **argv)
 
 	setvbuf(stdout, (char *)0, _IOLBF, 0); /* line buffered stdout */
 
+	seed = o2test_seed_setup(&argc, argv, 1);
+
 	while ((ch = getopt(argc, argv, "b:c:dfl:m:no:p:qr:s:t:w:AD:LN:OP:RS:WZ"))
 	       != EOF)
 		switch (ch) {
@@ -1081,13 +1099,10 @@ main(int argc, char **argv)
                         mapped_reads = 0;
                         break;
 		case 'S':
-                        seed = getnum(optarg, &endp);
-			if (seed == 0)
-				seed = time(0) % 10000;
-			if (!quiet)
-				fprintf(stdout, "Seed set to %d\n", seed);
-			if (seed < 0)
+                        s = getnum(optarg, &endp);
+			if (s < 0)
 				usage();
+			seed = s ? s : time(0) % 10000;
 			break;
 		case 'W':
 		        mapped_writes = 0;
@@ -1118,8 +1133,10 @@ main(int argc, char **argv)
 	signal(SIGUSR1,	cleanup);
 	signal(SIGUSR2,	cleanup);
 
-	initstate(seed, state, 256);
-	setstate(state);
+	o2test_srand(seed);
+	if (!quiet)
+		fprintf(stdout, "Seed set to %lu (rerun with --seed %lu)\n",
+			seed, seed);
 	fd = open(fname,
 		O_RDWR|(lite ? 0 : O_CREAT|O_TRUNC)|o_direct, 0666);
 	if (fd < 0) {
@@ -1162,8 +1179,7 @@ main(int argc, char **argv)
 		}
 	}
 	original_buf = (char *) malloc(maxfilelen);
-	for (i = 0; i < maxfilelen; i++)
-		original_buf[i] = random() % 256;
+	o2test_rand_fill(original_buf, maxfilelen);
 	good_buf = (char *) malloc(maxfilelen + writebdy);
 	good_buf = round_up(good_buf, writebdy, 0);
 	bzero(good_buf, maxfilelen);
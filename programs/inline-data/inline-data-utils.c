@@ -35,6 +35,8 @@
 #include <inttypes.h>
 #include <linux/types.h>
 
+#include "io_ops.h"
+
 #define PATTERN_SZ      	8192
 #define OCFS2_MAX_FILENAME_LEN	255
 
@@ -62,19 +64,6 @@ extern char mount_point[OCFS2_MAX_FILENAME_LEN];
 extern char work_place[OCFS2_MAX_FILENAME_LEN];
 extern char file_name[OCFS2_MAX_FILENAME_LEN];
 
-unsigned long get_rand(unsigned long min, unsigned long max)
-{
-	if (min == 0 && max == 0)
-		return 0;
-
-	return min + (rand() % (max - min + 1));
-}
-
-char rand_char(void)
-{
-	return 'A' + (char) get_rand(0, 25);
-}
-
 void fill_pattern(int size)
 {
 	int i;
@@ -170,52 +159,6 @@ int try_punch_hole(int fd, unsigned int offset, unsigned int count)
 	return 0;
 }
 
-int mmap_write_at(int fd, const char *buf, size_t count, off_t offset)
-{
-	unsigned int mmap_size = page_size;
-	unsigned int size = count + offset;
-	int i, j, ret;
-	char *region;
-
-	while (mmap_size < size)
-		mmap_size += page_size;
-
-	region = mmap(NULL, mmap_size, PROT_WRITE, MAP_SHARED, fd, 0);
-	if (region == MAP_FAILED) {
-		ret = errno;
-		fprintf(stderr, "mmap (write) error %d: \"%s\"\n", ret,
-			strerror(ret));
-		return -1;
-	}
-
-	j = 0;
-	for (i = offset; i < size; i++)
-		region[i] = buf[j++];
-
-	munmap(region, mmap_size);
-
-	return 0;
-}
-
-int write_at(int fd, const void *buf, size_t count, off_t offset)
-{
-	int ret;
-
-	ret = pwrite(fd, buf, count, offset);
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "write error %d: \"%s\"\n", ret, strerror(ret));
-		return -1;
-	}
-
-	if (ret != count) {
-		fprintf(stderr, "Short write: wanted %zu, got %d\n", count, ret);
-		return -1;
-	}
-
-	return 0;
-}
-
 int prep_file_no_fill(unsigned int size, int open_direct)
 {
 	int fd, ret;
@@ -58,6 +58,8 @@
 
 #include <ocfs2/ocfs2.h>
 
+#include "io_ops.h"
+
 #include <sys/ioctl.h>
 #include <inttypes.h>
 #include <linux/types.h>
@@ -104,8 +106,6 @@ static unsigned long file_nums = 2;
 pid_t *child_pid_list_mp = NULL;
 pid_t *child_pid_list_mf = NULL;
 
-extern unsigned long get_rand(unsigned long min, unsigned long max);
-extern char rand_char(void);
 extern void fill_pattern(int size);
 extern int truncate_pattern(int fd, unsigned int old_size,
 			    unsigned int new_size);
@@ -114,8 +114,6 @@ extern int try_ioctl(int which, int fd, unsigned int offset,
 		     unsigned int count);
 extern int try_reserve(int fd, unsigned int offset, unsigned int count);
 extern int try_punch_hole(int fd, unsigned int offset, unsigned int count);
-extern int mmap_write_at(int fd, const char *buf, size_t count, off_t offset);
-extern int write_at(int fd, const void *buf, size_t count, off_t offset);
 extern int prep_file_no_fill(unsigned int size, int open_direct);
 extern int prep_file(unsigned int size);
 extern int verify_pattern(int size, char *buf);
@@ -132,13 +130,14 @@ static void usage(void)
 {
 	printf("Usage: inline-data [-i <iteration>] "
 	       "[-c <concurrent_process_num>] [-m <multi_file_num>] "
-	       "<-d <device>> <mount_point>\n"
+	       "[--seed seed] <-d <device>> <mount_point>\n"
 	       "Run a series of tests intended to verify I/O to and from\n"
 	       "files/dirs with inline data.\n\n"
 	       "iteration specify the running times.\n"
 	       "concurrent_process_num specify the number of concurrent "
 	       "multi_file_num specify the number of multiple files"
 	       "processes to perform inline-data write/read.\n"
+	       "seed replays the random workload of an earlier run.\n"
 	       "device and mount_point are mandatory.\n");
 
 	exit(1);
@@ -199,6 +198,8 @@ static int setup(int argc, char *argv[])
 	else
 		prog++;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -227,7 +228,6 @@ static int setup(int argc, char *argv[])
 		return 1;
 	}
 
-	srand(getpid());
 	page_size = sysconf(_SC_PAGESIZE);
 
 	snprintf(work_place, OCFS2_MAX_FILENAME_LEN, "%s/%s",
@@ -312,6 +312,7 @@ static int concurrent_rw_test(void)
 		}
 		/*Children perform random write/read*/
 		if (pid == 0) {
+			o2test_rand_stream(i + 1);
 			for (j = 0; j < child_nums; j++) {
 				rand_offset = get_rand(0, max_inline_size - 1);
 				rand_count = get_rand(1, max_inline_size -
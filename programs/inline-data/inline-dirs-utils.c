@@ -31,6 +31,8 @@
 
 #include <ocfs2/ocfs2.h>
 
+#include "io_ops.h"
+
 #include <dirent.h>
 
 #include <stddef.h>
@@ -80,19 +82,6 @@ extern unsigned int num_dirents;
 extern char path[PATH_MAX];
 extern char path1[PATH_MAX];
 
-unsigned long get_rand(unsigned long min, unsigned long max)
-{
-	if (min == 0 && max == 0)
-		return 0;
-
-	return min + (rand() % (max - min + 1));
-}
-
-char rand_char(void)
-{
-	return 'A' + (char) get_rand(0, 25);
-}
-
 int is_dot_entry(struct my_dirent *dirent)
 {
 	if (dirent->name_len == 1 && dirent->name[0] == '.')
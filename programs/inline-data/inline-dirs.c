@@ -37,6 +37,8 @@
 
 #include <ocfs2/ocfs2.h>
 
+#include "io_ops.h"
+
 #include <dirent.h>
 
 #include <stddef.h>
@@ -65,13 +67,6 @@ struct my_dirent {
 	char		name[OCFS2_MAX_FILENAME_LEN];
 };
 
-union semun {
-	int val;                    /* value for SETVAL */
-	struct semid_ds *buf;       /* buffer for IPC_STAT, IPC_SET */
-	unsigned short int *array;  /* array for GETALL, SETALL */
-	struct seminfo *__buf;      /* buffer for IPC_INFO */
-};
-
 static char *prog;
 static char device[100];
 
@@ -111,8 +106,6 @@ char path1[PATH_MAX];
 
 static int testno = 1;
 
-extern unsigned long get_rand(unsigned long min, unsigned long max);
-extern inline char rand_char(void);
 extern int is_dot_entry(struct my_dirent *dirent);
 extern int unlink_dirent(struct my_dirent *dirent);
 extern void destroy_dir(void);
@@ -137,7 +130,7 @@ static void usage(void)
 {
 	printf("Usage: inline-dirs [-i <iteration>] [-s operated_entries] "
 	       "[-c <concurrent_process_num>] [-m <multi_file_num>] "
-	       "<-d <device>> <mount_point>\n"
+	       "[--seed seed] <-d <device>> <mount_point>\n"
 	       "Run a series of tests intended to verify I/O to and from\n"
 	       "dirs with inline data.\n\n"
 	       "iteration specify the running times.\n"
@@ -146,6 +139,7 @@ static void usage(void)
 	       "concurrent_process_num specify the number of concurrent "
 	       "multi_file_num specify the number of multiple dirs"
 	       "processes to perform inline-data read/rename.\n"
+	       "seed replays the random workload of an earlier run.\n"
 	       "device and mount_point are mandatory.\n");
 	exit(1);
 
@@ -388,49 +382,6 @@ static void sigterm_handler()
 
 }
 
-static int set_semvalue(void)
-{
-	union semun sem_union;
-
-	sem_union.val = 1;
-	if (semctl(sem_id, 0, SETVAL, sem_union) == -1) {
-		perror("semctl");
-		return -1;
-	}
-
-	return 0;
-}
-
-static int semaphore_p(void)
-{
-	struct sembuf sem_b;
-
-	sem_b.sem_num = 0;
-	sem_b.sem_op = -1; /* P() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_p failed\n");
-		return -1;
-	}
-
-	return 0;
-}
-
-static int semaphore_v(void)
-{
-	struct sembuf sem_b;
-
-	sem_b.sem_num = 0;
-	sem_b.sem_op = 1; /* V() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_v failed\n");
-		return -1;
-	}
-
-	return 0;
-}
-
 #if 0
 /*
  * This function is not in use for now, comment it out to suppress
@@ -463,7 +414,7 @@ static void run_concurrent_test(void)
 
 	/*get and init semaphore*/
 	sem_id = semget(sem_key, 1, 0766 | IPC_CREAT);
-	if (set_semvalue() < 0) {
+	if (set_semvalue(sem_id, 1) < 0) {
 		fprintf(stderr, "Set semaphore value failed!\n");
 		exit(1);
 	}
@@ -499,11 +450,12 @@ static void run_concurrent_test(void)
 			exit(pid);
 		}
 		if (pid == 0) {
-			if (semaphore_p() < 0)
+			o2test_rand_stream(i + 1);
+			if (semaphore_p(sem_id) < 0)
 				exit(-1);
 			/*Concurrent rename for dirents*/
 			random_rename_same_reclen(operated_entries);
-			if (semaphore_v() < 0)
+			if (semaphore_v(sem_id) < 0)
 				exit(-1);
 			/*child exits normally*/
 			sleep(1);
@@ -630,6 +582,8 @@ static void setup(int argc, char *argv[])
 	else
 		prog++;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -648,7 +602,6 @@ static void setup(int argc, char *argv[])
 					     MAX_DIRENTS);
 	memset(dirents, 0, sizeof(struct my_dirent) * MAX_DIRENTS);
 
-	srand(getpid());
 	page_size = sysconf(_SC_PAGESIZE);
 
 	snprintf(work_place, OCFS2_MAX_FILENAME_LEN, "%s/%s", mount_point,
@@ -58,6 +58,9 @@
 #include <linux/types.h>
 
 #include <mpi.h>
+#include "mpi_rand.h"
+
+#include "io_ops.h"
 
 #define PATTERN_SZ		8192
 #define HOSTNAME_MAX_SZ		255
@@ -96,8 +99,6 @@ static int iteration = 1;
 static int rank = -1, size;
 static char hostname[HOSTNAME_MAX_SZ];
 
-extern unsigned long get_rand(unsigned long min, unsigned long max);
-extern inline char rand_char(void);
 extern void fill_pattern(int size);
 extern int truncate_pattern(int fd, unsigned int old_size,
 			    unsigned int new_size);
@@ -106,8 +107,6 @@ extern int try_ioctl(int which, int fd, unsigned int offset,
 		     unsigned int count);
 extern int try_reserve(int fd, unsigned int offset, unsigned int count);
 extern int try_punch_hole(int fd, unsigned int offset, unsigned int count);
-extern int mmap_write_at(int fd, const char *buf, size_t count, off_t offset);
-extern int write_at(int fd, const void *buf, size_t count, off_t offset);
 extern int prep_file_no_fill(unsigned int size, int open_direct);
 extern int prep_file(unsigned int size);
 extern int verify_pattern(int size, char *buf);
@@ -122,10 +121,11 @@ extern int is_file_inlined(char *dirent_name, unsigned long *i_size,
 static void usage(void)
 {
 	printf("Usage: multi-inline-data [-i <iteration>] "
-	       "<-u <uuid>> <mount_point>\n"
+	       "[--seed seed] <-u <uuid>> <mount_point>\n"
 	       "Run a series of tests intended to verify I/O to and from\n"
 	       "files/dirs with inline data.\n\n"
 	       "iteration specify the running times.\n"
+	       "seed replays the random workload of an earlier run.\n"
 	       "uuid and mount_point are mandatory.\n");
 
 	MPI_Finalize();
@@ -249,6 +249,8 @@ static int setup(int argc, char *argv[])
 	else
 		prog++;
 
+	MPI_Seed_Setup(&argc, argv);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -270,7 +272,6 @@ static int setup(int argc, char *argv[])
 		return 1;
 	}
 
-	srand(getpid());
 	page_size = sysconf(_SC_PAGESIZE);
 	snprintf(work_place, OCFS2_MAX_FILENAME_LEN, "%s/%s", mount_point,
 		 WORK_PLACE);
@@ -49,6 +49,9 @@
 #include <linux/types.h>
 
 #include <mpi.h>
+#include "mpi_rand.h"
+
+#include "io_ops.h"
 
 #define OCFS2_MAX_FILENAME_LEN		255
 #define HOSTNAME_MAX_SZ			255
@@ -113,28 +116,16 @@ static int testno = 1;
 static int rank = -1, size;
 static char hostname[HOSTNAME_MAX_SZ];
 
-static unsigned long get_rand(unsigned long min, unsigned long max)
-{
-	if (min == 0 && max == 0)
-		return 0;
-
-	return min + (rand() % (max - min + 1));
-}
-
-static inline char rand_char(void)
-{
-	return 'A' + (char) get_rand(0, 25);
-}
-
 static void usage(void)
 {
 	printf("Usage: multi-inline-dirs [-i <iteration>] [-s operated_entries] "
-	       "<-u <uuid>> <mount_point>\n"
+	       "[--seed seed] <-u <uuid>> <mount_point>\n"
 	       "Run a series of tests intended to verify I/O to and from\n"
 	       "dirs with inline data.\n\n"
 	       "iteration specify the running times.\n"
 	       "operated_dir_entries specify the entires number to be "
 	       "operated,such as random create/unlink/rename.\n"
+	       "seed replays the random workload of an earlier run.\n"
 	       "uuid and mount_point are mandatory.\n");
 
 	MPI_Finalize();
@@ -1265,6 +1256,8 @@ static void setup(int argc, char *argv[])
 	else
 		prog++;
 
+	MPI_Seed_Setup(&argc, argv);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -1277,7 +1270,6 @@ static void setup(int argc, char *argv[])
 	if (ret < 0)
 		abort_printf("open ocfs2 volume failed!\n");
 
-	srand(getpid());
 	page_size = sysconf(_SC_PAGESIZE);
 	snprintf(work_place, OCFS2_MAX_FILENAME_LEN, "%s/%s", mount_point,
 		 WORK_PLACE);
@@ -33,7 +33,10 @@
 #include <limits.h>
 #include <sys/ioctl.h>
 
+#include <string.h>
+
 #include "aio.h"
+#include "io_ops.h"
 
 int o2test_aio_setup(struct o2test_aio *o2a, int nr_events)
 {
@@ -155,3 +158,113 @@ int o2test_aio_destroy(struct o2test_aio *o2a)
 
 	return ret;
 }
+
+/*
+ * Submits nr transfers, iov[i] at offsets[i], in one go and waits for
+ * all of them, any failed or short one fails the batch.
+ */
+int o2test_aio_rw_batch(int fd, int write, const struct iovec *iov,
+			const off_t *offsets, int nr)
+{
+	int ret, i, submitted = 0, reaped = 0, failed = 0;
+	io_context_t ctx = NULL;
+	struct iocb *iocbs = NULL, **iocbps = NULL;
+	struct io_event *events = NULL;
+	size_t bytes = 0;
+	unsigned long long start = io_stats_start();
+
+	iocbs = (struct iocb *)calloc(nr, sizeof(struct iocb));
+	iocbps = (struct iocb **)calloc(nr, sizeof(struct iocb *));
+	events = (struct io_event *)calloc(nr, sizeof(struct io_event));
+	if (!iocbs || !iocbps || !events) {
+		fprintf(stderr, "failed to allocate %d aio requests\n", nr);
+		ret = -1;
+		goto out;
+	}
+
+	ret = io_setup(nr, &ctx);
+	if (ret) {
+		fprintf(stderr, "error %s during %s\n", strerror(-ret),
+			"io_setup");
+		ctx = NULL;
+		ret = -1;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (write)
+			io_prep_pwrite(&iocbs[i], fd, iov[i].iov_base,
+				       iov[i].iov_len, offsets[i]);
+		else
+			io_prep_pread(&iocbs[i], fd, iov[i].iov_base,
+				      iov[i].iov_len, offsets[i]);
+		iocbps[i] = &iocbs[i];
+		bytes += iov[i].iov_len;
+	}
+
+	while (submitted < nr) {
+		ret = io_submit(ctx, nr - submitted, iocbps + submitted);
+		if (ret <= 0) {
+			fprintf(stderr, "error %s during %s\n",
+				strerror(ret ? -ret : EAGAIN), "io_submit");
+			failed = 1;
+			break;
+		}
+		submitted += ret;
+	}
+
+	while (reaped < submitted) {
+		ret = io_getevents(ctx, 1, submitted - reaped, events, NULL);
+		if (ret < 0) {
+			if (ret == -EINTR)
+				continue;
+			fprintf(stderr, "error %s during %s\n", strerror(-ret),
+				"io_getevents");
+			failed = 1;
+			break;
+		}
+
+		for (i = 0; i < ret; i++) {
+			if (events[i].res != events[i].obj->u.c.nbytes) {
+				fprintf(stderr, "aio %s at %lld returned %ld, "
+					"expected %lu\n",
+					write ? "write" : "read",
+					events[i].obj->u.c.offset,
+					(long)events[i].res,
+					events[i].obj->u.c.nbytes);
+				failed = 1;
+			}
+		}
+
+		reaped += ret;
+	}
+
+	ret = failed ? -1 : 0;
+
+out:
+	if (ctx)
+		io_destroy(ctx);
+
+	io_stats_end(write ? IO_OP_AIO_WRITE : IO_OP_AIO_READ, start,
+		     bytes, ret);
+
+	free(events);
+	free(iocbps);
+	free(iocbs);
+
+	return ret;
+}
+
+int o2test_aio_read_at(int fd, void *buf, size_t count, off_t offset)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
+
+	return o2test_aio_rw_batch(fd, 0, &iov, &offset, 1);
+}
+
+int o2test_aio_write_at(int fd, const void *buf, size_t count, off_t offset)
+{
+	struct iovec iov = { .iov_base = (void *)buf, .iov_len = count };
+
+	return o2test_aio_rw_batch(fd, 1, &iov, &offset, 1);
+}
@@ -19,6 +19,7 @@
 #define AIO_H
 
 #include <libaio.h>
+#include <sys/uio.h>
 
 struct o2test_aio {
 	struct io_context *o2a_ctx;
@@ -35,4 +36,9 @@ int o2test_aio_pread(struct o2test_aio *o2a, int fd, void *buf, size_t count,
 int o2test_aio_query(struct o2test_aio *o2a, long min_nr, long nr);
 int o2test_aio_destroy(struct o2test_aio *o2a);
 
+int o2test_aio_rw_batch(int fd, int write, const struct iovec *iov,
+			const off_t *offsets, int nr);
+int o2test_aio_read_at(int fd, void *buf, size_t count, off_t offset);
+int o2test_aio_write_at(int fd, const void *buf, size_t count, off_t offset);
+
 #endif
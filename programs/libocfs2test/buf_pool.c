@@ -0,0 +1,268 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * buf_pool.c
+ *
+ * Pooled, aligned and optionally hugepage backed buffers for the
+ * O_DIRECT paths of ocfs2-tests.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include "buf_pool.h"
+
+#define BUF_POOL_HUGE_SIZE	(2 * 1024 * 1024)
+
+static struct o2test_buf_pool dio_pool;
+static pthread_once_t dio_pool_once = PTHREAD_ONCE_INIT;
+static int dio_pool_ret;
+
+static size_t round_up(size_t val, size_t align)
+{
+	return (val + align - 1) / align * align;
+}
+
+/*
+ * hugetlb first, it's the only way to be sure of huge pages but needs
+ * them reserved up front, then a normal mapping with a THP hint.
+ */
+static int buf_pool_map(struct o2test_buf_pool *bp, size_t size, int flags)
+{
+	void *arena = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	if (flags & O2TEST_BUF_HUGE) {
+		arena = mmap(NULL, round_up(size, BUF_POOL_HUGE_SIZE),
+			     PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (arena != MAP_FAILED) {
+			bp->bp_arena_size = round_up(size, BUF_POOL_HUGE_SIZE);
+			bp->bp_hugetlb = 1;
+		}
+	}
+#endif
+
+	if (arena == MAP_FAILED) {
+		arena = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (arena == MAP_FAILED)
+			return -errno;
+
+		bp->bp_arena_size = size;
+#ifdef MADV_HUGEPAGE
+		if ((flags & O2TEST_BUF_HUGE) && size >= BUF_POOL_HUGE_SIZE)
+			madvise(arena, size, MADV_HUGEPAGE);
+#endif
+	}
+
+	bp->bp_arena = (char *)arena;
+
+	return 0;
+}
+
+int o2test_buf_pool_init(struct o2test_buf_pool *bp, size_t buf_size,
+			 unsigned int nr_bufs, int flags)
+{
+	unsigned int i;
+	int ret;
+
+	memset(bp, 0, sizeof(*bp));
+	bp->bp_ring_fd = -1;
+
+	if (!buf_size || !nr_bufs)
+		return -EINVAL;
+
+	bp->bp_buf_size = round_up(buf_size, O2TEST_BUF_ALIGN);
+	bp->bp_nr_bufs = nr_bufs;
+
+	bp->bp_free = (unsigned int *)malloc(sizeof(unsigned int) * nr_bufs);
+	if (!bp->bp_free)
+		return -ENOMEM;
+
+	ret = buf_pool_map(bp, bp->bp_buf_size * nr_bufs, flags);
+	if (ret) {
+		fprintf(stderr, "error %s during %s\n", strerror(-ret),
+			"mmap of buffer pool");
+		free(bp->bp_free);
+		bp->bp_free = NULL;
+		return ret;
+	}
+
+	/* hand out the low buffers first */
+	for (i = 0; i < nr_bufs; i++)
+		bp->bp_free[i] = nr_bufs - 1 - i;
+	bp->bp_nr_free = nr_bufs;
+
+	pthread_mutex_init(&bp->bp_lock, NULL);
+	pthread_cond_init(&bp->bp_wait, NULL);
+
+	return 0;
+}
+
+void o2test_buf_pool_destroy(struct o2test_buf_pool *bp)
+{
+	if (!bp->bp_arena)
+		return;
+
+	if (bp->bp_ring_fd >= 0)
+		o2test_buf_pool_unregister(bp);
+
+	munmap(bp->bp_arena, bp->bp_arena_size);
+	free(bp->bp_free);
+	pthread_mutex_destroy(&bp->bp_lock);
+	pthread_cond_destroy(&bp->bp_wait);
+
+	memset(bp, 0, sizeof(*bp));
+	bp->bp_ring_fd = -1;
+}
+
+void *o2test_buf_get(struct o2test_buf_pool *bp)
+{
+	unsigned int idx;
+
+	pthread_mutex_lock(&bp->bp_lock);
+	while (!bp->bp_nr_free)
+		pthread_cond_wait(&bp->bp_wait, &bp->bp_lock);
+	idx = bp->bp_free[--bp->bp_nr_free];
+	pthread_mutex_unlock(&bp->bp_lock);
+
+	return bp->bp_arena + (size_t)idx * bp->bp_buf_size;
+}
+
+void o2test_buf_put(struct o2test_buf_pool *bp, void *buf)
+{
+	int idx = o2test_buf_index(bp, buf);
+
+	if (idx < 0) {
+		fprintf(stderr, "buffer %p doesn't belong to the pool\n", buf);
+		return;
+	}
+
+	pthread_mutex_lock(&bp->bp_lock);
+	bp->bp_free[bp->bp_nr_free++] = idx;
+	pthread_cond_signal(&bp->bp_wait);
+	pthread_mutex_unlock(&bp->bp_lock);
+}
+
+int o2test_buf_index(struct o2test_buf_pool *bp, const void *buf)
+{
+	const char *p = (const char *)buf;
+
+	if (p < bp->bp_arena ||
+	    p >= bp->bp_arena + (size_t)bp->bp_nr_bufs * bp->bp_buf_size ||
+	    (p - bp->bp_arena) % bp->bp_buf_size)
+		return -1;
+
+	return (p - bp->bp_arena) / bp->bp_buf_size;
+}
+
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_register)
+
+int o2test_buf_pool_register(struct o2test_buf_pool *bp, int ring_fd)
+{
+	struct iovec *iov;
+	unsigned int i;
+	int ret = 0;
+
+	iov = (struct iovec *)malloc(sizeof(struct iovec) * bp->bp_nr_bufs);
+	if (!iov)
+		return -ENOMEM;
+
+	for (i = 0; i < bp->bp_nr_bufs; i++) {
+		iov[i].iov_base = bp->bp_arena + (size_t)i * bp->bp_buf_size;
+		iov[i].iov_len = bp->bp_buf_size;
+	}
+
+	/* pins the pages, RLIMIT_MEMLOCK applies on older kernels */
+	if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS,
+		    iov, bp->bp_nr_bufs) < 0)
+		ret = -errno;
+	else
+		bp->bp_ring_fd = ring_fd;
+
+	free(iov);
+
+	return ret;
+}
+
+int o2test_buf_pool_unregister(struct o2test_buf_pool *bp)
+{
+	int ret = 0;
+
+	if (bp->bp_ring_fd < 0)
+		return 0;
+
+	if (syscall(__NR_io_uring_register, bp->bp_ring_fd,
+		    IORING_UNREGISTER_BUFFERS, NULL, 0) < 0)
+		ret = -errno;
+
+	bp->bp_ring_fd = -1;
+
+	return ret;
+}
+
+#else
+
+int o2test_buf_pool_register(struct o2test_buf_pool *bp, int ring_fd)
+{
+	return -ENOSYS;
+}
+
+int o2test_buf_pool_unregister(struct o2test_buf_pool *bp)
+{
+	return 0;
+}
+
+#endif
+
+static void dio_pool_setup(void)
+{
+	dio_pool_ret = o2test_buf_pool_init(&dio_pool, O2TEST_DIO_BUF_SIZE,
+					    O2TEST_DIO_NR_BUFS,
+					    O2TEST_BUF_HUGE);
+}
+
+struct o2test_buf_pool *o2test_dio_pool(void)
+{
+	pthread_once(&dio_pool_once, dio_pool_setup);
+
+	return dio_pool_ret ? NULL : &dio_pool;
+}
+
+/* NULL only if the pool couldn't be set up at all */
+void *o2test_dio_buf_get(void)
+{
+	struct o2test_buf_pool *bp = o2test_dio_pool();
+
+	return bp ? o2test_buf_get(bp) : NULL;
+}
+
+void o2test_dio_buf_put(void *buf)
+{
+	if (buf)
+		o2test_buf_put(&dio_pool, buf);
+}
@@ -0,0 +1,75 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * buf_pool.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef BUF_POOL_H
+#define BUF_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * Fixed size, page aligned buffers carved out of one mmap()ed arena,
+ * good for O_DIRECT at any offset and length the device takes. With
+ * O2TEST_BUF_HUGE the arena is backed by hugetlb pages when the box
+ * has them reserved and asks for transparent huge pages otherwise.
+ * o2test_buf_get() blocks while every buffer is out, so a pool with
+ * nr_bufs buffers is enough for nr_bufs threads.
+ */
+#define O2TEST_BUF_ALIGN	4096
+#define O2TEST_BUF_HUGE		0x0001
+
+struct o2test_buf_pool {
+	char *bp_arena;
+	size_t bp_arena_size;
+	int bp_hugetlb;
+	size_t bp_buf_size;
+	unsigned int bp_nr_bufs;
+	unsigned int bp_nr_free;
+	unsigned int *bp_free;		/* stack of free buffer indexes */
+	pthread_mutex_t bp_lock;
+	pthread_cond_t bp_wait;
+	int bp_ring_fd;			/* io_uring the arena is registered with */
+};
+
+int o2test_buf_pool_init(struct o2test_buf_pool *bp, size_t buf_size,
+			 unsigned int nr_bufs, int flags);
+void o2test_buf_pool_destroy(struct o2test_buf_pool *bp);
+void *o2test_buf_get(struct o2test_buf_pool *bp);
+void o2test_buf_put(struct o2test_buf_pool *bp, void *buf);
+int o2test_buf_index(struct o2test_buf_pool *bp, const void *buf);
+
+/*
+ * Registers every buffer with the ring as a fixed buffer, index i in
+ * IORING_OP_{READ,WRITE}_FIXED being the buffer o2test_buf_index()
+ * returns i for. -ENOSYS when built without io_uring.
+ */
+int o2test_buf_pool_register(struct o2test_buf_pool *bp, int ring_fd);
+int o2test_buf_pool_unregister(struct o2test_buf_pool *bp);
+
+/*
+ * Process wide pool of O2TEST_DIO_BUF_SIZE buffers for the O_DIRECT
+ * paths of the tests, set up on first use and never torn down. Forked
+ * children get their own copy along with the rest of the memory.
+ */
+#define O2TEST_DIO_BUF_SIZE	(1024 * 1024)
+#define O2TEST_DIO_NR_BUFS	16
+
+struct o2test_buf_pool *o2test_dio_pool(void);
+void *o2test_dio_buf_get(void);
+void o2test_dio_buf_put(void *buf);
+
+#endif
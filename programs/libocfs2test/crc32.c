@@ -0,0 +1,496 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * crc32.c
+ *
+ * Shared crc32 engine for chunk verifiers in ocfs2-tests, dispatches
+ * to the fastest kernel the running cpu supports.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "crc32table.h"
+#include "crc32.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
+#define HAVE_CRC32_PCLMUL
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#define CRC32_POLY_LE		0xedb88320
+
+/* below this length the folding setup costs more than it saves */
+#define CRC32_PCLMUL_MIN	64
+
+typedef uint32_t (*crc32_func_t)(uint32_t crc, const unsigned char *p,
+				 size_t len);
+
+static uint32_t crc32_slice8_table[8][256];
+static int crc32_pclmul_ok;
+static int crc32_kernel = CRC32_KERNEL_TABLE;
+
+static inline uint32_t get_le32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Reference kernel, this is the loop every test used to carry its own
+ * copy of, kept around to validate and benchmark the faster ones.
+ */
+static uint32_t crc32_table(uint32_t crc, const unsigned char *p, size_t len)
+{
+	const uint32_t      *b = (const uint32_t *)p;
+	const uint32_t      *tab = crc32table_le;
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+# define DO_CRC(x) crc = tab[(crc ^ (x)) & 255] ^ (crc >> 8)
+#else
+# define DO_CRC(x) crc = tab[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
+#endif
+
+	crc = tole(crc);
+	/* Align it */
+	if (((long)b)&3 && len) {
+		do {
+			const uint8_t *p = (const uint8_t *)b;
+			DO_CRC(*p++);
+			b = (const void *)p;
+		} while ((--len) && ((long)b)&3);
+	}
+	if (len >= 4) {
+		/* load data 32 bits wide, xor data 32 bits wide. */
+		size_t save_len = len & 3;
+		len = len >> 2;
+		--b; /* use pre increment below(*++b) for speed */
+		do {
+			crc ^= *++b;
+			DO_CRC(0);
+			DO_CRC(0);
+			DO_CRC(0);
+			DO_CRC(0);
+		} while (--len);
+		b++; /* point to next byte(s) */
+		len = save_len;
+	}
+	/* And the last few bytes */
+	if (len) {
+		do {
+			const uint8_t *p = (const uint8_t *)b;
+			DO_CRC(*p++);
+			b = (const void *)p;
+		} while (--len);
+	}
+
+	return tole(crc);
+#undef DO_CRC
+}
+
+static void crc32_slice8_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLY_LE : 0);
+		crc32_slice8_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = crc32_slice8_table[0][i];
+		for (j = 1; j < 8; j++) {
+			crc = (crc >> 8) ^ crc32_slice8_table[0][crc & 0xff];
+			crc32_slice8_table[j][i] = crc;
+		}
+	}
+}
+
+/*
+ * Slicing-by-8 works on the crc in cpu order and loads data as little
+ * endian explicitly, so it gives the same result on every arch.
+ */
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *p, size_t len)
+{
+	const uint32_t (*t)[256] = (const uint32_t (*)[256])crc32_slice8_table;
+	uint32_t lo, hi;
+
+	while (len && ((unsigned long)p & 7)) {
+		crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+
+	while (len >= 8) {
+		lo = crc ^ get_le32(p);
+		hi = get_le32(p + 4);
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+		      t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+		      t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+		      t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#ifdef HAVE_CRC32_PCLMUL
+/*
+ * Fold 64 bytes at a time with carry-less multiplies, then reduce the
+ * 128 bits left over with Barrett reduction. Constants are the bit
+ * reflected x^n mod P(x) values from Intel's "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction" paper.
+ *
+ * Note that the sse4.2 crc32 instruction computes crc32c (Castagnoli),
+ * not this polynomial, so it can't be used here.
+ *
+ * len must be a multiple of 16 and at least 64.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_fold(uint32_t crc, const unsigned char *buf,
+				  size_t len)
+{
+	static const uint64_t k1k2[2] __attribute__((aligned(16))) =
+		{ 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const uint64_t k3k4[2] __attribute__((aligned(16))) =
+		{ 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const uint64_t k5k0[2] __attribute__((aligned(16))) =
+		{ 0x0163cd6124ULL, 0x0000000000ULL };
+	static const uint64_t poly[2] __attribute__((aligned(16))) =
+		{ 0x01db710641ULL, 0x01f7011641ULL };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+	x0 = _mm_load_si128((const __m128i *)k1k2);
+
+	buf += 64;
+	len -= 64;
+
+	/* four independent 128 bit lanes per 64 byte block */
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+		x1 = _mm_xor_si128(x1, x5);
+		x2 = _mm_xor_si128(x2, x6);
+		x3 = _mm_xor_si128(x3, x7);
+		x4 = _mm_xor_si128(x4, x8);
+
+		x1 = _mm_xor_si128(x1, y5);
+		x2 = _mm_xor_si128(x2, y6);
+		x3 = _mm_xor_si128(x3, y7);
+		x4 = _mm_xor_si128(x4, y8);
+
+		buf += 64;
+		len -= 64;
+	}
+
+	/* fold the four lanes into one */
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(x1, x2);
+	x1 = _mm_xor_si128(x1, x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(x1, x3);
+	x1 = _mm_xor_si128(x1, x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(x1, x4);
+	x1 = _mm_xor_si128(x1, x5);
+
+	/* remaining 16 byte blocks */
+	while (len >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)buf);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(x1, x2);
+		x1 = _mm_xor_si128(x1, x5);
+
+		buf += 16;
+		len -= 16;
+	}
+
+	/* 128 -> 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x0 = _mm_load_si128((const __m128i *)poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *p, size_t len)
+{
+	size_t fold_len;
+
+	if (len < CRC32_PCLMUL_MIN)
+		return crc32_slice8(crc, p, len);
+
+	fold_len = len & ~(size_t)15;
+	crc = crc32_pclmul_fold(crc, p, fold_len);
+
+	return crc32_slice8(crc, p + fold_len, len - fold_len);
+}
+
+static int crc32_pclmul_probe(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+
+	return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+#endif
+
+/*
+ * One crc step over byte c is crc' = A(crc) ^ t[c], where A is linear
+ * over GF(2). Feeding len copies of c thus gives
+ *
+ *	A^len(crc) ^ (I + A + ... + A^(len-1))(t[c])
+ *
+ * Both operators are 32x32 bit matrices, kept as the images of each bit,
+ * and are built by doubling in O(log(len)) matrix products.
+ */
+struct crc32_fill_ops {
+	size_t len;
+	uint32_t pow[32];	/* A^len */
+	uint32_t sum[32];	/* I + A + ... + A^(len-1) */
+};
+
+static inline uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+
+	while (vec) {
+		if (vec & 1)
+			sum ^= *mat;
+		vec >>= 1;
+		mat++;
+	}
+
+	return sum;
+}
+
+static void gf2_matrix_mul(uint32_t *res, const uint32_t *a, const uint32_t *b)
+{
+	uint32_t tmp[32];
+	int i;
+
+	for (i = 0; i < 32; i++)
+		tmp[i] = gf2_matrix_times(a, b[i]);
+
+	memcpy(res, tmp, sizeof(tmp));
+}
+
+static void crc32_fill_ops_init(struct crc32_fill_ops *ops, size_t len)
+{
+	uint32_t p[32], s[32], tmp[32];
+	size_t n = len;
+	int i;
+
+	/* p = A, s = I, i.e. the operators for a single byte */
+	for (i = 0; i < 32; i++) {
+		p[i] = (i < 8) ? crc32_slice8_table[0][1 << i] :
+				 (uint32_t)1 << (i - 8);
+		s[i] = (uint32_t)1 << i;
+		ops->pow[i] = (uint32_t)1 << i;
+		ops->sum[i] = 0;
+	}
+
+	while (n) {
+		if (n & 1) {
+			/* sum += pow * s, pow *= p */
+			gf2_matrix_mul(tmp, ops->pow, s);
+			for (i = 0; i < 32; i++)
+				ops->sum[i] ^= tmp[i];
+			gf2_matrix_mul(ops->pow, ops->pow, p);
+		}
+
+		n >>= 1;
+		if (!n)
+			break;
+
+		/* s += p * s, p *= p */
+		gf2_matrix_mul(tmp, p, s);
+		for (i = 0; i < 32; i++)
+			s[i] ^= tmp[i];
+		gf2_matrix_mul(p, p, p);
+	}
+
+	ops->len = len;
+}
+
+static const struct {
+	const char *name;
+	crc32_func_t func;
+} crc32_kernels[CRC32_KERNEL_NUM] = {
+	[CRC32_KERNEL_TABLE]	= { "table", crc32_table },
+	[CRC32_KERNEL_SLICE8]	= { "slice8", crc32_slice8 },
+#ifdef HAVE_CRC32_PCLMUL
+	[CRC32_KERNEL_PCLMUL]	= { "pclmul", crc32_pclmul },
+#else
+	[CRC32_KERNEL_PCLMUL]	= { "pclmul", NULL },
+#endif
+};
+
+/*
+ * Tables and cpu probing are done once at load time, so the hot path
+ * never has to check whether it has been initialized.
+ */
+__attribute__((constructor))
+static void crc32_init(void)
+{
+	crc32_slice8_init();
+
+#ifdef HAVE_CRC32_PCLMUL
+	crc32_pclmul_ok = crc32_pclmul_probe();
+#endif
+
+	crc32_set_kernel(CRC32_KERNEL_AUTO);
+}
+
+const char *crc32_kernel_name(int kernel)
+{
+	if (kernel < 0 || kernel >= CRC32_KERNEL_NUM)
+		return "unknown";
+
+	return crc32_kernels[kernel].name;
+}
+
+int crc32_kernel_supported(int kernel)
+{
+	switch (kernel) {
+	case CRC32_KERNEL_TABLE:
+	case CRC32_KERNEL_SLICE8:
+		return 1;
+	case CRC32_KERNEL_PCLMUL:
+		return crc32_pclmul_ok;
+	default:
+		return 0;
+	}
+}
+
+int crc32_get_kernel(void)
+{
+	return crc32_kernel;
+}
+
+int crc32_set_kernel(int kernel)
+{
+	if (kernel == CRC32_KERNEL_AUTO) {
+		if (crc32_kernel_supported(CRC32_KERNEL_PCLMUL))
+			kernel = CRC32_KERNEL_PCLMUL;
+		else
+			kernel = CRC32_KERNEL_SLICE8;
+	}
+
+	if (!crc32_kernel_supported(kernel)) {
+		fprintf(stderr, "crc32 kernel %s is not supported on this "
+			"cpu\n", crc32_kernel_name(kernel));
+		return -EINVAL;
+	}
+
+	crc32_kernel = kernel;
+
+	return 0;
+}
+
+uint32_t crc32_checksum_kernel(int kernel, uint32_t crc, const char *p,
+			       size_t len)
+{
+	if (!crc32_kernel_supported(kernel))
+		kernel = crc32_kernel;
+
+	return crc32_kernels[kernel].func(crc, (const unsigned char *)p, len);
+}
+
+/*
+ * crc32 of len bytes all set to c, without touching any memory. The
+ * operators only depend on len, chunk verifiers keep asking for the
+ * same one, so the last one built is cached per thread.
+ */
+uint32_t crc32_fill(uint32_t crc, unsigned char c, size_t len)
+{
+	static __thread struct crc32_fill_ops ops;
+
+	if (!len)
+		return crc;
+
+	if (ops.len != len)
+		crc32_fill_ops_init(&ops, len);
+
+	return gf2_matrix_times(ops.pow, crc) ^
+	       gf2_matrix_times(ops.sum, crc32_slice8_table[0][c]);
+}
+
+uint32_t crc32_checksum(uint32_t crc, const char *p, size_t len)
+{
+	return crc32_kernels[crc32_kernel].func(crc, (const unsigned char *)p,
+						len);
+}
@@ -0,0 +1,47 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * crc32.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * All kernels compute the same little-endian CRC32 (poly 0xedb88320)
+ * without pre/post inversion, exactly what the old per-test copies of
+ * crc32_checksum() produced, callers still pass ~0 as the seed.
+ */
+enum crc32_kernel {
+	CRC32_KERNEL_AUTO = -1,
+	CRC32_KERNEL_TABLE = 0,		/* byte-at-a-time crc32table_le */
+	CRC32_KERNEL_SLICE8,		/* slicing-by-8 */
+	CRC32_KERNEL_PCLMUL,		/* x86 PCLMULQDQ folding */
+	CRC32_KERNEL_NUM,
+};
+
+uint32_t crc32_checksum(uint32_t crc, const char *p, size_t len);
+uint32_t crc32_fill(uint32_t crc, unsigned char c, size_t len);
+uint32_t crc32_checksum_kernel(int kernel, uint32_t crc, const char *p,
+			       size_t len);
+
+const char *crc32_kernel_name(int kernel);
+int crc32_kernel_supported(int kernel);
+int crc32_get_kernel(void);
+int crc32_set_kernel(int kernel);
+
+#endif
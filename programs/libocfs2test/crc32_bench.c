@@ -0,0 +1,141 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * crc32_bench.c
+ *
+ * Micro-benchmark for the crc32 kernels in libocfs2test, reports GB/s
+ * for each kernel the cpu supports and cross-checks their results.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "crc32.h"
+#include "rand_ops.h"
+
+static unsigned long bufsize = 64 * 1024 * 1024;
+static unsigned long loops = 16;
+static unsigned int misalign;
+
+static void usage(void)
+{
+	fprintf(stdout, "crc32_bench [-s bufsize] [-l loops] [-a misalign] "
+		"[--seed seed]\n");
+	fprintf(stdout, "Example:\n"
+			"       ./crc32_bench -s 67108864 -l 16 -a 3\n");
+	exit(1);
+}
+
+static int parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while (1) {
+		c = getopt(argc, argv, "s:l:a:h");
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 's':
+			bufsize = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			loops = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			misalign = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (!bufsize || !loops)
+		return -EINVAL;
+
+	return 0;
+}
+
+static double get_time_seconds(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+	int kernel, ret = 0;
+	unsigned long i;
+	char *buf, *p;
+	uint32_t ref, crc;
+	double start, elapsed;
+
+	o2test_seed_setup(&argc, argv, 0);
+
+	if (parse_opts(argc, argv))
+		usage();
+
+	buf = (char *)malloc(bufsize + misalign);
+	if (!buf) {
+		fprintf(stderr, "malloc %lu bytes failed\n", bufsize);
+		return -ENOMEM;
+	}
+
+	p = buf + misalign;
+	o2test_rand_fill(p, bufsize);
+
+	ref = crc32_checksum_kernel(CRC32_KERNEL_TABLE, ~0, p, bufsize);
+
+	fprintf(stdout, "buffer %lu bytes, misalign %u, %lu loops, "
+		"default kernel %s\n", bufsize, misalign, loops,
+		crc32_kernel_name(crc32_get_kernel()));
+
+	for (kernel = 0; kernel < CRC32_KERNEL_NUM; kernel++) {
+		if (!crc32_kernel_supported(kernel)) {
+			fprintf(stdout, "%-8s  unsupported\n",
+				crc32_kernel_name(kernel));
+			continue;
+		}
+
+		crc = 0;
+		start = get_time_seconds();
+		for (i = 0; i < loops; i++)
+			crc = crc32_checksum_kernel(kernel, ~0, p, bufsize);
+		elapsed = get_time_seconds() - start;
+
+		fprintf(stdout, "%-8s  %8.3f GB/s  crc 0x%08x%s\n",
+			crc32_kernel_name(kernel),
+			(double)bufsize * loops / elapsed / 1e9, crc,
+			crc == ref ? "" : "  MISMATCH");
+
+		if (crc != ref)
+			ret = 1;
+	}
+
+	free(buf);
+
+	return ret;
+}
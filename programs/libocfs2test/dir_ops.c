@@ -458,49 +458,6 @@ int traverse_and_destroy(char *name)
 	return 0;
 }
 
-int set_semvalue(int sem_id)
-{
-	union semun sem_union;
-
-	sem_union.val = 1;
-	if (semctl(sem_id, 0, SETVAL, sem_union) == -1) {
-		perror("semctl");
-		return -1;
-	}
-
-	return 0;
-}
-
-int semaphore_p(int sem_id)
-{
-	struct sembuf sem_b;
-
-	sem_b.sem_num = 0;
-	sem_b.sem_op = -1; /* P() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_p failed\n");
-		return -1;
-	}
-
-	return 0;
-}
-
-int semaphore_v(int sem_id)
-{
-	struct sembuf sem_b;
-
-	sem_b.sem_num = 0;
-	sem_b.sem_op = 1; /* V() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_v failed\n");
-		return -1;
-	}
-
-	return 0;
-}
-
 int get_max_inlined_entries(int max_inline_size)
 {
 	unsigned int almost_full_entries;
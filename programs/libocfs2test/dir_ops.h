@@ -42,6 +42,8 @@
 #include <sys/wait.h>
 #include <inttypes.h>
 
+#include "io_ops.h"
+
 #define OCFS2_MAX_FILENAME_LEN          255
 #define MAX_DIRENTS                     40000
 
@@ -56,13 +58,6 @@ struct my_dirent {
 	char            name[OCFS2_MAX_FILENAME_LEN];
 };
 
-union semun {
-	int val;                    /* value for SETVAL */
-	struct semid_ds *buf;       /* buffer for IPC_STAT, IPC_SET */
-	unsigned short int *array;  /* array for GETALL, SETALL */
-	struct seminfo *__buf;      /* buffer for IPC_INFO */
-};
-
 int is_dot_entry(struct my_dirent *dirent);
 int unlink_dirent(char *dirname, struct my_dirent *dirent);
 int unlink_dirent_nam(char *dirname, char *name);
@@ -76,9 +71,6 @@ int verify_dirents(char *dir);
 int build_dir_tree(char *dirname, unsigned long entries, unsigned long depth,
 		   int is_random);
 int traverse_and_destroy(char *name);
-int set_semvalue(int sem_id);
-int semaphore_p(int sem_id);
-int semaphore_v(int sem_id);
 int get_max_inlined_entries(int max_inline_size);
 
 #endif
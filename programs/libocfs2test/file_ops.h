@@ -38,6 +38,8 @@
 
 #include <ocfs2/ocfs2.h>
 
+#include "io_ops.h"
+
 #define OCFS2_MAX_FILENAME_LEN  255
 #define MAX_WRITE_SIZE		32768
 #define RAND_CHAR_START		'A'
@@ -56,31 +58,11 @@ struct write_unit {
 	unsigned int  w_len;
 };
 
-unsigned long get_rand(unsigned long min, unsigned long max);
-char get_rand_char(void);
-unsigned int get_rand_nam(char *str, unsigned int least, unsigned int most);
-
-int read_at(int fd, void *buf, size_t count, off_t offset);
-int read_at_file(char *pathname, void *buf, size_t count, off_t offset);
-int mmap_read_at(int fd, char *buf, size_t count, off_t offset,
-		 size_t page_size);
-int mmap_read_at_file(char *pathname, void *buf, size_t count, off_t offset,
-		      size_t page_size);
-int write_at(int fd, const void *buf, size_t count, off_t offset);
-int write_at_file(char *pathname, const void *buf, size_t count, off_t offset);
-int mmap_write_at(int fd, const char *buf, size_t count, off_t offset,
-		  size_t page_size);
-int mmap_write_at_file(char *pathname, const void *buf, size_t count,
-		       off_t offset, size_t page_size);
-
 int reflink(const char *oldpath, const char *newpath);
 
-int do_write(int fd, struct write_unit *wu, int write_method, size_t page_size);
-int do_write_file(char *fname, struct write_unit *wu, int write_method,
-		  size_t page_size);
+int do_write(int fd, struct write_unit *wu, int write_method);
+int do_write_file(char *fname, struct write_unit *wu, int write_method);
 
 int get_bs_cs(char *device_name, unsigned int *bs, unsigned long *cs,
 	      unsigned long *max_inline_sz);
-
-int punch_hole(int fd, struct write_unit *wu);
 #endif
@@ -0,0 +1,249 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * file_prep.c
+ *
+ * Lays out and writes the chunked original file of the destructive
+ * tests, shared by file_verify and the tests with a write unit of
+ * their own.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE 500
+#define _LARGEFILE64_SOURCE
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io_ops.h"
+#include "rand_ops.h"
+#include "file_prep.h"
+
+static unsigned long long get_time_microseconds(void)
+{
+	unsigned long long curtime_ms = 0;
+	struct timeval curtime;
+
+	gettimeofday(&curtime, NULL);
+
+	curtime_ms = (unsigned long long)curtime.tv_sec * 1000000 +
+					 curtime.tv_usec;
+	return curtime_ms;
+}
+
+/* lays out one chunk at pattern, returns the checksum of its body */
+uint32_t chunk_fill_pattern(char *pattern, unsigned long chunk_no,
+			    unsigned long long timestamp, char c,
+			    unsigned int chunksize)
+{
+	unsigned long offset = 0;
+	uint32_t checksum;
+
+	checksum = chunk_body_checksum(c, chunksize);
+
+	memmove(pattern , &chunk_no, sizeof(unsigned long));
+	offset += sizeof(unsigned long);
+	memmove(pattern + offset, &timestamp, sizeof(unsigned long long));
+	offset += sizeof(unsigned long long);
+	memmove(pattern + offset, &checksum, sizeof(uint32_t));
+	offset += sizeof(uint32_t);
+
+	memset(pattern + offset, c, chunk_body_size(chunksize));
+
+	offset = chunksize - offset;
+
+	memmove(pattern + offset, &checksum, sizeof(uint32_t));
+	offset += sizeof(uint32_t);
+	memmove(pattern + offset, &timestamp, sizeof(unsigned long long));
+	offset += sizeof(unsigned long long);
+	memmove(pattern + offset, &chunk_no, sizeof(unsigned long));
+
+	return checksum;
+}
+
+struct prep_ctx {
+	int pc_fd;
+	unsigned int pc_chunksize;
+	unsigned long pc_num_chunks;
+	unsigned long pc_batch_chunks;
+	unsigned long pc_next;
+	volatile int pc_failed;
+};
+
+struct prep_worker {
+	pthread_t pw_thread;
+	struct prep_ctx *pw_ctx;
+	int pw_ret;
+};
+
+/*
+ * Workers claim the next batch of chunks, build every chunk once right
+ * in their own aligned staging buffer and write the batch with a single
+ * pwrite(), so queue_depth workers keep that many writes in flight.
+ */
+static void *prep_worker_fn(void *arg)
+{
+	struct prep_worker *pw = (struct prep_worker *)arg;
+	struct prep_ctx *ctx = pw->pw_ctx;
+	unsigned int chunksize = ctx->pc_chunksize;
+	unsigned long start, nr, j;
+	char *buf = NULL;
+	int ret = 0;
+
+	if (posix_memalign((void **)&buf, PREP_BUF_ALIGN,
+			   ctx->pc_batch_chunks * chunksize)) {
+		fprintf(stderr, "failed to allocate staging buffer\n");
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	while (!ctx->pc_failed) {
+
+		start = __sync_fetch_and_add(&ctx->pc_next,
+					     ctx->pc_batch_chunks);
+		if (start >= ctx->pc_num_chunks)
+			break;
+
+		nr = ctx->pc_num_chunks - start;
+		if (nr > ctx->pc_batch_chunks)
+			nr = ctx->pc_batch_chunks;
+
+		for (j = 0; j < nr; j++)
+			chunk_fill_pattern(buf + j * chunksize, start + j,
+					   get_time_microseconds(), rand_char(),
+					   chunksize);
+
+		ret = write_at(ctx->pc_fd, buf, nr * chunksize,
+			       (off_t)start * chunksize);
+		if (ret < 0)
+			goto out;
+	}
+
+	ret = 0;
+
+out:
+	if (ret)
+		ctx->pc_failed = 1;
+
+	pw->pw_ret = ret;
+
+	if (buf)
+		free(buf);
+
+	return NULL;
+}
+
+/*
+ * Original file for desctrutive tests, it consists of chunks, see
+ * file_prep.h for the layout. batch_bytes of chunks are built
+ * per write and queue_depth writes are kept in flight, O_DIRECT in flags
+ * is honored as long as chunksize is sector aligned.
+ */
+int prep_orig_file_in_batches(char *file_name, unsigned long filesize,
+			      unsigned int chunksize, int flags,
+			      size_t batch_bytes, unsigned int queue_depth,
+			      int report)
+{
+	int ret = 0;
+	unsigned int i;
+	struct prep_ctx ctx;
+	struct prep_worker *workers;
+	unsigned long long start_us, elapsed_us;
+	double bytes;
+
+	if ((flags & O_DIRECT) && (chunksize % PREP_DIRECTIO_ALIGN)) {
+		fprintf(stderr, "chunksize %u is not %d aligned, which is "
+			"required by O_DIRECT\n", chunksize,
+			PREP_DIRECTIO_ALIGN);
+		return -EINVAL;
+	}
+
+	if (!batch_bytes)
+		batch_bytes = PREP_BATCH_SIZE;
+	if (batch_bytes > PREP_BATCH_MAX)
+		batch_bytes = PREP_BATCH_MAX;
+	if (!queue_depth)
+		queue_depth = 1;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.pc_chunksize = chunksize;
+	ctx.pc_num_chunks = (filesize + chunksize - 1) / chunksize;
+	ctx.pc_batch_chunks = batch_bytes / chunksize;
+	if (!ctx.pc_batch_chunks)
+		ctx.pc_batch_chunks = 1;
+
+	ctx.pc_fd = open_file(file_name, flags);
+	if (ctx.pc_fd < 0)
+		return ctx.pc_fd;
+
+	workers = (struct prep_worker *)calloc(queue_depth,
+					       sizeof(struct prep_worker));
+	if (!workers) {
+		close(ctx.pc_fd);
+		return -ENOMEM;
+	}
+
+	start_us = get_time_microseconds();
+
+	for (i = 0; i < queue_depth; i++) {
+		workers[i].pw_ctx = &ctx;
+		if (queue_depth == 1) {
+			prep_worker_fn(&workers[i]);
+			break;
+		}
+
+		ret = pthread_create(&workers[i].pw_thread, NULL,
+				     prep_worker_fn, &workers[i]);
+		if (ret) {
+			fprintf(stderr, "failed to create prep thread: %s\n",
+				strerror(ret));
+			ctx.pc_failed = 1;
+			ret = -ret;
+			break;
+		}
+	}
+
+	if (queue_depth > 1) {
+		while (i--)
+			pthread_join(workers[i].pw_thread, NULL);
+	}
+
+	for (i = 0; !ret && i < queue_depth; i++)
+		ret = workers[i].pw_ret;
+
+	elapsed_us = get_time_microseconds() - start_us;
+
+	if (!ret && report) {
+		bytes = (double)ctx.pc_num_chunks * chunksize;
+		fprintf(stdout, "Prepared %s: %.0f bytes in %.3f secs, "
+			"%.2f MB/s (batch %lu chunks, queue depth %u%s)\n",
+			file_name, bytes, elapsed_us / 1000000.0,
+			elapsed_us ? bytes / elapsed_us : 0,
+			ctx.pc_batch_chunks, queue_depth,
+			(flags & O_DIRECT) ? ", O_DIRECT" : "");
+	}
+
+	free(workers);
+	close(ctx.pc_fd);
+
+	return ret;
+}
@@ -0,0 +1,64 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * file_prep.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef FILE_PREP_H
+#define FILE_PREP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "crc32.h"
+
+#define PREP_BATCH_SIZE		(4 * 1024 * 1024)
+#define PREP_BATCH_MAX		(256 * 1024 * 1024)
+#define PREP_BUF_ALIGN		4096
+#define PREP_DIRECTIO_ALIGN	512
+
+/*
+ * The original file of the destructive tests is made of chunks, each
+ * one chunkno + timestamp + checksum + random chars + checksum +
+ * timestamp + chunkno. Nothing in here knows a struct write_unit, so
+ * tests keeping their own, like directio_test, lay out and prepare the
+ * very same files as file_verify.
+ */
+#define CHUNK_HDR_SIZE		(sizeof(unsigned long) +		\
+				 sizeof(unsigned long long) +		\
+				 sizeof(uint32_t))
+
+static inline size_t chunk_body_size(unsigned int chunksize)
+{
+	return chunksize - CHUNK_HDR_SIZE * 2;
+}
+
+/*
+ * Body of a chunk is one char repeated, so its checksum can be computed
+ * without filling any memory.
+ */
+static inline uint32_t chunk_body_checksum(char c, unsigned int chunksize)
+{
+	return crc32_fill(~0, (unsigned char)c, chunk_body_size(chunksize));
+}
+
+uint32_t chunk_fill_pattern(char *pattern, unsigned long chunk_no,
+			    unsigned long long timestamp, char c,
+			    unsigned int chunksize);
+int prep_orig_file_in_batches(char *file_name, unsigned long filesize,
+			      unsigned int chunksize, int flags,
+			      size_t batch_bytes, unsigned int queue_depth,
+			      int report);
+
+#endif
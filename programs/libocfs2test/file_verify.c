@@ -26,12 +26,17 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
 #include <linux/types.h>
 #include <sys/time.h>
 #include <sys/sem.h>
 #include <sys/wait.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <endian.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,217 +44,61 @@
 #include <getopt.h>
 #include <stdarg.h>
 
-#include <sys/socket.h>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-
-#include <ocfs2/byteorder.h>
-#include "crc32table.h"
+#include "crc32.h"
+#include "pattern_ops.h"
+#include "io_ops.h"
 #include "file_verify.h"
 
 #define FILE_MODE               (S_IRUSR|S_IWUSR|S_IXUSR|S_IROTH|\
 				 S_IWOTH|S_IXOTH|S_IRGRP|S_IWGRP|S_IXGRP)
 
-static uint32_t crc32_checksum(uint32_t crc, char *p, size_t len)
-{
-	const uint32_t      *b = (uint32_t *)p;
-	const uint32_t      *tab = crc32table_le;
-
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-# define DO_CRC(x) crc = tab[(crc ^ (x)) & 255] ^ (crc >> 8)
-#else
-# define DO_CRC(x) crc = tab[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
-#endif
-
-	crc = cpu_to_le32(crc);
-	/* Align it */
-	if (((long)b)&3 && len) {
-		do {
-			uint8_t *p = (uint8_t *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while ((--len) && ((long)b)&3);
-	}
-	if (len >= 4) {
-		/* load data 32 bits wide, xor data 32 bits wide. */
-		size_t save_len = len & 3;
-		len = len >> 2;
-		--b; /* use pre increment below(*++b) for speed */
-		do {
-			crc ^= *++b;
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-		} while (--len);
-		b++; /* point to next byte(s) */
-		len = save_len;
-	}
-	/* And the last few bytes */
-	if (len) {
-		do {
-			uint8_t *p = (uint8_t *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while (--len);
-	}
-
-	return le32_to_cpu(crc);
-#undef DO_CRC
-}
-
-static unsigned long get_rand_ul(unsigned long min, unsigned long max)
+/*
+ * Reads what the file holds of [offset, offset + count) as of i_size,
+ * returns the bytes read.
+ */
+static ssize_t read_within(int fd, void *buf, size_t count, off_t offset,
+			   size_t i_size)
 {
-	if (min == 0 && max == 0)
+	if (offset >= i_size)
 		return 0;
 
-	return min + (rand() % (max - min + 1));
-}
-
-static char rand_char(void)
-{
-	return 'A' + (char) get_rand_ul(0, 25);
-}
-
-static int open_file(const char *filename, int flags)
-{
-	int fd, ret = 0;
-
-	fd = open64(filename, flags, FILE_MODE);
-	if (fd < 0) {
-		ret = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n", filename, ret,
-			strerror(ret));
-		return -1;
-	}
-
-	return fd;
-}
-
-int get_i_size(char *filename, unsigned long *size, int flags)
-{
-	struct stat stat;
-	int ret = 0, fd;
-
-	fd = open_file(filename, O_RDONLY | flags);
-	if (fd < 0)
-		return fd;
-
-	ret = fstat(fd, &stat);
-	if (ret == -1) {
-		ret = errno;
-		fprintf(stderr, "stat failure %d: %s\n", ret, strerror(ret));
-		return ret;
-	}
-
-	*size = (unsigned long) stat.st_size;
-	return ret;
-}
-
-static int read_at(int fd, void *buf, size_t count, off_t offset, size_t i_size)
-{
-	int ret;
-	size_t bytes_read;
-
-	if (((offset + count) > i_size) && (i_size >= offset)) {
+	if (offset + count > i_size)
 		count = i_size - offset;
-	}
-
-	if (!count)
-		return count;
 
-	ret = pread(fd, buf, count, offset);
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "read error %d: \"%s\"\n", ret, strerror(ret));
-		return -1;
-	}
-
-	bytes_read = ret;
-	while (bytes_read < count) {
-
-		ret = pread(fd, buf + bytes_read, count - bytes_read, offset +
-			    bytes_read);
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "read error %d: \"%s\"\n", ret,
-				strerror(ret));
-			return -1;
-		}
-
-		bytes_read += ret;
-	}
-
-	return count;
+	return read_upto(fd, buf, count, offset);
 }
 
-static int write_at(int fd, const void *buf, size_t count, off_t offset)
+/*
+ * Scratch chunk buffer reused across calls, one per thread, so that
+ * writing or reading a chunk doesn't cost a malloc() and free().
+ */
+static char *get_chunk_buf(unsigned int chunksize)
 {
-	int ret;
-	size_t bytes_write;
-
-	ret = pwrite(fd, buf, count, offset);
-
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "write error %d: \"%s\"\n", ret, strerror(ret));
-		return -1;
-	}
-
-	bytes_write = ret;
-	while (bytes_write < count) {
-
-		ret = pwrite(fd, buf + bytes_write, count - bytes_write,
-			     offset + bytes_write);
-
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "write error %d: \"%s\"\n", ret,
-				strerror(ret));
-			return -1;
+	static __thread char *chunk_buf;
+	static __thread unsigned int chunk_buf_size;
+
+	if (chunk_buf_size < chunksize) {
+		free(chunk_buf);
+		chunk_buf = NULL;
+		chunk_buf_size = 0;
+		if (posix_memalign((void **)&chunk_buf, VERIFY_BUF_ALIGN,
+				   chunksize)) {
+			fprintf(stderr, "failed to allocate %u bytes chunk "
+				"buffer\n", chunksize);
+			chunk_buf = NULL;
+			return NULL;
 		}
-
-		bytes_write += ret;
+		chunk_buf_size = chunksize;
 	}
 
-	return count;
+	return chunk_buf;
 }
 
 int fill_chunk_pattern(char *pattern, struct write_unit *wu)
 {
-	unsigned long offset = 0;
-	uint32_t checksum = 0;
-	unsigned int chunksize = wu->wu_chunksize;
-
-	memset(pattern, 0, chunksize);
-	offset = 0;
-
-	memmove(pattern , &wu->wu_chunk_no, sizeof(unsigned long));
-	offset += sizeof(unsigned long);
-	memmove(pattern + offset, &wu->wu_timestamp, sizeof(unsigned long long));
-	offset += sizeof(unsigned long long);
-
-	offset += sizeof(uint32_t);
-
-	memset(pattern + offset, wu->wu_char, chunksize - offset * 2);
-
-	checksum = crc32_checksum(~0, pattern + offset,
-				  (size_t)chunksize - offset * 2);
-
-	offset = chunksize - offset;
-
-	memmove(pattern + offset, &checksum, sizeof(uint32_t));
-	offset += sizeof(uint32_t);
-	memmove(pattern + offset, &wu->wu_timestamp,
-		sizeof(unsigned long long));
-	offset += sizeof(unsigned long long);
-	memmove(pattern + offset, &wu->wu_chunk_no, sizeof(unsigned long));
-
-	offset = sizeof(unsigned long) + sizeof(unsigned long long);
-	memmove(pattern + offset, &checksum, sizeof(uint32_t));
-
-	wu->wu_checksum = checksum;
+	wu->wu_checksum = chunk_fill_pattern(pattern, wu->wu_chunk_no,
+					     wu->wu_timestamp, wu->wu_char,
+					     wu->wu_chunksize);
 
 	return 0;
 }
@@ -282,19 +131,43 @@ static int dump_pattern(char *pattern, unsigned int chunksize,
 	return 0;
 }
 
-static int verify_chunk_pattern(char *pattern, struct write_unit *wu)
+/*
+ * Check a chunk in place against the write unit, header and trailer
+ * fields are compared directly and the body is checked for being
+ * wu_char throughout, without building the expected chunk.
+ */
+static int chunk_matches(const char *pattern, unsigned int chunksize,
+			 const struct write_unit *wu, uint32_t checksum)
 {
-	int match;
-	char *tmp_pattern;
+	const char *body = pattern + CHUNK_HDR_SIZE;
+	const char *trailer = pattern + chunksize - CHUNK_HDR_SIZE;
+	size_t body_size = chunk_body_size(chunksize);
+	unsigned long chunk_no;
+	unsigned long long timestamp;
+	uint32_t csum;
+	struct pattern_desc pd;
+
+	memcpy(&chunk_no, pattern, sizeof(unsigned long));
+	memcpy(&timestamp, pattern + sizeof(unsigned long),
+	       sizeof(unsigned long long));
+	memcpy(&csum, body - sizeof(uint32_t), sizeof(uint32_t));
+	if (chunk_no != wu->wu_chunk_no || timestamp != wu->wu_timestamp ||
+	    csum != checksum)
+		return 0;
 
-	tmp_pattern = (char *)malloc(wu->wu_chunksize);
-	fill_chunk_pattern(tmp_pattern, wu);
-	match = !memcmp(pattern, tmp_pattern, wu->wu_chunksize);
+	memcpy(&csum, trailer, sizeof(uint32_t));
+	memcpy(&timestamp, trailer + sizeof(uint32_t),
+	       sizeof(unsigned long long));
+	memcpy(&chunk_no, trailer + sizeof(uint32_t) +
+	       sizeof(unsigned long long), sizeof(unsigned long));
+	if (chunk_no != wu->wu_chunk_no || timestamp != wu->wu_timestamp ||
+	    csum != checksum)
+		return 0;
 
-	if (tmp_pattern)
-		free(tmp_pattern);
+	pd.pd_type = PATTERN_CONST;
+	pd.pd_seed = (unsigned char)wu->wu_char;
 
-	return match;
+	return pattern_verify(&pd, body, body_size, 0) == body_size;
 }
 
 static unsigned long long get_time_microseconds(void)
@@ -312,382 +185,532 @@ static unsigned long long get_time_microseconds(void)
 void prep_rand_dest_write_unit(struct write_unit *wu, unsigned long chunk_no,
 			       unsigned int chunksize)
 {
-	char *tmp_pattern;
-
-	tmp_pattern = (char *)malloc(chunksize);
-
 	wu->wu_char = rand_char();
 	wu->wu_chunk_no = chunk_no;
 	wu->wu_chunksize = chunksize;
 	wu->wu_timestamp = get_time_microseconds();
-
-	/*
-	 * the reason to do a redundant filling here is to get a checksum;-)
-	 */
-	fill_chunk_pattern(tmp_pattern, wu);
-
-	if (tmp_pattern)
-		free(tmp_pattern);
+	wu->wu_checksum = chunk_body_checksum(wu->wu_char, chunksize);
 }
 
 int do_write_chunk(int fd, struct write_unit wu)
 {
-	int ret;
-	char *tmp_pattern;
+	char *pattern;
 	size_t count = wu.wu_chunksize;
 	off_t offset = wu.wu_chunksize * wu.wu_chunk_no;
 
-	tmp_pattern = (char *)malloc(wu.wu_chunksize);
-	fill_chunk_pattern(tmp_pattern, &wu);
-
-	ret = write_at(fd, tmp_pattern, count, offset);
+	pattern = get_chunk_buf(wu.wu_chunksize);
+	if (!pattern)
+		return -ENOMEM;
 
-	if (tmp_pattern)
-		free(tmp_pattern);
+	fill_chunk_pattern(pattern, &wu);
 
-	return ret;
+	return write_at(fd, pattern, count, offset);
 }
 
 int do_read_chunk(int fd, unsigned long chunk_no, unsigned int chunksize,
 		  struct write_unit *wu)
 {
-	int ret;
-	char *tmp_pattern;
-	size_t count = chunksize, i_size;
+	ssize_t ret;
+	char *pattern;
+	size_t count = chunksize;
 	off_t offset = chunksize * chunk_no;
-	struct stat stat;
 
-	tmp_pattern = (char *)malloc(chunksize);
-
-	ret = fstat(fd, &stat);
-	if (ret == -1) {
-		ret = errno;
-		fprintf(stderr, "stat failure %d: %s\n", ret, strerror(ret));
-		return ret;
-	}
-	
-	i_size = stat.st_size;
+	pattern = get_chunk_buf(chunksize);
+	if (!pattern)
+		return -ENOMEM;
 
-	ret = read_at(fd, tmp_pattern, count, offset, i_size);
+	ret = read_upto(fd, pattern, count, offset);
 	if (ret < 0)
-		goto out;
+		return ret;
 
-	dump_pattern(tmp_pattern, chunksize, wu);
+	if (ret < count)
+		memset(pattern + ret, 0, count - ret);
 
-out:
-	if (tmp_pattern)
-		free(tmp_pattern);
+	dump_pattern(pattern, chunksize, wu);
 
 	return ret;
 }
 
+
 int prep_orig_file_in_chunks(char *file_name, unsigned long filesize,
 			     unsigned int chunksize, int flags)
 {
+	return prep_orig_file_in_batches(file_name, filesize, chunksize, flags,
+					 0, 1, 0);
+}
 
-	int fd, ret;
-	char *tmp_pattern;
-	unsigned long offset = 0, chunk_no = 0;
-	static struct write_unit wu;
 
-	tmp_pattern = (char *)malloc(chunksize);
+/*
+ * write_unit flavours of wu_table_merge_entry() and
+ * wu_table_lookup_entry().
+ */
+int wu_table_merge(struct wu_table *wt, struct write_unit *wu)
+{
+	struct wu_entry we;
 
-	fd = open_file(file_name, flags);
-	if (fd < 0)
-		return fd;
+	memset(&we, 0, sizeof(struct wu_entry));
+	we.we_timestamp = wu->wu_timestamp;
+	we.we_checksum = wu->wu_checksum;
+	we.we_char = wu->wu_char;
 
-	/*
-	 * Original file for desctrutive tests, it consists of chunks.
-	 * Each chunks consists of following parts:
-	 * chunkno + timestamp + checksum + random chars
-	 * + checksum + timestamp + chunkno
-	 *
-	*/
-	while (offset < filesize) {
+	return wu_table_merge_entry(wt, wu->wu_chunk_no, &we);
+}
 
-		prep_rand_dest_write_unit(&wu, chunk_no, chunksize);
+int wu_table_lookup(struct wu_table *wt, unsigned long chunk_no,
+		    struct write_unit *wu)
+{
+	int ret;
+	struct wu_entry we;
 
-		fill_chunk_pattern(tmp_pattern, &wu);
+	ret = wu_table_lookup_entry(wt, chunk_no, &we);
 
-		ret = do_write_chunk(fd, wu);
-		if (ret < 0)
-			goto bail;
+	wu->wu_chunk_no = chunk_no;
+	wu->wu_chunksize = wt->wt_chunksize;
+	wu->wu_timestamp = we.we_timestamp;
+	wu->wu_checksum = we.we_checksum;
+	wu->wu_char = we.we_char;
 
-		chunk_no++;
-		offset += chunksize;
-	}
+	return ret;
+}
 
-bail:
-	if (tmp_pattern)
-		free(tmp_pattern);
+static int read_text_record(FILE *logfile, struct write_unit *wu)
+{
+	int ret;
+	char arg1[100], arg2[100], arg3[100], arg4[100];
 
-	close(fd);
+	ret = fscanf(logfile, "%s\t%s\t%s\t%s\n", arg1, arg2, arg3, arg4);
+	if (ret != 4) {
+		fprintf(stderr, "input failure from write log, ret "
+			"%d, %d %s\n", ret, errno, strerror(errno));
+		return -EINVAL;
+	}
+
+	wu->wu_chunk_no = atol(arg1);
+	wu->wu_timestamp = atoll(arg2);
+	wu->wu_checksum = atoi(arg3);
+	wu->wu_char = arg4[0];
 
 	return 0;
 }
 
-int verify_file(int is_remote, FILE *logfile, struct write_unit *remote_wus,
-		char *filename, unsigned long filesize, unsigned int chunksize,
-		int verbose)
+static int read_text_log(FILE *logfile, struct wu_table *wt)
 {
-	int fd = 0, ret = 0;
-	struct write_unit *wus, wu, ewu;
-	unsigned long num_chunks = filesize / chunksize, i_size;
-	unsigned long i, t_bytes = sizeof(struct write_unit) * num_chunks;
-	char arg1[100], arg2[100], arg3[100], arg4[100], *tmp_pattern;
-
-	tmp_pattern = (char *)malloc(chunksize);
+	int ret;
+	struct write_unit wu;
 
 	memset(&wu, 0, sizeof(struct write_unit));
-	memset(&ewu, 0, sizeof(struct write_unit));
+	wu.wu_chunksize = wt->wt_chunksize;
 
-	wus = (struct write_unit *)malloc(t_bytes);
-	memset(wus, 0, t_bytes);
+	while (!feof(logfile)) {
 
-	ret = get_i_size(filename, &i_size, 0);
-	if (ret)
-		return ret;
+		ret = read_text_record(logfile, &wu);
+		if (ret)
+			return ret;
 
-	if (is_remote) {
-		memcpy(wus, remote_wus, t_bytes);
-		goto verify_body;
+		ret = wu_table_merge(wt, &wu);
+		if (ret)
+			return ret;
 	}
 
-	for (i = 0; i < num_chunks; i++) {
-		wus[i].wu_chunk_no = i;
-		wus[i].wu_chunksize = chunksize;
-	}
+	return 0;
+}
 
-	while (!feof(logfile)) {
+struct verify_ctx {
+	struct wu_table *vc_wt;
+	char *vc_filename;
+	int vc_fd;
+	int vc_verbose;
+	unsigned int vc_chunksize;
+	unsigned long vc_i_size;
+	unsigned long vc_batch_chunks;
+	volatile int vc_failed;
+};
+
+struct verify_worker {
+	pthread_t vw_thread;
+	struct verify_ctx *vw_ctx;
+	unsigned long vw_start;
+	unsigned long vw_end;
+	int vw_ret;
+};
+
+static unsigned int verify_threads = 1;
+static size_t verify_batch_bytes = VERIFY_BATCH_SIZE;
+
+void set_verify_parallel(unsigned int threads, size_t batch_bytes)
+{
+	verify_threads = threads ? threads : 1;
 
-		ret = fscanf(logfile, "%s\t%s\t%s\t%s\n", arg1, arg2,
-			     arg3, arg4);
-		if (ret != 4) {
-			fprintf(stderr, "input failure from write log, ret "
-				"%d, %d %s\n", ret, errno, strerror(errno));
-			ret = -EINVAL;
-			goto bail;
-		}
+	if (batch_bytes)
+		verify_batch_bytes = batch_bytes;
 
-		wu.wu_chunk_no = atol(arg1);
-		if (wu.wu_chunk_no > num_chunks) {
-			fprintf(stderr, "Chunkno grabed from write log"
-				"exceeds the filesize, you may probably"
-				" specify a too small filesize.\n");
-			return -EINVAL;
-		}
+	if (verify_batch_bytes > VERIFY_BATCH_MAX)
+		verify_batch_bytes = VERIFY_BATCH_MAX;
+}
 
-		wu.wu_timestamp = atoll(arg2);
-		wu.wu_checksum = atoi(arg3);
-		wu.wu_char = arg4[0];
-		wu.wu_chunksize = chunksize;
+/*
+ * Verify one chunk already read into memory, bytes is how much of it
+ * was within i_size.
+ */
+static int verify_chunk(struct verify_ctx *ctx, char *chunk, size_t bytes,
+			unsigned long i)
+{
+	struct write_unit wu, rwu, *ewu;
+	unsigned int chunksize = ctx->vc_chunksize;
+	uint32_t checksum;
 
-		if (wu.wu_timestamp >= wus[wu.wu_chunk_no].wu_timestamp) {
+	dump_pattern(chunk, chunksize, &wu);
 
-			memmove(&wus[wu.wu_chunk_no], &wu,
-				sizeof(struct write_unit));
-		}
-	}
+	/*
+	 * verify pattern of chunks absent from write records.
+	 */
+	if (!wu_table_lookup(ctx->vc_wt, i, &rwu)) {
 
-verify_body:
-	fd = open_file(filename, O_RDONLY);
-	if (fd < 0)
-		return fd;
+		if (ctx->vc_verbose)
+			fprintf(stdout, "  verifying #%lu chunk "
+				"out of write records\n", i);
+		/*
+		 * skip holes
+		 */
+		if (!wu.wu_timestamp)
+			return 0;
+
+		if (wu.wu_chunk_no != i) {
+			fprintf(stderr, "Chunk no expected: %lu, Found: %lu\n",
+				i, wu.wu_chunk_no);
+			return -EINVAL;
+		}
 
-	for (i = 0; i < num_chunks; i++) {
 		/*
-		 * Verification consists of two following parts:
-		 *
-		 *    - verify write records.
-		 *    - verify pattern of chunks absent from write records.
+		 * recalculate checksum
 		 */
-		memset(&wu, 0, sizeof(struct write_unit));
+		checksum = chunk_body_checksum(wu.wu_char, chunksize);
+		if (wu.wu_checksum != checksum) {
+			fprintf(stderr, "Checksum expected: %u Found: %u\n",
+				checksum, wu.wu_checksum);
+			return -1;
+		}
 
 		/*
-		 * verfication ends up touching the EOF of file.
+		 * the chunk should also be consistent with itself.
 		 */
-		if (i * chunksize >= i_size)
+		ewu = &wu;
+		goto check;
+	}
+
+	/*
+	 * verify write records in logfile.
+	 */
+	if (ctx->vc_verbose)
+		fprintf(stdout, "  verifying #%lu chunk in write "
+			"records\n", i);
+
+	if (bytes < chunksize) {
+		fprintf(stderr, "Short read(readed:%lu, expected:%d)"
+			"happened, you may probably set too big "
+			"filesize for verfiy_test.\n", (unsigned long)bytes,
+			chunksize);
+		return -1;
+	}
+
+	ewu = &rwu;
+	checksum = chunk_body_checksum(ewu->wu_char, chunksize);
+
+check:
+	if (!chunk_matches(chunk, chunksize, ewu, checksum)) {
+
+		fprintf(stderr, "Inconsistent chunk found in file %s!\n"
+			"Expected:\tchunkno(%ld)\ttimestmp(%llu)\t"
+			"chksum(%d)\tchar(%c)\nFound   :\tchunkno"
+			"(%ld)\ttimestmp(%llu)\tchksum(%d)\tchar(%c)\n",
+			ctx->vc_filename,
+			ewu->wu_chunk_no, ewu->wu_timestamp,
+			checksum, ewu->wu_char,
+			wu.wu_chunk_no, wu.wu_timestamp,
+			wu.wu_checksum, wu.wu_char);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Whether [offset, offset + count) may hold anything but a hole, errs
+ * on the side of yes when SEEK_DATA is not supported.
+ */
+static int range_has_data(int fd, unsigned long offset, size_t count,
+			  unsigned long i_size)
+{
+	off_t data = lseek(fd, offset, SEEK_DATA);
+
+	if (data < 0)
+		return errno != ENXIO;
+
+	return data < offset + count && data < i_size;
+}
+
+/*
+ * Each worker owns a contiguous range of chunks, reads them a batch at
+ * a time into its own buffer and asks the kernel to start reading the
+ * next batch before checking the current one.
+ */
+static void *verify_worker_fn(void *arg)
+{
+	struct verify_worker *vw = (struct verify_worker *)arg;
+	struct verify_ctx *ctx = vw->vw_ctx;
+	unsigned int chunksize = ctx->vc_chunksize;
+	unsigned long i_size = ctx->vc_i_size;
+	unsigned long start, nr, j, offset, next, bytes;
+	size_t count, batch = ctx->vc_batch_chunks * chunksize;
+	char *buf = NULL;
+	int ret = 0;
+
+	if (posix_memalign((void **)&buf, VERIFY_BUF_ALIGN, batch)) {
+		fprintf(stderr, "failed to allocate verify buffers\n");
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (start = vw->vw_start; start < vw->vw_end; start += nr) {
+
+		if (ctx->vc_failed)
 			break;
 
-		ret = do_read_chunk(fd, i, chunksize, &wu);
-		if (ret < 0)
-			return ret;
 		/*
-		 * verify pattern of chunks absent from write records.
+		 * verfication ends up touching the EOF of file.
 		 */
-		if (!wus[i].wu_timestamp) {
-
-			if (verbose)
-				fprintf(stdout, "  verifying #%lu chunk "
-					"out of write records\n", i);
-			/*
-			 * skip holes
-			 */
-			if (!wu.wu_timestamp)
-				continue;
-
-			if (wu.wu_chunk_no != i) {
-				fprintf(stderr, "Chunk no expected: %lu, Found: %lu\n",
-					i, wu.wu_chunk_no);
-				return -EINVAL;
-			}
-
-			/*
-			 * recalculate checksum
-			 */
-			memcpy(&ewu, &wu, sizeof(wu));
-                	fill_chunk_pattern(tmp_pattern, &ewu);
-                	if (wu.wu_checksum != ewu.wu_checksum) {
-                	        fprintf(stderr, "Checksum expected: %u Found: %u\n",
-                	                ewu.wu_checksum, wu.wu_checksum);
-                	        return -1;
-                	}
-
-			continue;
-		}
+		offset = start * chunksize;
+		if (offset >= i_size)
+			break;
+
+		nr = vw->vw_end - start;
+		if (nr > ctx->vc_batch_chunks)
+			nr = ctx->vc_batch_chunks;
+
+		count = nr * chunksize;
 
 		/*
-		 * verify write records in logfile.
+		 * a batch falling entirely in a hole reads back as zeros,
+		 * skip the read for mostly untouched sparse files.
 		 */
-		if (verbose)
-			fprintf(stdout, "  verifying #%lu chunk in write "
-				"records\n", i);
-
-		if (ret < chunksize) {
-			fprintf(stderr, "Short read(readed:%d, expected:%d)"
-				"happened, you may probably set too big "
-				"filesize for verfiy_test.\n", ret, chunksize);
-			return -1;
+		if (!range_has_data(ctx->vc_fd, offset, count, i_size)) {
+			memset(buf, 0, count);
+		} else {
+			ret = read_within(ctx->vc_fd, buf, count, offset,
+					  i_size);
+			if (ret < 0)
+				goto out;
+
+			if (ret < count)
+				memset(buf + ret, 0, count - ret);
 		}
 
-		fill_chunk_pattern(tmp_pattern, &wu);
-
-		if (!verify_chunk_pattern(tmp_pattern, &wus[i])) {
-
-			dump_pattern(tmp_pattern, chunksize, &wu);
-			fprintf(stderr, "Inconsistent chunk found in file %s!\n"
-				"Expected:\tchunkno(%ld)\ttimestmp(%llu)\t"
-				"chksum(%d)\tchar(%c)\nFound   :\tchunkno"
-				"(%ld)\ttimestmp(%llu)\tchksum(%d)\tchar(%c)\n",
-				filename,
-				wus[i].wu_chunk_no, wus[i].wu_timestamp,
-				wus[i].wu_checksum, wus[i].wu_char,
-				wu.wu_chunk_no, wu.wu_timestamp,
-				wu.wu_checksum, wu.wu_char);
-			ret = -1;
-			goto bail;
+		next = offset + count;
+		if (start + nr < vw->vw_end && next < i_size &&
+		    range_has_data(ctx->vc_fd, next, count, i_size))
+			posix_fadvise(ctx->vc_fd, next, count,
+				      POSIX_FADV_WILLNEED);
+
+		for (j = 0; j < nr; j++) {
+			if (offset + j * chunksize >= i_size)
+				break;
 
+			bytes = i_size - offset - j * chunksize;
+			if (bytes > chunksize)
+				bytes = chunksize;
+
+			ret = verify_chunk(ctx, buf + j * chunksize, bytes,
+					   start + j);
+			if (ret)
+				goto out;
 		}
 	}
 
 	ret = 0;
 
-bail:
-	if (tmp_pattern)
-		free(tmp_pattern);
+out:
+	if (ret)
+		ctx->vc_failed = 1;
 
-	if (wus)
-		free(wus);
+	vw->vw_ret = ret;
 
-	if (fd)
-		close(fd);
-	
-	return ret;
+	if (buf)
+		free(buf);
+
+	return NULL;
 }
 
-int init_sock(char *serv, int port)
+static int verify_chunks(struct wu_table *wt, char *filename, int verbose)
 {
-	int sockfd;
-	struct sockaddr_in servaddr;
-
-	sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	bzero(&servaddr, sizeof(struct sockaddr_in));
-	servaddr.sin_family = AF_INET;
-	servaddr.sin_port = htons(port);
-	inet_pton(AF_INET, serv, &servaddr.sin_addr);
+	int ret = 0;
+	struct verify_ctx ctx;
+	struct verify_worker *workers;
+	unsigned int chunksize = wt->wt_chunksize;
+	unsigned long num_chunks = wt->wt_num_chunks, per, i_size;
+	unsigned int i, nr_workers = verify_threads;
 
-	connect(sockfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
+	ret = get_i_size(filename, &i_size);
+	if (ret)
+		return ret;
 
-	return sockfd;
-}
+	memset(&ctx, 0, sizeof(ctx));
+	if (verbose)
+		fprintf(stdout, "Write record table: %s, %lu chunks recorded, "
+			"%lu bytes\n", wu_table_mode_name(wt->wt_mode),
+			wt->wt_used, (unsigned long)wt->wt_bytes);
+
+	ctx.vc_wt = wt;
+	ctx.vc_filename = filename;
+	ctx.vc_verbose = verbose;
+	ctx.vc_chunksize = chunksize;
+	ctx.vc_i_size = i_size;
+	ctx.vc_batch_chunks = verify_batch_bytes / chunksize;
+	if (!ctx.vc_batch_chunks)
+		ctx.vc_batch_chunks = 1;
+
+	ctx.vc_fd = open_file(filename, O_RDONLY);
+	if (ctx.vc_fd < 0)
+		return ctx.vc_fd;
+
+	if (nr_workers > num_chunks)
+		nr_workers = num_chunks ? num_chunks : 1;
+
+	workers = (struct verify_worker *)calloc(nr_workers,
+						 sizeof(struct verify_worker));
+	if (!workers) {
+		close(ctx.vc_fd);
+		return -ENOMEM;
+	}
 
-int set_semvalue(int sem_id, int val)
-{
-	union semun sem_union;
+	per = num_chunks / nr_workers;
+	for (i = 0; i < nr_workers; i++) {
+		workers[i].vw_ctx = &ctx;
+		workers[i].vw_start = i * per;
+		workers[i].vw_end = (i == nr_workers - 1) ? num_chunks :
+				    (i + 1) * per;
+	}
 
-	sem_union.val = val;
-	if (semctl(sem_id, 0, SETVAL, sem_union) == -1) {
-		perror("semctl");
-		return -1;
+	if (nr_workers == 1) {
+		verify_worker_fn(&workers[0]);
+		goto collect;
 	}
 
-	return 0;
-}
+	for (i = 0; i < nr_workers; i++) {
+		ret = pthread_create(&workers[i].vw_thread, NULL,
+				     verify_worker_fn, &workers[i]);
+		if (ret) {
+			fprintf(stderr, "failed to create verify thread: %s\n",
+				strerror(ret));
+			ctx.vc_failed = 1;
+			nr_workers = i;
+			break;
+		}
+	}
 
-int semaphore_init(int val)
-{
-	int ret, sem_id;
-	key_t sem_key = IPC_PRIVATE;
+	for (i = 0; i < nr_workers; i++)
+		pthread_join(workers[i].vw_thread, NULL);
 
-	/*get and init semaphore*/
-	sem_id = semget(sem_key, 1, 0766 | IPC_CREAT);
-	if (sem_id < 0) {
-		sem_id = errno;
-		fprintf(stderr, "semget failed, %s.\n", strerror(sem_id));
-		return -1;
+	if (ret) {
+		ret = -ret;
+		goto bail;
 	}
 
-	ret = set_semvalue(sem_id, 1);
-	if (ret < 0) {
-		fprintf(stderr, "Set semaphore value failed!\n");
-		return ret;
+collect:
+	for (i = 0; i < nr_workers; i++) {
+		if (workers[i].vw_ret) {
+			ret = workers[i].vw_ret;
+			break;
+		}
 	}
 
-	return sem_id;
+bail:
+	free(workers);
+	close(ctx.vc_fd);
+
+	return ret;
 }
 
-int semaphore_close(int sem_id)
+int verify_file(FILE *logfile, char *filename, unsigned long filesize,
+		unsigned int chunksize, int verbose)
 {
 	int ret = 0;
+	struct wu_table wt;
 
-	ret = semctl(sem_id, 0, IPC_RMID);
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "semctl to close sem failed, %s.\n", strerror(ret));
-		return -1;
-	}
+	ret = verify_table_init(&wt, filesize, chunksize);
+	if (ret)
+		return ret;
+
+	ret = read_text_log(logfile, &wt);
+
+	if (!ret)
+		ret = verify_chunks(&wt, filename, verbose);
+
+	wu_table_free(&wt);
 
 	return ret;
 }
 
-int semaphore_p(int sem_id)
+/*
+ * Verifies against a table of latest write records the caller has
+ * already merged, e.g. the one wu_sink_receive() builds up.
+ */
+int verify_file_wu_table(struct wu_table *wt, char *filename, int verbose)
 {
-	struct sembuf sem_b;
+	return verify_chunks(wt, filename, verbose);
+}
 
-	sem_b.sem_num = 0;
-	sem_b.sem_op = -1; /* P() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_p failed\n");
-		return -1;
+/*
+ * Same as verify_file() but takes the write records from a mapped
+ * binary log, zero filesize or chunksize means taking them from the
+ * log header.
+ */
+int verify_file_wu_log(struct wu_log *wl, char *filename,
+		       unsigned long filesize, unsigned int chunksize,
+		       int verbose)
+{
+	int ret = 0;
+	struct wu_table wt;
+	struct write_unit wu;
+	struct wu_log_record *rec;
+	unsigned long i;
+
+	if (!chunksize)
+		chunksize = wl->wl_chunksize;
+	if (!filesize)
+		filesize = wl->wl_filesize;
+
+	if (chunksize != wl->wl_chunksize) {
+		fprintf(stderr, "Chunksize %u mismatches the one(%u) recorded "
+			"in write log.\n", chunksize, wl->wl_chunksize);
+		return -EINVAL;
 	}
 
-	return 0;
-}
+	ret = verify_table_init(&wt, filesize, chunksize);
+	if (ret)
+		return ret;
 
-int semaphore_v(int sem_id)
-{
-	struct sembuf sem_b;
+	memset(&wu, 0, sizeof(struct write_unit));
+	wu.wu_chunksize = chunksize;
 
-	sem_b.sem_num = 0;
-	sem_b.sem_op = 1; /* V() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_v failed\n");
-		return -1;
+	for (i = 0; i < wl->wl_records; i++) {
+		rec = &wl->wl_recs[i];
+
+		wu.wu_chunk_no = le64toh(rec->wlr_chunk_no);
+		wu.wu_timestamp = le64toh(rec->wlr_timestamp);
+		wu.wu_checksum = le32toh(rec->wlr_checksum);
+		wu.wu_char = rec->wlr_char;
+
+		ret = wu_table_merge(&wt, &wu);
+		if (ret)
+			goto bail;
 	}
 
-	return 0;
+	ret = verify_chunks(&wt, filename, verbose);
+
+bail:
+	wu_table_free(&wt);
+
+	return ret;
 }
 
 int open_logfile(FILE **logfile, const char *logname, int readonly)
@@ -713,29 +736,237 @@ int open_logfile(FILE **logfile, const char *logname, int readonly)
 	return 0;
 }
 
-int log_write(struct write_unit *wu, union log_handler log, int remote)
+int log_write(struct write_unit *wu, FILE *logfile)
 {
-	int fd, ret = 0;
-	char log_rec[1024];
+	fprintf(logfile, "%lu\t%llu\t%d\t%c\n", wu->wu_chunk_no,
+		wu->wu_timestamp, wu->wu_checksum, wu->wu_char);
+	fflush(logfile);
+	fsync(fileno(logfile));
 
-	if (remote) {
-		snprintf(log_rec, sizeof(log_rec), "%lu\t%llu\t%d\t%c\n",
-			 wu->wu_chunk_no, wu->wu_timestamp, wu->wu_checksum,
-			 wu->wu_char);
-		ret = write(log.socket_log, log_rec, strlen(log_rec) + 1);
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "write socket error:%d, %s\n",
-				ret , strerror(ret));
-			return -EINVAL;
-		}
-	} else {
-		fprintf(log.stream_log, "%lu\t%llu\t%d\t%c\n", wu->wu_chunk_no,
-			wu->wu_timestamp, wu->wu_checksum, wu->wu_char);
-                fflush(log.stream_log);
-		fd = fileno(log.stream_log);
-		fsync(fd);
+	return 0;
+}
+
+int is_wu_log(const char *logname)
+{
+	int fd, ret;
+	char magic[sizeof(WU_LOG_MAGIC)];
+
+	fd = open(logname, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	ret = pread(fd, magic, sizeof(magic), 0);
+
+	close(fd);
+
+	return (ret == sizeof(magic)) && !memcmp(magic, WU_LOG_MAGIC,
+						 sizeof(magic));
+}
+
+static int wu_log_write_header(struct wu_log *wl)
+{
+	struct wu_log_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.wlh_magic, WU_LOG_MAGIC, sizeof(WU_LOG_MAGIC));
+	hdr.wlh_version = htole32(WU_LOG_VERSION);
+	hdr.wlh_chunksize = htole32(wl->wl_chunksize);
+	hdr.wlh_filesize = htole64(wl->wl_filesize);
+	hdr.wlh_records = htole64(wl->wl_records);
+
+	if (write_at(wl->wl_fd, &hdr, sizeof(hdr), 0) < 0)
+		return -EIO;
+
+	return 0;
+}
+
+int wu_log_create(struct wu_log *wl, const char *logname,
+		  unsigned int chunksize, unsigned long filesize, int sync)
+{
+	int ret;
+
+	memset(wl, 0, sizeof(struct wu_log));
+
+	wl->wl_fd = open_file(logname, O_CREAT | O_TRUNC | O_RDWR);
+	if (wl->wl_fd < 0)
+		return -EINVAL;
+
+	wl->wl_sync = sync;
+	wl->wl_chunksize = chunksize;
+	wl->wl_filesize = filesize;
+
+	ret = wu_log_write_header(wl);
+	if (ret) {
+		close(wl->wl_fd);
+		wl->wl_fd = -1;
+	}
+
+	return ret;
+}
+
+/*
+ * Records are appended at their fixed slot, the record count in header
+ * only gets updated on close, readers fall back to the file size for
+ * logs left behind by a crashed or fenced writer.
+ */
+int wu_log_write(struct wu_log *wl, struct write_unit *wu)
+{
+	struct wu_log_record rec;
+	off_t offset = sizeof(struct wu_log_header) +
+		       wl->wl_records * sizeof(struct wu_log_record);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.wlr_chunk_no = htole64(wu->wu_chunk_no);
+	rec.wlr_timestamp = htole64(wu->wu_timestamp);
+	rec.wlr_checksum = htole32(wu->wu_checksum);
+	rec.wlr_char = wu->wu_char;
+
+	if (write_at(wl->wl_fd, &rec, sizeof(rec), offset) < 0)
+		return -EIO;
+
+	wl->wl_records++;
+
+	if (wl->wl_sync)
+		fdatasync(wl->wl_fd);
+
+	return 0;
+}
+
+int wu_log_close(struct wu_log *wl)
+{
+	int ret;
+
+	if (wl->wl_fd < 0)
+		return 0;
+
+	ret = wu_log_write_header(wl);
+	if (!ret)
+		fsync(wl->wl_fd);
+
+	close(wl->wl_fd);
+	wl->wl_fd = -1;
+
+	return ret;
+}
+
+int wu_log_map(struct wu_log *wl, const char *logname)
+{
+	int ret = 0;
+	struct stat stat;
+	unsigned long nr_records;
+	void *region;
+
+	memset(wl, 0, sizeof(struct wu_log));
+
+	wl->wl_fd = open_file(logname, O_RDONLY);
+	if (wl->wl_fd < 0)
+		return -EINVAL;
+
+	ret = fstat(wl->wl_fd, &stat);
+	if (ret == -1) {
+		ret = errno;
+		fprintf(stderr, "stat failure %d: %s\n", ret, strerror(ret));
+		ret = -ret;
+		goto bail;
+	}
+
+	if (stat.st_size < sizeof(struct wu_log_header)) {
+		fprintf(stderr, "write log %s is too short\n", logname);
+		ret = -EINVAL;
+		goto bail;
+	}
+
+	wl->wl_map_len = stat.st_size;
+	region = mmap(NULL, wl->wl_map_len, PROT_READ, MAP_SHARED,
+		      wl->wl_fd, 0);
+	if (region == MAP_FAILED) {
+		ret = errno;
+		fprintf(stderr, "mmap write log %s error %d: \"%s\"\n",
+			logname, ret, strerror(ret));
+		ret = -ret;
+		goto bail;
+	}
+
+	madvise(region, wl->wl_map_len, MADV_SEQUENTIAL);
+
+	wl->wl_hdr = (struct wu_log_header *)region;
+	wl->wl_recs = (struct wu_log_record *)(wl->wl_hdr + 1);
+
+	if (memcmp(wl->wl_hdr->wlh_magic, WU_LOG_MAGIC,
+		   sizeof(WU_LOG_MAGIC)) ||
+	    le32toh(wl->wl_hdr->wlh_version) != WU_LOG_VERSION) {
+		fprintf(stderr, "%s is not a version %d binary write log\n",
+			logname, WU_LOG_VERSION);
+		ret = -EINVAL;
+		goto bail;
 	}
 
+	wl->wl_chunksize = le32toh(wl->wl_hdr->wlh_chunksize);
+	wl->wl_filesize = le64toh(wl->wl_hdr->wlh_filesize);
+	wl->wl_records = le64toh(wl->wl_hdr->wlh_records);
+
+	nr_records = (wl->wl_map_len - sizeof(struct wu_log_header)) /
+		     sizeof(struct wu_log_record);
+	if (!wl->wl_records || wl->wl_records > nr_records)
+		wl->wl_records = nr_records;
+
+	return 0;
+
+bail:
+	wu_log_unmap(wl);
+
+	return ret;
+}
+
+int wu_log_unmap(struct wu_log *wl)
+{
+	if (wl->wl_hdr)
+		munmap(wl->wl_hdr, wl->wl_map_len);
+
+	if (wl->wl_fd >= 0)
+		close(wl->wl_fd);
+
+	wl->wl_hdr = NULL;
+	wl->wl_recs = NULL;
+	wl->wl_fd = -1;
+
+	return 0;
+}
+
+/*
+ * Convert a text write log into the binary format, keeps logs from old
+ * runs usable with the binary verifier.
+ */
+int wu_log_convert(FILE *logfile, const char *logname, unsigned int chunksize,
+		   unsigned long filesize)
+{
+	int ret;
+	struct wu_log wl;
+	struct write_unit wu;
+
+	ret = wu_log_create(&wl, logname, chunksize, filesize, 0);
+	if (ret)
+		return ret;
+
+	memset(&wu, 0, sizeof(struct write_unit));
+	wu.wu_chunksize = chunksize;
+
+	while (!feof(logfile)) {
+
+		ret = read_text_record(logfile, &wu);
+		if (ret)
+			goto bail;
+
+		ret = wu_log_write(&wl, &wu);
+		if (ret)
+			goto bail;
+	}
+
+bail:
+	if (!ret)
+		ret = wu_log_close(&wl);
+	else
+		wu_log_close(&wl);
+
 	return ret;
 }
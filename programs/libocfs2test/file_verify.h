@@ -18,6 +18,16 @@
 #ifndef FILE_VERIFY_H
 #define FILE_VERIFY_H
 
+#include <pthread.h>
+
+#include "io_ops.h"
+#include "file_prep.h"
+#include "wu_stream.h"
+
+#define VERIFY_BATCH_SIZE	(1024 * 1024)
+#define VERIFY_BATCH_MAX	(256 * 1024 * 1024)
+#define VERIFY_BUF_ALIGN	4096
+
 struct write_unit {
 	unsigned long wu_chunk_no;
 	unsigned long long wu_timestamp;
@@ -26,19 +36,33 @@ struct write_unit {
 	char wu_char;
 };
 
-union log_handler {
-	FILE *stream_log;
-	int socket_log;
+/*
+ * Binary write-record log, a fixed header followed by fixed-width
+ * wu_log_records, all fields little endian. Readers mmap it and scan
+ * the records in place instead of parsing text.
+ */
+#define WU_LOG_MAGIC		"O2WULOG"
+#define WU_LOG_VERSION		1
+
+struct wu_log_header {
+	char wlh_magic[8];
+	uint32_t wlh_version;
+	uint32_t wlh_chunksize;
+	uint64_t wlh_filesize;
+	uint64_t wlh_records;
 };
 
-union semun {
-	int val;                    /* value for SETVAL */
-	struct semid_ds *buf;       /* buffer for IPC_STAT, IPC_SET */
-	unsigned short int *array;  /* array for GETALL, SETALL */
-	struct seminfo *__buf;      /* buffer for IPC_INFO */
+struct wu_log {
+	int wl_fd;
+	int wl_sync;
+	unsigned int wl_chunksize;
+	unsigned long wl_filesize;
+	unsigned long wl_records;
+	size_t wl_map_len;
+	struct wu_log_header *wl_hdr;
+	struct wu_log_record *wl_recs;
 };
 
-int get_i_size(char *filename, unsigned long *size, int flags);
 int prep_orig_file_in_chunks(char *file_name, unsigned long filesize,
 			     unsigned int chunksize, int flags);
 void prep_rand_dest_write_unit(struct write_unit *wu, unsigned long chunk_no,
@@ -47,18 +71,28 @@ int fill_chunk_pattern(char *pattern, struct write_unit *wu);
 int do_write_chunk(int fd, struct write_unit wu);
 int do_read_chunk(int fd, unsigned long chunk_no, unsigned int chunksize,
 		  struct write_unit *wu);
-int verify_file(int is_remote, FILE *logfile, struct write_unit *wus,
-		char *filename, unsigned long filesize, unsigned int chunksize,
-		int verbose);
-
-int init_sock(char *serv, int port);
-int set_semvalue(int sem_id, int val);
-int semaphore_init(int val);
-int semaphore_close(int sem_id);
-int semaphore_p(int sem_id);
-int semaphore_v(int sem_id);
+int wu_table_merge(struct wu_table *wt, struct write_unit *wu);
+int wu_table_lookup(struct wu_table *wt, unsigned long chunk_no,
+		    struct write_unit *wu);
+void set_verify_parallel(unsigned int threads, size_t batch_bytes);
+int verify_file(FILE *logfile, char *filename, unsigned long filesize,
+		unsigned int chunksize, int verbose);
 
 int open_logfile(FILE **logfile, const char *logname, int readonly);
-int log_write(struct write_unit *wu, union log_handler log, int remote);
+int log_write(struct write_unit *wu, FILE *logfile);
+
+int is_wu_log(const char *logname);
+int wu_log_create(struct wu_log *wl, const char *logname,
+		  unsigned int chunksize, unsigned long filesize, int sync);
+int wu_log_write(struct wu_log *wl, struct write_unit *wu);
+int wu_log_close(struct wu_log *wl);
+int wu_log_map(struct wu_log *wl, const char *logname);
+int wu_log_unmap(struct wu_log *wl);
+int wu_log_convert(FILE *logfile, const char *logname, unsigned int chunksize,
+		   unsigned long filesize);
+int verify_file_wu_table(struct wu_table *wt, char *filename, int verbose);
+int verify_file_wu_log(struct wu_log *wl, char *filename,
+		       unsigned long filesize, unsigned int chunksize,
+		       int verbose);
 
 #endif
@@ -0,0 +1,606 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * io_ops.c
+ *
+ * Common I/O and semaphore helpers shared by ocfs2-tests,
+ * replacing the copies each test used to carry.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE 500
+#define _LARGEFILE64_SOURCE
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/sem.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ocfs2/ocfs2.h>
+
+#include "io_ops.h"
+
+#define IO_FILE_MODE		(S_IRUSR|S_IWUSR|S_IXUSR|S_IROTH|\
+				 S_IWOTH|S_IXOTH|S_IRGRP|S_IWGRP|S_IXGRP)
+
+#define IO_IOV_MAX		1024
+
+int open_rw_flags = O_CREAT | O_RDWR;
+int open_ro_flags = O_RDONLY;
+
+static int io_stats_on;
+static struct io_stat io_stats[IO_OP_NUM];
+
+static const char *io_op_names[IO_OP_NUM] = {
+	[IO_OP_READ]		= "read",
+	[IO_OP_WRITE]		= "write",
+	[IO_OP_READV]		= "readv",
+	[IO_OP_WRITEV]		= "writev",
+	[IO_OP_MMAP_READ]	= "mmap_read",
+	[IO_OP_MMAP_WRITE]	= "mmap_write",
+	[IO_OP_AIO_READ]	= "aio_read",
+	[IO_OP_AIO_WRITE]	= "aio_write",
+	[IO_OP_PUNCH]		= "punch",
+};
+
+static write_at_fn write_at_hook;
+
+static void io_stats_atexit(void)
+{
+	io_stats_dump(stderr);
+}
+
+static void __attribute__((constructor)) io_ops_init(void)
+{
+	if (getenv("O2TEST_IO_STATS")) {
+		io_stats_on = 1;
+		atexit(io_stats_atexit);
+	}
+}
+
+void io_stats_enable(int enable)
+{
+	io_stats_on = enable;
+}
+
+static unsigned long long get_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+unsigned long long io_stats_start(void)
+{
+	return io_stats_on ? get_time_us() : 0;
+}
+
+void io_stats_end(int op, unsigned long long start, size_t bytes, int failed)
+{
+	struct io_stat *st = &io_stats[op];
+	unsigned long long us, max;
+
+	if (!start)
+		return;
+
+	us = get_time_us() - start;
+
+	__sync_fetch_and_add(&st->is_calls, 1);
+	__sync_fetch_and_add(&st->is_total_us, us);
+	if (failed)
+		__sync_fetch_and_add(&st->is_errors, 1);
+	else
+		__sync_fetch_and_add(&st->is_bytes, bytes);
+
+	max = st->is_max_us;
+	while (us > max &&
+	       !__sync_bool_compare_and_swap(&st->is_max_us, max, us))
+		max = st->is_max_us;
+}
+
+void io_stats_get(int op, struct io_stat *st)
+{
+	memcpy(st, &io_stats[op], sizeof(struct io_stat));
+}
+
+void io_stats_reset(void)
+{
+	memset(io_stats, 0, sizeof(io_stats));
+}
+
+void io_stats_dump(FILE *out)
+{
+	int op;
+	struct io_stat *st;
+
+	fprintf(out, "%-12s %12s %8s %14s %10s %10s\n", "op", "calls",
+		"errors", "bytes", "avg(us)", "max(us)");
+
+	for (op = 0; op < IO_OP_NUM; op++) {
+		st = &io_stats[op];
+		if (!st->is_calls)
+			continue;
+
+		fprintf(out, "%-12s %12llu %8llu %14llu %10llu %10llu\n",
+			io_op_names[op], st->is_calls, st->is_errors,
+			st->is_bytes, st->is_total_us / st->is_calls,
+			st->is_max_us);
+	}
+}
+
+int open_file(const char *filename, int flags)
+{
+	int fd, ret = 0;
+
+	fd = open64(filename, flags, IO_FILE_MODE);
+	if (fd < 0) {
+		ret = errno;
+		fprintf(stderr, "open file %s failed:%d:%s\n", filename, ret,
+			strerror(ret));
+		return -1;
+	}
+
+	return fd;
+}
+
+int get_i_size(char *filename, unsigned long *size)
+{
+	struct stat st;
+	int ret;
+
+	if (stat(filename, &st) < 0) {
+		ret = errno;
+		fprintf(stderr, "stat %s failure %d: %s\n", filename, ret,
+			strerror(ret));
+		return -1;
+	}
+
+	*size = (unsigned long)st.st_size;
+
+	return 0;
+}
+
+ssize_t read_upto(int fd, void *buf, size_t count, off_t offset)
+{
+	ssize_t ret;
+	size_t bytes_read = 0;
+	unsigned long long start = io_stats_start();
+
+	while (bytes_read < count) {
+
+		ret = pread(fd, buf + bytes_read, count - bytes_read, offset +
+			    bytes_read);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = errno;
+			fprintf(stderr, "read error %d: \"%s\"\n", (int)ret,
+				strerror(ret));
+			io_stats_end(IO_OP_READ, start, 0, 1);
+			return -1;
+		}
+
+		if (!ret)
+			break;
+
+		bytes_read += ret;
+	}
+
+	io_stats_end(IO_OP_READ, start, bytes_read, 0);
+
+	return bytes_read;
+}
+
+int read_at(int fd, void *buf, size_t count, off_t offset)
+{
+	ssize_t ret;
+
+	ret = read_upto(fd, buf, count, offset);
+	if (ret < 0)
+		return -1;
+
+	if (ret < count) {
+		fprintf(stderr, "short read at %lld: wanted %lu, got %ld\n",
+			(long long)offset, (unsigned long)count, (long)ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t count, off_t offset)
+{
+	ssize_t ret;
+	size_t bytes_write = 0;
+	unsigned long long start = io_stats_start();
+
+	while (bytes_write < count) {
+
+		ret = pwrite(fd, buf + bytes_write, count - bytes_write,
+			     offset + bytes_write);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = errno;
+			fprintf(stderr, "write error %d: \"%s\"\n", (int)ret,
+				strerror(ret));
+			io_stats_end(IO_OP_WRITE, start, 0, 1);
+			return -1;
+		}
+
+		/* no progress would spin here forever */
+		if (!ret) {
+			fprintf(stderr, "write at %lld made no progress\n",
+				(long long)(offset + bytes_write));
+			io_stats_end(IO_OP_WRITE, start, 0, 1);
+			return -EIO;
+		}
+
+		bytes_write += ret;
+	}
+
+	io_stats_end(IO_OP_WRITE, start, count, 0);
+
+	return 0;
+}
+
+void set_write_at_fn(write_at_fn fn)
+{
+	write_at_hook = fn;
+}
+
+int write_at(int fd, const void *buf, size_t count, off_t offset)
+{
+	if (write_at_hook)
+		return write_at_hook(fd, buf, count, offset);
+
+	return pwrite_all(fd, buf, count, offset);
+}
+
+/*
+ * Steps a private copy of the iovec past whatever a short preadv() or
+ * pwritev() already transferred.
+ */
+static int iov_advance(struct iovec **iov, int *iovcnt, size_t bytes)
+{
+	while (*iovcnt && bytes >= (*iov)->iov_len) {
+		bytes -= (*iov)->iov_len;
+		(*iov)++;
+		(*iovcnt)--;
+	}
+
+	if (*iovcnt) {
+		(*iov)->iov_base += bytes;
+		(*iov)->iov_len -= bytes;
+	}
+
+	return *iovcnt;
+}
+
+static int rw_vec_at(int fd, const struct iovec *iov, int iovcnt,
+		     off_t offset, int write)
+{
+	struct iovec vec[IO_IOV_MAX], *cur = vec;
+	size_t total = 0;
+	ssize_t ret;
+	int i, op = write ? IO_OP_WRITEV : IO_OP_READV;
+	unsigned long long start;
+
+	if (iovcnt > IO_IOV_MAX) {
+		fprintf(stderr, "%d iovecs exceed the limit of %d\n", iovcnt,
+			IO_IOV_MAX);
+		return -1;
+	}
+
+	start = io_stats_start();
+
+	for (i = 0; i < iovcnt; i++) {
+		vec[i] = iov[i];
+		total += iov[i].iov_len;
+	}
+
+	while (iov_advance(&cur, &iovcnt, 0)) {
+
+		if (write)
+			ret = pwritev(fd, cur, iovcnt, offset);
+		else
+			ret = preadv(fd, cur, iovcnt, offset);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = errno;
+			fprintf(stderr, "%s error %d: \"%s\"\n",
+				write ? "writev" : "readv", (int)ret,
+				strerror(ret));
+			io_stats_end(op, start, 0, 1);
+			return -1;
+		}
+
+		if (!ret && !write) {
+			fprintf(stderr, "short readv at %lld\n",
+				(long long)offset);
+			io_stats_end(op, start, 0, 1);
+			return -1;
+		}
+
+		if (!ret) {
+			fprintf(stderr, "writev at %lld made no progress\n",
+				(long long)offset);
+			io_stats_end(op, start, 0, 1);
+			return -EIO;
+		}
+
+		offset += ret;
+		iov_advance(&cur, &iovcnt, ret);
+	}
+
+	io_stats_end(op, start, total, 0);
+
+	return 0;
+}
+
+int readv_at(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+	return rw_vec_at(fd, iov, iovcnt, offset, 0);
+}
+
+int writev_at(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+	return rw_vec_at(fd, iov, iovcnt, offset, 1);
+}
+
+/*
+ * Only the pages covering [offset, offset + count) get mapped, instead
+ * of everything from the start of file.
+ */
+static int mmap_rw_at(int fd, char *buf, size_t count, off_t offset,
+		      int write)
+{
+	static long page_size;
+	int ret, op = write ? IO_OP_MMAP_WRITE : IO_OP_MMAP_READ;
+	off_t map_start;
+	size_t map_len;
+	char *region;
+	unsigned long long start = io_stats_start();
+
+	/* as with pread() and pwrite(), there is nothing to map */
+	if (!count)
+		return 0;
+
+	if (!page_size)
+		page_size = sysconf(_SC_PAGESIZE);
+
+	map_start = offset & ~((off_t)page_size - 1);
+	map_len = offset - map_start + count;
+
+	region = mmap(NULL, map_len, write ? PROT_WRITE : PROT_READ,
+		      MAP_SHARED, fd, map_start);
+	if (region == MAP_FAILED) {
+		ret = errno;
+		fprintf(stderr, "mmap (%s) error %d: \"%s\"\n",
+			write ? "write" : "read", ret, strerror(ret));
+		io_stats_end(op, start, 0, 1);
+		return -1;
+	}
+
+	if (write)
+		memcpy(region + (offset - map_start), buf, count);
+	else
+		memcpy(buf, region + (offset - map_start), count);
+
+	munmap(region, map_len);
+
+	io_stats_end(op, start, count, 0);
+
+	return 0;
+}
+
+int mmap_read_at(int fd, char *buf, size_t count, off_t offset)
+{
+	return mmap_rw_at(fd, buf, count, offset, 0);
+}
+
+int mmap_write_at(int fd, const char *buf, size_t count, off_t offset)
+{
+	return mmap_rw_at(fd, (char *)buf, count, offset, 1);
+}
+
+int read_at_file(char *pathname, void *buf, size_t count, off_t offset)
+{
+	int fd, ret;
+
+	fd = open_file(pathname, open_ro_flags);
+	if (fd < 0)
+		return fd;
+
+	ret = read_at(fd, buf, count, offset);
+
+	close(fd);
+
+	return ret;
+}
+
+int write_at_file(char *pathname, const void *buf, size_t count, off_t offset)
+{
+	int fd, ret;
+
+	fd = open_file(pathname, open_rw_flags);
+	if (fd < 0)
+		return fd;
+
+	ret = write_at(fd, buf, count, offset);
+
+	close(fd);
+
+	return ret;
+}
+
+int mmap_read_at_file(char *pathname, void *buf, size_t count, off_t offset)
+{
+	int fd, ret;
+
+	fd = open_file(pathname, open_ro_flags);
+	if (fd < 0)
+		return fd;
+
+	ret = mmap_read_at(fd, buf, count, offset);
+
+	close(fd);
+
+	return ret;
+}
+
+int mmap_write_at_file(char *pathname, const void *buf, size_t count,
+		       off_t offset)
+{
+	int fd, ret;
+
+	/*
+	 * a PROT_WRITE shared mapping wants the file opened read-write.
+	 */
+	fd = open_file(pathname, (open_rw_flags & ~O_ACCMODE) | O_RDWR);
+	if (fd < 0)
+		return fd;
+
+	ret = mmap_write_at(fd, buf, count, offset);
+
+	close(fd);
+
+	return ret;
+}
+
+/*
+ * Frees the range with ocfs2's UNRESVSP64, falling back to a hole
+ * punching fallocate on filesystems without that ioctl.
+ */
+int punch_hole(int fd, uint64_t start, uint64_t len)
+{
+	int ret;
+	struct ocfs2_space_resv sr;
+	unsigned long long begin = io_stats_start();
+
+	memset(&sr, 0, sizeof(sr));
+	sr.l_whence = 0;
+	sr.l_start = start;
+	sr.l_len = len;
+
+	ret = ioctl(fd, OCFS2_IOC_UNRESVSP64, &sr);
+	if (ret == -1 && errno == ENOTTY)
+		ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				start, len);
+
+	if (ret == -1) {
+		fprintf(stderr, "punch hole error %d: \"%s\"\n",
+			errno, strerror(errno));
+		io_stats_end(IO_OP_PUNCH, begin, 0, 1);
+		return -1;
+	}
+
+	io_stats_end(IO_OP_PUNCH, begin, len, 0);
+
+	return 0;
+}
+
+int set_semvalue(int sem_id, int val)
+{
+	union semun sem_union;
+
+	sem_union.val = val;
+	if (semctl(sem_id, 0, SETVAL, sem_union) == -1) {
+		perror("semctl");
+		return -1;
+	}
+
+	return 0;
+}
+
+int semaphore_init(int val)
+{
+	int ret, sem_id;
+	key_t sem_key = IPC_PRIVATE;
+
+	/*get and init semaphore*/
+	sem_id = semget(sem_key, 1, 0766 | IPC_CREAT);
+	if (sem_id < 0) {
+		sem_id = errno;
+		fprintf(stderr, "semget failed, %s.\n", strerror(sem_id));
+		return -1;
+	}
+
+	ret = set_semvalue(sem_id, val);
+	if (ret < 0) {
+		fprintf(stderr, "Set semaphore value failed!\n");
+		return ret;
+	}
+
+	return sem_id;
+}
+
+int semaphore_close(int sem_id)
+{
+	int ret = 0;
+
+	ret = semctl(sem_id, 0, IPC_RMID);
+	if (ret < 0) {
+		ret = errno;
+		fprintf(stderr, "semctl to close sem failed, %s.\n",
+			strerror(ret));
+		return -1;
+	}
+
+	return ret;
+}
+
+int semaphore_p(int sem_id)
+{
+	struct sembuf sem_b;
+
+	sem_b.sem_num = 0;
+	sem_b.sem_op = -1; /* P() */
+	sem_b.sem_flg = SEM_UNDO;
+	if (semop(sem_id, &sem_b, 1) == -1) {
+		fprintf(stderr, "semaphore_p failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int semaphore_v(int sem_id)
+{
+	struct sembuf sem_b;
+
+	sem_b.sem_num = 0;
+	sem_b.sem_op = 1; /* V() */
+	sem_b.sem_flg = SEM_UNDO;
+	if (semop(sem_id, &sem_b, 1) == -1) {
+		fprintf(stderr, "semaphore_v failed\n");
+		return -1;
+	}
+
+	return 0;
+}
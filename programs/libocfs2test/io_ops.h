@@ -0,0 +1,115 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * io_ops.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef IO_OPS_H
+#define IO_OPS_H
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/sem.h>
+
+#include "rand_ops.h"
+
+union semun {
+	int val;                    /* value for SETVAL */
+	struct semid_ds *buf;       /* buffer for IPC_STAT, IPC_SET */
+	unsigned short int *array;  /* array for GETALL, SETALL */
+	struct seminfo *__buf;      /* buffer for IPC_INFO */
+};
+
+/*
+ * Flags the *_at_file() helpers open files with, tests add O_DIRECT
+ * to both for their direct I/O passes.
+ */
+extern int open_rw_flags;
+extern int open_ro_flags;
+
+/*
+ * Per-call latency counters, kept once io_stats_enable() is called or
+ * O2TEST_IO_STATS is set in the environment, the latter also dumps
+ * them to stderr at exit.
+ */
+enum io_op {
+	IO_OP_READ = 0,
+	IO_OP_WRITE,
+	IO_OP_READV,
+	IO_OP_WRITEV,
+	IO_OP_MMAP_READ,
+	IO_OP_MMAP_WRITE,
+	IO_OP_AIO_READ,
+	IO_OP_AIO_WRITE,
+	IO_OP_PUNCH,
+	IO_OP_NUM,
+};
+
+struct io_stat {
+	unsigned long long is_calls;
+	unsigned long long is_errors;
+	unsigned long long is_bytes;
+	unsigned long long is_total_us;
+	unsigned long long is_max_us;
+};
+
+void io_stats_enable(int enable);
+unsigned long long io_stats_start(void);
+void io_stats_end(int op, unsigned long long start, size_t bytes, int failed);
+void io_stats_get(int op, struct io_stat *st);
+void io_stats_reset(void);
+void io_stats_dump(FILE *out);
+
+int open_file(const char *filename, int flags);
+int get_i_size(char *filename, unsigned long *size);
+
+/*
+ * All of the *_at() helpers transfer the whole count or fail, returning
+ * 0 or -1 and printing the error, -EIO for a write that makes no
+ * progress. read_upto() is the exception which stops at EOF and returns
+ * the bytes read.
+ */
+int read_at(int fd, void *buf, size_t count, off_t offset);
+ssize_t read_upto(int fd, void *buf, size_t count, off_t offset);
+int write_at(int fd, const void *buf, size_t count, off_t offset);
+int readv_at(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+int writev_at(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+int mmap_read_at(int fd, char *buf, size_t count, off_t offset);
+int mmap_write_at(int fd, const char *buf, size_t count, off_t offset);
+
+/*
+ * Routes every write_at() through another engine, e.g. one built on
+ * o2test_aio_write_at(), NULL restores plain pwrite().
+ */
+typedef int (*write_at_fn)(int fd, const void *buf, size_t count,
+			   off_t offset);
+void set_write_at_fn(write_at_fn fn);
+
+int read_at_file(char *pathname, void *buf, size_t count, off_t offset);
+int write_at_file(char *pathname, const void *buf, size_t count, off_t offset);
+int mmap_read_at_file(char *pathname, void *buf, size_t count, off_t offset);
+int mmap_write_at_file(char *pathname, const void *buf, size_t count,
+		       off_t offset);
+
+int punch_hole(int fd, uint64_t start, uint64_t len);
+
+int set_semvalue(int sem_id, int val);
+int semaphore_init(int val);
+int semaphore_close(int sem_id);
+int semaphore_p(int sem_id);
+int semaphore_v(int sem_id);
+
+#endif
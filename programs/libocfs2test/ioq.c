@@ -0,0 +1,600 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * ioq.c
+ *
+ * Queue depth driven random I/O against one file through pread/pwrite,
+ * libaio or io_uring, for the throughput and latency sweeps.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE 500
+#define _LARGEFILE64_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <libaio.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include "ioq.h"
+#include "buf_pool.h"
+#include "rand_ops.h"
+
+static const char *ioq_engine_names[IOQ_ENGINE_NUM] = {
+	[IOQ_ENGINE_SYNC]	= "sync",
+	[IOQ_ENGINE_LIBAIO]	= "libaio",
+	[IOQ_ENGINE_IO_URING]	= "io_uring",
+};
+
+/* 0 not probed yet, 1 usable, -1 not */
+static int ioq_engine_probed[IOQ_ENGINE_NUM];
+
+/*
+ * Per I/O bookkeeping, one slot for each entry of the queue. The slot
+ * number rides along as the completion cookie of both async engines.
+ */
+struct ioq_slot {
+	void *is_buf;
+	off_t is_offset;
+	struct iovec is_iov;
+	unsigned long long is_start;
+};
+
+struct ioq_ctx {
+	struct ioq_job *ic_job;
+	struct ioq_result *ic_res;
+	struct ioq_slot *ic_slots;
+	struct o2test_buf_pool ic_pool;
+	unsigned long ic_submitted;
+	unsigned long ic_completed;
+	off_t ic_nr_blocks;
+};
+
+const char *ioq_engine_name(int engine)
+{
+	if (engine < 0 || engine >= IOQ_ENGINE_NUM)
+		return "unknown";
+
+	return ioq_engine_names[engine];
+}
+
+int ioq_parse_engine(const char *name)
+{
+	int engine;
+
+	for (engine = 0; engine < IOQ_ENGINE_NUM; engine++)
+		if (!strcmp(name, ioq_engine_names[engine]))
+			return engine;
+
+	fprintf(stderr, "unknown io engine %s\n", name);
+
+	return -EINVAL;
+}
+
+static unsigned long long ioq_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* picks the next offset for slot and stamps its submission time */
+static void ioq_prep_slot(struct ioq_ctx *ic, unsigned int slot)
+{
+	struct ioq_slot *is = &ic->ic_slots[slot];
+
+	is->is_offset = (off_t)(o2test_rand() % ic->ic_nr_blocks) *
+		ic->ic_job->ij_bs;
+	is->is_iov.iov_base = is->is_buf;
+	is->is_iov.iov_len = ic->ic_job->ij_bs;
+	is->is_start = ioq_now_us();
+	ic->ic_submitted++;
+}
+
+static int ioq_complete_slot(struct ioq_ctx *ic, unsigned int slot, long res)
+{
+	struct ioq_slot *is = &ic->ic_slots[slot];
+	struct ioq_job *job = ic->ic_job;
+
+	lat_hist_record(&ic->ic_res->ir_lat, ioq_now_us() - is->is_start);
+	ic->ic_completed++;
+
+	if (res != (long)job->ij_bs) {
+		fprintf(stderr, "%s %s of %lu bytes at %lld returned %ld%s%s\n",
+			ioq_engine_name(job->ij_engine),
+			job->ij_write ? "write" : "read",
+			(unsigned long)job->ij_bs, (long long)is->is_offset,
+			res, res < 0 ? ":" : "",
+			res < 0 ? strerror(-res) : "");
+		return -1;
+	}
+
+	ic->ic_res->ir_ios++;
+	ic->ic_res->ir_bytes += job->ij_bs;
+
+	return 0;
+}
+
+static int ioq_run_sync(struct ioq_ctx *ic)
+{
+	struct ioq_job *job = ic->ic_job;
+	ssize_t ret;
+
+	while (ic->ic_submitted < job->ij_nr_ios) {
+		ioq_prep_slot(ic, 0);
+
+		if (job->ij_write)
+			ret = pwrite(job->ij_fd, ic->ic_slots[0].is_buf,
+				     job->ij_bs, ic->ic_slots[0].is_offset);
+		else
+			ret = pread(job->ij_fd, ic->ic_slots[0].is_buf,
+				    job->ij_bs, ic->ic_slots[0].is_offset);
+		if (ret < 0)
+			ret = -errno;
+
+		if (ioq_complete_slot(ic, 0, ret))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int ioq_run_libaio(struct ioq_ctx *ic)
+{
+	struct ioq_job *job = ic->ic_job;
+	unsigned int depth = job->ij_depth, i, nr_prep;
+	io_context_t ctx = NULL;
+	struct iocb *iocbs = NULL, **iocbps = NULL;
+	struct io_event *events = NULL;
+	int ret, submitted, failed = 0;
+
+	iocbs = (struct iocb *)calloc(depth, sizeof(struct iocb));
+	iocbps = (struct iocb **)calloc(depth, sizeof(struct iocb *));
+	events = (struct io_event *)calloc(depth, sizeof(struct io_event));
+	if (!iocbs || !iocbps || !events) {
+		fprintf(stderr, "failed to allocate %u aio requests\n", depth);
+		ret = -1;
+		goto out;
+	}
+
+	ret = io_setup(depth, &ctx);
+	if (ret) {
+		fprintf(stderr, "error %s during %s\n", strerror(-ret),
+			"io_setup");
+		ctx = NULL;
+		ret = -1;
+		goto out;
+	}
+
+	/* fill the queue, then put a new request in for every one reaped */
+	nr_prep = 0;
+	for (i = 0; i < depth && i < job->ij_nr_ios; i++)
+		iocbps[nr_prep++] = &iocbs[i];
+
+	while (nr_prep || ic->ic_completed < ic->ic_submitted) {
+		for (i = 0; i < nr_prep; i++) {
+			unsigned int slot = iocbps[i] - iocbs;
+			struct ioq_slot *is = &ic->ic_slots[slot];
+
+			ioq_prep_slot(ic, slot);
+			if (job->ij_write)
+				io_prep_pwrite(iocbps[i], job->ij_fd,
+					       is->is_buf, job->ij_bs,
+					       is->is_offset);
+			else
+				io_prep_pread(iocbps[i], job->ij_fd,
+					      is->is_buf, job->ij_bs,
+					      is->is_offset);
+		}
+
+		submitted = 0;
+		while (submitted < (int)nr_prep) {
+			ret = io_submit(ctx, nr_prep - submitted,
+					iocbps + submitted);
+			if (ret <= 0) {
+				fprintf(stderr, "error %s during %s\n",
+					strerror(ret ? -ret : EAGAIN),
+					"io_submit");
+				/* what never went in is not in flight */
+				ic->ic_submitted -= nr_prep - submitted;
+				failed = 1;
+				break;
+			}
+			submitted += ret;
+		}
+
+		if (submitted < (int)nr_prep)
+			break;
+		nr_prep = 0;
+
+		do {
+			ret = io_getevents(ctx, 1, depth, events, NULL);
+		} while (ret == -EINTR);
+		if (ret < 0) {
+			fprintf(stderr, "error %s during %s\n", strerror(-ret),
+				"io_getevents");
+			failed = 1;
+			break;
+		}
+
+		/* once one has failed the rest are only reaped, not resent */
+		for (i = 0; i < (unsigned int)ret; i++) {
+			if (ioq_complete_slot(ic, events[i].obj - iocbs,
+					      (long)events[i].res))
+				failed = 1;
+			else if (!failed &&
+				 ic->ic_submitted + nr_prep < job->ij_nr_ios)
+				iocbps[nr_prep++] = events[i].obj;
+		}
+	}
+
+	/*
+	 * Only a failed io_submit or io_getevents gets here with I/Os in
+	 * flight, don't leave the buffers to the kernel on the way out.
+	 */
+	while (ic->ic_completed < ic->ic_submitted) {
+		ret = io_getevents(ctx, 1, depth, events, NULL);
+		if (ret < 0 && ret != -EINTR)
+			break;
+		if (ret > 0)
+			ic->ic_completed += ret;
+	}
+
+	ret = failed ? -1 : 0;
+
+out:
+	if (ctx)
+		io_destroy(ctx);
+
+	free(events);
+	free(iocbps);
+	free(iocbs);
+
+	return ret;
+}
+
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+
+/*
+ * io_uring through the bare system calls, so the tests don't grow a
+ * liburing dependency. The slot buffers are registered as fixed
+ * buffers when the kernel lets us pin them, READV/WRITEV otherwise,
+ * both go back to the first kernels with io_uring. The rings are
+ * mapped one by one for the same reason.
+ */
+struct ioq_uring {
+	int iu_fd;
+	void *iu_sq_ptr;
+	size_t iu_sq_sz;
+	void *iu_cq_ptr;
+	size_t iu_cq_sz;
+	struct io_uring_sqe *iu_sqes;
+	size_t iu_sqes_sz;
+
+	unsigned int *iu_sq_head;
+	unsigned int *iu_sq_tail;
+	unsigned int *iu_sq_mask;
+	unsigned int *iu_sq_array;
+	unsigned int *iu_cq_head;
+	unsigned int *iu_cq_tail;
+	unsigned int *iu_cq_mask;
+	struct io_uring_cqe *iu_cqes;
+	int iu_fixed;
+};
+
+static int ioq_uring_setup(struct ioq_uring *iu, unsigned int entries)
+{
+	struct io_uring_params p;
+	int ret;
+
+	memset(iu, 0, sizeof(*iu));
+	memset(&p, 0, sizeof(p));
+	iu->iu_sq_ptr = iu->iu_cq_ptr = iu->iu_sqes = MAP_FAILED;
+
+	iu->iu_fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (iu->iu_fd < 0)
+		return -errno;
+
+	iu->iu_sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	iu->iu_cq_sz = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	iu->iu_sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	iu->iu_sq_ptr = mmap(NULL, iu->iu_sq_sz, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, iu->iu_fd,
+			     IORING_OFF_SQ_RING);
+	iu->iu_cq_ptr = mmap(NULL, iu->iu_cq_sz, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, iu->iu_fd,
+			     IORING_OFF_CQ_RING);
+	iu->iu_sqes = mmap(NULL, iu->iu_sqes_sz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, iu->iu_fd,
+			   IORING_OFF_SQES);
+	if (iu->iu_sq_ptr == MAP_FAILED || iu->iu_cq_ptr == MAP_FAILED ||
+	    iu->iu_sqes == MAP_FAILED) {
+		ret = -errno;
+		goto bail;
+	}
+
+	iu->iu_sq_head = (unsigned int *)((char *)iu->iu_sq_ptr +
+					  p.sq_off.head);
+	iu->iu_sq_tail = (unsigned int *)((char *)iu->iu_sq_ptr +
+					  p.sq_off.tail);
+	iu->iu_sq_mask = (unsigned int *)((char *)iu->iu_sq_ptr +
+					  p.sq_off.ring_mask);
+	iu->iu_sq_array = (unsigned int *)((char *)iu->iu_sq_ptr +
+					   p.sq_off.array);
+	iu->iu_cq_head = (unsigned int *)((char *)iu->iu_cq_ptr +
+					  p.cq_off.head);
+	iu->iu_cq_tail = (unsigned int *)((char *)iu->iu_cq_ptr +
+					  p.cq_off.tail);
+	iu->iu_cq_mask = (unsigned int *)((char *)iu->iu_cq_ptr +
+					  p.cq_off.ring_mask);
+	iu->iu_cqes = (struct io_uring_cqe *)((char *)iu->iu_cq_ptr +
+					      p.cq_off.cqes);
+
+	return 0;
+
+bail:
+	if (iu->iu_sqes != MAP_FAILED)
+		munmap(iu->iu_sqes, iu->iu_sqes_sz);
+	if (iu->iu_cq_ptr != MAP_FAILED)
+		munmap(iu->iu_cq_ptr, iu->iu_cq_sz);
+	if (iu->iu_sq_ptr != MAP_FAILED)
+		munmap(iu->iu_sq_ptr, iu->iu_sq_sz);
+	close(iu->iu_fd);
+
+	return ret;
+}
+
+static void ioq_uring_destroy(struct ioq_uring *iu)
+{
+	munmap(iu->iu_sqes, iu->iu_sqes_sz);
+	munmap(iu->iu_cq_ptr, iu->iu_cq_sz);
+	munmap(iu->iu_sq_ptr, iu->iu_sq_sz);
+	close(iu->iu_fd);
+}
+
+static void ioq_uring_queue(struct ioq_uring *iu, struct ioq_ctx *ic,
+			    unsigned int slot)
+{
+	struct ioq_slot *is = &ic->ic_slots[slot];
+	unsigned int tail = *iu->iu_sq_tail, idx;
+	struct io_uring_sqe *sqe;
+
+	ioq_prep_slot(ic, slot);
+
+	idx = tail & *iu->iu_sq_mask;
+	sqe = &iu->iu_sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd = ic->ic_job->ij_fd;
+	sqe->off = is->is_offset;
+	if (iu->iu_fixed) {
+		sqe->opcode = ic->ic_job->ij_write ? IORING_OP_WRITE_FIXED :
+			IORING_OP_READ_FIXED;
+		sqe->addr = (unsigned long)is->is_buf;
+		sqe->len = ic->ic_job->ij_bs;
+		sqe->buf_index = o2test_buf_index(&ic->ic_pool, is->is_buf);
+	} else {
+		sqe->opcode = ic->ic_job->ij_write ? IORING_OP_WRITEV :
+			IORING_OP_READV;
+		sqe->addr = (unsigned long)&is->is_iov;
+		sqe->len = 1;
+	}
+	sqe->user_data = slot;
+	iu->iu_sq_array[idx] = idx;
+
+	/* the kernel must see the sqe before it sees the new tail */
+	__atomic_store_n(iu->iu_sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int ioq_run_uring(struct ioq_ctx *ic)
+{
+	struct ioq_job *job = ic->ic_job;
+	struct ioq_uring iu;
+	struct io_uring_cqe *cqe;
+	unsigned int to_submit = 0, head, tail, slot;
+	int ret, failed = 0;
+
+	ret = ioq_uring_setup(&iu, job->ij_depth);
+	if (ret) {
+		fprintf(stderr, "error %s during %s\n", strerror(-ret),
+			"io_uring_setup");
+		return -1;
+	}
+
+	iu.iu_fixed = !o2test_buf_pool_register(&ic->ic_pool, iu.iu_fd);
+
+	for (slot = 0; slot < job->ij_depth &&
+	     ic->ic_submitted < job->ij_nr_ios; slot++) {
+		ioq_uring_queue(&iu, ic, slot);
+		to_submit++;
+	}
+
+	while (ic->ic_completed < ic->ic_submitted) {
+		ret = syscall(__NR_io_uring_enter, iu.iu_fd, to_submit, 1,
+			      IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "error %s during %s\n",
+				strerror(errno), "io_uring_enter");
+			break;
+		}
+		to_submit -= ret;
+
+		head = *iu.iu_cq_head;
+		tail = __atomic_load_n(iu.iu_cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			cqe = &iu.iu_cqes[head & *iu.iu_cq_mask];
+			slot = cqe->user_data;
+			if (ioq_complete_slot(ic, slot, cqe->res))
+				failed = 1;
+			else if (!failed && ic->ic_submitted < job->ij_nr_ios) {
+				ioq_uring_queue(&iu, ic, slot);
+				to_submit++;
+			}
+			head++;
+		}
+		__atomic_store_n(iu.iu_cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	/* tearing the ring down waits for whatever is still in flight */
+	if (iu.iu_fixed)
+		o2test_buf_pool_unregister(&ic->ic_pool);
+	ioq_uring_destroy(&iu);
+
+	return (failed || ic->ic_completed < ic->ic_submitted) ? -1 : 0;
+}
+
+#else
+
+static int ioq_run_uring(struct ioq_ctx *ic)
+{
+	fprintf(stderr, "built without io_uring support\n");
+
+	return -1;
+}
+
+#endif
+
+static int ioq_probe(int engine)
+{
+	io_context_t ctx = NULL;
+
+	switch (engine) {
+	case IOQ_ENGINE_SYNC:
+		return 1;
+	case IOQ_ENGINE_LIBAIO:
+		if (io_setup(1, &ctx))
+			return -1;
+		io_destroy(ctx);
+		return 1;
+	case IOQ_ENGINE_IO_URING:
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+	{
+		struct ioq_uring iu;
+
+		if (ioq_uring_setup(&iu, 1))
+			return -1;
+		ioq_uring_destroy(&iu);
+		return 1;
+	}
+#else
+		return -1;
+#endif
+	default:
+		return -1;
+	}
+}
+
+/* whether the engine was built in and the running kernel has it */
+int ioq_engine_supported(int engine)
+{
+	if (engine < 0 || engine >= IOQ_ENGINE_NUM)
+		return 0;
+
+	if (!ioq_engine_probed[engine])
+		ioq_engine_probed[engine] = ioq_probe(engine);
+
+	return ioq_engine_probed[engine] > 0;
+}
+
+/*
+ * Runs the job to completion and fills res, ir_seconds is wall time
+ * from the first submission to the last completion. Writes go out
+ * from random buffers filled once up front, so with O_DIRECT the fd
+ * needs a range, bs and file offsets aligned to the device.
+ */
+int ioq_run(struct ioq_job *job, struct ioq_result *res)
+{
+	struct ioq_ctx ic;
+	unsigned int i;
+	unsigned long long start;
+	int ret;
+
+	memset(res, 0, sizeof(*res));
+	lat_hist_init(&res->ir_lat);
+
+	if (!job->ij_depth || !job->ij_bs ||
+	    job->ij_range < (off_t)job->ij_bs) {
+		fprintf(stderr, "bad io job: depth %u, bs %lu, range %lld\n",
+			job->ij_depth, (unsigned long)job->ij_bs,
+			(long long)job->ij_range);
+		return -EINVAL;
+	}
+
+	if (job->ij_engine == IOQ_ENGINE_SYNC && job->ij_depth != 1) {
+		fprintf(stderr, "sync engine only runs at depth 1\n");
+		return -EINVAL;
+	}
+
+	memset(&ic, 0, sizeof(ic));
+	ic.ic_job = job;
+	ic.ic_res = res;
+	ic.ic_nr_blocks = job->ij_range / job->ij_bs;
+	ic.ic_slots = (struct ioq_slot *)calloc(job->ij_depth,
+						sizeof(struct ioq_slot));
+	if (!ic.ic_slots)
+		return -ENOMEM;
+
+	ret = o2test_buf_pool_init(&ic.ic_pool, job->ij_bs, job->ij_depth,
+				   O2TEST_BUF_HUGE);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < job->ij_depth; i++) {
+		ic.ic_slots[i].is_buf = o2test_buf_get(&ic.ic_pool);
+		if (job->ij_write)
+			o2test_rand_fill(ic.ic_slots[i].is_buf, job->ij_bs);
+	}
+
+	start = ioq_now_us();
+
+	switch (job->ij_engine) {
+	case IOQ_ENGINE_SYNC:
+		ret = ioq_run_sync(&ic);
+		break;
+	case IOQ_ENGINE_LIBAIO:
+		ret = ioq_run_libaio(&ic);
+		break;
+	case IOQ_ENGINE_IO_URING:
+		ret = ioq_run_uring(&ic);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	res->ir_seconds = (ioq_now_us() - start) / 1000000.0;
+
+	o2test_buf_pool_destroy(&ic.ic_pool);
+out:
+	free(ic.ic_slots);
+
+	return ret;
+}
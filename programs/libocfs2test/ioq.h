@@ -0,0 +1,64 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * ioq.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef IOQ_H
+#define IOQ_H
+
+#include <sys/types.h>
+
+#include "lat_hist.h"
+
+/*
+ * Engines which keep a queue of I/Os in flight against one file, sync
+ * is plain pread/pwrite and so only ever runs at depth 1. io_uring is
+ * driven through the raw system calls and needs HAVE_IO_URING at build
+ * time and a kernel which lets us set up a ring at run time.
+ */
+enum ioq_engine {
+	IOQ_ENGINE_SYNC = 0,
+	IOQ_ENGINE_LIBAIO,
+	IOQ_ENGINE_IO_URING,
+	IOQ_ENGINE_NUM,
+};
+
+/*
+ * ij_nr_ios transfers of ij_bs bytes at random ij_bs aligned offsets
+ * below ij_range, ij_depth of them in flight at any time.
+ */
+struct ioq_job {
+	int ij_fd;
+	int ij_engine;
+	int ij_write;
+	unsigned int ij_depth;
+	size_t ij_bs;
+	off_t ij_range;
+	unsigned long ij_nr_ios;
+};
+
+struct ioq_result {
+	unsigned long long ir_ios;
+	unsigned long long ir_bytes;
+	double ir_seconds;
+	struct lat_hist ir_lat;		/* usecs, submission to completion */
+};
+
+const char *ioq_engine_name(int engine);
+int ioq_parse_engine(const char *name);
+int ioq_engine_supported(int engine);
+int ioq_run(struct ioq_job *job, struct ioq_result *res);
+
+#endif
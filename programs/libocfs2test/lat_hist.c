@@ -0,0 +1,140 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * lat_hist.c
+ *
+ * Latency histograms with percentile and CSV reporting for the
+ * benchmark modes of ocfs2-tests.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <string.h>
+
+#include "lat_hist.h"
+
+static inline unsigned int lat_hist_index(uint64_t val)
+{
+	unsigned int shift;
+
+	if (val < LAT_HIST_SUB_COUNT)
+		return val;
+
+	/* val >> shift lands in [SUB_COUNT, 2 * SUB_COUNT) */
+	shift = 63 - __builtin_clzll(val) - LAT_HIST_SUB_BITS;
+
+	return (shift + 1) * LAT_HIST_SUB_COUNT +
+		((val >> shift) - LAT_HIST_SUB_COUNT);
+}
+
+/* highest value which still falls into bucket idx */
+static uint64_t lat_hist_bucket_top(unsigned int idx)
+{
+	unsigned int shift;
+	uint64_t sub;
+
+	if (idx < LAT_HIST_SUB_COUNT)
+		return idx;
+
+	shift = idx / LAT_HIST_SUB_COUNT - 1;
+	sub = idx % LAT_HIST_SUB_COUNT + LAT_HIST_SUB_COUNT;
+
+	return (sub << shift) + ((1ULL << shift) - 1);
+}
+
+void lat_hist_init(struct lat_hist *lh)
+{
+	memset(lh, 0, sizeof(*lh));
+	lh->lh_min = UINT64_MAX;
+}
+
+void lat_hist_record(struct lat_hist *lh, uint64_t val)
+{
+	lh->lh_buckets[lat_hist_index(val)]++;
+	lh->lh_count++;
+	lh->lh_sum += val;
+
+	if (val < lh->lh_min)
+		lh->lh_min = val;
+	if (val > lh->lh_max)
+		lh->lh_max = val;
+}
+
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src)
+{
+	unsigned int i;
+
+	if (!src->lh_count)
+		return;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++)
+		dst->lh_buckets[i] += src->lh_buckets[i];
+
+	dst->lh_count += src->lh_count;
+	dst->lh_sum += src->lh_sum;
+
+	if (src->lh_min < dst->lh_min)
+		dst->lh_min = src->lh_min;
+	if (src->lh_max > dst->lh_max)
+		dst->lh_max = src->lh_max;
+}
+
+/*
+ * The value below which pct percent of the samples fall, rounded up
+ * to the top of its bucket but never past the largest sample seen.
+ */
+uint64_t lat_hist_percentile(const struct lat_hist *lh, double pct)
+{
+	uint64_t rank, seen = 0, top;
+	unsigned int i;
+
+	if (!lh->lh_count)
+		return 0;
+
+	rank = (uint64_t)(pct / 100.0 * lh->lh_count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > lh->lh_count)
+		rank = lh->lh_count;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		seen += lh->lh_buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	top = lat_hist_bucket_top(i);
+
+	return top < lh->lh_max ? top : lh->lh_max;
+}
+
+double lat_hist_mean(const struct lat_hist *lh)
+{
+	if (!lh->lh_count)
+		return 0.0;
+
+	return (double)lh->lh_sum / lh->lh_count;
+}
+
+void lat_hist_csv_header(FILE *fp, const char *keys)
+{
+	fprintf(fp, "%s,count,min,mean,p50,p99,p999,max\n", keys);
+}
+
+void lat_hist_csv_row(FILE *fp, const char *keys, const struct lat_hist *lh)
+{
+	fprintf(fp, "%s,%"PRIu64",%"PRIu64",%.1f,%"PRIu64",%"PRIu64",%"PRIu64
+		",%"PRIu64"\n", keys, lh->lh_count,
+		lh->lh_count ? lh->lh_min : 0, lat_hist_mean(lh),
+		lat_hist_percentile(lh, 50.0), lat_hist_percentile(lh, 99.0),
+		lat_hist_percentile(lh, 99.9), lh->lh_max);
+}
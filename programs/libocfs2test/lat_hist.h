@@ -0,0 +1,57 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * lat_hist.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef LAT_HIST_H
+#define LAT_HIST_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/*
+ * Log-linear histogram: every power of two is split into
+ * LAT_HIST_SUB_COUNT equal buckets, so any recorded value is known to
+ * within 1/LAT_HIST_SUB_COUNT of itself over the full 64-bit range.
+ * Units are whatever the caller records, usecs by convention.
+ */
+#define LAT_HIST_SUB_BITS	5
+#define LAT_HIST_SUB_COUNT	(1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_BUCKETS	((64 - LAT_HIST_SUB_BITS + 1) * \
+				 LAT_HIST_SUB_COUNT)
+
+struct lat_hist {
+	uint64_t lh_count;
+	uint64_t lh_sum;
+	uint64_t lh_min;
+	uint64_t lh_max;
+	uint64_t lh_buckets[LAT_HIST_BUCKETS];
+};
+
+void lat_hist_init(struct lat_hist *lh);
+void lat_hist_record(struct lat_hist *lh, uint64_t val);
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src);
+uint64_t lat_hist_percentile(const struct lat_hist *lh, double pct);
+double lat_hist_mean(const struct lat_hist *lh);
+
+/*
+ * CSV rows are "<key columns>,count,min,mean,p50,p99,p999,max", the
+ * header takes the key column names, the row their values, both as a
+ * ready-made comma separated string.
+ */
+void lat_hist_csv_header(FILE *fp, const char *keys);
+void lat_hist_csv_row(FILE *fp, const char *keys, const struct lat_hist *lh);
+
+#endif
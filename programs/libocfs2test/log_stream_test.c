@@ -0,0 +1,265 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * log_stream_test.c
+ *
+ * Loopback test for the batched write record stream in wu_stream.c,
+ * a number of writer threads stream records to a sink on 127.0.0.1,
+ * the merged latest-writer table then gets cross-checked and the
+ * achieved records/s reported.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "wu_stream.h"
+
+/* scatters consecutive writes over the chunks */
+#define CHUNK_STRIDE	7919
+
+static int port = 12345;
+static int nr_writers = 4;
+static unsigned long nr_records = 1000000;
+static unsigned long num_chunks = 65536;
+static unsigned int chunksize = 4096;
+static unsigned long frame_records;
+static int table_mode = WU_TABLE_DENSE;
+
+struct writer {
+	pthread_t w_thread;
+	int w_id;
+	int w_ret;
+};
+
+static void usage(void)
+{
+	fprintf(stdout, "log_stream_test [-p port] [-n writers] "
+		"[-r records_per_writer] [-c chunks] [-k chunksize] "
+		"[-F frame_records] [-T table]\n");
+	fprintf(stdout, "Example:\n"
+			"       ./log_stream_test -p 12345 -n 4 -r 1000000\n");
+	exit(1);
+}
+
+static int parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while (1) {
+		c = getopt(argc, argv, "p:n:r:c:k:F:T:h");
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'n':
+			nr_writers = atoi(optarg);
+			break;
+		case 'r':
+			nr_records = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			num_chunks = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			chunksize = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			frame_records = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			table_mode = wu_table_parse_mode(optarg);
+			if (table_mode < 0)
+				return -EINVAL;
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (nr_writers <= 0 || !num_chunks || !chunksize)
+		return -EINVAL;
+
+	return 0;
+}
+
+static double get_time_seconds(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Record t (1 based, unique across writers) lands on a fixed chunk with
+ * timestamp t, so the expected winner of every chunk is known upfront.
+ */
+static unsigned long make_record(unsigned long long t, struct wu_entry *we)
+{
+	memset(we, 0, sizeof(struct wu_entry));
+	we->we_timestamp = t;
+	we->we_checksum = (uint32_t)(t * 2654435761UL);
+	we->we_char = 'A' + t % 26;
+
+	return (t * CHUNK_STRIDE) % num_chunks;
+}
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = (struct writer *)arg;
+	struct wu_stream ws;
+	struct wu_entry we;
+	unsigned long i, chunk_no;
+
+	w->w_ret = wu_stream_open(&ws, "127.0.0.1", port, chunksize,
+				  num_chunks * chunksize, 0, frame_records);
+	if (w->w_ret)
+		return NULL;
+
+	for (i = 0; i < nr_records; i++) {
+		chunk_no = make_record((unsigned long long)i * nr_writers +
+				       w->w_id + 1, &we);
+		w->w_ret = wu_stream_write(&ws, chunk_no, &we);
+		if (w->w_ret)
+			break;
+	}
+
+	if (!w->w_ret)
+		w->w_ret = wu_stream_close(&ws);
+	else
+		wu_stream_close(&ws);
+
+	return NULL;
+}
+
+static int check_table(struct wu_table *wt)
+{
+	unsigned long long t, last = (unsigned long long)nr_records *
+				     nr_writers;
+	unsigned long i, bad = 0;
+	struct wu_entry *expected, we, rwe;
+
+	expected = (struct wu_entry *)calloc(num_chunks,
+					     sizeof(struct wu_entry));
+	if (!expected)
+		return -ENOMEM;
+
+	for (t = 1; t <= last; t++) {
+		i = make_record(t, &we);
+		expected[i] = we;
+	}
+
+	for (i = 0; i < num_chunks; i++) {
+		wu_table_lookup_entry(wt, i, &rwe);
+
+		if (rwe.we_timestamp != expected[i].we_timestamp ||
+		    rwe.we_checksum != expected[i].we_checksum ||
+		    rwe.we_char != expected[i].we_char) {
+			if (bad++ < 10)
+				fprintf(stderr, "chunk %lu: got timestamp %llu"
+					", expected %llu\n", i,
+					(unsigned long long)rwe.we_timestamp,
+					(unsigned long long)
+					expected[i].we_timestamp);
+		}
+	}
+
+	free(expected);
+
+	return bad ? -EINVAL : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int lsn_sock, i, ret;
+	struct writer *writers;
+	struct wu_table wt;
+	unsigned long received;
+	double start, elapsed;
+
+	if (parse_opts(argc, argv))
+		usage();
+
+	set_verify_table(table_mode, NULL);
+
+	lsn_sock = wu_sink_listen(port);
+	if (lsn_sock < 0)
+		return 1;
+
+	writers = (struct writer *)calloc(nr_writers, sizeof(struct writer));
+	if (!writers)
+		return 1;
+
+	start = get_time_seconds();
+
+	for (i = 0; i < nr_writers; i++) {
+		writers[i].w_id = i;
+		ret = pthread_create(&writers[i].w_thread, NULL, writer_fn,
+				     &writers[i]);
+		if (ret) {
+			fprintf(stderr, "failed to create writer: %s\n",
+				strerror(ret));
+			return 1;
+		}
+	}
+
+	ret = wu_sink_receive(lsn_sock, nr_writers, &wt, &received);
+	elapsed = get_time_seconds() - start;
+
+	for (i = 0; i < nr_writers; i++) {
+		pthread_join(writers[i].w_thread, NULL);
+		if (writers[i].w_ret && !ret)
+			ret = writers[i].w_ret;
+	}
+
+	close(lsn_sock);
+	free(writers);
+
+	if (ret) {
+		fprintf(stderr, "streaming failed: %d\n", ret);
+		return 1;
+	}
+
+	fprintf(stdout, "%d writers, %lu records in %.3f s, %.0f records/s\n",
+		nr_writers, received, elapsed, received / elapsed);
+
+	if (received != nr_records * nr_writers ||
+	    wt.wt_chunksize != chunksize || wt.wt_num_chunks != num_chunks) {
+		fprintf(stderr, "stream lost records or header fields\n");
+		ret = 1;
+	} else if (check_table(&wt)) {
+		fprintf(stderr, "merged table mismatches\n");
+		ret = 1;
+	} else
+		fprintf(stdout, "merged table OK\n");
+
+	wu_table_free(&wt);
+
+	return ret;
+}
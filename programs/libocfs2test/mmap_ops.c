@@ -0,0 +1,113 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * mmap_ops.c
+ *
+ * madvise() names, page fault counts and prefault timing for the
+ * mmap tests.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "mmap_ops.h"
+
+static struct {
+	const char *name;
+	int advice;
+} mmap_advices[] = {
+	{ "normal",	MADV_NORMAL },
+	{ "sequential",	MADV_SEQUENTIAL },
+	{ "random",	MADV_RANDOM },
+	{ "willneed",	MADV_WILLNEED },
+#ifdef MADV_HUGEPAGE
+	{ "hugepage",	MADV_HUGEPAGE },
+#endif
+};
+
+#define NR_ADVICES	(sizeof(mmap_advices) / sizeof(mmap_advices[0]))
+
+int mmap_parse_advice(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NR_ADVICES; i++) {
+		if (!strcmp(name, mmap_advices[i].name))
+			return mmap_advices[i].advice;
+	}
+
+	return -1;
+}
+
+const char *mmap_advice_name(int advice)
+{
+	int i;
+
+	for (i = 0; i < NR_ADVICES; i++) {
+		if (mmap_advices[i].advice == advice)
+			return mmap_advices[i].name;
+	}
+
+	return "none";
+}
+
+void mmap_get_faults(struct mmap_faults *mf)
+{
+	struct rusage ru;
+
+	memset(mf, 0, sizeof(*mf));
+	if (getrusage(RUSAGE_SELF, &ru))
+		return;
+
+	mf->mf_minor = ru.ru_minflt;
+	mf->mf_major = ru.ru_majflt;
+}
+
+/* turns the counters read at start into the faults taken since */
+void mmap_faults_since(struct mmap_faults *mf,
+		       const struct mmap_faults *start)
+{
+	mmap_get_faults(mf);
+	mf->mf_minor -= start->mf_minor;
+	mf->mf_major -= start->mf_major;
+}
+
+unsigned long long mmap_usecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned long long mmap_prefault(const void *addr, size_t len)
+{
+	const volatile char *p = (const volatile char *)addr;
+	size_t page_size = getpagesize(), off;
+	unsigned long long start = mmap_usecs();
+	char c;
+
+	for (off = 0; off < len; off += page_size)
+		c = p[off];
+	(void)c;
+
+	return mmap_usecs() - start;
+}
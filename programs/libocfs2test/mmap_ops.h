@@ -0,0 +1,50 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * mmap_ops.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef MMAP_OPS_H
+#define MMAP_OPS_H
+
+#include <stddef.h>
+
+/*
+ * madvise() advice by the names the tests take on the command line:
+ * "normal", "sequential", "random", "willneed" and "hugepage".
+ * mmap_parse_advice() returns -1 for anything else, or for hugepage
+ * when the headers don't know it.
+ */
+int mmap_parse_advice(const char *name);
+const char *mmap_advice_name(int advice);
+
+/* the page fault counters getrusage() and /proc/self/stat report */
+struct mmap_faults {
+	unsigned long long mf_minor;
+	unsigned long long mf_major;
+};
+
+void mmap_get_faults(struct mmap_faults *mf);
+void mmap_faults_since(struct mmap_faults *mf,
+		       const struct mmap_faults *start);
+
+unsigned long long mmap_usecs(void);
+
+/*
+ * Reads a byte from every page of the range, faulting in whatever
+ * isn't mapped yet, and returns how many usecs that took.
+ */
+unsigned long long mmap_prefault(const void *addr, size_t len);
+
+#endif
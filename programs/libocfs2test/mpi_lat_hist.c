@@ -0,0 +1,54 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * mpi_lat_hist.c
+ *
+ * Merges the latency histograms of all ranks onto one.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <string.h>
+
+#include "mpi_lat_hist.h"
+
+int lat_hist_mpi_reduce(struct lat_hist *lh, int root, MPI_Comm comm)
+{
+	struct lat_hist all;
+	int ret, rank;
+
+	ret = MPI_Comm_rank(comm, &rank);
+	if (ret != MPI_SUCCESS)
+		return ret;
+
+	lat_hist_init(&all);
+
+	ret = MPI_Reduce(lh->lh_buckets, all.lh_buckets, LAT_HIST_BUCKETS,
+			 MPI_UNSIGNED_LONG_LONG, MPI_SUM, root, comm);
+	if (ret == MPI_SUCCESS)
+		/* lh_count and lh_sum */
+		ret = MPI_Reduce(&lh->lh_count, &all.lh_count, 2,
+				 MPI_UNSIGNED_LONG_LONG, MPI_SUM, root, comm);
+	if (ret == MPI_SUCCESS)
+		ret = MPI_Reduce(&lh->lh_min, &all.lh_min, 1,
+				 MPI_UNSIGNED_LONG_LONG, MPI_MIN, root, comm);
+	if (ret == MPI_SUCCESS)
+		ret = MPI_Reduce(&lh->lh_max, &all.lh_max, 1,
+				 MPI_UNSIGNED_LONG_LONG, MPI_MAX, root, comm);
+	if (ret != MPI_SUCCESS)
+		return ret;
+
+	if (rank == root)
+		memcpy(lh, &all, sizeof(all));
+
+	return MPI_SUCCESS;
+}
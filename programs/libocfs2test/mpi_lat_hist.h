@@ -0,0 +1,32 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * mpi_lat_hist.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef MPI_LAT_HIST_H
+#define MPI_LAT_HIST_H
+
+#include <mpi.h>
+
+#include "lat_hist.h"
+
+/*
+ * Collective over comm, every rank has to call it. On root lh ends up
+ * holding the histogram of all ranks, the others' are left untouched.
+ * Returns MPI_SUCCESS or the MPI error code of the failing reduce.
+ */
+int lat_hist_mpi_reduce(struct lat_hist *lh, int root, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,55 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * mpi_rand.c
+ *
+ * Keeps the random streams of all ranks derived from one seed.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <stdio.h>
+
+#include <mpi.h>
+
+#include "mpi_rand.h"
+
+unsigned long MPI_Seed_Setup(int *argc, char **argv)
+{
+	unsigned long seed;
+	int ret, rank;
+
+	seed = o2test_seed_setup(argc, argv, 1);
+
+	ret = MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	if (ret != MPI_SUCCESS) {
+		fprintf(stderr, "MPI_Comm_rank failed: %d\n", ret);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	ret = MPI_Bcast(&seed, sizeof(seed), MPI_BYTE, 0, MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS) {
+		fprintf(stderr, "MPI_Bcast failed: %d\n", ret);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	o2test_srand(seed);
+	o2test_rand_stream(rank);
+
+	if (!rank) {
+		fprintf(stdout, "Random seed: %lu (rerun with --seed %lu)\n",
+			seed, seed);
+		fflush(stdout);
+	}
+
+	return seed;
+}
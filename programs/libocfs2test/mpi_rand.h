@@ -0,0 +1,30 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * mpi_rand.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef MPI_RAND_H
+#define MPI_RAND_H
+
+#include "rand_ops.h"
+
+/*
+ * o2test_seed_setup() for MPI tests, call it after MPI_Init() and before
+ * getopt(). Rank 0's seed is broadcast and each rank draws from the
+ * stream of its rank number, only rank 0 prints the seed.
+ */
+unsigned long MPI_Seed_Setup(int *argc, char **argv);
+
+#endif
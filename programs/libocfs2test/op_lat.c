@@ -0,0 +1,385 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * op_lat.c
+ *
+ * Per thread latency histograms of the common file syscalls, dumped at
+ * exit or on SIGUSR1, so that any test can double as a latency probe.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#define _LARGEFILE64_SOURCE
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lat_hist.h"
+#include "op_lat.h"
+
+/*
+ * Only the owning thread ever writes its histograms. The dump reads
+ * them as they are, so one taken while the threads run can be out by
+ * the few samples being recorded right then, which is fine for a look
+ * at the tail. They are never freed, what a thread recorded before
+ * exiting still shows up at the end.
+ */
+struct op_lat_thread {
+	struct lat_hist		ot_hists[OP_LAT_NUM];
+	struct op_lat_thread	*ot_next;
+};
+
+int op_lat_on;
+
+static struct op_lat_thread *op_lat_threads;
+static __thread struct op_lat_thread *op_lat_self;
+
+/*
+ * SIGUSR1 stays blocked everywhere and the helper thread sigwait()s for
+ * it, so a dump never interrupts a sleep or a syscall of the test.
+ */
+static sigset_t op_lat_sigs;
+static int op_lat_forked;
+
+static const char *op_lat_names[OP_LAT_NUM] = {
+	[OP_LAT_OPEN]		= "open",
+	[OP_LAT_READ]		= "read",
+	[OP_LAT_WRITE]		= "write",
+	[OP_LAT_TRUNCATE]	= "truncate",
+	[OP_LAT_FSYNC]		= "fsync",
+	[OP_LAT_FDATASYNC]	= "fdatasync",
+	[OP_LAT_UNLINK]		= "unlink",
+};
+
+static unsigned long long get_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static struct op_lat_thread *op_lat_thread_get(void)
+{
+	struct op_lat_thread *ot = op_lat_self;
+	int op;
+
+	if (ot)
+		return ot;
+
+	ot = (struct op_lat_thread *)malloc(sizeof(*ot));
+	if (!ot)
+		return NULL;
+
+	for (op = 0; op < OP_LAT_NUM; op++)
+		lat_hist_init(&ot->ot_hists[op]);
+
+	do {
+		ot->ot_next = op_lat_threads;
+	} while (!__sync_bool_compare_and_swap(&op_lat_threads, ot->ot_next,
+					       ot));
+
+	op_lat_self = ot;
+
+	return ot;
+}
+
+void op_lat_dump(FILE *out)
+{
+	struct lat_hist *hists, *lh;
+	struct op_lat_thread *ot;
+	int op;
+
+	hists = (struct lat_hist *)malloc(sizeof(*hists) * OP_LAT_NUM);
+	if (!hists)
+		return;
+
+	for (op = 0; op < OP_LAT_NUM; op++)
+		lat_hist_init(&hists[op]);
+
+	for (ot = op_lat_threads; ot; ot = ot->ot_next) {
+		for (op = 0; op < OP_LAT_NUM; op++)
+			lat_hist_merge(&hists[op], &ot->ot_hists[op]);
+	}
+
+	for (op = 0; op < OP_LAT_NUM; op++) {
+		lh = &hists[op];
+		if (!lh->lh_count)
+			continue;
+
+		fprintf(out, "%s[%d]: %-9s count %"PRIu64" min %"PRIu64
+			" mean %.1f p50 %"PRIu64" p99 %"PRIu64" p999 %"PRIu64
+			" max %"PRIu64" usecs\n", program_invocation_short_name,
+			(int)getpid(), op_lat_names[op], lh->lh_count,
+			lh->lh_min, lat_hist_mean(lh),
+			lat_hist_percentile(lh, 50.0),
+			lat_hist_percentile(lh, 99.0),
+			lat_hist_percentile(lh, 99.9), lh->lh_max);
+	}
+	fflush(out);
+
+	free(hists);
+}
+
+static void *op_lat_helper(void *arg)
+{
+	int sig;
+
+	while (1) {
+		if (sigwait(&op_lat_sigs, &sig))
+			continue;
+
+		op_lat_dump(stderr);
+	}
+
+	return NULL;
+}
+
+static int op_lat_start_helper(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	sigset_t all, old;
+	int ret;
+
+	/* the helper inherits this, it never takes anyone else's signals */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	ret = pthread_create(&thread, &attr, op_lat_helper, NULL);
+	pthread_attr_destroy(&attr);
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return -ret;
+}
+
+/* an ignored signal is dropped even while blocked, so it gets this */
+static void op_lat_sigusr1(int sig)
+{
+}
+
+/*
+ * The child carries its parent's samples but not the helper. The
+ * samples go, the helper follows on the first op recorded as threads
+ * can't be made safely from in here.
+ */
+static void op_lat_atfork_child(void)
+{
+	struct op_lat_thread *ot;
+	int op;
+
+	for (ot = op_lat_threads; ot; ot = ot->ot_next) {
+		for (op = 0; op < OP_LAT_NUM; op++)
+			lat_hist_init(&ot->ot_hists[op]);
+	}
+
+	op_lat_forked = 1;
+}
+
+static void op_lat_atexit(void)
+{
+	op_lat_dump(stderr);
+}
+
+/*
+ * Threads started before this keep SIGUSR1 unblocked and may swallow
+ * it, call it early or leave it to O2TEST_OP_LAT.
+ */
+int op_lat_enable(void)
+{
+	struct sigaction sa;
+	int ret;
+
+	if (op_lat_on)
+		return 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = op_lat_sigusr1;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	sigemptyset(&op_lat_sigs);
+	sigaddset(&op_lat_sigs, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &op_lat_sigs, NULL);
+
+	ret = op_lat_start_helper();
+	if (ret) {
+		fprintf(stderr, "error %s starting the latency helper\n",
+			strerror(-ret));
+		pthread_sigmask(SIG_UNBLOCK, &op_lat_sigs, NULL);
+		return ret;
+	}
+
+	pthread_atfork(NULL, NULL, op_lat_atfork_child);
+	atexit(op_lat_atexit);
+
+	op_lat_on = 1;
+
+	return 0;
+}
+
+static void __attribute__((constructor)) op_lat_init(void)
+{
+	if (getenv("O2TEST_OP_LAT"))
+		op_lat_enable();
+}
+
+unsigned long long op_lat_start(void)
+{
+	return op_lat_on ? get_time_us() : 0;
+}
+
+/* failed calls are recorded too, they took their time all the same */
+void op_lat_end(int op, unsigned long long start)
+{
+	struct op_lat_thread *ot;
+	int saved_errno;
+
+	if (!start)
+		return;
+
+	saved_errno = errno;
+
+	if (op_lat_forked &&
+	    __sync_bool_compare_and_swap(&op_lat_forked, 1, 0))
+		op_lat_start_helper();
+
+	ot = op_lat_thread_get();
+	if (ot)
+		lat_hist_record(&ot->ot_hists[op], get_time_us() - start);
+
+	errno = saved_errno;
+}
+
+int timed_open(const char *pathname, int flags, mode_t mode)
+{
+	unsigned long long start = op_lat_start();
+	int fd;
+
+	fd = open64(pathname, flags, mode);
+	op_lat_end(OP_LAT_OPEN, start);
+
+	return fd;
+}
+
+ssize_t timed_read(int fd, void *buf, size_t count)
+{
+	unsigned long long start = op_lat_start();
+	ssize_t ret;
+
+	ret = read(fd, buf, count);
+	op_lat_end(OP_LAT_READ, start);
+
+	return ret;
+}
+
+ssize_t timed_pread(int fd, void *buf, size_t count, off_t offset)
+{
+	unsigned long long start = op_lat_start();
+	ssize_t ret;
+
+	ret = pread(fd, buf, count, offset);
+	op_lat_end(OP_LAT_READ, start);
+
+	return ret;
+}
+
+ssize_t timed_write(int fd, const void *buf, size_t count)
+{
+	unsigned long long start = op_lat_start();
+	ssize_t ret;
+
+	ret = write(fd, buf, count);
+	op_lat_end(OP_LAT_WRITE, start);
+
+	return ret;
+}
+
+ssize_t timed_pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+	unsigned long long start = op_lat_start();
+	ssize_t ret;
+
+	ret = pwrite(fd, buf, count, offset);
+	op_lat_end(OP_LAT_WRITE, start);
+
+	return ret;
+}
+
+int timed_ftruncate(int fd, off_t length)
+{
+	unsigned long long start = op_lat_start();
+	int ret;
+
+	ret = ftruncate(fd, length);
+	op_lat_end(OP_LAT_TRUNCATE, start);
+
+	return ret;
+}
+
+int timed_truncate(const char *pathname, off_t length)
+{
+	unsigned long long start = op_lat_start();
+	int ret;
+
+	ret = truncate(pathname, length);
+	op_lat_end(OP_LAT_TRUNCATE, start);
+
+	return ret;
+}
+
+int timed_fsync(int fd)
+{
+	unsigned long long start = op_lat_start();
+	int ret;
+
+	ret = fsync(fd);
+	op_lat_end(OP_LAT_FSYNC, start);
+
+	return ret;
+}
+
+int timed_fdatasync(int fd)
+{
+	unsigned long long start = op_lat_start();
+	int ret;
+
+	ret = fdatasync(fd);
+	op_lat_end(OP_LAT_FDATASYNC, start);
+
+	return ret;
+}
+
+int timed_unlink(const char *pathname)
+{
+	unsigned long long start = op_lat_start();
+	int ret;
+
+	ret = unlink(pathname);
+	op_lat_end(OP_LAT_UNLINK, start);
+
+	return ret;
+}
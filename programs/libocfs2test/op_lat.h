@@ -0,0 +1,66 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * op_lat.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef OP_LAT_H
+#define OP_LAT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * Per operation latency histograms for the syscalls the tests spend
+ * their time in. Recording is off unless O2TEST_OP_LAT is set in the
+ * environment or op_lat_enable() is called, and then costs the timed_*
+ * wrappers two clock reads and a few increments of histograms private
+ * to the calling thread, no locks and no shared cache lines.
+ *
+ * Once on, the percentiles of every op seen are printed to stderr at
+ * exit and whenever the process gets SIGUSR1. A helper thread takes the
+ * signal, the test's own threads have it blocked, so the dump comes
+ * just as well while every one of them is stuck in the kernel. A child
+ * forked off starts over from empty histograms and reports on its own.
+ */
+enum op_lat_op {
+	OP_LAT_OPEN = 0,
+	OP_LAT_READ,
+	OP_LAT_WRITE,
+	OP_LAT_TRUNCATE,
+	OP_LAT_FSYNC,
+	OP_LAT_FDATASYNC,
+	OP_LAT_UNLINK,
+	OP_LAT_NUM,
+};
+
+extern int op_lat_on;
+
+int op_lat_enable(void);
+unsigned long long op_lat_start(void);
+void op_lat_end(int op, unsigned long long start);
+void op_lat_dump(FILE *out);
+
+int timed_open(const char *pathname, int flags, mode_t mode);
+ssize_t timed_read(int fd, void *buf, size_t count);
+ssize_t timed_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t timed_write(int fd, const void *buf, size_t count);
+ssize_t timed_pwrite(int fd, const void *buf, size_t count, off_t offset);
+int timed_ftruncate(int fd, off_t length);
+int timed_truncate(const char *pathname, off_t length);
+int timed_fsync(int fd);
+int timed_fdatasync(int fd);
+int timed_unlink(const char *pathname);
+
+#endif
@@ -0,0 +1,178 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * pattern_bench.c
+ *
+ * Micro-benchmark for the pattern fill/verify kernels in libocfs2test,
+ * reports GB/s for each kernel the cpu supports and cross-checks what
+ * they produce against the scalar one.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "pattern_ops.h"
+#include "rand_ops.h"
+
+static unsigned long bufsize = 64 * 1024 * 1024;
+static unsigned long loops = 16;
+static unsigned int misalign;
+static int only_type = -1;
+
+static void usage(void)
+{
+	fprintf(stdout, "pattern_bench [-s bufsize] [-l loops] [-a misalign] "
+		"[-t const|incr|stamp|random|alpha] [--seed seed]\n");
+	fprintf(stdout, "Example:\n"
+			"       ./pattern_bench -s 67108864 -l 16 -a 3 -t stamp\n");
+	exit(1);
+}
+
+static int parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while (1) {
+		c = getopt(argc, argv, "s:l:a:t:h");
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 's':
+			bufsize = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			loops = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			misalign = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			only_type = pattern_parse_type(optarg);
+			if (only_type < 0)
+				return only_type;
+			break;
+		case 'h':
+		default:
+			usage();
+		}
+	}
+
+	if (!bufsize || !loops)
+		return -EINVAL;
+
+	return 0;
+}
+
+static double get_time_seconds(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double gbps(double elapsed)
+{
+	return (double)bufsize * loops / elapsed / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	int type, kernel, ret = 0;
+	unsigned long i;
+	char *buf, *ref, *p;
+	struct pattern_desc pd;
+	size_t bad = 0;
+	double start, fill_time, verify_time;
+
+	o2test_seed_setup(&argc, argv, 0);
+
+	if (parse_opts(argc, argv))
+		usage();
+
+	buf = (char *)malloc(bufsize + misalign);
+	ref = (char *)malloc(bufsize);
+	if (!buf || !ref) {
+		fprintf(stderr, "malloc %lu bytes failed\n", bufsize);
+		return -ENOMEM;
+	}
+
+	p = buf + misalign;
+
+	fprintf(stdout, "buffer %lu bytes, misalign %u, %lu loops, "
+		"default kernel %s\n", bufsize, misalign, loops,
+		pattern_kernel_name(pattern_get_kernel()));
+
+	for (type = 0; type < PATTERN_TYPE_NUM; type++) {
+		if (only_type >= 0 && type != only_type)
+			continue;
+
+		pd.pd_type = type;
+		pd.pd_seed = o2test_rand();
+
+		/* file position misaligned too, so heads and tails are hit */
+		pattern_fill_kernel(PATTERN_KERNEL_SCALAR, &pd, ref, bufsize,
+				    misalign);
+
+		for (kernel = 0; kernel < PATTERN_KERNEL_NUM; kernel++) {
+			if (!pattern_kernel_supported(kernel)) {
+				fprintf(stdout, "%-7s %-8s  unsupported\n",
+					pattern_type_name(type),
+					pattern_kernel_name(kernel));
+				continue;
+			}
+
+			start = get_time_seconds();
+			for (i = 0; i < loops; i++)
+				pattern_fill_kernel(kernel, &pd, p, bufsize,
+						    misalign);
+			fill_time = get_time_seconds() - start;
+
+			start = get_time_seconds();
+			for (i = 0; i < loops; i++)
+				bad = pattern_verify_kernel(kernel, &pd, p,
+							    bufsize, misalign);
+			verify_time = get_time_seconds() - start;
+
+			if (bad == bufsize)
+				bad = buf_mismatch(p, ref, bufsize);
+
+			fprintf(stdout, "%-7s %-8s  fill %8.3f GB/s  verify "
+				"%8.3f GB/s", pattern_type_name(type),
+				pattern_kernel_name(kernel), gbps(fill_time),
+				gbps(verify_time));
+			if (bad != bufsize) {
+				fprintf(stdout, "  MISMATCH at %lu",
+					(unsigned long)bad);
+				ret = 1;
+			}
+			fprintf(stdout, "\n");
+		}
+	}
+
+	free(buf);
+	free(ref);
+
+	return ret;
+}
@@ -0,0 +1,773 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * pattern_ops.c
+ *
+ * Shared fill/verify kernels for test data patterns in ocfs2-tests,
+ * dispatches to the widest vector unit the running cpu supports.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+
+#include "pattern_ops.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_PATTERN_SIMD
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#define PATTERN_ONES		0x0101010101010101ULL
+#define PATTERN_LOW7		0x7f7f7f7f7f7f7f7fULL
+#define PATTERN_HIGH1		0x8080808080808080ULL
+#define PATTERN_INCR_STEP	0x0706050403020100ULL
+#define PATTERN_EVEN_BYTES	0x00ff00ff00ff00ffULL
+#define PATTERN_GOLDEN		0x9e3779b97f4a7c15ULL
+#define PATTERN_MIX_MUL		0xbf58476d1ce4e5b9ULL
+
+/* how much buf_mismatch() hands memcmp() at a time */
+#define MISMATCH_STEP		4096
+
+/*
+ * A pattern_desc with everything the kernels need precomputed, pos
+ * arguments below are always multiples of 8.
+ */
+struct pattern_ctx {
+	int pc_type;
+	uint64_t pc_seed;
+	uint64_t pc_key;
+};
+
+typedef void (*pattern_fill_t)(const struct pattern_ctx *pc,
+			       unsigned char *buf, size_t nwords, uint64_t pos);
+typedef size_t (*pattern_verify_t)(const struct pattern_ctx *pc,
+				   const unsigned char *buf, size_t nwords,
+				   uint64_t pos);
+
+static int pattern_avx2_ok;
+static int pattern_kernel = PATTERN_KERNEL_SCALAR;
+
+/*
+ * Instantiate stmt once per pattern type with T a compile time
+ * constant, so that inlined per-type helpers lose their switch.
+ */
+#define PATTERN_SWITCH(type, stmt)					\
+	switch (type) {							\
+	case PATTERN_CONST: { const int T = PATTERN_CONST; stmt; break; } \
+	case PATTERN_INCR: { const int T = PATTERN_INCR; stmt; break; }	\
+	case PATTERN_STAMP: { const int T = PATTERN_STAMP; stmt; break; } \
+	case PATTERN_RANDOM: { const int T = PATTERN_RANDOM; stmt; break; } \
+	case PATTERN_ALPHA: { const int T = PATTERN_ALPHA; stmt; break; } \
+	default:							\
+		break;							\
+	}
+
+static inline uint64_t pattern_mix(uint64_t x)
+{
+	x ^= x >> 32;
+	x *= PATTERN_MIX_MUL;
+	x ^= x >> 29;
+	x *= PATTERN_MIX_MUL;
+	x ^= x >> 32;
+
+	return x;
+}
+
+/* bytewise a + b, without carries crossing into the next byte */
+static inline uint64_t swar_add8(uint64_t a, uint64_t b)
+{
+	return ((a & PATTERN_LOW7) + (b & PATTERN_LOW7)) ^
+		((a ^ b) & PATTERN_HIGH1);
+}
+
+/* 'A' + b * 26 / 256 for every byte b, 16 bit lanes can't overflow */
+static inline uint64_t swar_alpha(uint64_t x)
+{
+	uint64_t lo = x & PATTERN_EVEN_BYTES;
+	uint64_t hi = (x >> 8) & PATTERN_EVEN_BYTES;
+
+	lo = ((lo * 26) >> 8) & PATTERN_EVEN_BYTES;
+	hi = ((hi * 26) >> 8) & PATTERN_EVEN_BYTES;
+
+	return (lo | (hi << 8)) + 'A' * PATTERN_ONES;
+}
+
+static inline __attribute__((always_inline))
+uint64_t pattern_word(int type, const struct pattern_ctx *pc, uint64_t pos)
+{
+	switch (type) {
+	case PATTERN_CONST:
+		return (pc->pc_seed & 0xff) * PATTERN_ONES;
+	case PATTERN_INCR:
+		return swar_add8(((pc->pc_seed + pos) & 0xff) * PATTERN_ONES,
+				 PATTERN_INCR_STEP);
+	case PATTERN_STAMP:
+		return pos ^ pc->pc_seed;
+	case PATTERN_RANDOM:
+		return pattern_mix(pc->pc_key + (pos >> 3) * PATTERN_GOLDEN);
+	case PATTERN_ALPHA:
+		return swar_alpha(pattern_mix(pc->pc_key +
+					      (pos >> 3) * PATTERN_GOLDEN));
+	default:
+		return 0;
+	}
+}
+
+static void pattern_ctx_init(struct pattern_ctx *pc,
+			     const struct pattern_desc *pd)
+{
+	pc->pc_type = pd->pd_type;
+	pc->pc_seed = pd->pd_seed;
+	pc->pc_key = pattern_mix(pd->pd_seed ^ PATTERN_GOLDEN);
+}
+
+static unsigned char pattern_ctx_byte(const struct pattern_ctx *pc,
+				      uint64_t pos)
+{
+	uint64_t word = pattern_word(pc->pc_type, pc, pos & ~7ULL);
+
+	return (word >> ((pos & 7) * 8)) & 0xff;
+}
+
+static inline __attribute__((always_inline))
+void scalar_fill_type(int type, const struct pattern_ctx *pc,
+		      unsigned char *buf, size_t nwords, uint64_t pos)
+{
+	uint64_t word;
+	size_t i;
+
+	for (i = 0; i < nwords; i++, pos += 8) {
+		word = htole64(pattern_word(type, pc, pos));
+		memcpy(buf + i * 8, &word, 8);
+	}
+}
+
+static inline __attribute__((always_inline))
+size_t scalar_verify_type(int type, const struct pattern_ctx *pc,
+			  const unsigned char *buf, size_t nwords,
+			  uint64_t pos)
+{
+	uint64_t word, diff;
+	size_t i;
+
+	for (i = 0; i < nwords; i++, pos += 8) {
+		memcpy(&word, buf + i * 8, 8);
+		diff = le64toh(word) ^ pattern_word(type, pc, pos);
+		if (diff)
+			return i * 8 + __builtin_ctzll(diff) / 8;
+	}
+
+	return nwords * 8;
+}
+
+static void scalar_fill(const struct pattern_ctx *pc, unsigned char *buf,
+			size_t nwords, uint64_t pos)
+{
+	PATTERN_SWITCH(pc->pc_type,
+		       scalar_fill_type(T, pc, buf, nwords, pos));
+}
+
+static size_t scalar_verify(const struct pattern_ctx *pc,
+			    const unsigned char *buf, size_t nwords,
+			    uint64_t pos)
+{
+	size_t ret = 0;
+
+	PATTERN_SWITCH(pc->pc_type,
+		       ret = scalar_verify_type(T, pc, buf, nwords, pos));
+
+	return ret;
+}
+
+#ifdef HAVE_PATTERN_SIMD
+/*
+ * Vector kernels keep the pattern of the current block in a register
+ * and step it forward, the random types rehash the stepped keys. There
+ * is no 64 bit multiply below avx512, so it is built from three 32x32
+ * ones. Words past the last full vector are left to the scalar code.
+ */
+static inline __attribute__((always_inline))
+__m128i sse2_mullo64(__m128i x, __m128i c, __m128i c_hi)
+{
+	__m128i lo = _mm_mul_epu32(x, c);
+	__m128i t1 = _mm_mul_epu32(_mm_srli_epi64(x, 32), c);
+	__m128i t2 = _mm_mul_epu32(x, c_hi);
+
+	return _mm_add_epi64(lo, _mm_slli_epi64(_mm_add_epi64(t1, t2), 32));
+}
+
+static inline __attribute__((always_inline))
+__m128i sse2_mix(__m128i x)
+{
+	__m128i c = _mm_set1_epi64x(PATTERN_MIX_MUL);
+	__m128i c_hi = _mm_srli_epi64(c, 32);
+
+	x = _mm_xor_si128(x, _mm_srli_epi64(x, 32));
+	x = sse2_mullo64(x, c, c_hi);
+	x = _mm_xor_si128(x, _mm_srli_epi64(x, 29));
+	x = sse2_mullo64(x, c, c_hi);
+	x = _mm_xor_si128(x, _mm_srli_epi64(x, 32));
+
+	return x;
+}
+
+static inline __attribute__((always_inline))
+__m128i sse2_alpha(__m128i x)
+{
+	__m128i mask = _mm_set1_epi16(0xff);
+	__m128i mul = _mm_set1_epi16(26);
+	__m128i lo = _mm_and_si128(x, mask);
+	__m128i hi = _mm_srli_epi16(x, 8);
+
+	lo = _mm_srli_epi16(_mm_mullo_epi16(lo, mul), 8);
+	hi = _mm_srli_epi16(_mm_mullo_epi16(hi, mul), 8);
+
+	return _mm_add_epi8(_mm_or_si128(lo, _mm_slli_epi16(hi, 8)),
+			    _mm_set1_epi8('A'));
+}
+
+struct sse2_gen {
+	__m128i g_state;
+	__m128i g_step;
+	__m128i g_seed;
+};
+
+static inline __attribute__((always_inline))
+void sse2_gen_init(int type, const struct pattern_ctx *pc, uint64_t pos,
+		   struct sse2_gen *g)
+{
+	uint64_t w = pos >> 3;
+
+	switch (type) {
+	case PATTERN_CONST:
+		g->g_state = _mm_set1_epi8((char)pc->pc_seed);
+		break;
+	case PATTERN_INCR:
+		g->g_state = _mm_add_epi8(
+			_mm_set1_epi8((char)(pc->pc_seed + pos)),
+			_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+				      8, 9, 10, 11, 12, 13, 14, 15));
+		g->g_step = _mm_set1_epi8(16);
+		break;
+	case PATTERN_STAMP:
+		g->g_state = _mm_set_epi64x(pos + 8, pos);
+		g->g_step = _mm_set1_epi64x(16);
+		g->g_seed = _mm_set1_epi64x(pc->pc_seed);
+		break;
+	case PATTERN_RANDOM:
+	case PATTERN_ALPHA:
+		g->g_state = _mm_set_epi64x(pc->pc_key + (w + 1) * PATTERN_GOLDEN,
+					    pc->pc_key + w * PATTERN_GOLDEN);
+		g->g_step = _mm_set1_epi64x(2 * PATTERN_GOLDEN);
+		break;
+	}
+}
+
+static inline __attribute__((always_inline))
+__m128i sse2_gen_next(int type, struct sse2_gen *g)
+{
+	__m128i v = g->g_state;
+
+	switch (type) {
+	case PATTERN_CONST:
+		return v;
+	case PATTERN_INCR:
+		g->g_state = _mm_add_epi8(v, g->g_step);
+		return v;
+	case PATTERN_STAMP:
+		g->g_state = _mm_add_epi64(v, g->g_step);
+		return _mm_xor_si128(v, g->g_seed);
+	case PATTERN_RANDOM:
+		g->g_state = _mm_add_epi64(v, g->g_step);
+		return sse2_mix(v);
+	case PATTERN_ALPHA:
+		g->g_state = _mm_add_epi64(v, g->g_step);
+		return sse2_alpha(sse2_mix(v));
+	}
+
+	return v;
+}
+
+static inline __attribute__((always_inline))
+void sse2_fill_type(int type, const struct pattern_ctx *pc,
+		    unsigned char *buf, size_t nwords, uint64_t pos)
+{
+	struct sse2_gen g;
+	size_t i, nvecs = nwords / 2;
+
+	sse2_gen_init(type, pc, pos, &g);
+	for (i = 0; i < nvecs; i++)
+		_mm_storeu_si128((__m128i *)(buf + i * 16),
+				 sse2_gen_next(type, &g));
+
+	scalar_fill_type(type, pc, buf + nvecs * 16, nwords - nvecs * 2,
+			 pos + nvecs * 16);
+}
+
+static inline __attribute__((always_inline))
+size_t sse2_verify_type(int type, const struct pattern_ctx *pc,
+			const unsigned char *buf, size_t nwords, uint64_t pos)
+{
+	struct sse2_gen g;
+	__m128i v;
+	unsigned int mask;
+	size_t i, nvecs = nwords / 2;
+
+	sse2_gen_init(type, pc, pos, &g);
+	for (i = 0; i < nvecs; i++) {
+		v = _mm_loadu_si128((const __m128i *)(buf + i * 16));
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v,
+						sse2_gen_next(type, &g)));
+		if (mask != 0xffff)
+			return i * 16 + __builtin_ctz(~mask);
+	}
+
+	return nvecs * 16 +
+		scalar_verify_type(type, pc, buf + nvecs * 16,
+				   nwords - nvecs * 2, pos + nvecs * 16);
+}
+
+static void sse2_fill(const struct pattern_ctx *pc, unsigned char *buf,
+		      size_t nwords, uint64_t pos)
+{
+	PATTERN_SWITCH(pc->pc_type, sse2_fill_type(T, pc, buf, nwords, pos));
+}
+
+static size_t sse2_verify(const struct pattern_ctx *pc,
+			  const unsigned char *buf, size_t nwords,
+			  uint64_t pos)
+{
+	size_t ret = 0;
+
+	PATTERN_SWITCH(pc->pc_type,
+		       ret = sse2_verify_type(T, pc, buf, nwords, pos));
+
+	return ret;
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline __attribute__((always_inline)) AVX2
+__m256i avx2_mullo64(__m256i x, __m256i c, __m256i c_hi)
+{
+	__m256i lo = _mm256_mul_epu32(x, c);
+	__m256i t1 = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), c);
+	__m256i t2 = _mm256_mul_epu32(x, c_hi);
+
+	return _mm256_add_epi64(lo,
+				_mm256_slli_epi64(_mm256_add_epi64(t1, t2), 32));
+}
+
+static inline __attribute__((always_inline)) AVX2
+__m256i avx2_mix(__m256i x)
+{
+	__m256i c = _mm256_set1_epi64x(PATTERN_MIX_MUL);
+	__m256i c_hi = _mm256_srli_epi64(c, 32);
+
+	x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 32));
+	x = avx2_mullo64(x, c, c_hi);
+	x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 29));
+	x = avx2_mullo64(x, c, c_hi);
+	x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 32));
+
+	return x;
+}
+
+static inline __attribute__((always_inline)) AVX2
+__m256i avx2_alpha(__m256i x)
+{
+	__m256i mask = _mm256_set1_epi16(0xff);
+	__m256i mul = _mm256_set1_epi16(26);
+	__m256i lo = _mm256_and_si256(x, mask);
+	__m256i hi = _mm256_srli_epi16(x, 8);
+
+	lo = _mm256_srli_epi16(_mm256_mullo_epi16(lo, mul), 8);
+	hi = _mm256_srli_epi16(_mm256_mullo_epi16(hi, mul), 8);
+
+	return _mm256_add_epi8(_mm256_or_si256(lo, _mm256_slli_epi16(hi, 8)),
+			       _mm256_set1_epi8('A'));
+}
+
+struct avx2_gen {
+	__m256i g_state;
+	__m256i g_step;
+	__m256i g_seed;
+};
+
+static inline __attribute__((always_inline)) AVX2
+void avx2_gen_init(int type, const struct pattern_ctx *pc, uint64_t pos,
+		   struct avx2_gen *g)
+{
+	uint64_t w = pos >> 3;
+
+	switch (type) {
+	case PATTERN_CONST:
+		g->g_state = _mm256_set1_epi8((char)pc->pc_seed);
+		break;
+	case PATTERN_INCR:
+		g->g_state = _mm256_add_epi8(
+			_mm256_set1_epi8((char)(pc->pc_seed + pos)),
+			_mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					 8, 9, 10, 11, 12, 13, 14, 15,
+					 16, 17, 18, 19, 20, 21, 22, 23,
+					 24, 25, 26, 27, 28, 29, 30, 31));
+		g->g_step = _mm256_set1_epi8(32);
+		break;
+	case PATTERN_STAMP:
+		g->g_state = _mm256_set_epi64x(pos + 24, pos + 16, pos + 8,
+					       pos);
+		g->g_step = _mm256_set1_epi64x(32);
+		g->g_seed = _mm256_set1_epi64x(pc->pc_seed);
+		break;
+	case PATTERN_RANDOM:
+	case PATTERN_ALPHA:
+		g->g_state = _mm256_set_epi64x(
+			pc->pc_key + (w + 3) * PATTERN_GOLDEN,
+			pc->pc_key + (w + 2) * PATTERN_GOLDEN,
+			pc->pc_key + (w + 1) * PATTERN_GOLDEN,
+			pc->pc_key + w * PATTERN_GOLDEN);
+		g->g_step = _mm256_set1_epi64x(4 * PATTERN_GOLDEN);
+		break;
+	}
+}
+
+static inline __attribute__((always_inline)) AVX2
+__m256i avx2_gen_next(int type, struct avx2_gen *g)
+{
+	__m256i v = g->g_state;
+
+	switch (type) {
+	case PATTERN_CONST:
+		return v;
+	case PATTERN_INCR:
+		g->g_state = _mm256_add_epi8(v, g->g_step);
+		return v;
+	case PATTERN_STAMP:
+		g->g_state = _mm256_add_epi64(v, g->g_step);
+		return _mm256_xor_si256(v, g->g_seed);
+	case PATTERN_RANDOM:
+		g->g_state = _mm256_add_epi64(v, g->g_step);
+		return avx2_mix(v);
+	case PATTERN_ALPHA:
+		g->g_state = _mm256_add_epi64(v, g->g_step);
+		return avx2_alpha(avx2_mix(v));
+	}
+
+	return v;
+}
+
+static inline __attribute__((always_inline)) AVX2
+void avx2_fill_type(int type, const struct pattern_ctx *pc,
+		    unsigned char *buf, size_t nwords, uint64_t pos)
+{
+	struct avx2_gen g;
+	size_t i, nvecs = nwords / 4;
+
+	avx2_gen_init(type, pc, pos, &g);
+	for (i = 0; i < nvecs; i++)
+		_mm256_storeu_si256((__m256i *)(buf + i * 32),
+				    avx2_gen_next(type, &g));
+
+	scalar_fill_type(type, pc, buf + nvecs * 32, nwords - nvecs * 4,
+			 pos + nvecs * 32);
+}
+
+static inline __attribute__((always_inline)) AVX2
+size_t avx2_verify_type(int type, const struct pattern_ctx *pc,
+			const unsigned char *buf, size_t nwords, uint64_t pos)
+{
+	struct avx2_gen g;
+	__m256i v;
+	unsigned int mask;
+	size_t i, nvecs = nwords / 4;
+
+	avx2_gen_init(type, pc, pos, &g);
+	for (i = 0; i < nvecs; i++) {
+		v = _mm256_loadu_si256((const __m256i *)(buf + i * 32));
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v,
+						avx2_gen_next(type, &g)));
+		if (mask != 0xffffffffU)
+			return i * 32 + __builtin_ctz(~mask);
+	}
+
+	return nvecs * 32 +
+		scalar_verify_type(type, pc, buf + nvecs * 32,
+				   nwords - nvecs * 4, pos + nvecs * 32);
+}
+
+static AVX2 void avx2_fill(const struct pattern_ctx *pc, unsigned char *buf,
+			   size_t nwords, uint64_t pos)
+{
+	PATTERN_SWITCH(pc->pc_type, avx2_fill_type(T, pc, buf, nwords, pos));
+}
+
+static AVX2 size_t avx2_verify(const struct pattern_ctx *pc,
+			       const unsigned char *buf, size_t nwords,
+			       uint64_t pos)
+{
+	size_t ret = 0;
+
+	PATTERN_SWITCH(pc->pc_type,
+		       ret = avx2_verify_type(T, pc, buf, nwords, pos));
+
+	return ret;
+}
+
+/* the os has to save ymm state as well, not just the cpu support avx2 */
+static int pattern_avx2_probe(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	uint32_t xcr0_lo, xcr0_hi;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+
+	if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+		return 0;
+
+	__asm__ volatile("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+	if ((xcr0_lo & 6) != 6)
+		return 0;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+	return !!(ebx & bit_AVX2);
+}
+#endif
+
+static const struct {
+	const char *name;
+	pattern_fill_t fill;
+	pattern_verify_t verify;
+} pattern_kernels[PATTERN_KERNEL_NUM] = {
+	[PATTERN_KERNEL_SCALAR]	= { "scalar", scalar_fill, scalar_verify },
+#ifdef HAVE_PATTERN_SIMD
+	[PATTERN_KERNEL_SSE2]	= { "sse2", sse2_fill, sse2_verify },
+	[PATTERN_KERNEL_AVX2]	= { "avx2", avx2_fill, avx2_verify },
+#else
+	[PATTERN_KERNEL_SSE2]	= { "sse2", NULL, NULL },
+	[PATTERN_KERNEL_AVX2]	= { "avx2", NULL, NULL },
+#endif
+};
+
+static const char *pattern_type_names[PATTERN_TYPE_NUM] = {
+	[PATTERN_CONST]		= "const",
+	[PATTERN_INCR]		= "incr",
+	[PATTERN_STAMP]		= "stamp",
+	[PATTERN_RANDOM]	= "random",
+	[PATTERN_ALPHA]		= "alpha",
+};
+
+__attribute__((constructor))
+static void pattern_init(void)
+{
+#ifdef HAVE_PATTERN_SIMD
+	pattern_avx2_ok = pattern_avx2_probe();
+#endif
+
+	pattern_set_kernel(PATTERN_KERNEL_AUTO);
+}
+
+const char *pattern_type_name(int type)
+{
+	if (type < 0 || type >= PATTERN_TYPE_NUM)
+		return "unknown";
+
+	return pattern_type_names[type];
+}
+
+int pattern_parse_type(const char *name)
+{
+	int type;
+
+	for (type = 0; type < PATTERN_TYPE_NUM; type++)
+		if (!strcmp(name, pattern_type_names[type]))
+			return type;
+
+	return -EINVAL;
+}
+
+const char *pattern_kernel_name(int kernel)
+{
+	if (kernel < 0 || kernel >= PATTERN_KERNEL_NUM)
+		return "unknown";
+
+	return pattern_kernels[kernel].name;
+}
+
+int pattern_kernel_supported(int kernel)
+{
+	switch (kernel) {
+	case PATTERN_KERNEL_SCALAR:
+		return 1;
+#ifdef HAVE_PATTERN_SIMD
+	case PATTERN_KERNEL_SSE2:
+		return 1;
+	case PATTERN_KERNEL_AVX2:
+		return pattern_avx2_ok;
+#endif
+	default:
+		return 0;
+	}
+}
+
+int pattern_get_kernel(void)
+{
+	return pattern_kernel;
+}
+
+int pattern_set_kernel(int kernel)
+{
+	if (kernel == PATTERN_KERNEL_AUTO) {
+		kernel = PATTERN_KERNEL_NUM - 1;
+		while (!pattern_kernel_supported(kernel))
+			kernel--;
+	}
+
+	if (!pattern_kernel_supported(kernel)) {
+		fprintf(stderr, "pattern kernel %s is not supported on this "
+			"cpu\n", pattern_kernel_name(kernel));
+		return -EINVAL;
+	}
+
+	pattern_kernel = kernel;
+
+	return 0;
+}
+
+unsigned char pattern_byte(const struct pattern_desc *pd, uint64_t pos)
+{
+	struct pattern_ctx pc;
+
+	pattern_ctx_init(&pc, pd);
+
+	return pattern_ctx_byte(&pc, pos);
+}
+
+/*
+ * The kernels only deal in whole words at multiples of 8 in the file,
+ * bytes in front of the first and after the last one are done here.
+ */
+void pattern_fill_kernel(int kernel, const struct pattern_desc *pd,
+			 void *buf, size_t len, uint64_t pos)
+{
+	struct pattern_ctx pc;
+	unsigned char *p = buf;
+	size_t i, head, nwords;
+
+	if (!pattern_kernel_supported(kernel))
+		kernel = pattern_kernel;
+
+	pattern_ctx_init(&pc, pd);
+
+	head = (-pos) & 7;
+	if (head > len)
+		head = len;
+	for (i = 0; i < head; i++)
+		p[i] = pattern_ctx_byte(&pc, pos + i);
+
+	p += head;
+	pos += head;
+	len -= head;
+
+	nwords = len / 8;
+	pattern_kernels[kernel].fill(&pc, p, nwords, pos);
+
+	for (i = nwords * 8; i < len; i++)
+		p[i] = pattern_ctx_byte(&pc, pos + i);
+}
+
+/*
+ * Returns the index of the first byte in buf which doesn't match the
+ * pattern, or len if all of them do.
+ */
+size_t pattern_verify_kernel(int kernel, const struct pattern_desc *pd,
+			     const void *buf, size_t len, uint64_t pos)
+{
+	struct pattern_ctx pc;
+	const unsigned char *p = buf;
+	size_t i, head, nwords, bad;
+
+	if (!pattern_kernel_supported(kernel))
+		kernel = pattern_kernel;
+
+	pattern_ctx_init(&pc, pd);
+
+	head = (-pos) & 7;
+	if (head > len)
+		head = len;
+	for (i = 0; i < head; i++)
+		if (p[i] != pattern_ctx_byte(&pc, pos + i))
+			return i;
+
+	nwords = (len - head) / 8;
+	bad = pattern_kernels[kernel].verify(&pc, p + head, nwords,
+					     pos + head);
+	if (bad < nwords * 8)
+		return head + bad;
+
+	for (i = head + nwords * 8; i < len; i++)
+		if (p[i] != pattern_ctx_byte(&pc, pos + i))
+			return i;
+
+	return len;
+}
+
+void pattern_fill(const struct pattern_desc *pd, void *buf, size_t len,
+		  uint64_t pos)
+{
+	pattern_fill_kernel(pattern_kernel, pd, buf, len, pos);
+}
+
+size_t pattern_verify(const struct pattern_desc *pd, const void *buf,
+		      size_t len, uint64_t pos)
+{
+	return pattern_verify_kernel(pattern_kernel, pd, buf, len, pos);
+}
+
+/*
+ * Like memcmp() but returns where a and b first differ, or len if they
+ * don't. memcmp() is already vectorized, so it is only used to find the
+ * block holding the mismatch.
+ */
+size_t buf_mismatch(const void *a, const void *b, size_t len)
+{
+	const unsigned char *pa = a, *pb = b;
+	size_t off, i, n;
+
+	for (off = 0; off < len; off += n) {
+		n = len - off;
+		if (n > MISMATCH_STEP)
+			n = MISMATCH_STEP;
+
+		if (!memcmp(pa + off, pb + off, n))
+			continue;
+
+		for (i = 0; i < n; i++)
+			if (pa[off + i] != pb[off + i])
+				return off + i;
+	}
+
+	return len;
+}
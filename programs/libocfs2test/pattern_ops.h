@@ -0,0 +1,70 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * pattern_ops.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef PATTERN_OPS_H
+#define PATTERN_OPS_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * Every pattern is a pure function of (seed, pos), pos being where a
+ * byte lives in the file rather than in the buffer, so any sub-range
+ * can be regenerated or verified on its own.
+ */
+enum pattern_type {
+	PATTERN_CONST = 0,	/* seed & 0xff everywhere */
+	PATTERN_INCR,		/* (seed + pos) & 0xff */
+	PATTERN_STAMP,		/* each 8 byte word holds its pos ^ seed, le */
+	PATTERN_RANDOM,		/* keyed hash of the word pos */
+	PATTERN_ALPHA,		/* PATTERN_RANDOM mapped onto 'A'-'Z' */
+	PATTERN_TYPE_NUM,
+};
+
+struct pattern_desc {
+	int pd_type;
+	uint64_t pd_seed;
+};
+
+enum pattern_kernel {
+	PATTERN_KERNEL_AUTO = -1,
+	PATTERN_KERNEL_SCALAR = 0,	/* 8 bytes per step */
+	PATTERN_KERNEL_SSE2,
+	PATTERN_KERNEL_AVX2,
+	PATTERN_KERNEL_NUM,
+};
+
+void pattern_fill(const struct pattern_desc *pd, void *buf, size_t len,
+		  uint64_t pos);
+size_t pattern_verify(const struct pattern_desc *pd, const void *buf,
+		      size_t len, uint64_t pos);
+void pattern_fill_kernel(int kernel, const struct pattern_desc *pd,
+			 void *buf, size_t len, uint64_t pos);
+size_t pattern_verify_kernel(int kernel, const struct pattern_desc *pd,
+			     const void *buf, size_t len, uint64_t pos);
+unsigned char pattern_byte(const struct pattern_desc *pd, uint64_t pos);
+
+size_t buf_mismatch(const void *a, const void *b, size_t len);
+
+const char *pattern_type_name(int type);
+int pattern_parse_type(const char *name);
+const char *pattern_kernel_name(int kernel);
+int pattern_kernel_supported(int kernel);
+int pattern_get_kernel(void);
+int pattern_set_kernel(int kernel);
+
+#endif
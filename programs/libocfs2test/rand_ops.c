@@ -0,0 +1,262 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * rand_ops.c
+ *
+ * Seedable per-thread random generator and bulk random fills shared by
+ * the ocfs2-tests workload generators.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rand_ops.h"
+#include "pattern_ops.h"
+
+/* streams handed to threads which never asked for one */
+#define RAND_AUTO_STREAM	(1ULL << 32)
+
+static const char alnum_chars[62] =
+	"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+static uint64_t rand_seed;
+static unsigned long rand_auto_streams;
+
+static __thread uint64_t rand_s[4];
+static __thread int rand_ready;
+static __thread uint64_t rand_fork_key;
+
+static uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+static void rand_seed_state(uint64_t key, uint64_t stream)
+{
+	uint64_t x = key ^ (stream * 0xd1b54a32d192ed03ULL);
+	int i;
+
+	for (i = 0; i < 4; i++)
+		rand_s[i] = splitmix64(&x);
+
+	if (!(rand_s[0] | rand_s[1] | rand_s[2] | rand_s[3]))
+		rand_s[0] = 1;
+
+	rand_ready = 1;
+}
+
+/*
+ * A forked child would replay its parent's sequence, so every fork()
+ * draws a key from the parent's stream and the child seeds itself from
+ * it. The n-th child of a given parent therefore always gets the same
+ * stream for the same seed.
+ */
+static void rand_atfork_prepare(void)
+{
+	rand_fork_key = o2test_rand();
+}
+
+static void rand_atfork_child(void)
+{
+	rand_seed_state(rand_fork_key, RAND_AUTO_STREAM - 1);
+}
+
+static void __attribute__((constructor)) rand_ops_init(void)
+{
+	rand_seed = ((uint64_t)time(NULL) << 20) ^ getpid();
+	pthread_atfork(rand_atfork_prepare, NULL, rand_atfork_child);
+}
+
+void o2test_srand(unsigned long seed)
+{
+	rand_seed = seed;
+	rand_auto_streams = 0;
+	rand_seed_state(rand_seed, 0);
+}
+
+unsigned long o2test_get_seed(void)
+{
+	return rand_seed;
+}
+
+void o2test_rand_stream(unsigned long stream)
+{
+	rand_seed_state(rand_seed, stream);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+uint64_t o2test_rand(void)
+{
+	uint64_t result, t;
+
+	if (!rand_ready)
+		rand_seed_state(rand_seed, RAND_AUTO_STREAM +
+				__sync_add_and_fetch(&rand_auto_streams, 1));
+
+	result = rotl(rand_s[1] * 5, 7) * 9;
+	t = rand_s[1] << 17;
+
+	rand_s[2] ^= rand_s[0];
+	rand_s[3] ^= rand_s[1];
+	rand_s[1] ^= rand_s[2];
+	rand_s[0] ^= rand_s[3];
+	rand_s[2] ^= t;
+	rand_s[3] = rotl(rand_s[3], 45);
+
+	return result;
+}
+
+unsigned long o2test_seed_setup(int *argc, char **argv, int quiet)
+{
+	char *val = NULL, *end, *env;
+	unsigned long seed;
+	int i, j, skip;
+
+	for (i = 1; i < *argc; i++) {
+		if (!strcmp(argv[i], "--"))
+			break;
+
+		if (!strcmp(argv[i], "--seed") && i + 1 < *argc) {
+			val = argv[i + 1];
+			skip = 2;
+		} else if (!strncmp(argv[i], "--seed=", 7)) {
+			val = argv[i] + 7;
+			skip = 1;
+		} else
+			continue;
+
+		for (j = i; j + skip <= *argc; j++)
+			argv[j] = argv[j + skip];
+		*argc -= skip;
+		break;
+	}
+
+	if (!val) {
+		env = getenv("O2TEST_SEED");
+		if (env && *env)
+			val = env;
+	}
+
+	if (val) {
+		seed = strtoul(val, &end, 0);
+		if (*end) {
+			fprintf(stderr, "invalid seed \"%s\"\n", val);
+			exit(1);
+		}
+	} else
+		seed = (unsigned long)time(NULL) ^ ((unsigned long)getpid() << 16);
+
+	o2test_srand(seed);
+
+	if (!quiet) {
+		fprintf(stdout, "Random seed: %lu (rerun with --seed %lu)\n",
+			seed, seed);
+		fflush(stdout);
+	}
+
+	return seed;
+}
+
+unsigned long get_rand(unsigned long min, unsigned long max)
+{
+	unsigned long range;
+
+	if (min == 0 && max == 0)
+		return 0;
+
+	range = max - min + 1;
+	if (!range)
+		return o2test_rand();
+
+	return min + (o2test_rand() >> 11) % range;
+}
+
+char rand_char(void)
+{
+	return 'A' + (char) get_rand(0, 25);
+}
+
+void o2test_rand_fill(void *buf, size_t size)
+{
+	unsigned char *p = (unsigned char *)buf;
+	uint64_t x;
+
+	while (size >= sizeof(x)) {
+		x = o2test_rand();
+		memcpy(p, &x, sizeof(x));
+		p += sizeof(x);
+		size -= sizeof(x);
+	}
+
+	if (size) {
+		x = o2test_rand();
+		memcpy(p, &x, size);
+	}
+}
+
+/*
+ * Bulk 'A'-'Z' fill for write buffers, one draw keys a PATTERN_ALPHA
+ * run which the vector kernels expand at memory speed.
+ */
+int get_rand_buf(char *buf, unsigned long size)
+{
+	struct pattern_desc pd = { PATTERN_ALPHA, o2test_rand() };
+
+	pattern_fill(&pd, buf, size, 0);
+
+	return 0;
+}
+
+/*
+ * Map each byte of a 64-bit draw onto the alphabet by multiply and
+ * shift, eight characters per generator call.
+ */
+void get_rand_alnum(char *buf, unsigned long size)
+{
+	unsigned long i;
+	uint64_t x = 0;
+
+	for (i = 0; i < size; i++) {
+		if (!(i & 7))
+			x = o2test_rand();
+		buf[i] = alnum_chars[((x & 0xff) * sizeof(alnum_chars)) >> 8];
+		x >>= 8;
+	}
+}
+
+unsigned int get_rand_nam(char *str, unsigned int least, unsigned int most)
+{
+	unsigned int nam_len = get_rand(least, most);
+
+	get_rand_buf(str, nam_len);
+	str[nam_len] = '\0';
+
+	return nam_len;
+}
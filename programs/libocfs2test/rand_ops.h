@@ -0,0 +1,53 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * rand_ops.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef RAND_OPS_H
+#define RAND_OPS_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * xoshiro256** with one state per thread, so threaded workloads never
+ * touch libc's locked rand(). Every stream is derived from the global
+ * seed and a stream number, a run is reproduced by passing the same
+ * seed back and giving each thread, child or MPI rank the same stream
+ * via o2test_rand_stream(). Threads and forked children that don't pick
+ * a stream get a fresh one of their own on first use.
+ */
+void o2test_srand(unsigned long seed);
+unsigned long o2test_get_seed(void);
+void o2test_rand_stream(unsigned long stream);
+uint64_t o2test_rand(void);
+
+/*
+ * Strips "--seed N" or "--seed=N" from argv before getopt() sees it,
+ * falls back to $O2TEST_SEED and then to time ^ pid, seeds stream 0 and
+ * prints the seed to stdout unless quiet is set.
+ */
+unsigned long o2test_seed_setup(int *argc, char **argv, int quiet);
+
+unsigned long get_rand(unsigned long min, unsigned long max);
+char rand_char(void);
+
+/* bulk fills, several output bytes per generator call */
+void o2test_rand_fill(void *buf, size_t size);
+int get_rand_buf(char *buf, unsigned long size);
+void get_rand_alnum(char *buf, unsigned long size);
+unsigned int get_rand_nam(char *str, unsigned int least, unsigned int most);
+
+#endif
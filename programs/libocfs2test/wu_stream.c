@@ -0,0 +1,976 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * wu_stream.c
+ *
+ * Latest-writer tables of write records, and the batched record stream
+ * that feeds them from remote writers. Kept apart from file_verify.c so
+ * tests with a write_unit of their own can link it.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE 500
+#define _LARGEFILE64_SOURCE
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <endian.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#include "wu_stream.h"
+
+static int verify_table_mode = WU_TABLE_DENSE;
+static const char *verify_spill_dir;
+
+void set_verify_table(int mode, const char *spill_dir)
+{
+	verify_table_mode = mode;
+	verify_spill_dir = spill_dir;
+}
+
+static const char *wu_table_modes[] = {
+	[WU_TABLE_DENSE]	= "dense",
+	[WU_TABLE_SPARSE]	= "sparse",
+	[WU_TABLE_SPILL]	= "spill",
+};
+
+const char *wu_table_mode_name(int mode)
+{
+	if (mode < WU_TABLE_DENSE || mode > WU_TABLE_SPILL)
+		return "unknown";
+
+	return wu_table_modes[mode];
+}
+
+int wu_table_parse_mode(const char *name)
+{
+	int mode;
+
+	for (mode = WU_TABLE_DENSE; mode <= WU_TABLE_SPILL; mode++)
+		if (!strcmp(name, wu_table_modes[mode]))
+			return mode;
+
+	return -EINVAL;
+}
+
+static inline unsigned long wu_hash(uint64_t key, unsigned long nr_slots)
+{
+	return (key * 0x9e3779b97f4a7c15ULL) >> 32 & (nr_slots - 1);
+}
+
+static int wu_table_map(struct wu_table *wt, const char *spill_dir)
+{
+	int ret;
+	char path[PATH_MAX];
+
+	if (wt->wt_mode == WU_TABLE_DENSE) {
+		wt->wt_entries = mmap(NULL, wt->wt_bytes,
+				      PROT_READ | PROT_WRITE,
+				      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+				      -1, 0);
+		goto out;
+	}
+
+	/*
+	 * the table lives in an unlinked file, page cache writes it back
+	 * under memory pressure and untouched ranges stay holes on disk.
+	 */
+	snprintf(path, PATH_MAX, "%s/wu_table.XXXXXX",
+		 spill_dir ? spill_dir : "/tmp");
+
+	wt->wt_fd = mkstemp(path);
+	if (wt->wt_fd < 0) {
+		ret = errno;
+		fprintf(stderr, "failed to create spill file %s:%d:%s\n",
+			path, ret, strerror(ret));
+		return -ret;
+	}
+
+	unlink(path);
+
+	if (ftruncate(wt->wt_fd, wt->wt_bytes) < 0) {
+		ret = errno;
+		fprintf(stderr, "failed to size spill file to %lu:%d:%s\n",
+			(unsigned long)wt->wt_bytes, ret, strerror(ret));
+		return -ret;
+	}
+
+	wt->wt_entries = mmap(NULL, wt->wt_bytes, PROT_READ | PROT_WRITE,
+			      MAP_SHARED, wt->wt_fd, 0);
+
+out:
+	if (wt->wt_entries == MAP_FAILED) {
+		ret = errno;
+		wt->wt_entries = NULL;
+		fprintf(stderr, "failed to map %lu bytes for write records:"
+			"%d:%s\n", (unsigned long)wt->wt_bytes, ret,
+			strerror(ret));
+		return -ret;
+	}
+
+	return 0;
+}
+
+static int wu_table_alloc_slots(struct wu_table *wt, unsigned long nr_slots)
+{
+	wt->wt_slots = (struct wu_hash_slot *)calloc(nr_slots,
+						sizeof(struct wu_hash_slot));
+	if (!wt->wt_slots) {
+		fprintf(stderr, "failed to allocate %lu write record slots\n",
+			nr_slots);
+		return -ENOMEM;
+	}
+
+	wt->wt_nr_slots = nr_slots;
+	wt->wt_bytes = nr_slots * sizeof(struct wu_hash_slot);
+
+	return 0;
+}
+
+int wu_table_init(struct wu_table *wt, int mode, unsigned long num_chunks,
+		  unsigned int chunksize, const char *spill_dir)
+{
+	int ret;
+
+	memset(wt, 0, sizeof(struct wu_table));
+	wt->wt_fd = -1;
+	wt->wt_mode = mode;
+	wt->wt_chunksize = chunksize;
+	wt->wt_num_chunks = num_chunks;
+
+	switch (mode) {
+	case WU_TABLE_DENSE:
+	case WU_TABLE_SPILL:
+		wt->wt_bytes = num_chunks * sizeof(struct wu_entry);
+		if (!wt->wt_bytes)
+			return 0;
+		ret = wu_table_map(wt, spill_dir);
+		break;
+	case WU_TABLE_SPARSE:
+		ret = wu_table_alloc_slots(wt, WU_TABLE_HASH_MIN);
+		break;
+	default:
+		fprintf(stderr, "unknown write record table mode %d\n", mode);
+		ret = -EINVAL;
+	}
+
+	if (ret)
+		wu_table_free(wt);
+
+	return ret;
+}
+
+void wu_table_free(struct wu_table *wt)
+{
+	if (wt->wt_entries)
+		munmap(wt->wt_entries, wt->wt_bytes);
+
+	if (wt->wt_slots)
+		free(wt->wt_slots);
+
+	if (wt->wt_fd >= 0)
+		close(wt->wt_fd);
+
+	wt->wt_entries = NULL;
+	wt->wt_slots = NULL;
+	wt->wt_fd = -1;
+}
+
+static struct wu_hash_slot *wu_hash_find(struct wu_hash_slot *slots,
+					 unsigned long nr_slots, uint64_t key)
+{
+	unsigned long i = wu_hash(key, nr_slots);
+
+	while (slots[i].ws_key && slots[i].ws_key != key)
+		i = (i + 1) & (nr_slots - 1);
+
+	return &slots[i];
+}
+
+static int wu_hash_grow(struct wu_table *wt)
+{
+	int ret;
+	unsigned long i, old_nr = wt->wt_nr_slots;
+	struct wu_hash_slot *old = wt->wt_slots, *slot;
+
+	ret = wu_table_alloc_slots(wt, old_nr * 2);
+	if (ret) {
+		wt->wt_slots = old;
+		wt->wt_nr_slots = old_nr;
+		return ret;
+	}
+
+	for (i = 0; i < old_nr; i++) {
+		if (!old[i].ws_key)
+			continue;
+		slot = wu_hash_find(wt->wt_slots, wt->wt_nr_slots,
+				    old[i].ws_key);
+		*slot = old[i];
+	}
+
+	free(old);
+
+	return 0;
+}
+
+static struct wu_entry *wu_table_entry(struct wu_table *wt,
+				       unsigned long chunk_no, int create)
+{
+	struct wu_hash_slot *slot;
+	uint64_t key = (uint64_t)chunk_no + 1;
+
+	if (wt->wt_mode != WU_TABLE_SPARSE)
+		return &wt->wt_entries[chunk_no];
+
+	slot = wu_hash_find(wt->wt_slots, wt->wt_nr_slots, key);
+	if (slot->ws_key)
+		return &slot->ws_entry;
+
+	if (!create)
+		return NULL;
+
+	/*
+	 * keep the load under 3/4 so probe chains stay short.
+	 */
+	if ((wt->wt_used + 1) * 4 > wt->wt_nr_slots * 3) {
+		if (wu_hash_grow(wt))
+			return NULL;
+		slot = wu_hash_find(wt->wt_slots, wt->wt_nr_slots, key);
+	}
+
+	slot->ws_key = key;
+	wt->wt_used++;
+
+	return &slot->ws_entry;
+}
+
+int wu_table_merge_entry(struct wu_table *wt, unsigned long chunk_no,
+			 const struct wu_entry *we)
+{
+	struct wu_entry *te;
+
+	if (chunk_no >= wt->wt_num_chunks) {
+		fprintf(stderr, "Chunkno grabed from write log"
+			"exceeds the filesize, you may probably"
+			" specify a too small filesize.\n");
+		return -EINVAL;
+	}
+
+	if (!we->we_timestamp)
+		return 0;
+
+	te = wu_table_entry(wt, chunk_no, 1);
+	if (!te)
+		return -ENOMEM;
+
+	if (we->we_timestamp >= te->we_timestamp) {
+		if (wt->wt_mode != WU_TABLE_SPARSE && !te->we_timestamp)
+			wt->wt_used++;
+		te->we_timestamp = we->we_timestamp;
+		te->we_checksum = we->we_checksum;
+		te->we_char = we->we_char;
+	}
+
+	return 0;
+}
+
+/*
+ * Fills we with the latest record of chunk_no, returns 0 when there is
+ * none, lookups never modify the table and are safe across threads.
+ */
+int wu_table_lookup_entry(struct wu_table *wt, unsigned long chunk_no,
+			  struct wu_entry *we)
+{
+	struct wu_entry *te = NULL;
+
+	if (chunk_no < wt->wt_num_chunks && wt->wt_bytes)
+		te = wu_table_entry(wt, chunk_no, 0);
+
+	if (!te || !te->we_timestamp) {
+		memset(we, 0, sizeof(struct wu_entry));
+		return 0;
+	}
+
+	*we = *te;
+
+	return 1;
+}
+
+/*
+ * A table for filesize in chunks, of the mode set_verify_table() chose.
+ */
+int verify_table_init(struct wu_table *wt, unsigned long filesize,
+		      unsigned int chunksize)
+{
+	return wu_table_init(wt, verify_table_mode, filesize / chunksize,
+			     chunksize, verify_spill_dir);
+}
+
+static int send_all(int sock, const void *buf, size_t count)
+{
+	ssize_t ret;
+	const char *p = buf;
+
+	while (count) {
+		ret = send(sock, p, count, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = errno;
+			fprintf(stderr, "send to log sink failed:%d:%s\n",
+				(int)ret, strerror(ret));
+			return -ret;
+		}
+
+		p += ret;
+		count -= ret;
+	}
+
+	return 0;
+}
+
+static void entry_to_log_record(unsigned long chunk_no,
+				const struct wu_entry *we,
+				struct wu_log_record *rec)
+{
+	memset(rec, 0, sizeof(struct wu_log_record));
+	rec->wlr_chunk_no = htole64(chunk_no);
+	rec->wlr_timestamp = htole64(we->we_timestamp);
+	rec->wlr_checksum = htole32(we->we_checksum);
+	rec->wlr_char = we->we_char;
+}
+
+static unsigned long log_record_to_entry(struct wu_log_record *rec,
+					 struct wu_entry *we)
+{
+	memset(we, 0, sizeof(struct wu_entry));
+	we->we_timestamp = le64toh(rec->wlr_timestamp);
+	we->we_checksum = le32toh(rec->wlr_checksum);
+	we->we_char = rec->wlr_char;
+
+	return le64toh(rec->wlr_chunk_no);
+}
+
+/*
+ * The flusher ships a frame once enough records are queued for a full
+ * one, or when the oldest queued record has waited WU_STREAM_FLUSH_MS,
+ * writers only block when the whole queue is in flight.
+ */
+static void *wu_stream_flusher(void *arg)
+{
+	struct wu_stream *ws = (struct wu_stream *)arg;
+	struct wu_stream_frame *frame;
+	struct wu_log_record *recs;
+	struct timespec ts;
+	unsigned long n, first;
+	size_t frame_bytes;
+	int ret;
+
+	frame_bytes = sizeof(struct wu_stream_frame) +
+		      ws->ws_frame_records * sizeof(struct wu_log_record);
+	frame = (struct wu_stream_frame *)malloc(frame_bytes);
+	if (!frame) {
+		pthread_mutex_lock(&ws->ws_lock);
+		ws->ws_error = -ENOMEM;
+		pthread_cond_broadcast(&ws->ws_not_full);
+		pthread_mutex_unlock(&ws->ws_lock);
+		return NULL;
+	}
+
+	recs = (struct wu_log_record *)(frame + 1);
+
+	while (1) {
+		pthread_mutex_lock(&ws->ws_lock);
+
+		while (!ws->ws_count && !ws->ws_closing)
+			pthread_cond_wait(&ws->ws_not_empty, &ws->ws_lock);
+
+		if (ws->ws_count < ws->ws_frame_records && !ws->ws_closing) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += WU_STREAM_FLUSH_MS * 1000000L;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+
+			while (ws->ws_count < ws->ws_frame_records &&
+			       !ws->ws_closing) {
+				if (pthread_cond_timedwait(&ws->ws_not_empty,
+							   &ws->ws_lock, &ts))
+					break;
+			}
+		}
+
+		if (!ws->ws_count) {
+			pthread_mutex_unlock(&ws->ws_lock);
+			break;
+		}
+
+		n = ws->ws_count;
+		if (n > ws->ws_frame_records)
+			n = ws->ws_frame_records;
+
+		first = ws->ws_queue_records - ws->ws_head;
+		if (first > n)
+			first = n;
+
+		memcpy(recs, &ws->ws_queue[ws->ws_head],
+		       first * sizeof(struct wu_log_record));
+		memcpy(recs + first, ws->ws_queue,
+		       (n - first) * sizeof(struct wu_log_record));
+
+		ws->ws_head = (ws->ws_head + n) % ws->ws_queue_records;
+		ws->ws_count -= n;
+		pthread_cond_broadcast(&ws->ws_not_full);
+
+		pthread_mutex_unlock(&ws->ws_lock);
+
+		memset(frame, 0, sizeof(struct wu_stream_frame));
+		frame->wsf_records = htole32(n);
+
+		ret = send_all(ws->ws_sock, frame, sizeof(*frame) +
+			       n * sizeof(struct wu_log_record));
+
+		pthread_mutex_lock(&ws->ws_lock);
+		if (ret) {
+			ws->ws_error = ret;
+			pthread_cond_broadcast(&ws->ws_not_full);
+		} else
+			ws->ws_sent += n;
+		pthread_mutex_unlock(&ws->ws_lock);
+
+		if (ret)
+			break;
+	}
+
+	free(frame);
+
+	return NULL;
+}
+
+/*
+ * Opens a batched record stream to a wu_sink_receive() listener, serv is
+ * a host name or an IPv4 address, zero queue_records or frame_records
+ * means taking the defaults.
+ */
+int wu_stream_open(struct wu_stream *ws, char *serv, int port,
+		   unsigned int chunksize, unsigned long filesize,
+		   unsigned long queue_records, unsigned long frame_records)
+{
+	int ret;
+	char service[16];
+	struct addrinfo hints, *ai;
+	struct wu_stream_header hdr;
+
+	memset(ws, 0, sizeof(struct wu_stream));
+
+	ws->ws_queue_records = queue_records ? queue_records : WU_STREAM_QUEUE;
+	ws->ws_frame_records = frame_records ? frame_records : WU_STREAM_FRAME;
+	if (ws->ws_frame_records > WU_STREAM_FRAME_MAX)
+		ws->ws_frame_records = WU_STREAM_FRAME_MAX;
+	if (ws->ws_frame_records > ws->ws_queue_records)
+		ws->ws_frame_records = ws->ws_queue_records;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(service, sizeof(service), "%d", port);
+
+	ret = getaddrinfo(serv, service, &hints, &ai);
+	if (ret) {
+		fprintf(stderr, "invalid log sink address %s:%s\n", serv,
+			gai_strerror(ret));
+		ws->ws_sock = -1;
+		return -EINVAL;
+	}
+
+	ws->ws_sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (ws->ws_sock < 0) {
+		ret = errno;
+		fprintf(stderr, "socket failed:%d:%s\n", ret, strerror(ret));
+		freeaddrinfo(ai);
+		return -ret;
+	}
+
+	if (connect(ws->ws_sock, ai->ai_addr, ai->ai_addrlen) < 0) {
+		ret = errno;
+		fprintf(stderr, "connect to %s:%d failed:%d:%s\n", serv, port,
+			ret, strerror(ret));
+		freeaddrinfo(ai);
+		ret = -ret;
+		goto out_close;
+	}
+
+	freeaddrinfo(ai);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.wsh_magic, WU_STREAM_MAGIC, sizeof(WU_STREAM_MAGIC));
+	hdr.wsh_version = htole32(WU_STREAM_VERSION);
+	hdr.wsh_chunksize = htole32(chunksize);
+	hdr.wsh_filesize = htole64(filesize);
+	hdr.wsh_frame_records = htole32(ws->ws_frame_records);
+
+	ret = send_all(ws->ws_sock, &hdr, sizeof(hdr));
+	if (ret)
+		goto out_close;
+
+	ws->ws_queue = (struct wu_log_record *)malloc(ws->ws_queue_records *
+						sizeof(struct wu_log_record));
+	if (!ws->ws_queue) {
+		ret = -ENOMEM;
+		goto out_close;
+	}
+
+	pthread_mutex_init(&ws->ws_lock, NULL);
+	pthread_cond_init(&ws->ws_not_empty, NULL);
+	pthread_cond_init(&ws->ws_not_full, NULL);
+
+	ret = pthread_create(&ws->ws_flusher, NULL, wu_stream_flusher, ws);
+	if (ret) {
+		fprintf(stderr, "failed to create log flusher: %s\n",
+			strerror(ret));
+		ret = -ret;
+		free(ws->ws_queue);
+		goto out_close;
+	}
+
+	return 0;
+
+out_close:
+	close(ws->ws_sock);
+	ws->ws_sock = -1;
+
+	return ret;
+}
+
+int wu_stream_write(struct wu_stream *ws, unsigned long chunk_no,
+		    const struct wu_entry *we)
+{
+	int ret;
+	unsigned long tail;
+
+	pthread_mutex_lock(&ws->ws_lock);
+
+	while (ws->ws_count == ws->ws_queue_records && !ws->ws_error)
+		pthread_cond_wait(&ws->ws_not_full, &ws->ws_lock);
+
+	ret = ws->ws_error;
+	if (!ret) {
+		tail = (ws->ws_head + ws->ws_count) % ws->ws_queue_records;
+		entry_to_log_record(chunk_no, we, &ws->ws_queue[tail]);
+
+		if (++ws->ws_count == 1 ||
+		    ws->ws_count == ws->ws_frame_records)
+			pthread_cond_signal(&ws->ws_not_empty);
+	}
+
+	pthread_mutex_unlock(&ws->ws_lock);
+
+	return ret;
+}
+
+/*
+ * Drains the queue and ends the stream with an empty frame, the sink
+ * treats a connection dropping without one as a failed writer.
+ */
+int wu_stream_close(struct wu_stream *ws)
+{
+	int ret;
+	struct wu_stream_frame frame;
+
+	if (ws->ws_sock < 0)
+		return 0;
+
+	pthread_mutex_lock(&ws->ws_lock);
+	ws->ws_closing = 1;
+	pthread_cond_signal(&ws->ws_not_empty);
+	pthread_mutex_unlock(&ws->ws_lock);
+
+	pthread_join(ws->ws_flusher, NULL);
+
+	ret = ws->ws_error;
+	if (!ret) {
+		memset(&frame, 0, sizeof(frame));
+		ret = send_all(ws->ws_sock, &frame, sizeof(frame));
+	}
+
+	close(ws->ws_sock);
+	ws->ws_sock = -1;
+
+	pthread_cond_destroy(&ws->ws_not_full);
+	pthread_cond_destroy(&ws->ws_not_empty);
+	pthread_mutex_destroy(&ws->ws_lock);
+	free(ws->ws_queue);
+	ws->ws_queue = NULL;
+
+	return ret;
+}
+
+int wu_sink_listen(int port)
+{
+	int sock, ret, on = 1;
+	struct sockaddr_in addr;
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock < 0) {
+		ret = errno;
+		fprintf(stderr, "socket failed:%d:%s\n", ret, strerror(ret));
+		return -ret;
+	}
+
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(sock, SOMAXCONN) < 0) {
+		ret = errno;
+		fprintf(stderr, "failed to listen on port %d:%d:%s\n", port,
+			ret, strerror(ret));
+		close(sock);
+		return -ret;
+	}
+
+	return sock;
+}
+
+static int sink_crash_wait;
+
+/*
+ * Destructive tests crash the writers' box on purpose, their streams
+ * never end. With secs set, a writer hanging up ends its stream, and
+ * once secs seconds pass without a record the writers still waited for
+ * are taken as crashed, the table keeps what they had sent.
+ */
+void set_sink_crash_wait(int secs)
+{
+	sink_crash_wait = secs;
+}
+
+enum wu_sink_state {
+	WU_SINK_HEADER = 0,
+	WU_SINK_FRAME,
+	WU_SINK_RECORDS,
+	WU_SINK_DONE,
+};
+
+struct wu_sink_conn {
+	int sc_fd;
+	int sc_state;
+	size_t sc_want;
+	size_t sc_got;
+	unsigned long sc_frame_records;
+	char *sc_buf;
+};
+
+struct wu_sink {
+	struct wu_table *sk_wt;
+	int sk_ready;
+	unsigned long sk_filesize;
+	unsigned long sk_records;
+};
+
+static int wu_sink_header(struct wu_sink *sk, struct wu_sink_conn *sc)
+{
+	int ret;
+	char *buf;
+	struct wu_stream_header *hdr = (struct wu_stream_header *)sc->sc_buf;
+	unsigned int chunksize = le32toh(hdr->wsh_chunksize);
+	unsigned long filesize = le64toh(hdr->wsh_filesize);
+
+	if (memcmp(hdr->wsh_magic, WU_STREAM_MAGIC, sizeof(WU_STREAM_MAGIC)) ||
+	    le32toh(hdr->wsh_version) != WU_STREAM_VERSION) {
+		fprintf(stderr, "bad write record stream header\n");
+		return -EINVAL;
+	}
+
+	sc->sc_frame_records = le32toh(hdr->wsh_frame_records);
+	if (!chunksize || !sc->sc_frame_records) {
+		fprintf(stderr, "bad write record stream header\n");
+		return -EINVAL;
+	}
+
+	if (sc->sc_frame_records > WU_STREAM_FRAME_MAX) {
+		fprintf(stderr, "write record frames of %lu records exceed "
+			"the maximum %d\n", sc->sc_frame_records,
+			WU_STREAM_FRAME_MAX);
+		return -EINVAL;
+	}
+
+	if (!sk->sk_ready) {
+		ret = verify_table_init(sk->sk_wt, filesize, chunksize);
+		if (ret)
+			return ret;
+		sk->sk_ready = 1;
+		sk->sk_filesize = filesize;
+	} else if (chunksize != sk->sk_wt->wt_chunksize ||
+		   filesize != sk->sk_filesize) {
+		fprintf(stderr, "Writers disagree on chunksize(%u vs %u) or "
+			"filesize(%lu vs %lu).\n", chunksize,
+			sk->sk_wt->wt_chunksize, filesize, sk->sk_filesize);
+		return -EINVAL;
+	}
+
+	/* sc_buf is still freed with the connection if this fails */
+	buf = (char *)realloc(sc->sc_buf, sc->sc_frame_records *
+			      sizeof(struct wu_log_record));
+	if (!buf)
+		return -ENOMEM;
+	sc->sc_buf = buf;
+
+	return 0;
+}
+
+static int wu_sink_records(struct wu_sink *sk, struct wu_sink_conn *sc)
+{
+	int ret;
+	struct wu_entry we;
+	struct wu_log_record *recs = (struct wu_log_record *)sc->sc_buf;
+	unsigned long i, chunk_no;
+	unsigned long n = sc->sc_got / sizeof(struct wu_log_record);
+
+	for (i = 0; i < n; i++) {
+		chunk_no = log_record_to_entry(&recs[i], &we);
+		ret = wu_table_merge_entry(sk->sk_wt, chunk_no, &we);
+		if (ret)
+			return ret;
+	}
+
+	sk->sk_records += n;
+
+	return 0;
+}
+
+/*
+ * Reads what is available on one connection, and steps its state once
+ * the current unit (stream header, frame header or frame records) is
+ * complete, records get merged as soon as their frame lands.
+ */
+static int wu_sink_read(struct wu_sink *sk, struct wu_sink_conn *sc)
+{
+	int ret;
+	ssize_t n;
+	struct wu_stream_frame *frame;
+
+	n = read(sc->sc_fd, sc->sc_buf + sc->sc_got, sc->sc_want - sc->sc_got);
+	if (n < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			return 0;
+		if (errno == ECONNRESET && sink_crash_wait)
+			goto crashed;
+		ret = errno;
+		fprintf(stderr, "read from log stream failed:%d:%s\n", ret,
+			strerror(ret));
+		return -ret;
+	}
+
+	if (!n) {
+		if (sink_crash_wait)
+			goto crashed;
+		fprintf(stderr, "writer hung up before ending its write record"
+			" stream.\n");
+		return -EPIPE;
+	}
+
+	sc->sc_got += n;
+	if (sc->sc_got < sc->sc_want)
+		return 0;
+
+	switch (sc->sc_state) {
+	case WU_SINK_HEADER:
+		ret = wu_sink_header(sk, sc);
+		if (ret)
+			return ret;
+		sc->sc_state = WU_SINK_FRAME;
+		sc->sc_want = sizeof(struct wu_stream_frame);
+		break;
+	case WU_SINK_FRAME:
+		frame = (struct wu_stream_frame *)sc->sc_buf;
+		sc->sc_want = le32toh(frame->wsf_records);
+		if (!sc->sc_want) {
+			sc->sc_state = WU_SINK_DONE;
+			break;
+		}
+		if (sc->sc_want > sc->sc_frame_records) {
+			fprintf(stderr, "write record frame of %lu records "
+				"exceeds the announced %lu\n",
+				(unsigned long)sc->sc_want,
+				sc->sc_frame_records);
+			return -EINVAL;
+		}
+		sc->sc_state = WU_SINK_RECORDS;
+		sc->sc_want *= sizeof(struct wu_log_record);
+		break;
+	case WU_SINK_RECORDS:
+		ret = wu_sink_records(sk, sc);
+		if (ret)
+			return ret;
+		sc->sc_state = WU_SINK_FRAME;
+		sc->sc_want = sizeof(struct wu_stream_frame);
+		break;
+	}
+
+	sc->sc_got = 0;
+
+	return 0;
+
+crashed:
+	fprintf(stdout, "writer hung up, taking it as crashed.\n");
+	sc->sc_state = WU_SINK_DONE;
+
+	return 0;
+}
+
+/*
+ * Accepts nr_senders write record streams on lsn_sock and merges them
+ * into a latest-writer table as frames arrive, so the table is ready
+ * to verify once the last stream ends. The table is sized from the
+ * stream headers, the caller frees it with wu_table_free() on success.
+ */
+int wu_sink_receive(int lsn_sock, int nr_senders, struct wu_table *wt,
+		    unsigned long *nr_records)
+{
+	int ret = 0, i, nr_conns = 0, nr_done = 0, nr_fds, timeout;
+	struct wu_sink sk;
+	struct wu_sink_conn *conns;
+	struct pollfd *pfds;
+
+	memset(&sk, 0, sizeof(sk));
+	sk.sk_wt = wt;
+
+	conns = (struct wu_sink_conn *)calloc(nr_senders,
+					       sizeof(struct wu_sink_conn));
+	pfds = (struct pollfd *)calloc(nr_senders + 1, sizeof(struct pollfd));
+	if (!conns || !pfds) {
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	while (nr_done < nr_senders) {
+		nr_fds = 0;
+		for (i = 0; i < nr_conns; i++) {
+			pfds[nr_fds].fd = conns[i].sc_state == WU_SINK_DONE ?
+					  -1 : conns[i].sc_fd;
+			pfds[nr_fds++].events = POLLIN;
+		}
+
+		if (nr_conns < nr_senders) {
+			pfds[nr_fds].fd = lsn_sock;
+			pfds[nr_fds++].events = POLLIN;
+		}
+
+		timeout = -1;
+		if (sink_crash_wait && nr_conns)
+			timeout = sink_crash_wait * 1000;
+
+		ret = poll(pfds, nr_fds, timeout);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			goto bail;
+		}
+
+		if (!ret) {
+			fprintf(stdout, "No write records for %d seconds, "
+				"taking %d writers as crashed.\n",
+				sink_crash_wait, nr_senders - nr_done);
+			break;
+		}
+
+		ret = 0;
+
+		for (i = 0; i < nr_conns; i++) {
+			if (!pfds[i].revents)
+				continue;
+
+			ret = wu_sink_read(&sk, &conns[i]);
+			if (ret)
+				goto bail;
+
+			if (conns[i].sc_state == WU_SINK_DONE) {
+				close(conns[i].sc_fd);
+				nr_done++;
+			}
+		}
+
+		if (nr_conns < nr_senders && pfds[nr_conns].revents) {
+			conns[nr_conns].sc_fd = accept(lsn_sock, NULL, NULL);
+			if (conns[nr_conns].sc_fd < 0) {
+				ret = errno;
+				fprintf(stderr, "accept failed:%d:%s\n", ret,
+					strerror(ret));
+				ret = -ret;
+				goto bail;
+			}
+
+			conns[nr_conns].sc_state = WU_SINK_HEADER;
+			conns[nr_conns].sc_want =
+					sizeof(struct wu_stream_header);
+			conns[nr_conns].sc_buf =
+				(char *)malloc(sizeof(struct wu_stream_header));
+			nr_conns++;
+			if (!conns[nr_conns - 1].sc_buf) {
+				ret = -ENOMEM;
+				goto bail;
+			}
+		}
+	}
+
+	if (!sk.sk_ready) {
+		fprintf(stderr, "no writer got its write record stream "
+			"going.\n");
+		ret = -ENODATA;
+		goto bail;
+	}
+
+	if (nr_records)
+		*nr_records = sk.sk_records;
+
+bail:
+	if (conns) {
+		for (i = 0; i < nr_conns; i++) {
+			if (conns[i].sc_state != WU_SINK_DONE)
+				close(conns[i].sc_fd);
+			free(conns[i].sc_buf);
+		}
+		free(conns);
+	}
+
+	if (pfds)
+		free(pfds);
+
+	if (ret && sk.sk_ready)
+		wu_table_free(wt);
+
+	return ret;
+}
@@ -0,0 +1,145 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * wu_stream.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef WU_STREAM_H
+#define WU_STREAM_H
+
+#include <inttypes.h>
+#include <pthread.h>
+
+/*
+ * Latest-writer table, one packed 16-byte entry per recorded chunk, the
+ * chunk number being implied by the slot (dense and spill) or kept in
+ * the hash slot (sparse). A zero timestamp means no record.
+ */
+enum wu_table_mode {
+	WU_TABLE_DENSE = 0,	/* flat array in anonymous memory */
+	WU_TABLE_SPARSE,	/* open addressing hash of recorded chunks */
+	WU_TABLE_SPILL,		/* flat array in an unlinked mmap'ed file */
+};
+
+#define WU_TABLE_HASH_MIN	1024
+
+struct wu_entry {
+	uint64_t we_timestamp;
+	uint32_t we_checksum;
+	char we_char;
+	uint8_t we_pad[3];
+};
+
+struct wu_hash_slot {
+	uint64_t ws_key;	/* chunk_no + 1, zero for empty */
+	struct wu_entry ws_entry;
+};
+
+struct wu_table {
+	int wt_mode;
+	int wt_fd;
+	unsigned int wt_chunksize;
+	unsigned long wt_num_chunks;
+	unsigned long wt_used;
+	size_t wt_bytes;
+	struct wu_entry *wt_entries;
+	struct wu_hash_slot *wt_slots;
+	unsigned long wt_nr_slots;
+};
+
+/*
+ * One write record as the binary write log and the record stream carry
+ * it, all fields little endian.
+ */
+struct wu_log_record {
+	uint64_t wlr_chunk_no;
+	uint64_t wlr_timestamp;
+	uint32_t wlr_checksum;
+	uint8_t wlr_char;
+	uint8_t wlr_pad[3];
+};
+
+/*
+ * Streamed write records for remote verification, a stream header is
+ * followed by frames, each a record count and that many wu_log_records.
+ * A frame with no records ends the stream.
+ */
+#define WU_STREAM_MAGIC		"O2WUSTR"
+#define WU_STREAM_VERSION	1
+#define WU_STREAM_QUEUE		65536
+#define WU_STREAM_FRAME		4096
+#define WU_STREAM_FRAME_MAX	65536	/* what a sink accepts */
+#define WU_STREAM_FLUSH_MS	10
+
+/*
+ * Seconds of silence after which a sink set up for destructive tests
+ * takes the writers it still waits for as crashed.
+ */
+#define WU_SINK_CRASH_WAIT	30
+
+struct wu_stream_header {
+	char wsh_magic[8];
+	uint32_t wsh_version;
+	uint32_t wsh_chunksize;
+	uint64_t wsh_filesize;
+	uint32_t wsh_frame_records;
+	uint32_t wsh_pad;
+};
+
+struct wu_stream_frame {
+	uint32_t wsf_records;
+	uint32_t wsf_pad;
+};
+
+struct wu_stream {
+	int ws_sock;
+	int ws_closing;
+	int ws_error;
+	unsigned long ws_queue_records;
+	unsigned long ws_frame_records;
+	unsigned long ws_head;
+	unsigned long ws_count;
+	unsigned long ws_sent;
+	struct wu_log_record *ws_queue;
+	pthread_t ws_flusher;
+	pthread_mutex_t ws_lock;
+	pthread_cond_t ws_not_empty;
+	pthread_cond_t ws_not_full;
+};
+
+int wu_table_init(struct wu_table *wt, int mode, unsigned long num_chunks,
+		  unsigned int chunksize, const char *spill_dir);
+void wu_table_free(struct wu_table *wt);
+int wu_table_merge_entry(struct wu_table *wt, unsigned long chunk_no,
+			 const struct wu_entry *we);
+int wu_table_lookup_entry(struct wu_table *wt, unsigned long chunk_no,
+			  struct wu_entry *we);
+const char *wu_table_mode_name(int mode);
+int wu_table_parse_mode(const char *name);
+void set_verify_table(int mode, const char *spill_dir);
+int verify_table_init(struct wu_table *wt, unsigned long filesize,
+		      unsigned int chunksize);
+
+int wu_stream_open(struct wu_stream *ws, char *serv, int port,
+		   unsigned int chunksize, unsigned long filesize,
+		   unsigned long queue_records, unsigned long frame_records);
+int wu_stream_write(struct wu_stream *ws, unsigned long chunk_no,
+		    const struct wu_entry *we);
+int wu_stream_close(struct wu_stream *ws);
+int wu_sink_listen(int port);
+void set_sink_crash_wait(int secs);
+int wu_sink_receive(int lsn_sock, int nr_senders, struct wu_table *wt,
+		    unsigned long *nr_records);
+
+#endif
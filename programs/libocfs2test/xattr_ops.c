@@ -50,8 +50,6 @@ void xattr_name_generator(unsigned long xattr_no,
 	 * followed by a series of random characters(A-Z,a-z,0-9).
 	*/
 	unsigned int i;
-	unsigned int seed;
-	char random_ch = 'A';
 	char postfix[7];
 	char xattr_namespace_prefix[10];
 
@@ -78,31 +76,12 @@ void xattr_name_generator(unsigned long xattr_no,
 		break;
 	}
 
-	seed = time(NULL) ^ xattr_no ^ getpid();
-	srandom(seed);
-
-	xattr_name_rsz = random() % (to - from + 1) + from;
+	xattr_name_rsz = get_rand(from, to);
 	memset(xattr_name_list_set[xattr_no], 0, xattr_name_sz + 1);
 
-	for (i = strlen(xattr_name); i < xattr_name_rsz - 6; i++) {
-		switch (i % 3) {
-		case 0:
-			random_ch = (xattr_no + random() + time(NULL)) % 9 + 48;
-			break;
-		case 1:
-			random_ch = (xattr_no + random() + time(NULL)) % 26 +
-				     65;
-			break;
-		case 2:
-			random_ch = (xattr_no + random() + time(NULL)) % 26 +
-				     97;
-			break;
-		default:
-			break;
-		}
-
-		xattr_name[i] = random_ch;
-	}
+	i = strlen(xattr_name);
+	if (xattr_name_rsz - 6 > i)
+		get_rand_alnum(xattr_name + i, xattr_name_rsz - 6 - i);
 
 	xattr_name[xattr_name_rsz - 6] = 0;
 	snprintf(postfix, 7, "%06ld", xattr_no);
@@ -117,34 +96,10 @@ void xattr_value_generator(int xattr_no, unsigned long from,
 	 * Generate a xattr value string with a series of random
 	 * characters(A-Z,a-z,0-9),also with a random length.
 	*/
-	unsigned long i;
-	char random_ch;
-	unsigned int seed;
 	unsigned long xattr_value_rsz;
 
-	seed = time(NULL) ^ xattr_no ^ getpid();
-	srandom(seed);
-
-	xattr_value_rsz = random() % (to - from + 1) + from;
-
-	for (i = 0; i < xattr_value_rsz - 1; i++) {
-		switch (i % 3) {
-		case 0:
-			random_ch = (random() + xattr_no) % 9 + 48;
-			break;
-		case 1:
-			random_ch = (random() + xattr_no) % 26 + 65;
-			break;
-		case 2:
-			random_ch = (random() + xattr_no)  % 26 + 97;
-			break;
-		default:
-			break;
-		}
-
-		xattr_value[i] = random_ch;
-	}
-
+	xattr_value_rsz = get_rand(from, to);
+	get_rand_alnum(xattr_value, xattr_value_rsz - 1);
 	xattr_value[xattr_value_rsz - 1] = 0;
 }
 
@@ -34,6 +34,8 @@
 #include <signal.h>
 #include <time.h>
 
+#include "rand_ops.h"
+
 #define MAX_FILENAME_SZ         255
 #define DEFAULT_XATTR_NUMS      10
 
@@ -0,0 +1,734 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * group_commit.c
+ *
+ * The group commit log benchmark behind logwriter -g and
+ * multi_logwriter.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "op_lat.h"
+#include "group_commit.h"
+
+#define GC_DEFAULT_APPENDERS	4
+#define GC_DEFAULT_REC_SIZE	128
+#define GC_DEFAULT_SECS		10
+#define GC_MAX_BATCH		1024
+
+/* "node appender seq " heads every record, a newline ends it */
+#define GC_HDR_FMT		"%08x %08x %016llx "
+#define GC_HDR_LEN		35
+#define GC_MIN_REC_SIZE		64
+
+#define GC_VERIFY_RECS		1024
+
+#define NSEC_PER_SEC		1000000000ULL
+
+static const char *gc_sync_names[GC_SYNC_NUM] = {
+	[GC_SYNC_FDATASYNC]	= "fdatasync",
+	[GC_SYNC_FSYNC]		= "fsync",
+	[GC_SYNC_ODSYNC]	= "dsync",
+	[GC_SYNC_RWF_DSYNC]	= "rwf_dsync",
+};
+
+/*
+ * gg_written counts the batches whose write has returned, so a sync
+ * started once gg_written is read covers them all. gg_synced is how
+ * many the last finished sync covered.
+ */
+struct gc_group {
+	pthread_mutex_t		gg_lock;
+	pthread_cond_t		gg_cond;
+	unsigned long long	gg_written;
+	unsigned long long	gg_synced;
+	int			gg_syncing;
+	int			gg_ret;
+};
+
+struct gc_appender {
+	pthread_t		ga_thread;
+	pid_t			ga_pid;
+	struct gc_opts		*ga_opts;
+	struct gc_group		*ga_group;
+	unsigned int		ga_node;
+	unsigned int		ga_id;
+	unsigned long long	ga_end;		/* nsecs, unused with go_commits */
+	int			ga_ret;
+	struct gc_result	ga_res;
+};
+
+static unsigned long long now_nsecs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void gc_usage(const char *prog)
+{
+	printf("usage: %s [-a <appenders>] [-P] [-b <batch>] "
+	       "[-r <record size>] [-m <sync>] [-G [-w <usecs>]] "
+	       "[-s <secs> | -n <commits>] [--seed seed] <logfile>\n\n"
+	       "Group commit mode. Every appender appends <batch> records\n"
+	       "to <logfile> with one write and waits for them to be durable\n"
+	       "before appending the next batch. Commits/sec and commit\n"
+	       "latency percentiles are reported, the log is checked for\n"
+	       "lost, doubled or torn records at the end.\n\n"
+	       "-a <appenders>\tConcurrent appenders, default %d\n"
+	       "-P\t\tAppenders are processes rather than threads\n"
+	       "-b <batch>\tRecords per commit, default 1, at most %d\n"
+	       "-r <size>\tRecord size in bytes, default %d, at least %d\n"
+	       "-m <sync>\tHow a commit is made durable: \"fdatasync\"\n"
+	       "\t\t(default) or \"fsync\" after the write, \"dsync\" opens\n"
+	       "\t\tthe log O_DSYNC and \"rwf_dsync\" writes with\n"
+	       "\t\tpwritev2(RWF_DSYNC)\n"
+	       "-G\t\tThreads share their syncs, one syncs for all the\n"
+	       "\t\tcommits written so far while the others wait on it.\n"
+	       "\t\tfdatasync or fsync only\n"
+	       "-w <usecs>\tHow long a -G sync leader waits for more commits\n"
+	       "\t\tto come in before it syncs, default 0\n"
+	       "-s <secs>\tRun for <secs> seconds, default %d\n"
+	       "-n <commits>\tRun for <commits> commits per appender\n",
+	       prog, GC_DEFAULT_APPENDERS, GC_MAX_BATCH, GC_DEFAULT_REC_SIZE,
+	       GC_MIN_REC_SIZE, GC_DEFAULT_SECS);
+}
+
+static int gc_parse_sync(const char *arg)
+{
+	int i;
+
+	for (i = 0; i < GC_SYNC_NUM; i++) {
+		if (!strcmp(arg, gc_sync_names[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+int gc_parse_opts(int argc, char **argv, struct gc_opts *go)
+{
+	int c;
+
+	memset(go, 0, sizeof(*go));
+	go->go_appenders = GC_DEFAULT_APPENDERS;
+	go->go_batch = 1;
+	go->go_rec_size = GC_DEFAULT_REC_SIZE;
+	go->go_sync = GC_SYNC_FDATASYNC;
+	go->go_secs = GC_DEFAULT_SECS;
+
+	while (1) {
+		c = getopt(argc, argv, "ga:Pb:r:m:Gw:s:n:");
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'g':
+			break;
+		case 'a':
+			go->go_appenders = atoi(optarg);
+			break;
+		case 'P':
+			go->go_procs = 1;
+			break;
+		case 'b':
+			go->go_batch = atoi(optarg);
+			break;
+		case 'r':
+			go->go_rec_size = atoi(optarg);
+			break;
+		case 'm':
+			go->go_sync = gc_parse_sync(optarg);
+			if (go->go_sync < 0) {
+				fprintf(stderr, "Unknown sync mode \"%s\"\n",
+					optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'G':
+			go->go_group = 1;
+			break;
+		case 'w':
+			go->go_delay = atoi(optarg);
+			break;
+		case 's':
+			go->go_secs = atoi(optarg);
+			break;
+		case 'n':
+			go->go_commits = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	if (argc - optind != 1)
+		return -EINVAL;
+
+	go->go_file = argv[optind];
+
+	if (!go->go_appenders || !go->go_batch ||
+	    go->go_batch > GC_MAX_BATCH) {
+		fprintf(stderr, "Need at least one appender and a batch of "
+			"1 to %d records\n", GC_MAX_BATCH);
+		return -EINVAL;
+	}
+
+	if (go->go_rec_size < GC_MIN_REC_SIZE) {
+		fprintf(stderr, "Records must be at least %d bytes\n",
+			GC_MIN_REC_SIZE);
+		return -EINVAL;
+	}
+
+	if (!go->go_commits && !go->go_secs) {
+		fprintf(stderr, "Need a run time or a number of commits\n");
+		return -EINVAL;
+	}
+
+	if (go->go_group && (go->go_procs ||
+			     (go->go_sync != GC_SYNC_FDATASYNC &&
+			      go->go_sync != GC_SYNC_FSYNC))) {
+		fprintf(stderr, "-G needs threads and fdatasync or fsync\n");
+		return -EINVAL;
+	}
+
+#ifndef RWF_DSYNC
+	if (go->go_sync == GC_SYNC_RWF_DSYNC) {
+		fprintf(stderr, "This build has no pwritev2(RWF_DSYNC)\n");
+		return -EINVAL;
+	}
+#endif
+
+	return 0;
+}
+
+int gc_prepare(struct gc_opts *go)
+{
+	int fd, ret;
+
+	fd = open(go->go_file, O_WRONLY|O_CREAT|O_TRUNC,
+		  S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (fd < 0) {
+		ret = errno;
+		fprintf(stderr, "open file %s failed:%d:%s\n", go->go_file,
+			ret, strerror(ret));
+		return -ret;
+	}
+
+	close(fd);
+
+	return 0;
+}
+
+static int gc_sync_fd(struct gc_opts *go, int fd)
+{
+	int ret;
+
+	if (go->go_sync == GC_SYNC_FSYNC)
+		ret = timed_fsync(fd);
+	else
+		ret = timed_fdatasync(fd);
+	if (ret) {
+		ret = errno;
+		fprintf(stderr, "%s error %d: \"%s\"\n",
+			gc_sync_names[go->go_sync], ret, strerror(ret));
+		return -ret;
+	}
+
+	return 0;
+}
+
+/* waits until a sync started after our write has finished */
+static int gc_group_sync(struct gc_appender *ga, int fd)
+{
+	struct gc_group *gg = ga->ga_group;
+	unsigned long long mine, upto;
+	int ret = 0;
+
+	pthread_mutex_lock(&gg->gg_lock);
+	mine = ++gg->gg_written;
+
+	while (gg->gg_synced < mine && !gg->gg_ret) {
+		if (gg->gg_syncing) {
+			pthread_cond_wait(&gg->gg_cond, &gg->gg_lock);
+			continue;
+		}
+
+		gg->gg_syncing = 1;
+		pthread_mutex_unlock(&gg->gg_lock);
+
+		if (ga->ga_opts->go_delay)
+			usleep(ga->ga_opts->go_delay);
+
+		pthread_mutex_lock(&gg->gg_lock);
+		upto = gg->gg_written;
+		pthread_mutex_unlock(&gg->gg_lock);
+
+		ret = gc_sync_fd(ga->ga_opts, fd);
+		ga->ga_res.gr_syncs++;
+
+		pthread_mutex_lock(&gg->gg_lock);
+		if (ret)
+			gg->gg_ret = ret;
+		else
+			gg->gg_synced = upto;
+		gg->gg_syncing = 0;
+		pthread_cond_broadcast(&gg->gg_cond);
+	}
+
+	ret = gg->gg_ret;
+	pthread_mutex_unlock(&gg->gg_lock);
+
+	return ret;
+}
+
+static int gc_commit(struct gc_appender *ga, int fd, char *buf, size_t len)
+{
+	struct gc_opts *go = ga->ga_opts;
+	ssize_t ret;
+
+	if (go->go_sync == GC_SYNC_RWF_DSYNC) {
+#ifdef RWF_DSYNC
+		struct iovec iov = { buf, len };
+		unsigned long long start = op_lat_start();
+
+		/* -1 is the file position, O_APPEND takes care of it */
+		ret = pwritev2(fd, &iov, 1, -1, RWF_DSYNC);
+		op_lat_end(OP_LAT_WRITE, start);
+#else
+		ret = -1;
+		errno = ENOSYS;
+#endif
+	} else
+		ret = timed_write(fd, buf, len);
+
+	if (ret < 0) {
+		ret = errno;
+		fprintf(stderr, "write error %d: \"%s\"\n", (int)ret,
+			strerror(ret));
+		return -ret;
+	}
+
+	/* a record split over two writes can't be told from a torn one */
+	if (ret != len) {
+		fprintf(stderr, "short write, wanted %lu, wrote %ld\n",
+			(unsigned long)len, (long)ret);
+		return -EIO;
+	}
+
+	if (go->go_sync == GC_SYNC_ODSYNC || go->go_sync == GC_SYNC_RWF_DSYNC) {
+		ga->ga_res.gr_syncs++;
+		return 0;
+	}
+
+	if (go->go_group)
+		return gc_group_sync(ga, fd);
+
+	ga->ga_res.gr_syncs++;
+
+	return gc_sync_fd(go, fd);
+}
+
+static void gc_stamp(char *rec, unsigned int node, unsigned int id,
+		     unsigned long long seq)
+{
+	char hdr[GC_HDR_LEN + 1];
+
+	snprintf(hdr, sizeof(hdr), GC_HDR_FMT, node, id, seq);
+	memcpy(rec, hdr, GC_HDR_LEN);
+}
+
+static char gc_fill_char(unsigned int id)
+{
+	return 'a' + id % 26;
+}
+
+static int gc_append(struct gc_appender *ga)
+{
+	struct gc_opts *go = ga->ga_opts;
+	struct gc_result *res = &ga->ga_res;
+	unsigned long long seq = 0, start, begin;
+	size_t len = (size_t)go->go_batch * go->go_rec_size;
+	unsigned int i;
+	int fd, flags = O_WRONLY|O_APPEND, ret = 0;
+	char *buf;
+
+	lat_hist_init(&res->gr_lat);
+
+	if (go->go_sync == GC_SYNC_ODSYNC)
+		flags |= O_DSYNC;
+
+	buf = (char *)malloc(len);
+	if (!buf) {
+		fprintf(stderr, "Not enough memory for a batch of %lu "
+			"bytes\n", (unsigned long)len);
+		return -ENOMEM;
+	}
+
+	memset(buf, gc_fill_char(ga->ga_id), len);
+	for (i = 0; i < go->go_batch; i++)
+		buf[(i + 1) * go->go_rec_size - 1] = '\n';
+
+	fd = timed_open(go->go_file, flags, 0);
+	if (fd < 0) {
+		ret = errno;
+		fprintf(stderr, "open file %s failed:%d:%s\n", go->go_file,
+			ret, strerror(ret));
+		free(buf);
+		return -ret;
+	}
+
+	begin = now_nsecs();
+
+	while (1) {
+		if (go->go_commits) {
+			if (res->gr_commits >= go->go_commits)
+				break;
+		} else if (now_nsecs() >= ga->ga_end)
+			break;
+
+		for (i = 0; i < go->go_batch; i++)
+			gc_stamp(buf + i * go->go_rec_size, ga->ga_node,
+				 ga->ga_id, seq++);
+
+		start = now_nsecs();
+		ret = gc_commit(ga, fd, buf, len);
+		if (ret)
+			break;
+
+		lat_hist_record(&res->gr_lat, (now_nsecs() - start) / 1000);
+		res->gr_commits++;
+		res->gr_records += go->go_batch;
+	}
+
+	res->gr_secs = (now_nsecs() - begin) / (double)NSEC_PER_SEC;
+
+	close(fd);
+	free(buf);
+
+	return ret;
+}
+
+static void *gc_appender_thread(void *arg)
+{
+	struct gc_appender *ga = (struct gc_appender *)arg;
+
+	ga->ga_ret = gc_append(ga);
+
+	return NULL;
+}
+
+/* the appenders of a process run are shared with their parent */
+static struct gc_appender *gc_alloc_appenders(struct gc_opts *go)
+{
+	size_t size = sizeof(struct gc_appender) * go->go_appenders;
+	void *p;
+
+	if (!go->go_procs)
+		return (struct gc_appender *)calloc(1, size);
+
+	p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+		 -1, 0);
+
+	return p == MAP_FAILED ? NULL : (struct gc_appender *)p;
+}
+
+static void gc_free_appenders(struct gc_opts *go, struct gc_appender *ga)
+{
+	if (go->go_procs)
+		munmap(ga, sizeof(struct gc_appender) * go->go_appenders);
+	else
+		free(ga);
+}
+
+static int gc_start(struct gc_appender *ga)
+{
+	pid_t pid;
+	int ret;
+
+	if (!ga->ga_opts->go_procs) {
+		ret = pthread_create(&ga->ga_thread, NULL, gc_appender_thread,
+				     ga);
+		if (ret)
+			fprintf(stderr, "could not start thread: %d\n", ret);
+		return -ret;
+	}
+
+	/* ga is shared, only the parent may fill in the pid */
+	pid = fork();
+	if (pid < 0) {
+		ret = errno;
+		fprintf(stderr, "fork error %d: \"%s\"\n", ret, strerror(ret));
+		return -ret;
+	}
+
+	if (!pid) {
+		ga->ga_ret = gc_append(ga);
+		/* keep clear of the parent's atexit handlers, MPI's too */
+		if (op_lat_on)
+			op_lat_dump(stderr);
+		_exit(ga->ga_ret ? 1 : 0);
+	}
+
+	ga->ga_pid = pid;
+
+	return 0;
+}
+
+static void gc_wait(struct gc_appender *ga)
+{
+	int status;
+
+	if (!ga->ga_opts->go_procs) {
+		pthread_join(ga->ga_thread, NULL);
+		return;
+	}
+
+	if (waitpid(ga->ga_pid, &status, 0) < 0 ||
+	    !WIFEXITED(status) || WEXITSTATUS(status)) {
+		if (!ga->ga_ret)
+			ga->ga_ret = -ECHILD;
+	}
+}
+
+int gc_run(struct gc_opts *go, unsigned int node, struct gc_result *res)
+{
+	struct gc_appender *appenders, *ga;
+	struct gc_group group;
+	unsigned long long begin, end = 0;
+	unsigned int i, started;
+	int ret = 0;
+
+	memset(res, 0, sizeof(*res));
+	lat_hist_init(&res->gr_lat);
+
+	appenders = gc_alloc_appenders(go);
+	if (!appenders) {
+		fprintf(stderr, "Not enough memory for %u appenders\n",
+			go->go_appenders);
+		return -ENOMEM;
+	}
+
+	memset(&group, 0, sizeof(group));
+	pthread_mutex_init(&group.gg_lock, NULL);
+	pthread_cond_init(&group.gg_cond, NULL);
+
+	/* nothing of ours should come out twice from the children */
+	fflush(stdout);
+	fflush(stderr);
+
+	begin = now_nsecs();
+	if (!go->go_commits)
+		end = begin + go->go_secs * NSEC_PER_SEC;
+
+	for (started = 0; started < go->go_appenders; started++) {
+		ga = &appenders[started];
+		ga->ga_opts = go;
+		ga->ga_group = go->go_group ? &group : NULL;
+		ga->ga_node = node;
+		ga->ga_id = started;
+		ga->ga_end = end;
+
+		ret = gc_start(ga);
+		if (ret)
+			break;
+	}
+
+	for (i = 0; i < started; i++) {
+		ga = &appenders[i];
+		gc_wait(ga);
+
+		if (ga->ga_ret && !ret) {
+			ret = ga->ga_ret;
+			fprintf(stderr, "Appender %u failed with %d\n", i, ret);
+		}
+
+		res->gr_commits += ga->ga_res.gr_commits;
+		res->gr_records += ga->ga_res.gr_records;
+		res->gr_syncs += ga->ga_res.gr_syncs;
+		lat_hist_merge(&res->gr_lat, &ga->ga_res.gr_lat);
+	}
+
+	res->gr_secs = (now_nsecs() - begin) / (double)NSEC_PER_SEC;
+
+	pthread_mutex_destroy(&group.gg_lock);
+	pthread_cond_destroy(&group.gg_cond);
+	gc_free_appenders(go, appenders);
+
+	return ret;
+}
+
+static int gc_check_record(struct gc_opts *go, const char *rec,
+			   unsigned long long *next, unsigned int nr_nodes,
+			   unsigned long long off)
+{
+	char hdr[GC_HDR_LEN + 1];
+	unsigned int node, id, i;
+	unsigned long long seq, *expect;
+	char fill;
+
+	memcpy(hdr, rec, GC_HDR_LEN);
+	hdr[GC_HDR_LEN] = '\0';
+
+	if (sscanf(hdr, "%8x %8x %16llx", &node, &id, &seq) != 3 ||
+	    node >= nr_nodes || id >= go->go_appenders ||
+	    rec[go->go_rec_size - 1] != '\n') {
+		fprintf(stderr, "Garbled record at offset %llu\n", off);
+		return -EIO;
+	}
+
+	fill = gc_fill_char(id);
+	for (i = GC_HDR_LEN; i < go->go_rec_size - 1; i++) {
+		if (rec[i] != fill) {
+			fprintf(stderr, "Torn record at offset %llu, byte %u "
+				"is 0x%x\n", off, i, (unsigned char)rec[i]);
+			return -EIO;
+		}
+	}
+
+	expect = &next[node * go->go_appenders + id];
+	if (seq != *expect) {
+		fprintf(stderr, "Record at offset %llu is seq %llu of node %u "
+			"appender %u, expected seq %llu\n", off, seq, node, id,
+			*expect);
+		return -EIO;
+	}
+	(*expect)++;
+
+	return 0;
+}
+
+/*
+ * Every appender's records have to come back in order with none
+ * missing, and there must be as many as the runs reported committed.
+ */
+int gc_verify(struct gc_opts *go, unsigned int nr_nodes,
+	      unsigned long long records)
+{
+	unsigned long long *next, off = 0, seen = 0;
+	size_t chunk = (size_t)GC_VERIFY_RECS * go->go_rec_size, have, i;
+	ssize_t got;
+	char *buf;
+	int fd, ret = 0;
+
+	next = (unsigned long long *)calloc((size_t)nr_nodes *
+					    go->go_appenders,
+					    sizeof(unsigned long long));
+	buf = (char *)malloc(chunk);
+	if (!next || !buf) {
+		fprintf(stderr, "Not enough memory to verify the log\n");
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	fd = timed_open(go->go_file, O_RDONLY, 0);
+	if (fd < 0) {
+		ret = errno;
+		fprintf(stderr, "open file %s failed:%d:%s\n", go->go_file,
+			ret, strerror(ret));
+		ret = -ret;
+		goto out;
+	}
+
+	while (!ret) {
+		have = 0;
+		while (have < chunk) {
+			got = timed_pread(fd, buf + have, chunk - have,
+					  off + have);
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got < 0) {
+				ret = errno;
+				fprintf(stderr, "read error %d: \"%s\"\n", ret,
+					strerror(ret));
+				ret = -ret;
+				break;
+			}
+			if (!got)
+				break;
+			have += got;
+		}
+		if (ret || !have)
+			break;
+
+		if (have % go->go_rec_size) {
+			fprintf(stderr, "Log ends in a partial record at "
+				"offset %llu\n",
+				off + have - have % go->go_rec_size);
+			ret = -EIO;
+			break;
+		}
+
+		for (i = 0; i < have && !ret; i += go->go_rec_size)
+			ret = gc_check_record(go, buf + i, next, nr_nodes,
+					      off + i);
+
+		seen += have / go->go_rec_size;
+		off += have;
+	}
+
+	close(fd);
+
+	if (!ret && seen != records) {
+		fprintf(stderr, "Log holds %llu records, %llu were committed\n",
+			seen, records);
+		ret = -EIO;
+	}
+
+out:
+	free(buf);
+	free(next);
+
+	return ret;
+}
+
+void gc_report(struct gc_opts *go, const char *who, struct gc_result *res)
+{
+	struct lat_hist *lh = &res->gr_lat;
+	double secs = res->gr_secs > 0 ? res->gr_secs : 1;
+
+	printf("%s: %u %s per node, %s%s, %u x %u byte records per "
+	       "commit\n", who, go->go_appenders,
+	       go->go_procs ? "processes" : "threads",
+	       gc_sync_names[go->go_sync], go->go_group ? " group commit" : "",
+	       go->go_batch, go->go_rec_size);
+	printf("%s: %llu commits, %llu syncs in %.3f secs, %.1f commits/sec, "
+	       "%.1f records/sec, %.2f MB/sec, %.2f commits per sync\n", who,
+	       res->gr_commits, res->gr_syncs, res->gr_secs,
+	       res->gr_commits / secs, res->gr_records / secs,
+	       res->gr_records * go->go_rec_size / secs / (1024 * 1024),
+	       res->gr_syncs ? res->gr_commits / (double)res->gr_syncs : 0.0);
+	printf("%s: commit latency usecs: count %"PRIu64", min %"PRIu64
+	       ", mean %.1f, p50 %"PRIu64", p99 %"PRIu64", p999 %"PRIu64
+	       ", max %"PRIu64"\n", who, lh->lh_count,
+	       lh->lh_count ? lh->lh_min : 0, lat_hist_mean(lh),
+	       lat_hist_percentile(lh, 50.0), lat_hist_percentile(lh, 99.0),
+	       lat_hist_percentile(lh, 99.9), lh->lh_max);
+}
@@ -0,0 +1,72 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * group_commit.h
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef GROUP_COMMIT_H
+#define GROUP_COMMIT_H
+
+#include "lat_hist.h"
+
+/*
+ * A log shipper's commit loop: every appender appends a batch of fixed
+ * size records to the one log with a single write and waits for it to
+ * be durable before the next. How it waits is the sync mode. With -G
+ * the threads of a node share their fdatasync()s, whoever finds none
+ * running syncs for everyone written so far and the rest wait on it,
+ * otherwise it is left to the file system to batch the commits up in
+ * its journal.
+ *
+ * Every record carries its node, appender and sequence number so the
+ * log can be checked afterwards for lost, doubled or torn records.
+ */
+enum gc_sync {
+	GC_SYNC_FDATASYNC = 0,
+	GC_SYNC_FSYNC,
+	GC_SYNC_ODSYNC,
+	GC_SYNC_RWF_DSYNC,
+	GC_SYNC_NUM,
+};
+
+struct gc_opts {
+	char		*go_file;
+	unsigned int	go_appenders;
+	int		go_procs;	/* fork appenders, not threads */
+	unsigned int	go_batch;	/* records per commit */
+	unsigned int	go_rec_size;
+	int		go_sync;
+	int		go_group;	/* share fdatasyncs between threads */
+	unsigned int	go_delay;	/* usecs a group leader waits */
+	unsigned int	go_secs;
+	unsigned long	go_commits;	/* per appender, overrides go_secs */
+};
+
+struct gc_result {
+	unsigned long long	gr_commits;
+	unsigned long long	gr_records;
+	unsigned long long	gr_syncs;
+	double			gr_secs;
+	struct lat_hist		gr_lat;		/* usecs per commit */
+};
+
+void gc_usage(const char *prog);
+int gc_parse_opts(int argc, char **argv, struct gc_opts *go);
+int gc_prepare(struct gc_opts *go);
+int gc_run(struct gc_opts *go, unsigned int node, struct gc_result *res);
+int gc_verify(struct gc_opts *go, unsigned int nr_nodes,
+	      unsigned long long records);
+void gc_report(struct gc_opts *go, const char *who, struct gc_result *res);
+
+#endif
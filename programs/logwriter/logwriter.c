@@ -39,6 +39,10 @@
 #include <sys/wait.h>
 #include <stdlib.h>
 
+#include "op_lat.h"
+#include "rand_ops.h"
+#include "group_commit.h"
+
 #define DEFAULT_SLEEP 1000000
 #define DEFAULT_COUNT 1000000
 #define HOSTNAME_SZ 100
@@ -56,6 +60,29 @@
         printf("[%d] Error %d (Line %d, Function \"%s\"): \"%s\"\n",          \
                getpid(), err, __LINE__, __FUNCTION__, strerror(err))
 
+static int group_commit_main(int argc, char **argv)
+{
+	struct gc_opts go;
+	struct gc_result res;
+	int ret;
+
+	if (gc_parse_opts(argc, argv, &go)) {
+		gc_usage("logwriter -g");
+		return 1;
+	}
+
+	ret = gc_prepare(&go);
+	if (ret)
+		return 1;
+
+	ret = gc_run(&go, 0, &res);
+	gc_report(&go, "logwriter", &res);
+	if (!ret)
+		ret = gc_verify(&go, 1, res.gr_records);
+
+	return ret ? 1 : 0;
+}
+
 int main(int argc, char **argv)
 {
 	unsigned int usec = DEFAULT_SLEEP;
@@ -68,13 +95,23 @@ int main(int argc, char **argv)
 	char timebuf[TIMESZ];
 	time_t systime;
 
+	o2test_seed_setup(&argc, argv, 0);
+
+	if ((argc >= 2) && !strcmp(argv[1], "-g"))
+		return group_commit_main(argc, argv);
+
 	if ((argc < 2) || (argc > 4)) {
-           printf("Usage: %s logfile [sleeptime] [loop count]\n", argv[0]);
+           printf("Usage: %s [--seed seed] logfile [sleeptime] "
+		  "[loop count]\n", argv[0]);
+           printf("       %s [--seed seed] -g [options] logfile\n",
+		  argv[0]);
 	   printf("will write out a log to logfile, sleeping \n"
 	          "\"sleeptime\" microseconds between writes.\n"
 		  "\"loop count\" Numer of time it will write to logfile.\n"
 		  "\"sleeptime\" defaults to 1000000.\n"
-		  "\"loop count\" defaults to 1000000.\n");
+		  "\"loop count\" defaults to 1000000.\n"
+		  "-g benchmarks group commits instead, \"-g -h\" for "
+		  "its options.\n");
            return(0);
 	}
 
@@ -98,7 +135,7 @@ int main(int argc, char **argv)
         }
 
 #ifdef OPEN_ONCE
-	fd = open(logfile, OPEN_FLAGS, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	fd = timed_open(logfile, OPEN_FLAGS, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
 	if (fd == -1) {
 		status = errno;
 		PRINTERR(status);
@@ -132,8 +169,8 @@ int main(int argc, char **argv)
 			       hostname, timebuf, argv[0], LOG_ARGS);
 
 #ifndef OPEN_ONCE
-		fd = open(logfile, OPEN_FLAGS,
-			  S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+		fd = timed_open(logfile, OPEN_FLAGS,
+				S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
 		if (fd == -1) {
 			status = errno;
 			PRINTERR(status);
@@ -141,7 +178,7 @@ int main(int argc, char **argv)
 		}
 #endif
 
-		written = write(fd, buffer, len);
+		written = timed_write(fd, buffer, len);
 		if (written == -1) {
 			status = errno;
 			PRINTERR(status);
@@ -0,0 +1,152 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * multi_logwriter.c
+ *
+ * The group commit benchmark of logwriter -g run on every rank at
+ * once against one shared log, to see how commit batching in the
+ * journal scales across the cluster.
+ *
+ * Copyright (C) 2011 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <mpi.h>
+
+#include "mpi_lat_hist.h"
+#include "mpi_rand.h"
+#include "group_commit.h"
+
+#define HOSTNAME_SIZE 256
+
+static char hostname[HOSTNAME_SIZE];
+static int rank = -1, num_procs;
+
+static void abort_printf(const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("%s (rank %d): ", hostname, rank);
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+
+	MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+/* rank 0 ends up with the whole cluster's numbers in res */
+static void reduce_result(struct gc_result *res)
+{
+	unsigned long long mine[3], all[3];
+	double slowest;
+	int ret;
+
+	mine[0] = res->gr_commits;
+	mine[1] = res->gr_records;
+	mine[2] = res->gr_syncs;
+
+	ret = MPI_Reduce(mine, all, 3, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0,
+			 MPI_COMM_WORLD);
+	if (ret == MPI_SUCCESS)
+		ret = MPI_Reduce(&res->gr_secs, &slowest, 1, MPI_DOUBLE,
+				 MPI_MAX, 0, MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Reduce failed: %d\n", ret);
+
+	ret = lat_hist_mpi_reduce(&res->gr_lat, 0, MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Reduce failed: %d\n", ret);
+
+	if (rank)
+		return;
+
+	res->gr_commits = all[0];
+	res->gr_records = all[1];
+	res->gr_syncs = all[2];
+	res->gr_secs = slowest;
+}
+
+int main(int argc, char **argv)
+{
+	struct gc_opts go;
+	struct gc_result res;
+	char who[HOSTNAME_SIZE + 32];
+	int ret;
+
+	ret = MPI_Init(&argc, &argv);
+	if (ret != MPI_SUCCESS) {
+		fprintf(stderr, "MPI_Init failed: %d\n", ret);
+		exit(1);
+	}
+
+	if (gethostname(hostname, HOSTNAME_SIZE) < 0)
+		abort_printf("gethostname failed: %s\n", strerror(errno));
+
+	ret = MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Comm_rank failed: %d\n", ret);
+
+	ret = MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Comm_size failed: %d\n", ret);
+
+	MPI_Seed_Setup(&argc, argv);
+
+	if (gc_parse_opts(argc, argv, &go)) {
+		if (!rank)
+			gc_usage(argv[0]);
+		MPI_Finalize();
+		return 1;
+	}
+
+	if (!rank && gc_prepare(&go))
+		abort_printf("Could not create %s\n", go.go_file);
+
+	ret = MPI_Barrier(MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Barrier failed: %d\n", ret);
+
+	ret = gc_run(&go, rank, &res);
+	if (ret)
+		abort_printf("Appending to %s failed: %d\n", go.go_file, ret);
+
+	snprintf(who, sizeof(who), "%s (rank %d)", hostname, rank);
+	gc_report(&go, who, &res);
+	fflush(stdout);
+
+	/* every rank is done committing once rank 0 has the totals */
+	reduce_result(&res);
+
+	if (!rank) {
+		snprintf(who, sizeof(who), "All %d ranks", num_procs);
+		gc_report(&go, who, &res);
+
+		if (gc_verify(&go, num_procs, res.gr_records))
+			abort_printf("Log %s failed verification\n",
+				     go.go_file);
+		printf("Log %s verified, %llu records\n", go.go_file,
+		       res.gr_records);
+	}
+
+	MPI_Finalize();
+
+	return 0;
+}
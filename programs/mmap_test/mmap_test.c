@@ -24,6 +24,10 @@
  *
  *              This test really has no cluster relevance.
  *
+ *              -P maps with MAP_POPULATE, -a madvise()s the mapping and
+ *              the page faults taken by the mmap() and by reading the
+ *              tail page are printed with how long each took.
+ *
  * Author     : Mark Fasheh
  * 
  */
@@ -39,6 +43,8 @@
 #include <sys/mman.h>
 #include <errno.h>
 
+#include "mmap_ops.h"
+#include "rand_ops.h"
 
 int main(int argc, char *argv[])
 {
@@ -48,15 +54,44 @@ int main(int argc, char *argv[])
     struct stat stat_buf;
     int page_size = getpagesize();
     int offset, remain;
+    int c, flags = MAP_SHARED, advice = -1;
+    unsigned long long usecs;
+    struct mmap_faults before, faults;
+
+    o2test_seed_setup(&argc, argv, 0);
 
+    while ((c = getopt(argc, argv, "hPa:")) != -1)
+    {
+        switch (c)
+        {
+        case 'P':
+            flags |= MAP_POPULATE;
+            break;
+        case 'a':
+            advice = mmap_parse_advice(optarg);
+            if (advice == -1)
+                goto usage;
+            break;
+        default:
+            goto usage;
+        }
+    }
 
-    if ((argc < 2) || (strcmp(argv[1],"-h") == 0))
+    if (argc - optind != 1)
     {
-        fprintf(stderr, "Usage: mmap_test <filename>\n");
+usage:
+        fprintf(stderr, "Usage: mmap_test [-P] [-a <advice>] [--seed <seed>] "
+                "<filename>\n"
+                "-P\t\tmap with MAP_POPULATE\n"
+                "-a <advice>\tmadvise() the mapping with \"normal\", "
+                "\"sequential\",\n\t\t\"random\", \"willneed\" or "
+                "\"hugepage\"\n"
+                "--seed <seed>\treplay the random choices of an earlier "
+                "run\n");
         return 1;
     }
 
-    filename = argv[1];
+    filename = argv[optind];
 
     fd = open(filename, O_RDONLY);
     if (fd < 0)
@@ -72,13 +107,28 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    buf = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    mmap_get_faults(&before);
+    usecs = mmap_usecs();
+
+    buf = mmap(NULL, stat_buf.st_size, PROT_READ, flags, fd, 0);
     if (buf == MAP_FAILED)
     {
         perror("MMap");
         return 1;
     }
 
+    if (advice != -1 && madvise(buf, stat_buf.st_size, advice))
+    {
+        perror("MAdvise");
+        return 1;
+    }
+
+    usecs = mmap_usecs() - usecs;
+    mmap_faults_since(&faults, &before);
+    fprintf(stdout, "mmap%s took %llu usecs, %llu minor and %llu major "
+            "faults\n", (flags & MAP_POPULATE) ? "(MAP_POPULATE)" : "",
+            usecs, faults.mf_minor, faults.mf_major);
+
     offset = stat_buf.st_size % page_size;
 
     /* fix offset if the file size is multiple of page size */
@@ -91,6 +141,13 @@ int main(int argc, char *argv[])
     ptr = buf + (stat_buf.st_size - offset);
     remain = page_size - offset;
 
+    mmap_get_faults(&before);
+    usecs = mmap_prefault(ptr, 1);
+    mmap_faults_since(&faults, &before);
+    fprintf(stdout, "faulting in the tail page took %llu usecs, %llu minor "
+            "and %llu major faults\n", usecs, faults.mf_minor,
+            faults.mf_major);
+
     fprintf(stdout, "buf = %p, ptr = %p, size = %lu, offset = %d, remain = %d\n",
             buf, ptr, stat_buf.st_size, offset, remain);
 
@@ -13,6 +13,9 @@
 #include <string.h>
 #include <assert.h>
 
+#include "op_lat.h"
+#include "rand_ops.h"
+
 #define DEFAULT_CSIZE_BITS	12
 
 static unsigned int clustersize_bits = DEFAULT_CSIZE_BITS;
@@ -25,7 +28,8 @@ static int die = 0;
 
 static void usage(void)
 {
-	printf("Usage: mmap_truncate [-c csize_bits] [-s seconds] FILE\n\n"
+	printf("Usage: mmap_truncate [-c csize_bits] [-s seconds] "
+	       "[--seed seed] FILE\n\n"
 	       "Stress file system stability by testing end of file boundary\n"
 	       "conditions with mmap by racing truncates and writes to a\n"
 	       "shared writeable region.\n\n"
@@ -34,7 +38,8 @@ static void usage(void)
 	       "-c\tsets the fs clustersize used by the test.\n"
 	       "\tThe default is to use a csize_bits of 12 (4096 bytes).\n"
 	       "-s\tsets the number of seconds to run the test.\n"
-	       "\tThe default is to run for 300 seconds.\n");
+	       "\tThe default is to run for 300 seconds.\n"
+	       "--seed\treplays the random sleeps of an earlier run.\n");
 	exit(0);
 }
 
@@ -85,6 +90,9 @@ static void signal_handler(int sig)
 		printf("Alarm fired, exiting\n");
 		die = 1;
 	}
+	/* the parent stops the truncating child this way */
+	if (sig == SIGINT)
+		die = 1;
 	if (setup_sighandler(SIGBUS))
 		abort();
 }
@@ -107,7 +115,7 @@ static int truncate_file(int fd, unsigned long size)
 {
 	int ret;
 
-	ret = ftruncate(fd, size);
+	ret = timed_ftruncate(fd, size);
 	if (ret == -1) {
 		fprintf(stderr, "ftruncate error %d: \"%s\"\n", errno,
 			strerror(errno));
@@ -121,8 +129,8 @@ static int prep_file(char *name, unsigned long size)
 {
 	int ret, fd;
 
-	fd = open(name, O_RDWR|O_CREAT|O_TRUNC,
-		  S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	fd = timed_open(name, O_RDWR|O_CREAT|O_TRUNC,
+			S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
 	if (fd == -1) {
 		fprintf(stderr, "open error %d: \"%s\"\n", errno,
 			strerror(errno));
@@ -147,12 +155,7 @@ static int prep_file(char *name, unsigned long size)
 
 static void random_sleep(unsigned int max_usecs)
 {
-	int r = rand();
-	unsigned int usec;
-
-	usec = r % max_usecs;
-
-	usleep(usec);
+	usleep(get_rand(0, max_usecs - 1));
 }
 
 static void mmap_process(unsigned long file_size)
@@ -193,6 +196,8 @@ int main(int argc, char *argv[])
 	int ret, fd;
 	unsigned long trunc_size, file_size;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (argc < 2) {
 		usage();
 		return 1;
@@ -210,6 +215,9 @@ int main(int argc, char *argv[])
 	if (setup_sighandler(SIGALRM))
 		return 1;
 
+	if (setup_sighandler(SIGINT))
+		return 1;
+
 	file_size = 2 * clustersize;
 	trunc_size = file_size - clustersize;
 
@@ -34,9 +34,18 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sched.h>
 
 #include "mpi.h"
 
+#include "pattern_ops.h"
+#include "mpi_rand.h"
+#include "mpi_lat_hist.h"
+#include "mmap_ops.h"
+
 #define HOSTNAME_SIZE 50
 static char hostname[HOSTNAME_SIZE];
 static int rank = -1, num_procs;
@@ -56,12 +65,58 @@ static unsigned int blocksize = 508;
 static unsigned int max_passes = 1;
 static char startchar = 'a';
 static unsigned int num_blocks;
+static unsigned int free_rounds = 0;
+static unsigned int blocks_per_proc = 64;
+static int map_populate = 0;
+static int map_advice = -1;
+static int time_prefault = 0;
 
 static int this_pass;
 static char *local_pattern;
 static char *tmpblock;
 static char *mapped_area = NULL;
 
+/*
+ * Free running mode stamps the head of every block it writes with
+ * this and ends the block with a copy of ms_seq. Writers store the
+ * head, the body and then the tail, readers load the tail, the block
+ * and then the head, a read whose head and tail disagree raced with a
+ * write and is retried.
+ */
+#define FREE_STAMP_MAGIC	0x4d4d4150U	/* "MMAP" */
+#define FREE_MIN_BLOCKSIZE	64
+#define FREE_TORN_SECS		10
+
+struct free_stamp {
+	uint32_t	ms_magic;
+	uint32_t	ms_rank;
+	uint32_t	ms_epoch;
+	uint32_t	ms_block;
+	uint64_t	ms_seq;
+	uint64_t	ms_nsecs;	/* write time, on rank 0's clock */
+};
+
+/* newest write a reader has seen in each block */
+struct free_seen {
+	uint32_t	fs_epoch;
+	uint64_t	fs_seq;
+};
+
+struct free_stats {
+	unsigned long long	st_writes;
+	unsigned long long	st_reads;
+	unsigned long long	st_retries;
+	unsigned long long	st_bytes;
+	struct lat_hist		st_visible;	/* usecs to first read */
+};
+
+static int64_t clock_offset;
+static struct free_seen *seen;
+static struct free_stats stats;
+
+static struct mmap_faults test_faults;
+static unsigned long long test_start;
+
 static void abort_printf(const char *fmt, ...)
 {
 	va_list       ap;
@@ -75,21 +130,25 @@ static void abort_printf(const char *fmt, ...)
 	MPI_Abort(MPI_COMM_WORLD, 1);
 }
 
-static void fill_with_expected_pattern(char *buf, unsigned int block)
+static void get_expected_pattern(struct pattern_desc *pd, unsigned int block)
 {
-	int i;
-	char c = '\0';
+	pd->pd_type = PATTERN_CONST;
+	pd->pd_seed = (unsigned char)(startchar + block);
+}
 
-	c = startchar + block;
+static void fill_with_expected_pattern(char *buf, unsigned int block)
+{
+	struct pattern_desc pd;
 
-	for(i = 0; i < blocksize; i++)
-		buf[i] = c;
+	get_expected_pattern(&pd, block);
+	pattern_fill(&pd, buf, blocksize, (uint64_t)block * blocksize);
 }
 
 static void usage(void)
 {
 	printf("mmap_test [-t] [-c] [-r <how>] [-w <how>] [-b <blocksize>] "
-	       "[-h] [-i <iter>] <filename>\n\n"
+	       "[-h] [-i <iter>] [-F <rounds> [-n <blocks>]] [-P] "
+	       "[-a <advice>] [-T] [--seed seed] <filename>\n\n"
        "Requires at least two processes. The rank zero process preps\n"
        "a file by opening it O_CREAT|O_TRUNC and filling the file\n"
        "with a pattern. All nodes then open the file and\n"
@@ -103,13 +162,33 @@ static void usage(void)
        "-r <how>\tReaders use \"mmap\", \"regular\" or \"random\" I/O: default \"mmap\"\n"
        "-w <how>\tWriters use \"mmap\", \"regular\" or \"random\" I/O: default \"mmap\"\n"
        "-b <blocksize>\tBlocksize to use, defaults to 508. Must be > 10\n"
-       "\t\tUse unaligned block sizes for best results.\n"
+       "\t\tUse unaligned block sizes for best results. \"page\" makes\n"
+       "\t\tevery block exactly one page, \"straddle\" a page and 8\n"
+       "\t\tbytes so every block crosses a page boundary and shares\n"
+       "\t\tits pages with its neighbours\n"
        "-h\t\tNormally the file is zeroed via eof writes, but this instructs\n"
        "\t\tthe code to only ftruncate(), thus creating a hole where it\n"
        "\t\twill be writing\n"
        "-i <iter>\tNumber of times to pass through the file. Default is 1\n"
        "-e <which>\tHave the rank zero node inject an error by truncating\n"
-       "\t\tthe entire file length on iteration <which>\n");
+       "\t\tthe entire file length on iteration <which>\n"
+       "-F <rounds>\tFree running mode. Each node owns <blocks> blocks and\n"
+       "\t\trewrites every one of them <rounds> times per iteration,\n"
+       "\t\tchecking the blocks of the other nodes as it goes, without\n"
+       "\t\twaiting on anybody. Writes are stamped with (rank, epoch, seq)\n"
+       "\t\tand readers fail on a stamp going backwards. Nodes only sync\n"
+       "\t\tat the end of an iteration (epoch), where every block has to\n"
+       "\t\tshow its last write. Reports pages/sec and the latency from\n"
+       "\t\ta write to another node first seeing it. mmap I/O only and\n"
+       "\t\t<blocksize> must be at least 64\n"
+       "-n <blocks>\tBlocks per node in free running mode, defaults to 64\n"
+       "-P\t\tMap the file with MAP_POPULATE\n"
+       "-a <advice>\tmadvise() the mapping with \"normal\", \"sequential\",\n"
+       "\t\t\"random\", \"willneed\" or \"hugepage\"\n"
+       "-T\t\tTime the mmap() call and a pass touching every page of\n"
+       "\t\tthe mapping before the test, with the page faults each took\n"
+       "--seed <seed>\tReplay the random choices of an earlier run\n"
+       "Every node reports the page faults it took during the test.\n");
 
 	MPI_Finalize();
 	exit(1);
@@ -133,7 +212,7 @@ static int parse_opts(int argc, char **argv)
 	int c;
 
 	while (1) {
-		c = getopt(argc, argv, "ctb:r:w:hi:e:");
+		c = getopt(argc, argv, "ctb:r:w:hi:e:F:n:Pa:T");
 		if (c == -1)
 			break;
 
@@ -145,7 +224,12 @@ static int parse_opts(int argc, char **argv)
 			prep_open_flags = 0;
 			break;
 		case 'b':
-			blocksize = atoi(optarg);
+			if (!strcmp(optarg, "page"))
+				blocksize = getpagesize();
+			else if (!strcmp(optarg, "straddle"))
+				blocksize = getpagesize() + 8;
+			else
+				blocksize = atoi(optarg);
 			if (blocksize <= 10)
 				return EINVAL;
 			break;
@@ -167,6 +251,27 @@ static int parse_opts(int argc, char **argv)
 			inject_truncate = 1;
 			injection_pass = atoi(optarg);
 			break;
+		case 'F':
+			free_rounds = atoi(optarg);
+			if (!free_rounds)
+				return EINVAL;
+			break;
+		case 'n':
+			blocks_per_proc = atoi(optarg);
+			if (!blocks_per_proc)
+				return EINVAL;
+			break;
+		case 'P':
+			map_populate = 1;
+			break;
+		case 'a':
+			map_advice = mmap_parse_advice(optarg);
+			if (map_advice == -1)
+				return EINVAL;
+			break;
+		case 'T':
+			time_prefault = 1;
+			break;
 		default:
 			return EINVAL;
 		}
@@ -180,6 +285,17 @@ static int parse_opts(int argc, char **argv)
 	if (inject_truncate && (injection_pass > max_passes))
 		return EINVAL;
 
+	if (free_rounds) {
+		if (!mmap_reads || !mmap_writes || random_readers ||
+		    random_writers || inject_truncate) {
+			fprintf(stderr, "Free running mode only does mmap I/O "
+				"and can't inject errors\n\n");
+			return EINVAL;
+		}
+		if (blocksize < FREE_MIN_BLOCKSIZE)
+			return EINVAL;
+	}
+
 	if (argc - optind != 1)
 		return EINVAL;
 
@@ -256,10 +372,17 @@ static void write_block(int fd, unsigned int blkno, char *block)
 
 static void do_mmap(int fd, off_t length)
 {
-	int ret;
+	int ret, flags = MAP_SHARED;
+	unsigned long long start;
+	struct mmap_faults before, faults;
 
-	mapped_area = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd,
-			   0);
+	if (map_populate)
+		flags |= MAP_POPULATE;
+
+	mmap_get_faults(&before);
+	start = mmap_usecs();
+
+	mapped_area = mmap(NULL, length, PROT_READ|PROT_WRITE, flags, fd, 0);
 	if (mapped_area == MAP_FAILED) {
 		ret = errno;
 		abort_printf("Error %d mapping file \"%s\" from offset 0 \n"
@@ -267,6 +390,72 @@ static void do_mmap(int fd, off_t length)
 			     ret, filename, (unsigned long)length,
 			     strerror(ret));
 	}
+
+	if (map_advice != -1) {
+		ret = madvise(mapped_area, length, map_advice);
+		if (ret) {
+			ret = errno;
+			abort_printf("Error %d from madvise(%s): %s\n", ret,
+				     mmap_advice_name(map_advice),
+				     strerror(ret));
+		}
+	}
+
+	if (time_prefault) {
+		start = mmap_usecs() - start;
+		mmap_faults_since(&faults, &before);
+		printf("%s (rank %d): mmap%s took %llu usecs, %llu minor "
+		       "and %llu major faults\n", hostname, rank,
+		       map_populate ? "(MAP_POPULATE)" : "", start,
+		       faults.mf_minor, faults.mf_major);
+		fflush(stdout);
+	}
+}
+
+static void prefault_file(off_t length)
+{
+	unsigned long long usecs;
+	struct mmap_faults before, faults;
+
+	mmap_get_faults(&before);
+	usecs = mmap_prefault(mapped_area, length);
+	mmap_faults_since(&faults, &before);
+
+	printf("%s (rank %d): Prefaulting %lu pages took %llu usecs, %llu "
+	       "minor and %llu major faults\n", hostname, rank,
+	       (unsigned long)((length + getpagesize() - 1) / getpagesize()),
+	       usecs, faults.mf_minor, faults.mf_major);
+	fflush(stdout);
+}
+
+/*
+ * Faults and time from the end of the prep to the end of the test,
+ * every rank prints its own and rank 0 the sum.
+ */
+static void fault_report(void)
+{
+	struct mmap_faults faults;
+	unsigned long long mine[2], all[2];
+	unsigned long long usecs = mmap_usecs() - test_start;
+	int ret;
+
+	mmap_faults_since(&faults, &test_faults);
+
+	printf("%s (rank %d): Test took %llu usecs, %llu minor and %llu "
+	       "major page faults\n", hostname, rank, usecs,
+	       faults.mf_minor, faults.mf_major);
+	fflush(stdout);
+
+	mine[0] = faults.mf_minor;
+	mine[1] = faults.mf_major;
+	ret = MPI_Reduce(mine, all, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0,
+			 MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Reduce failed: %d\n", ret);
+
+	if (!rank)
+		printf("All %d ranks: %llu minor and %llu major page faults\n",
+		       num_procs, all[0], all[1]);
 }
 
 static void zero_file(int fd, off_t length)
@@ -314,10 +503,15 @@ static int prep_file(void)
 			     ret, filename, strerror(ret));
 	}
 
-	do_mmap(fd, length);
+	/* MAP_POPULATE has nothing to fault in until the file is sized */
+	if (!map_populate)
+		do_mmap(fd, length);
 
 	zero_file(fd, length);
 
+	if (map_populate)
+		do_mmap(fd, length);
+
 	ret = MPI_Barrier(MPI_COMM_WORLD);
 	if (ret != MPI_SUCCESS)
 		abort_printf("Prep MPI_Barrier failed: %d\n", ret);
@@ -339,6 +533,9 @@ open_after:
 	do_mmap(fd, length);
 
 populate:
+	if (time_prefault)
+		prefault_file(length);
+
 	if (pre_populate) {
 		int i;
 		char *b = mapped_area;
@@ -354,9 +551,7 @@ populate:
 
 static int randomize_bool(void)
 {
-	if (rand() < (RAND_MAX / 2))
-		return 0;
-	return 1;
+	return get_rand(0, 1);
 }
 
 static void trunc_file(int fd)
@@ -401,6 +596,8 @@ static void do_writer(int fd, unsigned int block, char *pattern)
 static void do_reader(int fd, unsigned int block, char *pattern)
 {
 	int ret;
+	size_t bad;
+	struct pattern_desc pd;
 
 	if (random_readers)
 		mmap_reads = randomize_bool();
@@ -417,10 +614,15 @@ static void do_reader(int fd, unsigned int block, char *pattern)
 
 	read_block(fd, block, tmpblock);
 
-	if (memcmp(pattern, tmpblock, blocksize)) {
+	get_expected_pattern(&pd, block);
+	bad = pattern_verify(&pd, tmpblock, blocksize,
+			     (uint64_t)block * blocksize);
+	if (bad != blocksize) {
 		fprintf(stderr,
-			"%s (rank %d): Verification failed for block %u.\n",
-			hostname, rank, block);
+			"%s (rank %d): Verification failed for block %u "
+			"at byte %lu: expected '%c', found 0x%02x.\n",
+			hostname, rank, block, (unsigned long)bad, pattern[bad],
+			(unsigned char)tmpblock[bad]);
 		fprintf(stderr,
 			"%s (rank %d): First 10 expected chars: \"%.*s\"\n",
 			hostname, rank, 10, pattern);
@@ -458,6 +660,318 @@ static void write_verify_blocks(int fd)
 	}
 }
 
+static uint64_t free_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec +
+			  clock_offset);
+}
+
+/*
+ * Puts every rank on rank 0's clock so that a write stamped on one
+ * node can be timed on another. The offset comes from the ping-pong
+ * with the shortest round trip and is good to half of it.
+ */
+#define CLOCK_SYNC_ROUNDS	16
+
+static void sync_clocks(void)
+{
+	int i, r, ret = MPI_SUCCESS;
+	long long t0, t1, t2, offset = 0, best_rtt = -1;
+	MPI_Status status;
+
+	clock_offset = 0;
+
+	for (r = 1; r < num_procs; r++) {
+		for (i = 0; i < CLOCK_SYNC_ROUNDS; i++) {
+			if (!rank) {
+				ret = MPI_Recv(&t1, 1, MPI_LONG_LONG, r, 0,
+					       MPI_COMM_WORLD, &status);
+				t0 = free_now();
+				if (ret == MPI_SUCCESS)
+					ret = MPI_Send(&t0, 1, MPI_LONG_LONG,
+						       r, 0, MPI_COMM_WORLD);
+			} else if (rank == r) {
+				t1 = free_now();
+				ret = MPI_Send(&t1, 1, MPI_LONG_LONG, 0, 0,
+					       MPI_COMM_WORLD);
+				if (ret == MPI_SUCCESS)
+					ret = MPI_Recv(&t0, 1, MPI_LONG_LONG,
+						       0, 0, MPI_COMM_WORLD,
+						       &status);
+				t2 = free_now();
+				if (best_rtt < 0 || t2 - t1 < best_rtt) {
+					best_rtt = t2 - t1;
+					offset = t0 - (t1 + t2) / 2;
+				}
+			}
+			if (ret != MPI_SUCCESS)
+				abort_printf("Clock sync failed: %d\n", ret);
+		}
+	}
+
+	clock_offset = offset;
+}
+
+static uint64_t free_final_seq(unsigned int epoch, unsigned int index)
+{
+	return ((uint64_t)epoch * free_rounds + free_rounds - 1) *
+		blocks_per_proc + index + 1;
+}
+
+static void free_body_pattern(struct pattern_desc *pd,
+			      const struct free_stamp *st)
+{
+	pd->pd_type = PATTERN_STAMP;
+	pd->pd_seed = st->ms_seq ^ ((uint64_t)st->ms_rank << 48);
+}
+
+static void free_write_block(unsigned int block, unsigned int epoch,
+			     uint64_t seq)
+{
+	char *start = mapped_area + (size_t)block * blocksize;
+	size_t body = blocksize - sizeof(struct free_stamp) - sizeof(seq);
+	struct free_stamp st;
+	struct pattern_desc pd;
+
+	st.ms_magic = FREE_STAMP_MAGIC;
+	st.ms_rank = rank;
+	st.ms_epoch = epoch;
+	st.ms_block = block;
+	st.ms_seq = seq;
+	st.ms_nsecs = free_now();
+
+	memcpy(start, &st, sizeof(st));
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	free_body_pattern(&pd, &st);
+	pattern_fill(&pd, start + sizeof(st), body,
+		     (uint64_t)block * blocksize + sizeof(st));
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	memcpy(start + blocksize - sizeof(seq), &seq, sizeof(seq));
+
+	stats.st_writes++;
+	stats.st_bytes += blocksize;
+}
+
+/* leaves a copy of the block, taken while nobody wrote it, in tmpblock */
+static void free_read_block(unsigned int block, struct free_stamp *st)
+{
+	char *start = mapped_area + (size_t)block * blocksize;
+	uint64_t head, tail, give_up = 0;
+
+	while (1) {
+		memcpy(&tail, start + blocksize - sizeof(tail), sizeof(tail));
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		memcpy(tmpblock, start, blocksize);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		memcpy(&head, start + offsetof(struct free_stamp, ms_seq),
+		       sizeof(head));
+
+		if (head == tail) {
+			memcpy(st, tmpblock, sizeof(*st));
+			stats.st_reads++;
+			stats.st_bytes += blocksize;
+			return;
+		}
+
+		stats.st_retries++;
+
+		/* the writer may just have been scheduled out mid block */
+		if (!give_up)
+			give_up = free_now() + FREE_TORN_SECS * 1000000000ULL;
+		else if (free_now() > give_up)
+			abort_printf("Block %u was still being written after "
+				     "%d secs\n", block, FREE_TORN_SECS);
+		sched_yield();
+	}
+}
+
+static void free_fail(unsigned int block, unsigned int epoch,
+		      struct free_stamp *st, const char *why)
+{
+	abort_printf("Epoch %u, block %u %s: found rank %u, epoch %u, "
+		     "block %u, seq %"PRIu64", last saw epoch %u, "
+		     "seq %"PRIu64"\n", epoch, block, why, st->ms_rank,
+		     st->ms_epoch, st->ms_block, st->ms_seq,
+		     seen[block].fs_epoch, seen[block].fs_seq);
+}
+
+/*
+ * While the epoch runs a block may still show the last epoch, once
+ * everybody has been through the barrier it must show the final write
+ * of the epoch just gone or a newer one.
+ */
+static void free_check_block(unsigned int block, unsigned int epoch,
+			     int boundary)
+{
+	struct free_stamp st;
+	struct free_seen *fs = &seen[block];
+	struct pattern_desc pd;
+	unsigned int index = block % blocks_per_proc;
+	size_t body = blocksize - sizeof(st) - sizeof(uint64_t), bad;
+	uint64_t final, now;
+
+	free_read_block(block, &st);
+
+	if (!st.ms_magic && !st.ms_seq) {
+		if (fs->fs_seq || epoch || boundary)
+			free_fail(block, epoch, &st, "lost its writes");
+		return;
+	}
+
+	if (st.ms_magic != FREE_STAMP_MAGIC ||
+	    st.ms_rank != block / blocks_per_proc || st.ms_block != block ||
+	    (st.ms_seq - 1) % blocks_per_proc != index ||
+	    (st.ms_seq - 1) / ((uint64_t)free_rounds * blocks_per_proc) !=
+	    st.ms_epoch)
+		free_fail(block, epoch, &st, "has a bad stamp");
+
+	if (st.ms_seq < fs->fs_seq || st.ms_epoch < fs->fs_epoch)
+		free_fail(block, epoch, &st, "went backwards");
+
+	if (boundary) {
+		final = free_final_seq(epoch, index);
+		if (!(st.ms_epoch == epoch && st.ms_seq == final) &&
+		    !(st.ms_epoch == epoch + 1 && st.ms_seq > final))
+			free_fail(block, epoch, &st,
+				  "is missing the last write of the epoch");
+	} else if (st.ms_epoch != epoch && st.ms_epoch + 1 != epoch)
+		free_fail(block, epoch, &st, "is from the wrong epoch");
+
+	free_body_pattern(&pd, &st);
+	bad = pattern_verify(&pd, tmpblock + sizeof(st), body,
+			     (uint64_t)block * blocksize + sizeof(st));
+	if (bad != body)
+		abort_printf("Epoch %u, block %u, seq %"PRIu64" from rank %u "
+			     "doesn't match its stamp at byte %lu\n", epoch,
+			     block, st.ms_seq, st.ms_rank,
+			     (unsigned long)(sizeof(st) + bad));
+
+	if (st.ms_seq > fs->fs_seq) {
+		/* the barrier wait would swamp the latency at a boundary */
+		if (!boundary) {
+			now = free_now();
+			lat_hist_record(&stats.st_visible,
+					now > st.ms_nsecs ?
+					(now - st.ms_nsecs) / 1000 : 0);
+		}
+		fs->fs_seq = st.ms_seq;
+		fs->fs_epoch = st.ms_epoch;
+	}
+}
+
+static void free_report(double elapsed)
+{
+	unsigned long long mine[4], all[4];
+	double slowest;
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct lat_hist *lh = &stats.st_visible;
+	int ret;
+
+	printf("%s (rank %d): %llu writes, %llu reads, %llu torn reads "
+	       "retried, %.0f pages/sec\n", hostname, rank, stats.st_writes,
+	       stats.st_reads, stats.st_retries,
+	       stats.st_bytes / (double)page_size / elapsed);
+	fflush(stdout);
+
+	mine[0] = stats.st_writes;
+	mine[1] = stats.st_reads;
+	mine[2] = stats.st_retries;
+	mine[3] = stats.st_bytes;
+
+	ret = MPI_Reduce(mine, all, 4, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0,
+			 MPI_COMM_WORLD);
+	if (ret == MPI_SUCCESS)
+		ret = MPI_Reduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0,
+				 MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Reduce failed: %d\n", ret);
+
+	ret = lat_hist_mpi_reduce(lh, 0, MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("MPI_Reduce failed: %d\n", ret);
+
+	if (rank)
+		return;
+
+	printf("All %d ranks: %llu writes, %llu reads, %llu torn reads "
+	       "retried in %.3f secs, %.0f pages/sec\n", num_procs, all[0],
+	       all[1], all[2], slowest, all[3] / (double)page_size / slowest);
+	printf("Write to first read on another rank, usecs: count %"PRIu64
+	       ", min %"PRIu64", mean %.1f, p50 %"PRIu64", p99 %"PRIu64
+	       ", p999 %"PRIu64", max %"PRIu64"\n", lh->lh_count,
+	       lh->lh_count ? lh->lh_min : 0, lat_hist_mean(lh),
+	       lat_hist_percentile(lh, 50.0), lat_hist_percentile(lh, 99.0),
+	       lat_hist_percentile(lh, 99.9), lh->lh_max);
+}
+
+/*
+ * Each pass of the inner loop writes the next of our blocks and then
+ * checks the same block of every other rank, so the blocks are read
+ * about as often as they are rewritten. Nothing waits on another rank
+ * until the epoch is over.
+ */
+static void free_run(void)
+{
+	unsigned int epoch, round, i, r, block;
+	uint64_t seq = 0;
+	double start;
+	int ret;
+
+	seen = calloc(num_blocks, sizeof(*seen));
+	if (!seen)
+		abort_printf("No memory for %u blocks!\n", num_blocks);
+
+	lat_hist_init(&stats.st_visible);
+
+	sync_clocks();
+
+	ret = MPI_Barrier(MPI_COMM_WORLD);
+	if (ret != MPI_SUCCESS)
+		abort_printf("Start MPI_Barrier failed: %d\n", ret);
+
+	start = MPI_Wtime();
+
+	for (epoch = 0; epoch < max_passes; epoch++) {
+		for (round = 0; round < free_rounds; round++) {
+			for (i = 0; i < blocks_per_proc; i++) {
+				free_write_block(rank * blocks_per_proc + i,
+						 epoch, ++seq);
+
+				for (r = 1; r < num_procs; r++) {
+					block = ((rank + r) % num_procs) *
+						blocks_per_proc + i;
+					free_check_block(block, epoch, 0);
+				}
+			}
+		}
+
+		ret = MPI_Barrier(MPI_COMM_WORLD);
+		if (ret != MPI_SUCCESS)
+			abort_printf("Epoch MPI_Barrier failed: %d\n", ret);
+
+		for (block = 0; block < num_blocks; block++) {
+			if (block / blocks_per_proc != rank)
+				free_check_block(block, epoch, 1);
+		}
+
+		if (!rank) {
+			printf("%s (rank %d): Epoch %u verified\n", hostname,
+			       rank, epoch);
+			fflush(stdout);
+		}
+	}
+
+	free_report(MPI_Wtime() - start);
+
+	free(seen);
+}
+
 int main(int argc, char *argv[])
 {
 	int ret, fd;
@@ -468,6 +982,8 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	MPI_Seed_Setup(&argc, argv);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -492,16 +1008,24 @@ int main(int argc, char *argv[])
 	       hostname, rank, num_procs, filename);
 
 	num_blocks = num_procs;
+	if (free_rounds)
+		num_blocks *= blocks_per_proc;
 
 	local_pattern = calloc(1, blocksize);
 	tmpblock = calloc(1, blocksize);
 	if (!local_pattern || !tmpblock)
 		abort_printf("No memory to allocate pattern!\n");
 
-	srand(getpid());
-
 	fd = prep_file();
 
+	mmap_get_faults(&test_faults);
+	test_start = mmap_usecs();
+
+	if (free_rounds) {
+		free_run();
+		goto out;
+	}
+
 	for (this_pass = 0; this_pass < max_passes; this_pass++) {
 		write_verify_blocks(fd);
 
@@ -511,6 +1035,9 @@ int main(int argc, char *argv[])
 			startchar++;
 	}
 
+out:
+	fault_report();
+
 	end_test(fd);
 
         MPI_Finalize();
@@ -51,9 +51,16 @@ Usage = """
 [-c | --cache]	   		Populate the local cache by reading the full file first.
 [-r | --reader <how>] 		Readers use "mmap", "regular" or "random" I/O: default "mmap".
 [-w | --writer <how>] 		Writers use "mmap", "regular" or "random" I/O: default "mmap".
-[-b | --blocksize <blocksize>]  Blocksize to use, defaults to 508. Must be > 10.
+[-b | --blocksize <blocksize>]  Blocksize to use, defaults to 508. Must be > 10, or "page" or "straddle".
 [-H | --hole] 			Creating a hole where it will be writing.
 [-e | --error <which>] 		Inject an error by truncating the entire file length on iteration <which>.
+[-F | --free <rounds>]		Free running mode, rewrite every block <rounds> times per iteration.
+[-B | --blocks <blocks>]	Blocks per process in free running mode, defaults to 64.
+[-N | --procs <procs>]		Processes to start, defaults to one per node. Give more
+				than there are nodes to run several per node, e.g. all on one host.
+[-P | --populate]		Map the file with MAP_POPULATE.
+[-a | --advice <advice>]	madvise() the mapping: normal, sequential, random, willneed or hugepage.
+[-T | --time-prefault]		Time the mmap() and a pass faulting in every page.
 [-f | --filename <filename>] 
 [-h | --help]
 """
@@ -112,14 +119,52 @@ if __name__=='__main__':
 	parser.add_option('-b',
 		'--blocksize',
 		dest='blocksize',
-		type='int',
-		help='Blocksize to use,defaults to 508,must be > 10.')
+		type='string',
+		help='Blocksize to use,defaults to 508,must be > 10, or page or straddle.')
 #
 	parser.add_option('-e',
 		'--error',
 		dest='error',
 		type='int',
 		help='Inject an error by truncating the entire file length on iteration <which>.')
+#
+	parser.add_option('-F',
+		'--free',
+		dest='free',
+		type='int',
+		help='Free running mode, rewrite every block <rounds> times per iteration.')
+#
+	parser.add_option('-B',
+		'--blocks',
+		dest='blocks',
+		type='int',
+		help='Blocks per process in free running mode, defaults to 64.')
+#
+	parser.add_option('-N',
+		'--procs',
+		dest='procs',
+		type='int',
+		help='Processes to start, defaults to one per node.')
+#
+	parser.add_option('-P',
+		'--populate',
+		action="store_true",
+		dest='populate',
+		default=False,
+		help='Map the file with MAP_POPULATE.')
+#
+	parser.add_option('-a',
+		'--advice',
+		dest='advice',
+		type='string',
+		help='madvise() the mapping: normal, sequential, random, willneed or hugepage.')
+#
+	parser.add_option('-T',
+		'--time-prefault',
+		action="store_true",
+		dest='time_prefault',
+		default=False,
+		help='Time the mmap() and a pass faulting in every page.')
 #
 	parser.add_option('-r',
 		'--reader',
@@ -183,6 +228,11 @@ if __name__=='__main__':
 		if not options.writer in ('mmap','regular','random'):
 			parser.error('use right writer type:mmap,regular,random')
 
+	if options.advice:
+		if not options.advice in ('normal','sequential','random',
+					  'willneed','hugepage'):
+			parser.error('use right advice:normal,sequential,random,willneed,hugepage')
+
 	if options.truncate:
 		truncate_arg = '-t '
 	else:
@@ -214,7 +264,7 @@ if __name__=='__main__':
 		iterations_arg = ''
 
 	if options.blocksize:
-		blocksize_arg = '-b ' + str(options.blocksize)
+		blocksize_arg = '-b ' + options.blocksize
 	else:
 		blocksize_arg = ''
 
@@ -223,6 +273,24 @@ if __name__=='__main__':
 	else:
 		error_arg = ''
 	
+	if options.free:
+		free_arg = '-F ' + str(options.free)
+	else:
+		free_arg = ''
+
+	if options.blocks:
+		blocks_arg = '-n ' + str(options.blocks)
+	else:
+		blocks_arg = ''
+
+	map_arg = ''
+	if options.populate:
+		map_arg = map_arg + '-P '
+	if options.advice:
+		map_arg = map_arg + '-a ' + options.advice + ' '
+	if options.time_prefault:
+		map_arg = map_arg + '-T '
+
 	if options.filename:
 		filename_arg =  options.filename
 
@@ -240,6 +308,12 @@ if __name__=='__main__':
 			nodelist = nodelist.append(options.nodelist)
 		else:
 			nodelist = options.nodelist.split(',')
+		if options.procs:
+			# every process needs a slot, hand them out round robin
+			procs = options.procs
+			nodelist = options.nodelist.split(',')
+			options.nodelist = string.join([nodelist[i % nodelen]
+				for i in range(procs)], ',')
 	else:
 		if not options.cleanup:
 			parser.error('Invalid node list.')
@@ -255,7 +329,7 @@ if options.cleanup:
 o2tf.OpenMPIInit(DEBUGON, options.nodelist, logfile, 'ssh')
 #
 ret = o2tf.openmpi_run(DEBUGON, procs, 
-	str('%s %s %s %s %s %s %s %s %s %s 2>&1 >> %s' % (cmd, 
+	str('%s %s %s %s %s %s %s %s %s %s %s %s %s 2>&1 >> %s' % (cmd, 
 	truncate_arg,
 	cache_arg, 
 	reader_arg,
@@ -264,6 +338,9 @@ ret = o2tf.openmpi_run(DEBUGON, procs,
 	hole_arg,
 	iterations_arg,
 	error_arg,
+	free_arg,
+	blocks_arg,
+	map_arg,
 	filename_arg,
 	logfile)), 
 	options.nodelist, 
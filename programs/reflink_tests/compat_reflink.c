@@ -3,8 +3,10 @@
  *
  * compat_reflink.c
  *
- * Use ioctl() based reflink call for old kernels which have no
- * reflink(2) system call implemented.
+ * reflink() for the tests, on top of whichever clone call the chosen
+ * backend provides. OCFS2_IOC_REFLINK stands in for the reflink(2)
+ * system call old kernels don't have, the generic backends let the
+ * same workloads run against any filesystem with shared extents.
  *
  * Written by tristan.ye@oracle.com
  *
@@ -20,20 +22,70 @@
  * General Public License for more details.
  */
 
-#define _GNU_SOURCE
-#define _XOPEN_SOURCE 500
-#define _LARGEFILE64_SOURCE
+#include "reflink_test.h"
 
-#include <unistd.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
 
-#include <ocfs2/ocfs2.h>
+/*
+ * Private copies of the vfs clone ABI, linux/fs.h can't be pulled in
+ * next to the ocfs2 headers. Same layout, so the same ioctl numbers.
+ */
+struct o2test_clone_range {
+	int64_t src_fd;
+	uint64_t src_offset;
+	uint64_t src_length;
+	uint64_t dest_offset;
+};
 
-extern int open_ro_flags;
+#define O2TEST_FICLONE		_IOW(0x94, 9, int)
+#define O2TEST_FICLONERANGE	_IOW(0x94, 13, struct o2test_clone_range)
 
-int reflink(const char *oldpath, const char *newpath, unsigned long preserve)
+#define XATTR_LIST_MAX_SZ	65536
+#define XATTR_VALUE_BUF_SZ	65536
+
+static int reflink_backend = REFLINK_BACKEND_OCFS2;
+
+static const char *reflink_backend_names[REFLINK_BACKEND_NUM] = {
+	[REFLINK_BACKEND_OCFS2]		= "ocfs2",
+	[REFLINK_BACKEND_FICLONE]	= "ficlone",
+	[REFLINK_BACKEND_FICLONERANGE]	= "ficlonerange",
+	[REFLINK_BACKEND_COPY_RANGE]	= "copy_range",
+};
+
+const char *reflink_backend_name(int backend)
+{
+	if (backend < 0 || backend >= REFLINK_BACKEND_NUM)
+		return "unknown";
+
+	return reflink_backend_names[backend];
+}
+
+int reflink_parse_backend(const char *name)
+{
+	int backend;
+
+	for (backend = 0; backend < REFLINK_BACKEND_NUM; backend++)
+		if (!strcmp(name, reflink_backend_names[backend]))
+			return backend;
+
+	fprintf(stderr, "unknown reflink backend %s\n", name);
+
+	return -EINVAL;
+}
+
+int reflink_get_backend(void)
+{
+	return reflink_backend;
+}
+
+void reflink_set_backend(int backend)
+{
+	reflink_backend = backend;
+}
+
+static int ocfs2_reflink(const char *oldpath, const char *newpath,
+			 unsigned long preserve)
 {
 	int fd, ret, o_ret;
 	struct reflink_arguments args;
@@ -66,3 +118,250 @@ int reflink(const char *oldpath, const char *newpath, unsigned long preserve)
 
 	return 0;
 }
+
+static int clone_range(int sfd, int dfd, off_t src_off, off_t dst_off,
+		       off_t len)
+{
+	struct o2test_clone_range args;
+
+	args.src_fd = sfd;
+	args.src_offset = src_off;
+	args.src_length = len;
+	args.dest_offset = dst_off;
+
+	if (ioctl(dfd, O2TEST_FICLONERANGE, &args))
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * The filesystem is free to share extents or to copy, which of the two
+ * happened is what a CoW baseline against other backends will show.
+ */
+static int copy_range(int sfd, int dfd, off_t src_off, off_t dst_off,
+		      off_t len)
+{
+#ifdef __NR_copy_file_range
+	loff_t soff = src_off, doff = dst_off;
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = syscall(__NR_copy_file_range, sfd, &soff, dfd, &doff,
+			      (size_t)len, 0);
+		if (ret < 0)
+			return -errno;
+		if (!ret)
+			break;
+		len -= ret;
+	}
+
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/*
+ * OCFS2_IOC_REFLINK shares xattrs along with the data, the generic
+ * clone calls only do data, so preserve copies them over by hand.
+ */
+static int copy_xattrs(int sfd, int dfd)
+{
+	char *list = NULL, *value = NULL, *name;
+	ssize_t list_sz, value_sz;
+	int ret = 0;
+
+	list = (char *)malloc(XATTR_LIST_MAX_SZ);
+	value = (char *)malloc(XATTR_VALUE_BUF_SZ);
+	if (!list || !value) {
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	list_sz = flistxattr(sfd, list, XATTR_LIST_MAX_SZ);
+	if (list_sz < 0) {
+		/* nothing to copy if the fs has no xattrs at all */
+		ret = (errno == ENOTSUP) ? 0 : -errno;
+		goto bail;
+	}
+
+	for (name = list; name < list + list_sz; name += strlen(name) + 1) {
+		value_sz = fgetxattr(sfd, name, value, XATTR_VALUE_BUF_SZ);
+		if (value_sz < 0) {
+			ret = -errno;
+			break;
+		}
+
+		if (fsetxattr(dfd, name, value, value_sz, 0)) {
+			ret = -errno;
+			fprintf(stderr, "copy xattr %s failed:%d:%s\n", name,
+				-ret, strerror(-ret));
+			break;
+		}
+	}
+
+bail:
+	free(list);
+	free(value);
+
+	return ret;
+}
+
+static int generic_clone(int backend, int sfd, int dfd, off_t src_off,
+			 off_t dst_off, off_t len)
+{
+	switch (backend) {
+	case REFLINK_BACKEND_FICLONE:
+		if (!src_off && !dst_off && !len)
+			return ioctl(dfd, O2TEST_FICLONE, sfd) ? -errno : 0;
+		/* FICLONE is whole file only */
+		return clone_range(sfd, dfd, src_off, dst_off, len);
+	case REFLINK_BACKEND_FICLONERANGE:
+		/* a zero length clones through to the end of the source */
+		return clone_range(sfd, dfd, src_off, dst_off, len);
+	case REFLINK_BACKEND_COPY_RANGE:
+		return copy_range(sfd, dfd, src_off, dst_off, len);
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Whole file reflink on top of the generic calls, newpath must not
+ * exist, same as with the ocfs2 ioctl.
+ */
+static int generic_reflink(const char *oldpath, const char *newpath,
+			   unsigned long preserve)
+{
+	int sfd, dfd, ret;
+	off_t len = 0;
+	struct stat st;
+
+	sfd = open64(oldpath, open_ro_flags);
+	if (sfd < 0) {
+		ret = errno;
+		fprintf(stderr, "open file %s failed:%d:%s\n", oldpath, ret,
+			strerror(ret));
+		return -ret;
+	}
+
+	if (fstat(sfd, &st)) {
+		ret = -errno;
+		close(sfd);
+		return ret;
+	}
+
+	dfd = open64(newpath, O_CREAT | O_EXCL | O_WRONLY,
+		     st.st_mode & 07777);
+	if (dfd < 0) {
+		ret = errno;
+		fprintf(stderr, "create file %s failed:%d:%s\n", newpath, ret,
+			strerror(ret));
+		close(sfd);
+		return -ret;
+	}
+
+	/* copy_file_range() stops at eof, it has to be told how far */
+	if (reflink_backend == REFLINK_BACKEND_COPY_RANGE)
+		len = st.st_size;
+
+	ret = generic_clone(reflink_backend, sfd, dfd, 0, 0, len);
+	if (!ret && reflink_backend == REFLINK_BACKEND_COPY_RANGE)
+		ret = ftruncate(dfd, st.st_size) ? -errno : 0;
+	if (ret) {
+		fprintf(stderr, "%s of %s to %s failed:%d:%s\n",
+			reflink_backend_name(reflink_backend), oldpath,
+			newpath, -ret, strerror(-ret));
+		goto bail;
+	}
+
+	if (preserve) {
+		/* owner is best effort, only root may give files away */
+		if (fchown(dfd, st.st_uid, st.st_gid) && errno != EPERM) {
+			ret = -errno;
+			goto bail;
+		}
+
+		ret = copy_xattrs(sfd, dfd);
+	}
+
+bail:
+	close(sfd);
+	close(dfd);
+
+	if (ret)
+		unlink(newpath);
+
+	return ret;
+}
+
+int reflink(const char *oldpath, const char *newpath, unsigned long preserve)
+{
+	if (reflink_backend == REFLINK_BACKEND_OCFS2)
+		return ocfs2_reflink(oldpath, newpath, preserve);
+
+	return generic_reflink(oldpath, newpath, preserve);
+}
+
+/*
+ * Share len bytes at src_off of oldpath into newpath at dst_off,
+ * newpath is created if needed. Offsets and len have to be aligned
+ * to the fs block size for the clone ioctls, except that len may run
+ * up to the end of oldpath.
+ */
+int reflink_range(const char *oldpath, const char *newpath, off_t src_off,
+		  off_t dst_off, off_t len)
+{
+	int sfd, dfd, ret;
+	struct stat st;
+
+	if (reflink_backend == REFLINK_BACKEND_OCFS2) {
+		fprintf(stderr, "ocfs2 reflink backend can't clone partial "
+			"ranges\n");
+		return -EOPNOTSUPP;
+	}
+
+	sfd = open64(oldpath, open_ro_flags);
+	if (sfd < 0) {
+		ret = errno;
+		fprintf(stderr, "open file %s failed:%d:%s\n", oldpath, ret,
+			strerror(ret));
+		return -ret;
+	}
+
+	/*
+	 * A zero len runs to the end of oldpath as with FICLONERANGE,
+	 * copy_file_range() would take it as nothing to copy.
+	 */
+	if (reflink_backend == REFLINK_BACKEND_COPY_RANGE && !len) {
+		if (fstat(sfd, &st)) {
+			ret = -errno;
+			close(sfd);
+			return ret;
+		}
+		if (st.st_size > src_off)
+			len = st.st_size - src_off;
+	}
+
+	dfd = open64(newpath, O_CREAT | O_WRONLY, FILE_MODE);
+	if (dfd < 0) {
+		ret = errno;
+		fprintf(stderr, "open file %s failed:%d:%s\n", newpath, ret,
+			strerror(ret));
+		close(sfd);
+		return -ret;
+	}
+
+	ret = generic_clone(reflink_backend, sfd, dfd, src_off, dst_off, len);
+	if (ret)
+		fprintf(stderr, "%s of %s [%lld, +%lld) to %s at %lld "
+			"failed:%d:%s\n", reflink_backend_name(reflink_backend),
+			oldpath, (long long)src_off, (long long)len, newpath,
+			(long long)dst_off, -ret, strerror(-ret));
+
+	close(sfd);
+	close(dfd);
+
+	return ret;
+}
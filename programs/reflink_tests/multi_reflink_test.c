@@ -24,6 +24,8 @@
 #include "xattr_test.h"
 
 #include <mpi.h>
+#include "mpi_rand.h"
+#include "mpi_lat_hist.h"
 
 ocfs2_filesys *fs;
 struct ocfs2_super_block *ocfs2_sb;
@@ -32,9 +34,6 @@ unsigned int blocksize;
 unsigned long clustersize;
 unsigned int max_inline_size;
 
-int open_rw_flags = FILE_RW_FLAGS;
-int open_ro_flags = FILE_RO_FLAGS;
-
 unsigned long page_size;
 unsigned long file_size = 1024 * 1024;
 
@@ -52,10 +51,10 @@ static int rank = -1, size;
 
 static unsigned long ref_counts = 10;
 static unsigned long ref_trees = 10;
+static int stress_threads;
 
 int test_flags = 0x00000000;
 
-static char dio_buf[DIRECTIO_SLICE] __attribute__ ((aligned(DIRECTIO_SLICE)));
 
 /*
   used to verify if original file corrupt
@@ -117,7 +116,8 @@ static void usage(void)
 {
        root_printf("Usage: multi_reflink_test [-i iteration] [-l file_size] "
 	       "[-p refcount_tree_pairs] [-n reflink_nums] <-w work_place> "
-	       "[-f] [-x] [-r] [-m] [-y] [-s] [-c] [-O] [-A]\n"
+	       "[-f] [-x] [-r] [-m] [-y] [-s] [-c] [-O] [-A] [-k backend] "
+	       "[-t threads] [--seed seed]\n"
 	       "iteration specify the running times.\n"
 	       "file_size specify the size of original file.\n"
 	       "reflink_nums specify the number of reflinks.\n"
@@ -128,10 +128,16 @@ static void usage(void)
 	       "-r specify the random test.\n"
 	       "-y specify the destructive test.\n"
 	       "-s specify the stress test.\n"
+	       "-t run refcount_tree_pairs trees through prep, reflink, CoW"
+	       " and unlink with this many threads per rank as part of the"
+	       " stress test, reporting ops/sec per phase.\n"
 	       "-c specify the comprehensive test.here need 6 ranks at least.\n"
 	       "-O specify O_DIRECT test.\n"
 	       "-A specify asynchronous io test.\n"
-	       "-m specify the mmap test.\n");
+	       "-m specify the mmap test.\n"
+	       "-k specify the clone backend: ocfs2 (default), ficlone,"
+	       " ficlonerange or copy_range.\n"
+	       "--seed replays the random choices of an earlier run.\n");
 
 	MPI_Finalize();
 	exit(1);
@@ -140,10 +146,11 @@ static void usage(void)
 
 int parse_opts(int argc, char **argv)
 {
-	int c;
+	int c, backend;
 
 	while (1) {
-		c = getopt(argc, argv, "I:i:w:OAfFrRmMyYcCsSW:n:N:l:L:p:P:x:X:");
+		c = getopt(argc, argv,
+			   "I:i:w:OAfFrRmMyYcCsSW:n:N:l:L:p:P:x:X:k:t:");
 		if (c == -1)
 			break;
 
@@ -182,6 +189,7 @@ int parse_opts(int argc, char **argv)
 			break;
 		case 'A':
 			test_flags |= ASIO_TEST;
+			set_write_at_fn(aio_write_and_check);
 			break;
 		case 'r':
 		case 'R':
@@ -195,6 +203,15 @@ int parse_opts(int argc, char **argv)
 		case 'Y':
 			test_flags |= DEST_TEST;
 			break;
+		case 't':
+			stress_threads = atoi(optarg);
+			break;
+		case 'k':
+			backend = reflink_parse_backend(optarg);
+			if (backend < 0)
+				return EINVAL;
+			reflink_set_backend(backend);
+			break;
 		case 'c':
 		case 'C':
 			test_flags |= COMP_TEST;
@@ -249,10 +266,11 @@ static void setup(int argc, char *argv[])
 	else
 		prog++;
 
+	MPI_Seed_Setup(&argc, argv);
+
 	if (parse_opts(argc, argv))
 		usage();
 
-	srand(getpid());
 	page_size = sysconf(_SC_PAGESIZE);
 
 	if (test_flags & XATR_TEST) {
@@ -615,7 +633,7 @@ bail_free:
 static int directio_test(void)
 {
 	int ret, fd;
-	char dest[PATH_MAX];
+	char dest[PATH_MAX], *dio_buf;
 	int sub_testno = 1;
 	int o_flags_rw, o_flags_ro;
 
@@ -635,6 +653,10 @@ static int directio_test(void)
 	while (align_filesz < file_size)
 		align_filesz += align_slice;
 
+	dio_buf = (char *)o2test_dio_buf_get();
+	if (!dio_buf)
+		abort_printf("no buffer for O_DIRECT I/O\n");
+
 	root_printf("Test %d: Multi-nodes O_DIRECT test.\n", testno++);
 
 	snprintf(orig_path, PATH_MAX, "%s/multi_original_directio_refile",
@@ -801,6 +823,8 @@ static int directio_test(void)
 	open_rw_flags = o_flags_rw;
 	open_ro_flags = o_flags_ro;
 
+	o2test_dio_buf_put(dio_buf);
+
 	MPI_Barrier_Sync();
 
 	return 0;
@@ -1345,6 +1369,225 @@ static int xattr_test(void)
 	return 0;
 }
 
+/*
+ * Thread pool for the parallel stress, each rank runs stress_threads
+ * workers which take refcount trees off a shared counter, so the prep,
+ * reflink, CoW and unlink of many trees are in flight at once.
+ */
+#define POOL_TREE_SIZE		(32 * 1024)
+
+enum pool_phase {
+	POOL_PREP = 0,
+	POOL_REFLINK,
+	POOL_COW,
+	POOL_UNLINK,
+	POOL_PHASE_NUM,
+	POOL_EXIT = POOL_PHASE_NUM,
+};
+
+static const char *pool_phase_names[POOL_PHASE_NUM] = {
+	"prep", "reflink", "cow", "unlink",
+};
+
+struct stress_pool {
+	pthread_barrier_t sp_start;
+	pthread_barrier_t sp_done;
+	int sp_phase;
+	unsigned long sp_next;
+	int sp_ret;
+};
+
+struct pool_worker {
+	struct stress_pool *pw_pool;
+	int pw_id;
+	char *pw_buf;
+	struct lat_hist pw_hists[POOL_PHASE_NUM];
+};
+
+static void pool_tree_paths(unsigned long i, char *orig, char *dest)
+{
+	snprintf(orig, PATH_MAX, "%s/multi_original_pool_stress_refile_"
+		 "rank%d_%ld", workplace, rank, i);
+	snprintf(dest, PATH_MAX, "%s_target", orig);
+}
+
+static int pool_do_one(struct pool_worker *pw, int phase, unsigned long i)
+{
+	char orig[PATH_MAX], dest[PATH_MAX];
+	unsigned long offset;
+	int ret;
+
+	pool_tree_paths(i, orig, dest);
+
+	switch (phase) {
+	case POOL_PREP:
+		get_rand_buf(pw->pw_buf, POOL_TREE_SIZE);
+		return write_at_file(orig, pw->pw_buf, POOL_TREE_SIZE, 0);
+	case POOL_REFLINK:
+		return reflink(orig, dest, 1);
+	case POOL_COW:
+		offset = get_rand(0, POOL_TREE_SIZE - 1);
+		get_rand_buf(pw->pw_buf, 1);
+		return write_at_file(dest, pw->pw_buf, 1, offset);
+	case POOL_UNLINK:
+		ret = do_unlink(orig);
+		if (!ret)
+			ret = do_unlink(dest);
+		return ret;
+	}
+
+	return -EINVAL;
+}
+
+static void *pool_worker_fn(void *arg)
+{
+	struct pool_worker *pw = (struct pool_worker *)arg;
+	struct stress_pool *sp = pw->pw_pool;
+	unsigned long i;
+	unsigned long long start;
+	int ret;
+
+	/* reproducible per rank and thread for a given --seed */
+	o2test_rand_stream(((unsigned long)(pw->pw_id + 1) << 16) + rank);
+
+	while (1) {
+		pthread_barrier_wait(&sp->sp_start);
+		if (sp->sp_phase == POOL_EXIT)
+			break;
+
+		while (!sp->sp_ret) {
+			i = __sync_fetch_and_add(&sp->sp_next, 1);
+			if (i >= ref_trees)
+				break;
+
+			start = get_time_microseconds();
+			ret = pool_do_one(pw, sp->sp_phase, i);
+			lat_hist_record(&pw->pw_hists[sp->sp_phase],
+					get_time_microseconds() - start);
+			if (ret) {
+				__sync_bool_compare_and_swap(&sp->sp_ret, 0,
+							     ret);
+				break;
+			}
+		}
+
+		pthread_barrier_wait(&sp->sp_done);
+	}
+
+	return NULL;
+}
+
+static int pool_stress_test(void)
+{
+	struct stress_pool sp;
+	struct pool_worker *workers = NULL;
+	pthread_t *threads = NULL;
+	struct lat_hist *lh = NULL;
+	double elapsed, max_elapsed;
+	unsigned long long start;
+	int i, phase, nr_threads = 0, ret = 0;
+
+	memset(&sp, 0, sizeof(sp));
+	pthread_barrier_init(&sp.sp_start, NULL, stress_threads + 1);
+	pthread_barrier_init(&sp.sp_done, NULL, stress_threads + 1);
+
+	workers = (struct pool_worker *)calloc(stress_threads,
+					       sizeof(*workers));
+	threads = (pthread_t *)calloc(stress_threads, sizeof(*threads));
+	lh = (struct lat_hist *)malloc(sizeof(*lh));
+	if (!workers || !threads || !lh) {
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	for (i = 0; i < stress_threads; i++) {
+		workers[i].pw_pool = &sp;
+		workers[i].pw_id = i;
+		for (phase = 0; phase < POOL_PHASE_NUM; phase++)
+			lat_hist_init(&workers[i].pw_hists[phase]);
+
+		workers[i].pw_buf = (char *)malloc(POOL_TREE_SIZE);
+		if (!workers[i].pw_buf) {
+			ret = -ENOMEM;
+			goto bail;
+		}
+	}
+
+	for (nr_threads = 0; nr_threads < stress_threads; nr_threads++) {
+		ret = pthread_create(&threads[nr_threads], NULL,
+				     pool_worker_fn, &workers[nr_threads]);
+		if (ret) {
+			abort_printf("pthread_create failed: %d:%s\n", ret,
+				     strerror(ret));
+			ret = -ret;
+			goto bail;
+		}
+	}
+
+	root_printf("  *%-8s %10s %12s %10s %10s %10s\n", "phase", "ops",
+		    "ops/sec", "p50(us)", "p99(us)", "max(us)");
+
+	for (phase = 0; phase < POOL_PHASE_NUM; phase++) {
+
+		/* ranks start every phase together, they share the fs */
+		MPI_Barrier_Sync();
+
+		sp.sp_phase = phase;
+		sp.sp_next = 0;
+
+		start = get_time_microseconds();
+		pthread_barrier_wait(&sp.sp_start);
+		pthread_barrier_wait(&sp.sp_done);
+		elapsed = (get_time_microseconds() - start) / 1000000.0;
+
+		if (sp.sp_ret) {
+			ret = sp.sp_ret;
+			abort_printf("%s phase failed: %d\n",
+				     pool_phase_names[phase], ret);
+			goto bail;
+		}
+
+		lat_hist_init(lh);
+		for (i = 0; i < stress_threads; i++)
+			lat_hist_merge(lh, &workers[i].pw_hists[phase]);
+
+		ret = lat_hist_mpi_reduce(lh, 0, MPI_COMM_WORLD);
+		if (ret != MPI_SUCCESS)
+			abort_printf("MPI_Reduce failed: %d\n", ret);
+		MPI_Reduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0,
+			   MPI_COMM_WORLD);
+
+		root_printf("  *%-8s %10llu %12.1f %10llu %10llu %10llu\n",
+			    pool_phase_names[phase],
+			    (unsigned long long)lh->lh_count,
+			    max_elapsed > 0 ? lh->lh_count / max_elapsed : 0.0,
+			    (unsigned long long)lat_hist_percentile(lh, 50.0),
+			    (unsigned long long)lat_hist_percentile(lh, 99.0),
+			    (unsigned long long)lh->lh_max);
+	}
+
+bail:
+	if (nr_threads) {
+		sp.sp_phase = POOL_EXIT;
+		pthread_barrier_wait(&sp.sp_start);
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(threads[i], NULL);
+	}
+
+	if (workers)
+		for (i = 0; i < stress_threads; i++)
+			free(workers[i].pw_buf);
+
+	free(workers);
+	free(threads);
+	free(lh);
+
+	pthread_barrier_destroy(&sp.sp_start);
+	pthread_barrier_destroy(&sp.sp_done);
+
+	return ret;
+}
+
 static int stress_test(void)
 {
 	unsigned long i, j;
@@ -1619,6 +1862,15 @@ static int stress_test(void)
 			goto bail;
 	}
 
+	if (stress_threads > 0) {
+		MPI_Barrier_Sync();
+
+		root_printf("  *SubTest %d: Parallel stress test with %d "
+			    "threads per rank on %lu refcount trees.\n",
+			    sub_testno++, stress_threads, ref_trees);
+		ret = pool_stress_test();
+	}
+
 bail:
 	if (write_buf)
 		free(write_buf);
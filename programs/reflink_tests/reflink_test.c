@@ -35,9 +35,6 @@ unsigned int blocksize;
 unsigned long clustersize;
 unsigned int max_inline_size;
 
-int open_rw_flags = FILE_RW_FLAGS;
-int open_ro_flags = FILE_RO_FLAGS;
-
 unsigned long page_size;
 unsigned long file_size = 1024 * 1024;
 
@@ -50,7 +47,12 @@ static char ref_path[PATH_MAX];
 static char fh_log_orig[PATH_MAX];
 static char fh_log_dest[PATH_MAX];
 
-static char dest_log_path[PATH_MAX];
+static char bench_csv_path[PATH_MAX];
+static FILE *bench_fp;
+static int bench_round;
+
+static char space_report_path[PATH_MAX];
+static FILE *space_fp;
 
 static char lsnr_addr[HOSTNAME_LEN];
 
@@ -108,7 +110,9 @@ static void usage(void)
 	printf("Usage: reflink_tests [-i iteration] <-n ref_counts> "
 	       "<-p refcount_tree_pairs> <-l file_size> <-d disk> "
 	       "<-w workplace> -f -b [-c conc_procs] -m -s -r [-x xattr_nums]"
-	       " [-h holes_num] [-o holes_filling_log] -O -A -D <child_nums> -I -H -T\n\n"
+	       " [-h holes_num] [-o holes_filling_log] -O -A -D <child_nums> -I -H -T"
+	       " -g [-k backend] -E [-J csv_file] [-j threads] [-u space_report]"
+	       " [-v child_nums] [--seed seed]\n\n"
 	       "-f enable basic feature test.\n"
 	       "-b enable boundary test.\n"
 	       "-c enable concurrent tests with conc_procs processes.\n"
@@ -118,10 +122,24 @@ static void usage(void)
 	       "-O enable O_DIRECT test.\n"
 	       "-A enable asynchronous io test.\n"
 	       "-D enable destructive test.\n"
-	       "-v enable verification for destructive test.\n"
+	       "-v enable verification for destructive test, run it on "
+	       "another node before -D, it receives the write records of "
+	       "the child_nums writers on the listening port.\n"
+	       "-j verify the destructive test's reflinks with this many"
+	       " threads, it takes effect when -v enabled.\n"
 	       "-H enable CoW verification test for punching holes.\n"
 	       "-T enable CoW verification test for truncating.\n"
 	       "-I enable inline-data test.\n"
+	       "-g enable partial-range reflink test, not for ocfs2 backend.\n"
+	       "-E enable reflink fan-out benchmark, create and CoW latency"
+	       " against refcount tree depth and width.\n"
+	       "-J write the benchmark histograms of every round as CSV to"
+	       " csv_file.\n"
+	       "-u write free space and extent counts around every CoW phase"
+	       " of the basic and punch hole tests as CSV to space_report.\n"
+	       "-k specify the clone backend: ocfs2 (default), ficlone,"
+	       " ficlonerange or copy_range, all but ocfs2 run on any fs"
+	       " with shared extents and need no disk.\n"
 	       "-x enable combination test with xattr.\n"
 	       "-h enable holes punching and filling tests.\n"
 	       "-o specify logfile for holes filling tests,it takes effect"
@@ -133,19 +151,21 @@ static void usage(void)
 	       "ref_counts specify the reflinks number for one shared inode.\n"
 	       "refcount_tree_pairs specify the refcount tree numbers in fs.\n"
 	       "file_size specify the file size for reflinks.\n"
-	       "disk specify the target volume.\n"
-	       "workplace specify the dir where tests will happen.\n\n");
+	       "disk specify the target volume, ocfs2 backend only.\n"
+	       "workplace specify the dir where tests will happen.\n"
+	       "--seed replays the random choices of an earlier run.\n\n");
 	exit(1);
 }
 
 static int parse_opts(int argc, char **argv)
 {
 	char c;
+	int backend;
 
 	while (1) {
 		c = getopt(argc, argv,
-			   "i:d:w:IOAfFbBsSrRHTmMW:n:N:"
-			   "l:L:c:C:p:x:X:h:o:v:a:P:D:");
+			   "i:d:w:IOAfFbBsSrRHTgmMW:n:N:"
+			   "l:L:c:C:p:x:X:h:o:v:a:P:D:k:EJ:j:u:");
 		if (c == -1)
 			break;
 
@@ -172,6 +192,7 @@ static int parse_opts(int argc, char **argv)
 			break;
 		case 'A':
 			test_flags |= ASIO_TEST;
+			set_write_at_fn(aio_write_and_check);
 			break;
 		case 'D':
 			test_flags |= DSCV_TEST;
@@ -189,9 +210,15 @@ static int parse_opts(int argc, char **argv)
 			strcpy(fh_log_orig, optarg);
 			break;
 		case 'v':
-			strcpy(dest_log_path, optarg);
+			child_nums = atol(optarg);
 			test_flags |= VERI_TEST;
 			break;
+		case 'j':
+			set_dest_verify_threads(atoi(optarg));
+			break;
+		case 'u':
+			strcpy(space_report_path, optarg);
+			break;
 		case 'a':
 			strcpy(lsnr_addr, optarg);
 			break;
@@ -238,6 +265,21 @@ static int parse_opts(int argc, char **argv)
 		case 'T':
 			test_flags |= TRUC_TEST;
 			break;
+		case 'g':
+			test_flags |= RNGE_TEST;
+			break;
+		case 'E':
+			test_flags |= BNCH_TEST;
+			break;
+		case 'J':
+			strcpy(bench_csv_path, optarg);
+			break;
+		case 'k':
+			backend = reflink_parse_backend(optarg);
+			if (backend < 0)
+				return EINVAL;
+			reflink_set_backend(backend);
+			break;
 		default:
 			break;
 		}
@@ -246,7 +288,8 @@ static int parse_opts(int argc, char **argv)
 	if (strcmp(workplace, "") == 0)
 		return EINVAL;
 
-	if (strcmp(device, "") == 0)
+	if ((reflink_get_backend() == REFLINK_BACKEND_OCFS2) &&
+	    (strcmp(device, "") == 0))
 		return EINVAL;
 
 	if (test_flags & DSCV_TEST)
@@ -267,13 +310,21 @@ static void setup(int argc, char *argv[])
 	else
 		prog++;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (parse_opts(argc, argv))
 		usage();
 
-	ret = open_ocfs2_volume(device);
-	if (ret < 0) {
-		fprintf(stderr, "Open_ocfs2_volume failed!\n");
-		exit(ret);
+	if (reflink_get_backend() == REFLINK_BACKEND_OCFS2) {
+		ret = open_ocfs2_volume(device);
+		if (ret < 0) {
+			fprintf(stderr, "Open_ocfs2_volume failed!\n");
+			exit(ret);
+		}
+	} else {
+		ret = open_generic_volume(workplace);
+		if (ret < 0)
+			exit(ret);
 	}
 
 	orig_pattern = (char *)malloc(PATTERN_SIZE);
@@ -282,9 +333,31 @@ static void setup(int argc, char *argv[])
 
 	memset(orig_pattern, 0, PATTERN_SIZE);
 
-	srand(getpid());
 	page_size = sysconf(_SC_PAGESIZE);
 
+	if (strcmp(space_report_path, "")) {
+		space_fp = fopen(space_report_path, "w");
+		if (!space_fp) {
+			ret = errno;
+			fprintf(stderr, "open %s failed:%d:%s\n",
+				space_report_path, ret, strerror(ret));
+			exit(ret);
+		}
+		space_report_header(space_fp);
+	}
+
+	/* one CSV for all iterations, rows carry their round */
+	if (strcmp(bench_csv_path, "")) {
+		bench_fp = fopen(bench_csv_path, "w");
+		if (!bench_fp) {
+			ret = errno;
+			fprintf(stderr, "open %s failed:%d:%s\n",
+				bench_csv_path, ret, strerror(ret));
+			exit(ret);
+		}
+		lat_hist_csv_header(bench_fp, "round,shape,op,refs_lo,refs_hi");
+	}
+
 	if ((test_flags & XATR_TEST) || (test_flags & INLN_TEST)) {
 		xattr_name = (char *)malloc(XATTR_NAME_MAX_SZ + 1);
 		name_get = (char *)malloc(XATTR_NAME_MAX_SZ + 1);
@@ -319,6 +392,12 @@ static void teardown(void)
 	if (child_pid_list)
 		free(child_pid_list);
 
+	if (space_fp)
+		fclose(space_fp);
+
+	if (bench_fp)
+		fclose(bench_fp);
+
 	if ((test_flags & XATR_TEST) || (test_flags & INLN_TEST)) {
 
 		free((void *)xattr_name);
@@ -348,10 +427,32 @@ static void should_exit(int is_error)
 	}
 }
 
+/* sample orig_path and its reflinks before a CoW phase, if -u was given */
+static void space_begin(struct space_sample *before)
+{
+	if (space_fp)
+		should_exit(sample_space(orig_path, ref_counts, before));
+}
+
+static void space_end(const char *test, const char *phase,
+		      struct space_sample *before)
+{
+	struct space_sample after;
+
+	if (!space_fp)
+		return;
+
+	should_exit(sample_space(orig_path, ref_counts, &after));
+	space_report_row(space_fp, test, phase, before, &after);
+}
+
 static int basic_test()
 {
 	int i, ret;
 	int sub_testno = 1;
+	struct reflink_pair_stat stat;
+	struct space_sample ss;
+	char space_test[32];
 
 	printf("Test %d: Basic reflink test.\n", testno++);
 
@@ -360,6 +461,7 @@ static int basic_test()
 	for (i = 0; i < 2; i++) {
 
 		printf("  *Use Contiguous Extent = %d.\n", i);
+		snprintf(space_test, sizeof(space_test), "basic_contig%d", i);
 		printf("  *SubTest %d: Prepare file.\n", sub_testno++);
 		ret = prep_orig_file(orig_path, file_size, i);
 		should_exit(ret);
@@ -368,6 +470,12 @@ static int basic_test()
 		       ref_counts);
 		ret = do_reflinks(orig_path, orig_path, ref_counts, 0);
 		should_exit(ret);
+		printf("  *SubTest %d: Verify %ld reflinks.\n", sub_testno++,
+		       ref_counts);
+		ret = verify_reflinks(orig_path, orig_path, ref_counts, &stat);
+		should_exit(ret);
+		printf("  *%llu bytes shared, %llu in holes, %llu compared.\n",
+		       stat.rps_shared, stat.rps_holes, stat.rps_diverged);
 		printf("  *SubTest %d: Read %ld reflinks.\n", sub_testno++,
 		       ref_counts);
 		ret = do_reads_on_reflinks(orig_path, ref_counts, file_size,
@@ -377,35 +485,43 @@ static int basic_test()
 		printf("  *SubTest %d: Do CoW on %ld reflinks.\n", sub_testno++,
 		       ref_counts);
 		if (test_flags & RAND_TEST) {
+			space_begin(&ss);
 			ret = do_cows_on_write(orig_path, ref_counts, file_size,
 					       HUNK_SIZE);
 			should_exit(ret);
+			space_end(space_test, "cow_write_rand", &ss);
 			ret = verify_orig_file(orig_path);
 			should_exit(ret);
 		} else {
 			printf("  *SubTest %d: Do CoW on %d interval.\n",
 			       sub_testno++, blocksize);
+			space_begin(&ss);
 			ret = do_cows_on_write(orig_path, ref_counts, file_size,
 					       blocksize);
 			should_exit(ret);
+			space_end(space_test, "cow_write_block_interval", &ss);
 			printf("  *SubTest %d: Verify Original inode.\n",
 			       sub_testno++);
 			ret = verify_orig_file(orig_path);
 			should_exit(ret);
 			printf("  *SubTest %d: Do CoW on %ld interval.\n",
 			       sub_testno++, clustersize);
+			space_begin(&ss);
 			ret = do_cows_on_write(orig_path, ref_counts, file_size,
 					       clustersize);
 			should_exit(ret);
+			space_end(space_test, "cow_write_cluster_interval", &ss);
 			printf("  *SubTest %d: Verify Original inode.\n",
 			       sub_testno++);
 			ret = verify_orig_file(orig_path);
 			should_exit(ret);
 			printf("  *SubTest %d: Do CoW on %d interval.\n",
 			       sub_testno, HUNK_SIZE);
+			space_begin(&ss);
 			ret = do_cows_on_write(orig_path, ref_counts, file_size,
 					       HUNK_SIZE);
 			should_exit(ret);
+			space_end(space_test, "cow_write_hunk_interval", &ss);
 			printf("  *SubTest %d: Verify Original inode.\n",
 			       sub_testno++);
 			ret = verify_orig_file(orig_path);
@@ -431,8 +547,10 @@ static int basic_test()
 		should_exit(ret);
 		printf("  *SubTest %d: Do CoW on truncate with %ld reflinks.\n",
 		       sub_testno++, ref_counts);
+		space_begin(&ss);
 		ret = do_cows_on_ftruncate(orig_path, ref_counts, file_size);
 		should_exit(ret);
+		space_end(space_test, "cow_truncate", &ss);
 		printf("  *SubTest %d: Verify Original inode.\n", sub_testno++);
 		ret = verify_orig_file(orig_path);
 		should_exit(ret);
@@ -450,8 +568,10 @@ static int basic_test()
 		should_exit(ret);
 		printf("  *SubTest %d: Do CoW on append with %ld reflinks.\n",
 		       sub_testno++, ref_counts);
+		space_begin(&ss);
 		ret = do_appends(orig_path, ref_counts);
 		should_exit(ret);
+		space_end(space_test, "cow_append", &ss);
 		ret = verify_orig_file(orig_path);
 		should_exit(ret);
 		printf("  *SubTest %d: Unlink %ld reflinks.\n", sub_testno++,
@@ -1034,7 +1154,7 @@ static int concurrent_test()
 		/* and some increment the refcount, some decrement*/
 		if (pid == 0) {
 
-			srand(getpid());
+			o2test_rand_stream(i + 1);
 
 			choice = get_rand(0, 3);
 
@@ -1909,11 +2029,23 @@ static int holes_fill_test(void)
 	return 0;
 }
 
+/*
+ * Last thing before the crash: end our own stream, then hold the
+ * semaphore long enough for the other children's streams to empty.
+ */
+static void drain_records(struct wu_stream *ws)
+{
+	wu_stream_close(ws);
+	usleep(2 * WU_STREAM_FLUSH_MS * 1000);
+}
+
 static int destructive_test(void)
 {
-	int o_flags_rw, o_flags_ro, sockfd, i, j, status;
+	int o_flags_rw, o_flags_ro, i, j, status;
 	int ret, o_ret, fd, rc, sub_testno = 1;
-	char log_rec[1024], dest[PATH_MAX];
+	char dest[PATH_MAX];
+
+	struct wu_stream ws;
 
 	struct dest_write_unit dwu;
 
@@ -1976,10 +2108,6 @@ static int destructive_test(void)
 
 	signal(SIGCHLD, sigchld_handler);
 
-	printf("  *SubTest %d: Init socket for msg sending\n", sub_testno++);
-
-	sockfd = init_sock(lsnr_addr, port);
-
 	printf("  *SubTest %d: Fork %lu children to write in chunks.\n",
 	       sub_testno++, child_nums);
 
@@ -2005,7 +2133,12 @@ static int destructive_test(void)
 		/* child to do CoW*/
 		if (pid == 0) {
 
-			srand(getpid());
+			o2test_rand_stream(i + 1);
+
+			ret = wu_stream_open(&ws, lsnr_addr, port, CHUNK_SIZE,
+					     chunk_no * CHUNK_SIZE, 0, 0);
+			if (ret)
+				goto child_bail;
 
 			for (j = 0; j < chunk_no; j++) {
 
@@ -2014,18 +2147,16 @@ static int destructive_test(void)
 					goto child_bail;
 				}
 
-				memset(log_rec, 0, sizeof(log_rec));
 				prep_rand_dest_write_unit(&dwu, get_rand(0,
 							  chunk_no - 1));
-				snprintf(log_rec, sizeof(log_rec), "%lu\t%llu"
-					 "\t%d\t%c\n", dwu.d_chunk_no,
-					 dwu.d_timestamp, dwu.d_checksum,
-					 dwu.d_char);
 
 				ret = do_write_chunk(fd, &dwu);
 				if (ret)
 					goto child_bail;
-				write(sockfd, log_rec, strlen(log_rec) + 1);
+
+				ret = log_stream_write(&ws, &dwu);
+				if (ret)
+					goto child_bail;
 
 				if (semaphore_v(sem_id) < 0) {
 					ret = -1;
@@ -2039,19 +2170,19 @@ static int destructive_test(void)
 						goto child_bail;
 					}
 
+					/*
+					 * The verifier tells what a target
+					 * has to hold by when it was taken.
+					 */
 					snprintf(dest, PATH_MAX,
-						 "%s_target_%d_%d",
-						 orig_path, getpid(), j);
-					memset(log_rec, 0, sizeof(log_rec));
-					snprintf(log_rec, sizeof(log_rec),
-						 "Reflink:\t%s\t->\t%s\n",
-						 orig_path, dest);
+						 "%s_target_%llu_%d",
+						 orig_path,
+						 get_time_microseconds(),
+						 getpid());
 					ret = reflink(orig_path, dest, 1);
 					if (ret)
 						goto child_bail;
-					write(sockfd, log_rec,
-					      strlen(log_rec) + 1);
-					
+
 					if (semaphore_v(sem_id) < 0) {
 						ret = -1;
 						goto child_bail;
@@ -2067,6 +2198,7 @@ static int destructive_test(void)
 							goto child_bail;
 						}
 
+						drain_records(&ws);
 						system("echo b>/proc/sysrq-trigger");
 					}
 				} else if (j == chunk_no - 1) {
@@ -2076,18 +2208,19 @@ static int destructive_test(void)
 							goto child_bail;
 						}
 
+						drain_records(&ws);
 						system("echo b>/proc/sysrq-trigger");
 				}
 
 				usleep(10000);
 			}
 child_bail:
+			if (wu_stream_close(&ws) < 0 && !ret)
+				ret = -1;
+
 			if (fd)
 				close(fd);
 
-			if (sockfd)
-				close(sockfd);
-
 			if (sem_id)
 				semaphore_close(sem_id);
 
@@ -2125,9 +2258,6 @@ child_bail:
 	if (fd)
 		close(fd);
 
-	if (sockfd)
-		close(sockfd);
-
 	if (sem_id)
 		semaphore_close(sem_id);
 
@@ -2139,8 +2269,9 @@ static int verification_dest(void)
 
 	unsigned long align_slice = CHUNK_SIZE;
 	unsigned long align_filesz = align_slice;
-	unsigned long chunk_no = 0;
-	int ret;
+	unsigned long chunk_no = 0, records;
+	int ret, lsn_sock;
+	struct wu_table wt;
 
 	while (align_filesz < file_size)
 		align_filesz += CHUNK_SIZE;
@@ -2152,7 +2283,29 @@ static int verification_dest(void)
 	snprintf(orig_path, PATH_MAX, "%s/original_destructive_refile",
 		 workplace);
 
-	ret = verify_dest_files(dest_log_path, orig_path, chunk_no);
+	printf("  *SubTest 1: Receive write records of %lu children on "
+	       "port %lu.\n", child_nums, port);
+
+	lsn_sock = wu_sink_listen(port);
+	should_exit(lsn_sock);
+
+	set_sink_crash_wait(WU_SINK_CRASH_WAIT);
+	ret = wu_sink_receive(lsn_sock, child_nums, &wt, &records);
+	close(lsn_sock);
+	should_exit(ret);
+
+	printf("  *SubTest 2: Verify original file and its targets "
+	       "against %lu write records.\n", records);
+
+	if (wt.wt_num_chunks != chunk_no) {
+		fprintf(stderr, "Writers log %lu chunks, not %lu.\n",
+			wt.wt_num_chunks, chunk_no);
+		ret = -EINVAL;
+	} else {
+		ret = verify_dest_files(&wt, orig_path, chunk_no);
+	}
+
+	wu_table_free(&wt);
 	should_exit(ret);
 
 	return ret;
@@ -2381,6 +2534,7 @@ static int verify_punch_hole_cow_test(void)
 	int sub_testno = 1;
 	char *write_pattern = NULL;
 	char *read_pattern = NULL;
+	struct space_sample ss;
 
 	unsigned long i;
 	unsigned long long offset, len, read_size;
@@ -2410,6 +2564,8 @@ static int verify_punch_hole_cow_test(void)
 	printf("  *SubTest %d: Punching hole to original file.\n",
 	       sub_testno++);
 
+	space_begin(&ss);
+
 	fd = open_file(orig_path, O_RDWR);
 	if (fd < 0)
 		goto bail;
@@ -2437,6 +2593,8 @@ static int verify_punch_hole_cow_test(void)
 	
 	close(fd);
 
+	space_end("punch_hole", "cow_punch_hole", &ss);
+
 	printf("  *SubTest %d: Verify reflinks after punching holes.\n",
 	       sub_testno++);
 
@@ -2608,6 +2766,319 @@ bail:
 	return ret;
 }
 
+/*
+ * Clone random block aligned ranges of the original into new files,
+ * check the data came across and that CoW on the clones leaves the
+ * original alone, then report how fast the backend cloned.
+ */
+static int range_reflink_test(void)
+{
+	int ret = 0;
+	int sub_testno = 1;
+	char dest[PATH_MAX];
+	char *read_buf = NULL, *write_buf = NULL;
+	unsigned long i, range_size, nblocks, blk, nblks;
+	unsigned long src_off, dst_off, len;
+	unsigned long long start, lat, total_lat = 0, max_lat = 0;
+	unsigned long long total_bytes = 0;
+
+	printf("Test %d: Partial-range reflink test.\n", testno++);
+
+	if (reflink_get_backend() == REFLINK_BACKEND_OCFS2) {
+		printf("  *SubTest %d: Skipped, the %s backend can't clone "
+		       "ranges.\n", sub_testno++,
+		       reflink_backend_name(REFLINK_BACKEND_OCFS2));
+		return 0;
+	}
+
+	/* only the first PATTERN_SIZE bytes can be verified */
+	range_size = file_size;
+	if (range_size > PATTERN_SIZE)
+		range_size = PATTERN_SIZE;
+
+	nblocks = range_size / blocksize;
+	if (!nblocks) {
+		printf("  *SubTest %d: Skipped, file_size is below one "
+		       "block.\n", sub_testno++);
+		return 0;
+	}
+
+	read_buf = (char *)malloc(nblocks * blocksize);
+	write_buf = (char *)malloc(nblocks * blocksize);
+	if (!read_buf || !write_buf) {
+		fprintf(stderr, "failed to allocate %lu bytes\n",
+			nblocks * blocksize);
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	if (snprintf(orig_path, PATH_MAX, "%s/original_range_refile",
+		     workplace) >= PATH_MAX) {
+		fprintf(stderr, "workplace %s is too long\n", workplace);
+		ret = -ENAMETOOLONG;
+		goto bail;
+	}
+
+	printf("  *SubTest %d: Prepare original file in %lu bytes.\n",
+	       sub_testno++, file_size);
+	ret = prep_orig_file(orig_path, file_size, 1);
+	should_exit(ret);
+
+	printf("  *SubTest %d: Do %ld range reflinks via %s.\n",
+	       sub_testno++, ref_counts,
+	       reflink_backend_name(reflink_get_backend()));
+
+	for (i = 0; i < ref_counts; i++) {
+		snprintf(dest, PATH_MAX, "%sr%ld", orig_path, i);
+
+		blk = get_rand(0, nblocks - 1);
+		nblks = get_rand(1, nblocks - blk);
+		src_off = blk * blocksize;
+		len = nblks * blocksize;
+		dst_off = get_rand(0, nblocks - 1) * blocksize;
+
+		start = get_time_microseconds();
+		ret = reflink_range(orig_path, dest, src_off, dst_off, len);
+		lat = get_time_microseconds() - start;
+		if (ret)
+			goto bail;
+
+		total_lat += lat;
+		total_bytes += len;
+		if (lat > max_lat)
+			max_lat = lat;
+
+		ret = read_at_file(dest, read_buf, len, dst_off);
+		if (ret)
+			goto bail;
+
+		ret = verify_pattern(read_buf, src_off, len);
+		if (ret) {
+			fprintf(stderr, "range reflink %s differs from the "
+				"original\n", dest);
+			goto bail;
+		}
+
+		/* CoW on the clone */
+		get_rand_buf(write_buf, len);
+		ret = write_at_file(dest, write_buf, len, dst_off);
+		if (ret)
+			goto bail;
+	}
+
+	printf("  *SubTest %d: Cloned %llu bytes, %.2f MB/s, latency avg "
+	       "%llu us, max %llu us.\n", sub_testno++, total_bytes,
+	       total_lat ? (double)total_bytes / total_lat : 0.0,
+	       ref_counts ? total_lat / ref_counts : 0, max_lat);
+
+	printf("  *SubTest %d: Verify original file after CoWs.\n",
+	       sub_testno++);
+	ret = verify_orig_file(orig_path);
+	should_exit(ret);
+
+	ret = do_unlinks(orig_path, ref_counts);
+	should_exit(ret);
+
+	ret = do_unlink(orig_path);
+	should_exit(ret);
+
+bail:
+	if (read_buf)
+		free(read_buf);
+
+	if (write_buf)
+		free(write_buf);
+
+	should_exit(ret);
+
+	return ret;
+}
+
+/*
+ * Latency is binned by the position of a reflink in its tree, band b
+ * holding reflinks [2^b - 1, 2^(b + 1) - 1), that is depth for a
+ * chain, width for a fan-out from one head and tree size otherwise.
+ */
+static unsigned int bench_band(unsigned long i)
+{
+	unsigned int band = 0;
+
+	for (i++; i > 1; i >>= 1)
+		band++;
+
+	return band;
+}
+
+static void bench_csv_rows(FILE *fp, const char *shape, const char *op,
+			   struct lat_hist *hists, unsigned int nbands)
+{
+	unsigned int b;
+	char keys[128];
+	struct lat_hist total;
+
+	lat_hist_init(&total);
+
+	for (b = 0; b < nbands; b++) {
+		if (!hists[b].lh_count)
+			continue;
+
+		snprintf(keys, sizeof(keys), "%d,%s,%s,%lu,%lu", bench_round,
+			 shape, op, (1UL << b) - 1, (1UL << (b + 1)) - 2);
+		if (fp)
+			lat_hist_csv_row(fp, keys, &hists[b]);
+		lat_hist_merge(&total, &hists[b]);
+	}
+
+	snprintf(keys, sizeof(keys), "%d,%s,%s,all,all", bench_round, shape,
+		 op);
+	if (fp)
+		lat_hist_csv_row(fp, keys, &total);
+
+	printf("  %s %s: %"PRIu64" ops, p50 %"PRIu64" us, p99 %"PRIu64
+	       " us, p999 %"PRIu64" us, max %"PRIu64" us.\n", shape, op,
+	       total.lh_count, lat_hist_percentile(&total, 50.0),
+	       lat_hist_percentile(&total, 99.0),
+	       lat_hist_percentile(&total, 99.9), total.lh_max);
+}
+
+/*
+ * Build one refcount tree in the given shape, timing every reflink.
+ * Then take the first write on one cluster of each reflink, which has
+ * to CoW a still shared extent. Buffered writes are synced as part of
+ * the op, filesystems which only allocate at writeback would otherwise
+ * hide the CoW.
+ */
+static int bench_one_shape(FILE *fp, int manner, const char *shape,
+			   char *cow_buf, struct lat_hist *create,
+			   struct lat_hist *cow, unsigned int nbands)
+{
+	int ret, fd;
+	unsigned long i, j = 0, clusters, offset;
+	unsigned long long start;
+	char from[PATH_MAX], to[PATH_MAX];
+
+	for (i = 0; i < nbands; i++) {
+		lat_hist_init(&create[i]);
+		lat_hist_init(&cow[i]);
+	}
+
+	ret = prep_orig_file(orig_path, file_size, 1);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < ref_counts; i++) {
+		/* j is 0 for the head, or n + 1 for reflink n */
+		if (!i || manner == 0)
+			j = 0;
+		else if (manner == 1)
+			j = i;
+		else
+			j = get_rand(0, i);
+
+		if (!j)
+			strcpy(from, orig_path);
+		else
+			snprintf(from, PATH_MAX, "%sr%ld", orig_path, j - 1);
+		snprintf(to, PATH_MAX, "%sr%ld", orig_path, i);
+
+		start = get_time_microseconds();
+		ret = reflink(from, to, 1);
+		if (ret)
+			return ret;
+		lat_hist_record(&create[bench_band(i)],
+				get_time_microseconds() - start);
+	}
+
+	clusters = file_size / clustersize;
+	if (!clusters)
+		clusters = 1;
+
+	for (i = 0; i < ref_counts; i++) {
+		snprintf(to, PATH_MAX, "%sr%ld", orig_path, i);
+		fd = open64(to, open_rw_flags);
+		if (fd < 0) {
+			ret = errno;
+			fprintf(stderr, "open file %s failed:%d:%s\n", to, ret,
+				strerror(ret));
+			return -ret;
+		}
+
+		offset = get_rand(0, clusters - 1) * clustersize;
+		get_rand_buf(cow_buf, clustersize);
+
+		start = get_time_microseconds();
+		ret = write_at(fd, cow_buf, clustersize, offset);
+		if (!ret && (test_flags & ODCT_TEST) == 0)
+			ret = fsync(fd);
+		lat_hist_record(&cow[bench_band(i)],
+				get_time_microseconds() - start);
+		close(fd);
+		if (ret)
+			return ret;
+	}
+
+	bench_csv_rows(fp, shape, "reflink", create, nbands);
+	bench_csv_rows(fp, shape, "cow", cow, nbands);
+
+	ret = do_unlinks(orig_path, ref_counts);
+	if (ret)
+		return ret;
+
+	return do_unlink(orig_path);
+}
+
+static int fanout_bench_test(void)
+{
+	int ret = 0, manner;
+	int sub_testno = 1;
+	unsigned int nbands;
+	char *cow_buf = NULL;
+	struct lat_hist *create = NULL, *cow = NULL;
+	const char *shapes[] = { "head", "chain", "random" };
+
+	printf("Test %d: Reflink fan-out benchmark.\n", testno++);
+
+	nbands = bench_band(ref_counts - 1) + 1;
+	create = (struct lat_hist *)malloc(sizeof(*create) * nbands);
+	cow = (struct lat_hist *)malloc(sizeof(*cow) * nbands);
+	if (!create || !cow) {
+		ret = -ENOMEM;
+		goto bail;
+	}
+
+	/* aligned for O_DIRECT as well */
+	ret = posix_memalign((void **)&cow_buf, DIRECTIO_SLICE, clustersize);
+	if (ret) {
+		ret = -ret;
+		goto bail;
+	}
+
+	snprintf(orig_path, PATH_MAX, "%s/original_bench_refile", workplace);
+
+	for (manner = 0; manner < 3; manner++) {
+		printf("  *SubTest %d: %lu reflinks in %s shape, then one "
+		       "%lu byte CoW on each.\n", sub_testno++, ref_counts,
+		       shapes[manner], clustersize);
+		ret = bench_one_shape(bench_fp, manner, shapes[manner],
+				      cow_buf, create, cow, nbands);
+		if (ret)
+			break;
+	}
+
+	if (bench_fp)
+		fflush(bench_fp);
+	bench_round++;
+
+bail:
+	free(cow_buf);
+	free(create);
+	free(cow);
+
+	should_exit(ret);
+
+	return ret;
+}
+
 static void run_test(void)
 {
 	int i;
@@ -2658,6 +3129,12 @@ static void run_test(void)
 		if (test_flags & TRUC_TEST)
 			verify_truncate_cow_test();
 
+		if (test_flags & RNGE_TEST)
+			range_reflink_test();
+
+		if (test_flags & BNCH_TEST)
+			fanout_bench_test();
+
 	}
 }
 
@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <signal.h>
@@ -35,23 +36,25 @@
 #include <linux/types.h>
 #include <sys/time.h>
 #include <sys/sem.h>
+#include <pthread.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <getopt.h>
-
-#include <sys/socket.h>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <dirent.h>
 
 #include <ocfs2/ocfs2.h>
 #include <ocfs2/byteorder.h>
-#include "crc32table.h"
+#include "crc32.h"
 
 #include "aio.h"
+#include "io_ops.h"
+#include "pattern_ops.h"
+#include "lat_hist.h"
+#include "buf_pool.h"
+#include "wu_stream.h"
 
 #ifndef O_DIRECT
 #define O_DIRECT		040000 /* direct disk access hint */
@@ -86,6 +89,8 @@
 #define PUNH_TEST		0x00004000
 #define TRUC_TEST		0x00008000
 #define ASIO_TEST		0x00010000
+#define RNGE_TEST		0x00020000
+#define BNCH_TEST		0x00040000
 
 #define MPI_RET_SUCCESS		0
 #define MPI_RET_FAILED		1
@@ -110,32 +115,6 @@ struct dest_write_unit{
 	char d_char;
 };
 
-struct dest_logs {
-	char filename[PATH_MAX];
-	unsigned long index;
-};
-
-union semun {
-	int val;                    /* value for SETVAL */
-	struct semid_ds *buf;       /* buffer for IPC_STAT, IPC_SET */
-	unsigned short int *array;  /* array for GETALL, SETALL */
-	struct seminfo *__buf;      /* buffer for IPC_INFO */
-};
-
-char rand_char(void);
-unsigned long get_rand(unsigned long min, unsigned long max);
-int get_rand_buf(char *buf, unsigned long size);
-
-int read_at(int fd, void *buf, size_t count, off_t offset);
-int read_at_file(char *pathname, void *buf, size_t count, off_t offset);
-int mmap_read_at(int fd, char *buf, size_t count, off_t offset);
-int mmap_read_at_file(char *pathname, void *buf, size_t count, off_t offset);
-int write_at(int fd, const void *buf, size_t count, off_t offset);
-int write_at_file(char *pathname, const void *buf, size_t count, off_t offset);
-int mmap_write_at(int fd, const char *buf, size_t count, off_t offset);
-int mmap_write_at_file(char *pathname, const void *buf, size_t count,
-		       off_t offset);
-
 int fill_pattern(unsigned long size);
 int prep_orig_file(char *file_name, unsigned long size, int once);
 int prep_orig_file_dio(char *file_name, unsigned long size);
@@ -146,8 +125,67 @@ int prep_orig_file_with_pattern(char *file_name, unsigned long size,
 int verify_pattern(char *buf, unsigned long offset, unsigned long size);
 int verify_orig_file(char *orig);
 
+/*
+ * How reflink() and reflink_range() clone files, everything but ocfs2
+ * works on any filesystem that shares extents, e.g. xfs or btrfs.
+ */
+enum reflink_backend {
+	REFLINK_BACKEND_OCFS2 = 0,	/* OCFS2_IOC_REFLINK */
+	REFLINK_BACKEND_FICLONE,	/* FICLONE */
+	REFLINK_BACKEND_FICLONERANGE,	/* FICLONERANGE */
+	REFLINK_BACKEND_COPY_RANGE,	/* copy_file_range(2) */
+	REFLINK_BACKEND_NUM,
+};
+
+const char *reflink_backend_name(int backend);
+int reflink_parse_backend(const char *name);
+int reflink_get_backend(void);
+void reflink_set_backend(int backend);
 int reflink(const char *oldpath, const char *newpath, unsigned long preserve);
+int reflink_range(const char *oldpath, const char *newpath, off_t src_off,
+		  off_t dst_off, off_t len);
+
+/*
+ * File extents as FIEMAP reports them, or the data runs SEEK_DATA and
+ * SEEK_HOLE find when FIEMAP is not there, in which case no physical
+ * address is known and fe_shareable is never set.
+ */
+struct file_extent {
+	uint64_t fe_logical;
+	uint64_t fe_physical;
+	uint64_t fe_length;
+	int fe_shareable;
+};
+
+struct extent_map {
+	unsigned long em_count;
+	struct file_extent *em_extents;
+};
+
+/* how verify_reflink_pair_stat() got through a pair, in bytes */
+struct reflink_pair_stat {
+	unsigned long long rps_size;
+	unsigned long long rps_shared;		/* same physical blocks */
+	unsigned long long rps_holes;		/* holes in both */
+	unsigned long long rps_diverged;	/* read and compared */
+};
+
+/* free space and extent counts at one point of a CoW workload */
+struct space_sample {
+	unsigned long long ss_free;	/* bytes free in the fs */
+	unsigned long long ss_written;	/* get_cow_bytes_written() */
+	unsigned long ss_files;
+	unsigned long long ss_extents;
+	unsigned long long ss_mapped;	/* bytes covered by the extents */
+};
+
+int get_extent_map(int fd, uint64_t size, struct extent_map *em);
+void put_extent_map(struct extent_map *em);
 int verify_reflink_pair(const char *src, const char *dest);
+int verify_reflink_pair_stat(const char *src, const char *dest,
+			     struct reflink_pair_stat *stat);
+int verify_reflinks(const char *src, const char *dest_prefix,
+		    unsigned long iter, struct reflink_pair_stat *stat);
 int do_reflinks(const char *src, const char *dest_prefix, unsigned long iter,
 		int manner);
 int do_reflinks_at_random(const char *src, const char *dest_prefix,
@@ -158,10 +196,16 @@ int do_cows_on_write(char *ref_pfx, unsigned long iter, unsigned long size,
 		     unsigned long interval);
 int do_cows_on_ftruncate(char *ref_pfx, unsigned long iter, unsigned long size);
 int do_appends(char *ref_pfx, unsigned long iter);
+unsigned long long get_cow_bytes_written(void);
+int sample_space(char *ref_pfx, unsigned long iter, struct space_sample *ss);
+void space_report_header(FILE *fp);
+void space_report_row(FILE *fp, const char *test, const char *phase,
+		      struct space_sample *before, struct space_sample *after);
 int do_unlink(char *path);
 int do_unlinks(char *ref_pfx, unsigned long iter);
 
 int open_ocfs2_volume(char *device_name);
+int open_generic_volume(char *path);
 
 int prep_file_with_hole(char *name, unsigned long size);
 FILE *open_logfile(char *logname);
@@ -180,19 +224,10 @@ int do_write_chunk(int fd, struct dest_write_unit *dwu);
 /*
 int do_write_chunk_file(char *fname, struct dest_write_unit *du);
 */
-int init_sock(char *serv, int port);
-long get_verify_logs_num(char *log);
-int verify_dest_file(char *log, struct dest_logs d_log, unsigned long chunk_no);
-int verify_dest_files(char *log, char *orig, unsigned long chunk_no);
-uint32_t crc32_checksum(uint32_t crc, char *p, size_t len);
-
-/* Add utils for semaphore ops */
-int set_semvalue(int sem_id, int val);
-int semaphore_close(int sem_id);
-int semaphore_p(int sem_id);
-int semaphore_v(int sem_id);
-
-int open_file(const char *filename, int flags);
-int punch_hole(int fd, uint64_t start, uint64_t len);
+int log_stream_write(struct wu_stream *ws, struct dest_write_unit *dwu);
+int verify_dest_files(struct wu_table *wt, char *orig, unsigned long chunk_no);
+void set_dest_verify_threads(unsigned int threads);
+
+int aio_write_and_check(int fd, const void *buf, size_t count, off_t offset);
 
 #endif
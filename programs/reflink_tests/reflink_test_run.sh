@@ -76,7 +76,6 @@ LISTENER_ADDR=
 LISTENER_PORT=
 
 VERI_TEST=
-VERI_LOG=
 
 REFLINK_TEST_BIN="${BINDIR}/reflink_test"
 FILL_HOLES_BIN="${BINDIR}/fill_holes"
@@ -98,13 +97,15 @@ set -o pipefail
 function f_usage()
 {
         echo "usage: `basename ${0}` [-D <-a remote_listener_addr_in_IPV4> <-p port>] \
-[-v verify_log] [-W] [-A] [-o logdir] <-d device> <mountpoint path>"
+[-v <-p port>] [-W] [-A] [-o logdir] <-d device> <mountpoint path>"
         echo "       -o output directory for the logs"
         echo "       -d block device name used for ocfs2 volume"
         echo "       -W enable data=writeback mode"
 	echo "       -A enable asynchronous io testing mode"
 	echo "       -D enable destructive test,it will crash the testing node,\
 be cautious, you need to specify listener addr and port then"
+	echo "       -v run as the listener on another node mounting the same \
+device, start it before -D, it verifies the files once the testing node crashed"
         echo "       <mountpoint path> specify the testing mounting point."
         exit 1;
 
@@ -117,7 +118,7 @@ function f_getoptions()
                 exit 1
          fi
 
-         while getopts "o:WDAhd:a:p:v:" options; do
+         while getopts "o:WDAhd:a:p:v" options; do
                 case $options in
                 o ) LOG_DIR="$OPTARG";;
                 d ) DEVICE="$OPTARG";;
@@ -126,7 +127,7 @@ function f_getoptions()
 		D ) DSCV_TEST="1";;
 		a ) LISTENER_ADDR="$OPTARG";;
 		p ) LISTENER_PORT="$OPTARG";;
-		v ) VERI_LOG="$OPTARG";;
+		v ) VERI_TEST="1";;
                 h ) f_usage;;
                 * ) f_usage;;
                 esac
@@ -163,12 +164,10 @@ function f_check()
 		fi
 	fi
 
-	if [ -n "${VERI_LOG}" ];then
-		if [ ! -f "${VERI_LOG}" ];then
-			echo "Please specify a legal verify log file."
+	if [ -n "${VERI_TEST}" ];then
+		if [ -z "${LISTENER_PORT}" ];then
+			echo "You need to specify listening port in verify test."
 			exit 1
-		else
-			VERI_TEST="1"
 		fi
 	fi
 
@@ -407,10 +406,12 @@ function f_runtest()
 	f_mount ${LOG_FILE} ${DEVICE} ${MOUNT_POINT} ocfs2 ${MOUNT_OPTS}
 	RET=$?
 	f_exit_or_not ${RET}
+	WORK_PLACE=${MOUNT_POINT}/${WORK_PLACE_DIRENT}
 	f_LogMsg ${LOG_FILE} "[${TEST_NO}] Verify Test After Desctruction, CMD:${SUDO} \
-${REFLINK_TEST_BIN} -i 1 -n 10 -p 10 -l 1638400 -d ${DEVICE} -w ${WORK_PLACE} -v ${VERI_LOG} "
+${REFLINK_TEST_BIN} -i 1 -n 10 -p 10 -l 1638400 -d ${DEVICE} -w ${WORK_PLACE} \
+-v 10 -P ${LISTENER_PORT} "
 	${SUDO} ${REFLINK_TEST_BIN} -i 1 -n 10 -p 10 -l 1638400 -d ${DEVICE} -w \
-${WORK_PLACE} -v ${VERI_LOG} >>${LOG_FILE} 2>&1
+${WORK_PLACE} -v 10 -P ${LISTENER_PORT} >>${LOG_FILE} 2>&1
         RET=$?
         f_echo_status ${RET} | tee -a ${RUN_LOG_FILE}
 	exit ${RET}
@@ -32,349 +32,63 @@ extern unsigned int blocksize;
 extern unsigned long clustersize;
 extern unsigned int max_inline_size;
 
-extern int open_rw_flags;
-extern int open_ro_flags;
-
 extern ocfs2_filesys *fs;
 extern struct ocfs2_super_block *ocfs2_sb;
 
 extern char *prog;
 
-static char buf_dio[DIRECTIO_SLICE] __attribute__ ((aligned(DIRECTIO_SLICE)));
-static char chunk_pattern[CHUNK_SIZE] __attribute__ ((aligned(DIRECTIO_SLICE)));
-
-uint32_t crc32_checksum(uint32_t crc, char *p, size_t len)
-{
-	const uint32_t      *b = (uint32_t *)p;
-	const uint32_t      *tab = crc32table_le;
-
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-# define DO_CRC(x) crc = tab[(crc ^ (x)) & 255] ^ (crc >> 8)
-#else
-# define DO_CRC(x) crc = tab[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
-#endif
-
-	crc = cpu_to_le32(crc);
-	/* Align it */
-	if (((long)b)&3 && len) {
-		do {
-			uint8_t *p = (uint8_t *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while ((--len) && ((long)b)&3);
-	}
-	if (len >= 4) {
-		/* load data 32 bits wide, xor data 32 bits wide. */
-		size_t save_len = len & 3;
-		len = len >> 2;
-		--b; /* use pre increment below(*++b) for speed */
-		do {
-			crc ^= *++b;
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-		} while (--len);
-		b++; /* point to next byte(s) */
-		len = save_len;
-	}
-	/* And the last few bytes */
-	if (len) {
-		do {
-			uint8_t *p = (uint8_t *)b;
-			DO_CRC(*p++);
-			b = (void *)p;
-		} while (--len);
-	}
-
-	return le32_to_cpu(crc);
-#undef DO_CRC
-}
-
-unsigned long get_rand(unsigned long min, unsigned long max)
-{
-	if (min == 0 && max == 0)
-		return 0;
-
-	return min + (rand() % (max - min + 1));
-}
-
-char rand_char(void)
-{
-	return 'A' + (char) get_rand(0, 25);
-}
-
-int read_at(int fd, void *buf, size_t count, off_t offset)
-{
-	int ret;
-	size_t bytes_read;
-
-	ret = pread(fd, buf, count, offset);
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "read error %d: \"%s\"\n", ret, strerror(ret));
-		return -1;
-	}
-
-	bytes_read = ret;
-	while (bytes_read < count) {
-
-		ret = pread(fd, buf + bytes_read, count - bytes_read, offset +
-			    bytes_read);
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "read error %d: \"%s\"\n", ret,
-				strerror(ret));
-			return -1;
-		}
-
-		bytes_read += ret;
-	}
-
-	return 0;
-}
-
-int read_at_file(char *pathname, void *buf, size_t count, off_t offset)
-{
-	int fd, ret, o_ret;
-
-	fd  = open64(pathname, open_ro_flags);
-	if (fd < 0) {
-		o_ret = fd;
-		fd = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n", pathname, fd,
-			strerror(fd));
-		fd = o_ret;
-		return fd;
-	}
-
-	ret = read_at(fd, buf, count, offset);
-
-	close(fd);
-
-	return ret;
-}
-
-
-int mmap_read_at(int fd, char *buf, size_t count, off_t offset)
-{
-	int ret;
-	unsigned long mmap_size = page_size;
-	unsigned long size = offset + count;
-	char *region;
-
-	while (mmap_size < size)
-		mmap_size += page_size;
+/* data the CoW helpers wrote into reflinks, for the space report */
+static unsigned long long cow_bytes_written;
 
-	region = mmap(NULL, mmap_size, PROT_READ, MAP_SHARED, fd, 0);
-	if (region == MAP_FAILED) {
-		ret = errno;
-		fprintf(stderr, "mmap (read) error %d: \"%s\"\n", ret,
-			strerror(ret));
-		return -1;
-	}
-
-	memcpy(buf, region + offset, count);
-
-	munmap(region, mmap_size);
-
-	return 0;
-}
-
-int mmap_read_at_file(char *pathname, void *buf, size_t count,
-		      off_t offset)
-{
-	int fd, ret, o_ret;
-
-	fd  = open64(pathname, open_ro_flags);
-	if (fd < 0) {
-		o_ret = fd;
-		fd = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n", pathname, fd,
-			strerror(fd));
-		fd = o_ret;
-		return fd;
-	}
-
-	ret = mmap_read_at(fd, buf, count, offset);
-
-	close(fd);
-
-	return ret;
-}
-
-int write_at(int fd, const void *buf, size_t count, off_t offset)
+/*
+ * write_at() engine for ASIO_TEST, issues the write through libaio and
+ * reads it back to catch aio writes that silently went missing.
+ */
+int aio_write_and_check(int fd, const void *buf, size_t count, off_t offset)
 {
 	int ret, i;
-	size_t bytes_write;
-	struct o2test_aio o2a;
 	void *buf_cmp = NULL;
 	unsigned long long *ubuf = (unsigned long long *)buf;
-        unsigned long long *ubuf_cmp = NULL;
-
-	if (test_flags & ASIO_TEST) {
-
-		if (test_flags & ODCT_TEST) {
-			ret = posix_memalign(&buf_cmp, DIRECTIO_SLICE,
-					     count);
-			if (ret) {
-				ret = errno;
-				fprintf(stderr, "error %s during %s\n",
-					strerror(ret), "posix_memalign");
-				ret = -1;
-				goto bail;
-			}
-		} else
-			buf_cmp = (char *)malloc(count);
-
-		ret = o2test_aio_setup(&o2a, 1);
-		if (ret < 0)
-			goto bail;
-
-		ret = o2test_aio_pwrite(&o2a, fd, (void *)buf, count, offset);
-		if (ret < 0)
-			goto bail;
-
-		ret = o2test_aio_query(&o2a, 1, 1);
-		if(ret < 0)
-			goto bail;
+	unsigned long long *ubuf_cmp = NULL;
 
-		ret = pread(fd, buf_cmp, count, offset);
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "pread error %d: \"%s\"\n", ret,
-				strerror(ret));
-			ret = -1;
-			goto bail;
+	if (test_flags & ODCT_TEST) {
+		ret = posix_memalign(&buf_cmp, DIRECTIO_SLICE, count);
+		if (ret) {
+			fprintf(stderr, "error %s during %s\n",
+				strerror(ret), "posix_memalign");
+			return -1;
 		}
-
-		if (memcmp(buf, buf_cmp, count)) {
-
-			ubuf_cmp = (unsigned long long *)buf_cmp;
-			for (i = 0; i < count / sizeof(unsigned long long); i++)
-				printf("%d: 0x%llx[aio_write]  0x%llx[pread]\n",
-				       i, ubuf[i], ubuf_cmp[i]);
+	} else {
+		buf_cmp = malloc(count);
+		if (!buf_cmp) {
+			fprintf(stderr, "failed to allocate %lu bytes\n",
+				(unsigned long)count);
+			return -1;
 		}
-
-		ret = o2test_aio_destroy(&o2a);
-
-		goto bail;
 	}
 
-	ret = pwrite(fd, buf, count, offset);
-
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "write error %d: \"%s\"\n", ret, strerror(ret));
-		ret = -1;
+	ret = o2test_aio_write_at(fd, buf, count, offset);
+	if (ret < 0)
 		goto bail;
-	}
-
-	bytes_write = ret;
-	while (bytes_write < count) {
 
-		ret = pwrite(fd, buf + bytes_write, count - bytes_write,
-			     offset + bytes_write);
+	ret = read_at(fd, buf_cmp, count, offset);
+	if (ret < 0)
+		goto bail;
 
-		if (ret < 0) {
-			ret = errno;
-			fprintf(stderr, "write error %d: \"%s\"\n", ret,
-				strerror(ret));
-			ret = -1;
-			goto bail;
-		}
+	if (memcmp(buf, buf_cmp, count)) {
 
-		bytes_write += ret;
+		ubuf_cmp = (unsigned long long *)buf_cmp;
+		for (i = 0; i < count / sizeof(unsigned long long); i++)
+			printf("%d: 0x%llx[aio_write]  0x%llx[pread]\n",
+			       i, ubuf[i], ubuf_cmp[i]);
 	}
 
-	ret = 0;
 bail:
-	if (buf_cmp)
-		free(buf_cmp);
-
-	return ret;
-}
-
-int write_at_file(char *pathname, const void *buf, size_t count,
-			 off_t offset)
-{
-	int fd, ret, o_ret;
-
-	fd  = open64(pathname, open_rw_flags);
-	if (fd < 0) {
-		o_ret = fd;
-		fd = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n", pathname, fd,
-			strerror(fd));
-		fd = o_ret;
-		return fd;
-	}
-
-	ret = write_at(fd, buf, count, offset);
-
-	close(fd);
+	free(buf_cmp);
 
 	return ret;
 }
 
-int mmap_write_at(int fd, const char *buf, size_t count, off_t offset)
-{
-	int ret;
-	unsigned long mmap_size = page_size;
-	unsigned long size = offset + count;
-	char *region;
-
-	while (mmap_size < size)
-		mmap_size += page_size;
-
-	region = mmap(NULL, mmap_size, PROT_WRITE, MAP_SHARED, fd, 0);
-	if (region == MAP_FAILED) {
-		ret = errno;
-		fprintf(stderr, "mmap (write) error %d: \"%s\"\n", ret,
-			strerror(ret));
-		return -1;
-	}
-
-	memcpy(region + offset, buf, count);
-
-	munmap(region, mmap_size);
-
-	return 0;
-}
-
-int mmap_write_at_file(char *pathname, const void *buf, size_t count,
-		       off_t offset)
-{
-	int fd, ret, o_ret;
-
-	fd  = open64(pathname, open_rw_flags);
-	if (fd < 0) {
-		o_ret = fd;
-		fd = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n", pathname, fd,
-			strerror(fd));
-		fd = o_ret;
-		return fd;
-	}
-
-	ret = mmap_write_at(fd, buf, count, offset);
-
-	close(fd);
-
-	return ret;
-}
-
-
-int get_rand_buf(char *buf, unsigned long size)
-{
-	unsigned long i;
-
-	for (i = 0; i < size; i++)
-		buf[i] = rand_char();
-
-	return 0;
-}
-
 int fill_pattern(unsigned long size)
 {
 	memset(orig_pattern, 0, PATTERN_SIZE);
@@ -585,10 +299,15 @@ int prep_orig_file_with_pattern(char *file_name, unsigned long size,
 	return 0;
 }
 
+/*
+ * Every DIRECTIO_SLICE gets its own random char as before, but they go
+ * out O2TEST_DIO_BUF_SIZE at a time from a pooled buffer.
+ */
 int prep_orig_file_dio(char *file_name, unsigned long size)
 {
 	int fd, ret, o_ret, flags;
-	unsigned long offset = 0, write_size = DIRECTIO_SLICE;
+	unsigned long offset = 0, write_size, i;
+	char *buf;
 
 
 	if ((size % DIRECTIO_SLICE) != 0) {
@@ -613,19 +332,28 @@ int prep_orig_file_dio(char *file_name, unsigned long size)
 	}
 
 
+	buf = (char *)o2test_dio_buf_get();
+	if (!buf) {
+		close(fd);
+		return -ENOMEM;
+	}
+
 	while (offset < size) {
 
+		write_size = O2TEST_DIO_BUF_SIZE;
 		if (offset + write_size > size)
 			write_size = size - offset;
 
-		memset(buf_dio, rand_char(), DIRECTIO_SLICE);
+		for (i = 0; i < write_size; i += DIRECTIO_SLICE)
+			memset(buf + i, rand_char(), DIRECTIO_SLICE);
 
-		ret = pwrite(fd, buf_dio, write_size, offset);
+		ret = pwrite(fd, buf, write_size, offset);
 		if (ret < 0) {
 			o_ret = ret;
 			ret = errno;
 			fprintf(stderr, "write failed:%d:%s\n", ret,
 				strerror(ret));
+			o2test_dio_buf_put(buf);
 			return ret;
 		}
 
@@ -633,6 +361,7 @@ int prep_orig_file_dio(char *file_name, unsigned long size)
 
 	}
 
+	o2test_dio_buf_put(buf);
 	close(fd);
 	return 0;
 }
@@ -717,9 +446,10 @@ int prep_orig_file_in_chunks(char *file_name, unsigned long chunks)
 {
 
 	int fd, ret, o_ret, flags;
-	unsigned long offset = 0;
+	unsigned long offset = 0, write_size, i;
 	unsigned long size = CHUNK_SIZE * chunks, chunk_no = 0;
 	struct dest_write_unit dwu;
+	char *buf;
 
 	if ((CHUNK_SIZE % DIRECTIO_SLICE) != 0) {
 
@@ -748,86 +478,537 @@ int prep_orig_file_in_chunks(char *file_name, unsigned long chunks)
 	 * chunkno + timestamp + checksum + random chars
 	 * + checksum + timestamp + chunkno
 	 *
+	 * They are laid out in a pooled buffer and written a buffer at
+	 * a time.
 	*/
+	buf = (char *)o2test_dio_buf_get();
+	if (!buf) {
+		close(fd);
+		return -ENOMEM;
+	}
 
 	while (offset < size) {
 
-		memset(&dwu, 0, sizeof(struct dest_write_unit));
-		dwu.d_chunk_no = chunk_no;
-		fill_chunk_pattern(chunk_pattern, &dwu);
+		write_size = O2TEST_DIO_BUF_SIZE;
+		if (offset + write_size > size)
+			write_size = size - offset;
 
-		ret = write_at(fd, chunk_pattern, CHUNK_SIZE, offset);
-		if (ret < 0)
+		for (i = 0; i < write_size; i += CHUNK_SIZE) {
+			memset(&dwu, 0, sizeof(struct dest_write_unit));
+			dwu.d_chunk_no = chunk_no++;
+			fill_chunk_pattern(buf + i, &dwu);
+		}
+
+		ret = write_at(fd, buf, write_size, offset);
+		if (ret < 0) {
+			o2test_dio_buf_put(buf);
 			return ret;
+		}
 
-		chunk_no++;
-		offset += CHUNK_SIZE;
+		offset += write_size;
 	}
 
+	o2test_dio_buf_put(buf);
+
 	fsync(fd);
 	close(fd);
 
 	return 0;
 }
 
-int verify_reflink_pair(const char *src, const char *dest)
+/*
+ * Private copy of the FIEMAP ABI, linux/fs.h can't be pulled in next
+ * to the ocfs2 headers.
+ */
+struct o2test_fiemap_extent {
+	uint64_t fe_logical;
+	uint64_t fe_physical;
+	uint64_t fe_length;
+	uint64_t fe_reserved64[2];
+	uint32_t fe_flags;
+	uint32_t fe_reserved[3];
+};
+
+struct o2test_fiemap {
+	uint64_t fm_start;
+	uint64_t fm_length;
+	uint32_t fm_flags;
+	uint32_t fm_mapped_extents;
+	uint32_t fm_extent_count;
+	uint32_t fm_reserved;
+	struct o2test_fiemap_extent fm_extents[0];
+};
+
+#define O2TEST_FS_IOC_FIEMAP		_IOWR('f', 11, struct o2test_fiemap)
+#define O2TEST_FIEMAP_FLAG_SYNC		0x00000001
+#define O2TEST_FIEMAP_EXTENT_LAST	0x00000001
+
+/*
+ * Where the data may move, be shared with nobody or not be addressable
+ * by block, equal physical addresses say nothing about equal data.
+ * That is UNKNOWN, DELALLOC, ENCODED, DATA_ENCRYPTED, NOT_ALIGNED,
+ * DATA_INLINE and DATA_TAIL.
+ */
+#define O2TEST_FIEMAP_EXTENT_UNSHAREABLE	0x0000078e
+
+#define FIEMAP_BATCH		256
+
+#define PAIR_VERIFY_IO		(4 * 1024 * 1024)
+#define PAIR_VERIFY_THREADS	4
+#define PAIR_VERIFY_ALIGN	4096
+
+static int add_file_extent(struct extent_map *em, uint64_t logical,
+			   uint64_t physical, uint64_t length, int shareable)
+{
+	struct file_extent *fe;
+
+	if (!(em->em_count % FIEMAP_BATCH)) {
+		fe = (struct file_extent *)realloc(em->em_extents,
+				(em->em_count + FIEMAP_BATCH) * sizeof(*fe));
+		if (!fe)
+			return -ENOMEM;
+		em->em_extents = fe;
+	}
+
+	fe = &em->em_extents[em->em_count++];
+	fe->fe_logical = logical;
+	fe->fe_physical = physical;
+	fe->fe_length = length;
+	fe->fe_shareable = shareable;
+
+	return 0;
+}
+
+static int get_extent_map_fiemap(int fd, struct extent_map *em)
+{
+	struct o2test_fiemap *fm;
+	struct o2test_fiemap_extent *fe;
+	uint64_t start = 0;
+	uint32_t i;
+	int ret = 0, last = 0;
+
+	fm = (struct o2test_fiemap *)malloc(sizeof(*fm) +
+					    FIEMAP_BATCH * sizeof(*fe));
+	if (!fm)
+		return -ENOMEM;
+
+	while (!last) {
+		memset(fm, 0, sizeof(*fm));
+		fm->fm_start = start;
+		fm->fm_length = ~0ULL - start;
+		/* delalloc has no blocks yet, have it allocated first */
+		fm->fm_flags = O2TEST_FIEMAP_FLAG_SYNC;
+		fm->fm_extent_count = FIEMAP_BATCH;
+
+		if (ioctl(fd, O2TEST_FS_IOC_FIEMAP, fm)) {
+			ret = -errno;
+			break;
+		}
+
+		if (!fm->fm_mapped_extents)
+			break;
+
+		for (i = 0; i < fm->fm_mapped_extents; i++) {
+			fe = &fm->fm_extents[i];
+			ret = add_file_extent(em, fe->fe_logical,
+					      fe->fe_physical, fe->fe_length,
+					      !(fe->fe_flags &
+					O2TEST_FIEMAP_EXTENT_UNSHAREABLE));
+			if (ret)
+				goto out;
+
+			if (fe->fe_flags & O2TEST_FIEMAP_EXTENT_LAST)
+				last = 1;
+			start = fe->fe_logical + fe->fe_length;
+		}
+	}
+
+out:
+	free(fm);
+
+	return ret;
+}
+
+/*
+ * API_COMPAT_CFLAGS may -include headers pulling in unistd.h before
+ * reflink_test.h gets to define _GNU_SOURCE.
+ */
+#ifndef SEEK_DATA
+#define SEEK_DATA	3
+#define SEEK_HOLE	4
+#endif
+
+static int get_extent_map_seek(int fd, uint64_t size, struct extent_map *em)
+{
+	off_t data, hole, pos = 0;
+
+	while (pos < size) {
+		data = lseek(fd, pos, SEEK_DATA);
+		if (data < 0) {
+			if (errno == ENXIO)
+				return 0;
+			return -errno;
+		}
+
+		hole = lseek(fd, data, SEEK_HOLE);
+		if (hole < 0)
+			return -errno;
+
+		if (add_file_extent(em, data, 0, hole - data, 0))
+			return -ENOMEM;
+
+		pos = hole;
+	}
+
+	return 0;
+}
+
+/*
+ * Extents of the first size bytes of fd, sorted by logical offset.
+ * Tries FIEMAP, then SEEK_DATA/SEEK_HOLE, then calls the whole file
+ * data, so callers always get a usable map.
+ */
+int get_extent_map(int fd, uint64_t size, struct extent_map *em)
+{
+	int ret;
+
+	memset(em, 0, sizeof(*em));
+
+	ret = get_extent_map_fiemap(fd, em);
+	if (!ret)
+		return 0;
+
+	em->em_count = 0;
+	if (ret != -ENOMEM)
+		ret = get_extent_map_seek(fd, size, em);
+	if (!ret)
+		return 0;
+
+	em->em_count = 0;
+	if (ret != -ENOMEM && size)
+		ret = add_file_extent(em, 0, 0, size, 0);
+	if (ret)
+		put_extent_map(em);
+
+	return ret;
+}
+
+void put_extent_map(struct extent_map *em)
+{
+	free(em->em_extents);
+	memset(em, 0, sizeof(*em));
+}
+
+/* the extent containing off if any, *next is where the next run starts */
+static struct file_extent *lookup_extent(struct extent_map *em,
+					 unsigned long *idx, uint64_t off,
+					 uint64_t *next)
+{
+	struct file_extent *fe;
+
+	while (*idx < em->em_count) {
+		fe = &em->em_extents[*idx];
+		if (fe->fe_logical + fe->fe_length > off)
+			break;
+		(*idx)++;
+	}
+
+	if (*idx == em->em_count) {
+		*next = ~0ULL;
+		return NULL;
+	}
+
+	fe = &em->em_extents[*idx];
+	if (fe->fe_logical > off) {
+		*next = fe->fe_logical;
+		return NULL;
+	}
+
+	*next = fe->fe_logical + fe->fe_length;
+
+	return fe;
+}
+
+struct pair_range {
+	uint64_t pr_offset;
+	uint64_t pr_length;
+};
+
+struct pair_verify_ctx {
+	const char *pv_src;
+	const char *pv_dest;
+	int pv_fds;
+	int pv_fdd;
+	struct pair_range *pv_ranges;
+	unsigned long pv_nr_ranges;
+	unsigned long pv_next;
+	int pv_ret;
+};
+
+static void *pair_verify_worker(void *arg)
 {
-	int fds = -1, fdd = -1, ret = 0;
+	struct pair_verify_ctx *pv = (struct pair_verify_ctx *)arg;
+	struct pair_range *pr;
 	char *bufs = NULL, *bufd = NULL;
-	unsigned long reads, readd;
+	ssize_t reads, readd;
+	size_t count, mis;
+	unsigned long i;
+	int ret = 0;
+
+	if (posix_memalign((void **)&bufs, PAIR_VERIFY_ALIGN, PAIR_VERIFY_IO) ||
+	    posix_memalign((void **)&bufd, PAIR_VERIFY_ALIGN, PAIR_VERIFY_IO)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	while (!pv->pv_ret) {
+		i = __sync_fetch_and_add(&pv->pv_next, 1);
+		if (i >= pv->pv_nr_ranges)
+			break;
+
+		pr = &pv->pv_ranges[i];
+		/* O_DIRECT wants whole sectors, the tail reads short */
+		count = (pr->pr_length + DIRECTIO_SLICE - 1) &
+			~((size_t)DIRECTIO_SLICE - 1);
+
+		reads = read_upto(pv->pv_fds, bufs, count, pr->pr_offset);
+		readd = read_upto(pv->pv_fdd, bufd, count, pr->pr_offset);
+		if (reads < 0 || readd < 0) {
+			ret = -EIO;
+			break;
+		}
+
+		if (reads < pr->pr_length || readd < pr->pr_length) {
+			fprintf(stderr, "short read on %s or %s at %llu\n",
+				pv->pv_src, pv->pv_dest,
+				(unsigned long long)pr->pr_offset);
+			ret = 1;
+			break;
+		}
+
+		mis = buf_mismatch(bufs, bufd, pr->pr_length);
+		if (mis != pr->pr_length) {
+			fprintf(stderr, "%s and %s differ at offset %llu\n",
+				pv->pv_src, pv->pv_dest,
+				(unsigned long long)pr->pr_offset + mis);
+			ret = 1;
+			break;
+		}
+	}
+
+out:
+	if (ret)
+		__sync_bool_compare_and_swap(&pv->pv_ret, 0, ret);
+
+	free(bufs);
+	free(bufd);
+
+	return NULL;
+}
+
+static int add_pair_range(struct pair_verify_ctx *pv, uint64_t off,
+			  uint64_t len)
+{
+	struct pair_range *pr;
+	uint64_t piece;
+
+	while (len) {
+		piece = len < PAIR_VERIFY_IO ? len : PAIR_VERIFY_IO;
+
+		if (!(pv->pv_nr_ranges % FIEMAP_BATCH)) {
+			pr = (struct pair_range *)realloc(pv->pv_ranges,
+				(pv->pv_nr_ranges + FIEMAP_BATCH) *
+				sizeof(*pr));
+			if (!pr)
+				return -ENOMEM;
+			pv->pv_ranges = pr;
+		}
+
+		pr = &pv->pv_ranges[pv->pv_nr_ranges++];
+		pr->pr_offset = off;
+		pr->pr_length = piece;
+
+		off += piece;
+		len -= piece;
+	}
+
+	return 0;
+}
+
+/*
+ * Walk both extent maps side by side. Runs mapped to the same physical
+ * blocks in both files are still shared and equal by construction,
+ * runs which are holes in both are zeros in both, only what is left,
+ * the ranges CoW or writes made diverge, has to be read.
+ */
+static int plan_pair_verify(struct pair_verify_ctx *pv,
+			    struct extent_map *ems, struct extent_map *emd,
+			    struct reflink_pair_stat *stat)
+{
+	struct file_extent *fs_ext, *fd_ext;
+	unsigned long is = 0, id = 0;
+	uint64_t off = 0, end, nexts, nextd, size = stat->rps_size;
+	uint64_t div_start = 0, div_len = 0;
+	int ret;
+
+	while (off < size) {
+		fs_ext = lookup_extent(ems, &is, off, &nexts);
+		fd_ext = lookup_extent(emd, &id, off, &nextd);
+
+		end = nexts < nextd ? nexts : nextd;
+		if (end > size)
+			end = size;
+
+		if (!fs_ext && !fd_ext) {
+			stat->rps_holes += end - off;
+		} else if (fs_ext && fd_ext && fs_ext->fe_shareable &&
+			   fd_ext->fe_shareable &&
+			   fs_ext->fe_physical + (off - fs_ext->fe_logical) ==
+			   fd_ext->fe_physical + (off - fd_ext->fe_logical)) {
+			stat->rps_shared += end - off;
+		} else {
+			if (div_start + div_len != off) {
+				ret = add_pair_range(pv, div_start, div_len);
+				if (ret)
+					return ret;
+				div_start = off;
+				div_len = 0;
+			}
+			div_len += end - off;
+			stat->rps_diverged += end - off;
+		}
+
+		off = end;
+	}
+
+	return add_pair_range(pv, div_start, div_len);
+}
+
+int verify_reflink_pair_stat(const char *src, const char *dest,
+			     struct reflink_pair_stat *stat)
+{
+	struct pair_verify_ctx pv;
+	struct extent_map ems, emd;
+	struct stat sts, std;
+	pthread_t threads[PAIR_VERIFY_THREADS];
+	unsigned long i, nr_threads;
+	int ret;
 
-	bufs = (char *)malloc(HUNK_SIZE);
-	bufd = (char *)malloc(HUNK_SIZE);
+	memset(&pv, 0, sizeof(pv));
+	memset(&ems, 0, sizeof(ems));
+	memset(&emd, 0, sizeof(emd));
+	memset(stat, 0, sizeof(*stat));
+	pv.pv_src = src;
+	pv.pv_dest = dest;
+	pv.pv_fdd = -1;
 
-	fds = open64(src, open_ro_flags);
-	if (fds < 0) {
-		ret  = errno;
+	pv.pv_fds = open64(src, open_ro_flags);
+	if (pv.pv_fds < 0) {
+		ret = errno;
 		fprintf(stderr, "open file %s failed:%d:%s\n", src, ret,
 			strerror(ret));
-		ret = fds;
-		goto bail;
+		return -ret;
 	}
 
-	fdd = open64(dest, open_ro_flags);
-	if (fdd < 0) {
+	pv.pv_fdd = open64(dest, open_ro_flags);
+	if (pv.pv_fdd < 0) {
 		ret = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n", src, ret,
+		fprintf(stderr, "open file %s failed:%d:%s\n", dest, ret,
 			strerror(ret));
-		ret = fdd;
+		ret = -ret;
 		goto bail;
 	}
 
-	while ((reads = read(fds, bufs, HUNK_SIZE)) &&
-	       (readd = read(fdd, bufd, HUNK_SIZE))) {
+	if (fstat(pv.pv_fds, &sts) || fstat(pv.pv_fdd, &std)) {
+		ret = -errno;
+		goto bail;
+	}
 
-		if (reads != readd) {
-			fprintf(stderr, "data readed are not in the "
-				"same size\n");
-			ret = 1;
-			goto bail;
-		}
+	if (sts.st_size != std.st_size) {
+		fprintf(stderr, "%s is %lld bytes but %s is %lld\n", src,
+			(long long)sts.st_size, dest, (long long)std.st_size);
+		ret = 1;
+		goto bail;
+	}
 
-		ret = memcmp(bufs, bufd, reads);
-		if (ret) {
-			fprintf(stderr, "data readed are different\n");
-			goto bail;
+	stat->rps_size = sts.st_size;
+
+	ret = get_extent_map(pv.pv_fds, stat->rps_size, &ems);
+	if (!ret)
+		ret = get_extent_map(pv.pv_fdd, stat->rps_size, &emd);
+	if (!ret)
+		ret = plan_pair_verify(&pv, &ems, &emd, stat);
+	if (ret)
+		goto bail;
+
+	nr_threads = pv.pv_nr_ranges < PAIR_VERIFY_THREADS ?
+		     pv.pv_nr_ranges : PAIR_VERIFY_THREADS;
+
+	if (nr_threads <= 1) {
+		pair_verify_worker(&pv);
+	} else {
+		for (i = 0; i < nr_threads; i++) {
+			ret = pthread_create(&threads[i], NULL,
+					     pair_verify_worker, &pv);
+			if (ret) {
+				fprintf(stderr, "pthread_create failed:%d:%s\n",
+					ret, strerror(ret));
+				pv.pv_ret = -ret;
+				break;
+			}
 		}
+
+		nr_threads = i;
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(threads[i], NULL);
 	}
 
-bail:
-	if (bufs)
-		free(bufs);
+	ret = pv.pv_ret;
+
+bail:
+	put_extent_map(&ems);
+	put_extent_map(&emd);
+	free(pv.pv_ranges);
+
+	close(pv.pv_fds);
+	if (pv.pv_fdd >= 0)
+		close(pv.pv_fdd);
+
+	return ret;
+}
+
+int verify_reflink_pair(const char *src, const char *dest)
+{
+	struct reflink_pair_stat stat;
+
+	return verify_reflink_pair_stat(src, dest, &stat);
+}
+
+/* verify reflinks dest_prefix"r0".."r<iter-1>" against src, summing up */
+int verify_reflinks(const char *src, const char *dest_prefix,
+		    unsigned long iter, struct reflink_pair_stat *stat)
+{
+	struct reflink_pair_stat one;
+	char dest[PATH_MAX];
+	unsigned long i;
+	int ret;
+
+	memset(stat, 0, sizeof(*stat));
 
-	if (bufd)
-		free(bufd);
+	for (i = 0; i < iter; i++) {
+		snprintf(dest, PATH_MAX, "%sr%ld", dest_prefix, i);
 
-	if (fds > 0)
-		close(fds);
+		ret = verify_reflink_pair_stat(src, dest, &one);
+		if (ret)
+			return ret;
 
-	if (fdd > 0)
-		close(fdd);
+		stat->rps_size += one.rps_size;
+		stat->rps_shared += one.rps_shared;
+		stat->rps_holes += one.rps_holes;
+		stat->rps_diverged += one.rps_diverged;
+	}
 
-	return ret;
+	return 0;
 }
 
 int verify_pattern(char *buf, unsigned long offset, unsigned long size)
@@ -968,7 +1149,7 @@ int do_reflinks_at_random(const char *src, const char *dest_prefix,
 {
 	int ret = 0, o_ret, fd, method;
 	unsigned long i = 0;
-	char dest[PATH_MAX], *buf = NULL, *ptr;
+	char dest[PATH_MAX], *buf = NULL, *ptr, *dio_buf = NULL;
 
 	unsigned long write_size = 0, append_size = 0, truncate_size = 0;
 	unsigned long read_size = 0, offset = 0;
@@ -986,9 +1167,14 @@ int do_reflinks_at_random(const char *src, const char *dest_prefix,
 		goto bail;
 	}
 
-	if (test_flags & ODCT_TEST)
-		ptr = buf_dio;
-	else
+	if (test_flags & ODCT_TEST) {
+		dio_buf = (char *)o2test_dio_buf_get();
+		if (!dio_buf) {
+			ret = -ENOMEM;
+			goto bail;
+		}
+		ptr = dio_buf;
+	} else
 		ptr = buf;
 
 	while (i < iter) {
@@ -1107,6 +1293,8 @@ bail:
 	if (buf)
 		free(buf);
 
+	o2test_dio_buf_put(dio_buf);
+
 	if (fd > 0)
 		close(fd);
 
@@ -1119,13 +1307,18 @@ int do_reads_on_reflinks(char *ref_pfx, unsigned long iter,
 	int ret = 0, fd;
 	unsigned long i, read_size, offset = 0;
 	char ref_path[PATH_MAX];
-	char *buf = NULL, *ptr;
+	char *buf = NULL, *ptr, *dio_buf = NULL;
 
 	buf = (char *)malloc(HUNK_SIZE * 2);
 
-	if (test_flags & ODCT_TEST)
-		ptr = buf_dio;
-	else
+	if (test_flags & ODCT_TEST) {
+		dio_buf = (char *)o2test_dio_buf_get();
+		if (!dio_buf) {
+			ret = -ENOMEM;
+			goto bail;
+		}
+		ptr = dio_buf;
+	} else
 		ptr = buf;
 
 	for (i = 0; i < iter; i++) {
@@ -1209,6 +1402,8 @@ bail:
 	if (buf)
 		free(buf);
 
+	o2test_dio_buf_put(dio_buf);
+
 	return ret;
 }
 
@@ -1218,13 +1413,18 @@ int do_cows_on_write(char *ref_pfx, unsigned long iter,
 	int ret = 0, fd;
 	unsigned long i, write_size, offset = 0;
 	char ref_path[PATH_MAX];
-	char *buf = NULL, *ptr;
+	char *buf = NULL, *ptr, *dio_buf = NULL;
 
 	buf = (char *)malloc(HUNK_SIZE * 2);
 
-	if (test_flags & ODCT_TEST)
-		ptr = buf_dio;
-	else
+	if (test_flags & ODCT_TEST) {
+		dio_buf = (char *)o2test_dio_buf_get();
+		if (!dio_buf) {
+			ret = -ENOMEM;
+			goto bail;
+		}
+		ptr = dio_buf;
+	} else
 		ptr = buf;
 
 	for (i = 0; i < iter; i++) {
@@ -1278,6 +1478,8 @@ int do_cows_on_write(char *ref_pfx, unsigned long iter,
 					goto bail;
 				}
 
+				cow_bytes_written += write_size;
+
 			} else {
 
 				/*
@@ -1297,6 +1499,8 @@ int do_cows_on_write(char *ref_pfx, unsigned long iter,
 
 					goto bail;
 				}
+
+				cow_bytes_written += write_size;
 			}
 
 			if (test_flags & RAND_TEST)
@@ -1313,6 +1517,8 @@ bail:
 	if (buf)
 		free(buf);
 
+	o2test_dio_buf_put(dio_buf);
+
 	return ret;
 }
 
@@ -1362,13 +1568,18 @@ int do_appends(char *ref_pfx, unsigned long iter)
 	int ret = 0, fd, o_ret;
 	unsigned long i, append_size;
 	char ref_path[PATH_MAX];
-	char *buf = NULL, *ptr;
+	char *buf = NULL, *ptr, *dio_buf = NULL;
 
 	buf = (char *)malloc(HUNK_SIZE);
 
-	if (test_flags & ODCT_TEST)
-		ptr = buf_dio;
-	else
+	if (test_flags & ODCT_TEST) {
+		dio_buf = (char *)o2test_dio_buf_get();
+		if (!dio_buf) {
+			ret = -ENOMEM;
+			goto bail;
+		}
+		ptr = dio_buf;
+	} else
 		ptr = buf;
 
 	for (i = 0; i < iter; i++) {
@@ -1403,6 +1614,8 @@ int do_appends(char *ref_pfx, unsigned long iter)
 			goto bail;
 		}
 
+		cow_bytes_written += append_size;
+
 		close(fd);
 	}
 
@@ -1410,9 +1623,111 @@ bail:
 	if (buf)
 		free(buf);
 
+	o2test_dio_buf_put(dio_buf);
+
 	return ret;
 }
 
+unsigned long long get_cow_bytes_written(void)
+{
+	return cow_bytes_written;
+}
+
+/*
+ * Free space of the fs and the extents of ref_pfx plus its reflinks
+ * ref_pfx"r0".."r<iter-1>", those which exist. Dirty data is synced
+ * first so delayed allocation shows up in both.
+ */
+int sample_space(char *ref_pfx, unsigned long iter, struct space_sample *ss)
+{
+	struct statfs stfs;
+	struct stat st;
+	struct extent_map em;
+	char path[PATH_MAX];
+	unsigned long i, j;
+	int fd, ret = 0;
+
+	memset(ss, 0, sizeof(*ss));
+	ss->ss_written = cow_bytes_written;
+
+	sync();
+
+	if (statfs(ref_pfx, &stfs)) {
+		ret = errno;
+		fprintf(stderr, "statfs %s failed:%d:%s\n", ref_pfx, ret,
+			strerror(ret));
+		return -ret;
+	}
+
+	ss->ss_free = (unsigned long long)stfs.f_bfree * stfs.f_bsize;
+
+	for (i = 0; i <= iter; i++) {
+		if (i == iter)
+			strcpy(path, ref_pfx);
+		else
+			snprintf(path, PATH_MAX, "%sr%ld", ref_pfx, i);
+
+		fd = open64(path, O_RDONLY);
+		if (fd < 0) {
+			if (errno == ENOENT)
+				continue;
+			ret = errno;
+			fprintf(stderr, "open file %s failed:%d:%s\n", path,
+				ret, strerror(ret));
+			return -ret;
+		}
+
+		ret = fstat(fd, &st) ? -errno : 0;
+		if (!ret)
+			ret = get_extent_map(fd, st.st_size, &em);
+		close(fd);
+		if (ret)
+			return ret;
+
+		ss->ss_files++;
+		ss->ss_extents += em.em_count;
+		for (j = 0; j < em.em_count; j++)
+			ss->ss_mapped += em.em_extents[j].fe_length;
+
+		put_extent_map(&em);
+	}
+
+	return 0;
+}
+
+void space_report_header(FILE *fp)
+{
+	fprintf(fp, "test,phase,clustersize,files,bytes_written,"
+		"bytes_allocated,write_amp,extents_before,extents_after,"
+		"extents_per_file,avg_extent_bytes\n");
+}
+
+/*
+ * One CSV row for a phase, from samples taken before and after it.
+ * Allocation is the drop in free space, negative when the phase freed
+ * more than it took, write_amp is left empty when nothing was written.
+ */
+void space_report_row(FILE *fp, const char *test, const char *phase,
+		      struct space_sample *before, struct space_sample *after)
+{
+	unsigned long long written = after->ss_written - before->ss_written;
+	long long allocated = (long long)before->ss_free -
+			      (long long)after->ss_free;
+
+	fprintf(fp, "%s,%s,%lu,%lu,%llu,%lld,", test, phase, clustersize,
+		after->ss_files, written, allocated);
+
+	if (written)
+		fprintf(fp, "%.3f", (double)allocated / written);
+
+	fprintf(fp, ",%llu,%llu,%.2f,%.0f\n", before->ss_extents,
+		after->ss_extents, after->ss_files ?
+		(double)after->ss_extents / after->ss_files : 0.0,
+		after->ss_extents ?
+		(double)after->ss_mapped / after->ss_extents : 0.0);
+	fflush(fp);
+}
+
 int do_unlink(char *path)
 {
 	int ret, o_ret;
@@ -1484,6 +1799,32 @@ int open_ocfs2_volume(char *device_name)
 	return 0;
 }
 
+/*
+ * Geometry for the generic reflink backends, where the tests run on
+ * whatever filesystem holds path rather than an ocfs2 volume.
+ */
+int open_generic_volume(char *path)
+{
+	struct statfs st;
+	int ret;
+
+	if (statfs(path, &st)) {
+		ret = errno;
+		fprintf(stderr, "statfs %s failed:%d:%s\n", path, ret,
+			strerror(ret));
+		return -ret;
+	}
+
+	/* extents are shared per block, there are no clusters */
+	blocksize = st.f_bsize;
+	clustersize = st.f_bsize;
+
+	/* nor inline data, keep the inline tests on sub-block files */
+	max_inline_size = blocksize / 2;
+
+	return 0;
+}
+
 /*
  * Following funcs borrowed from fill_verify_holes
  * to test holes punching and filling in reflinks
@@ -1667,373 +2008,328 @@ int do_write_chunk(int fd, struct dest_write_unit *dwu)
 	int ret;
 	size_t count = CHUNK_SIZE;
 	off_t offset = CHUNK_SIZE * dwu->d_chunk_no;
+	char *pattern;
+
+	pattern = (char *)o2test_dio_buf_get();
+	if (!pattern)
+		return -ENOMEM;
 
-	fill_chunk_pattern(chunk_pattern, dwu);
+	fill_chunk_pattern(pattern, dwu);
+
+	ret = write_at(fd, pattern, count, offset);
+
+	o2test_dio_buf_put(pattern);
 
-	ret = write_at(fd, chunk_pattern, count, offset);
 	if (ret < 0)
 		return ret;
 
 	return 0;
 }
 
-int init_sock(char *serv, int port)
+/*
+ * Queues the record on the destructive test's stream to the remote
+ * verifier, blocks only when the stream falls behind.
+ */
+int log_stream_write(struct wu_stream *ws, struct dest_write_unit *dwu)
 {
-	int sockfd;
-	struct sockaddr_in servaddr;
+	struct wu_entry we;
 
-	sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	bzero(&servaddr, sizeof(struct sockaddr_in));
-	servaddr.sin_family = AF_INET;
-	servaddr.sin_port = htons(port);
-	inet_pton(AF_INET, serv, &servaddr.sin_addr);
+	memset(&we, 0, sizeof(struct wu_entry));
+	we.we_timestamp = dwu->d_timestamp;
+	we.we_checksum = dwu->d_checksum;
+	we.we_char = dwu->d_char;
 
-	connect(sockfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
-
-	return sockfd;
+	return wu_stream_write(ws, dwu->d_chunk_no, &we);
 }
 
-long get_verify_logs_num(char *log)
-{
-	FILE *logfile;
-	long num_logs = 1;
-	int ret;
-	char arg1[100], arg2[100], arg3[100], arg4[100];
-
-	logfile = fopen(log, "r");
-	if (!logfile) {
-		fprintf(stderr, "Error %d opening dest log: %s\n", errno,
-			strerror(errno));
-		num_logs = -1;
-		goto bail;
-	}
-
-	while (!feof(logfile)) {
-
-		ret = fscanf(logfile, "%s\t%s\t%s\t%s\n", arg1, arg2,
-			     arg3, arg4);
-		if (ret != 4) {
-			fprintf(stderr, "input failure from dest log, ret "
-				"%d, %d %s\n", ret, errno, strerror(errno));
-			num_logs = -1;
-			goto bail;
-		}
-
-		if (strcmp(arg1, "Reflink:"))
-			continue;
-		else
-			num_logs++;
-	}
+#define DEST_FILE_BATCH		1024
 
-bail:
-	if (logfile)
-		fclose(logfile);
+static unsigned int dest_verify_threads = 1;
 
-	return num_logs;
+void set_dest_verify_threads(unsigned int threads)
+{
+	dest_verify_threads = threads ? threads : 1;
 }
 
-int verify_dest_file(char *log, struct dest_logs d_log, unsigned long chunk_no)
+/*
+ * A reflink of the destructive test's original, named after the time
+ * it was taken, or the original itself with a zero reflink_ts.
+ */
+struct dest_file {
+	char filename[PATH_MAX];
+	unsigned long long reflink_ts;
+};
+
+static int dest_files_grow(struct dest_file **dfs, unsigned long nr)
 {
-	FILE *logfile;
-	struct dest_write_unit *dwus, dwu;
-	unsigned long i, t_bytes = sizeof(struct dest_write_unit) * chunk_no;
-	unsigned long record_index = 0;
-	int fd = 0, ret = 0, o_ret;
-	char arg1[100], arg2[100], arg3[100], arg4[100];
+	void *p;
 
-	memset(&dwu, 0, sizeof(struct dest_write_unit));
+	if (nr % DEST_FILE_BATCH)
+		return 0;
 
-	dwus = (struct dest_write_unit *)malloc(t_bytes);
-	memset(dwus, 0, t_bytes);
+	p = realloc(*dfs, (nr + DEST_FILE_BATCH) * sizeof(struct dest_file));
+	if (!p)
+		return -ENOMEM;
+	*dfs = p;
 
-	for (i = 0; i < chunk_no; i++)
-		dwus[i].d_chunk_no = i;
+	return 0;
+}
 
-	logfile = fopen(log, "r");
-	if (!logfile) {
-		fprintf(stderr, "Error %d opening dest log: %s\n", errno,
-			strerror(errno));
-		ret = -EINVAL;
-		goto bail;
+/*
+ * Collect the reflinks the destructive test left next to orig, they
+ * are named orig_target_<reflink time>_<pid>, orig itself comes last.
+ */
+static int scan_dest_files(char *orig, struct dest_file **dfs,
+			   unsigned long *nr_dfs)
+{
+	DIR *dir;
+	struct dirent *de;
+	char dirname[PATH_MAX], prefix[PATH_MAX], *base;
+	unsigned long long reflink_ts;
+	size_t prefix_len;
+	int pid, ret = 0;
+
+	*dfs = NULL;
+	*nr_dfs = 0;
+
+	snprintf(dirname, PATH_MAX, "%s", orig);
+	base = strrchr(dirname, '/');
+	if (base) {
+		*base++ = '\0';
+		snprintf(prefix, PATH_MAX, "%s_target_", base);
+	} else {
+		snprintf(prefix, PATH_MAX, "%s_target_", orig);
+		strcpy(dirname, ".");
 	}
+	prefix_len = strlen(prefix);
 
-	while (!feof(logfile)) {
+	dir = opendir(dirname);
+	if (!dir) {
+		ret = errno;
+		fprintf(stderr, "opendir %s failed:%d:%s\n", dirname, ret,
+			strerror(ret));
+		return -ret;
+	}
 
-		ret = fscanf(logfile, "%s\t%s\t%s\t%s\n", arg1, arg2,
-			     arg3, arg4);
-		if (ret != 4) {
-			fprintf(stderr, "input failure from dest log, ret "
-				"%d, %d %s\n", ret, errno, strerror(errno));
-			ret = -EINVAL;
-			goto bail;
-		}
+	while ((de = readdir(dir)) != NULL) {
+		if (strncmp(de->d_name, prefix, prefix_len))
+			continue;
 
-		if (!strcmp(arg1, "Reflink:"))
+		if (sscanf(de->d_name + prefix_len, "%llu_%d", &reflink_ts,
+			   &pid) != 2)
 			continue;
-		else {
-			dwu.d_chunk_no = atol(arg1);
-			if (dwu.d_chunk_no > chunk_no) {
-				fprintf(stderr, "Chunkno grabed from logfile "
-					"exceeds the filesize, you may probably"
-					" specify a too small filesize.\n");
-				return -1;
-			}
-			dwu.d_timestamp = atoll(arg2);
-			dwu.d_checksum = atoi(arg3);
-			dwu.d_char = arg4[0];
 
-			record_index++;
-		}
+		ret = dest_files_grow(dfs, *nr_dfs);
+		if (ret)
+			goto bail;
 
-		if (dwu.d_timestamp >= dwus[dwu.d_chunk_no].d_timestamp) {
+		snprintf((*dfs)[*nr_dfs].filename, PATH_MAX, "%s/%s", dirname,
+			 de->d_name);
+		(*dfs)[(*nr_dfs)++].reflink_ts = reflink_ts;
+	}
 
-			memmove(&dwus[dwu.d_chunk_no], &dwu,
-				sizeof(struct dest_write_unit));
-		}
+	ret = dest_files_grow(dfs, *nr_dfs);
+	if (ret)
+		goto bail;
 
-		if (record_index == d_log.index)
-			break;
+	snprintf((*dfs)[*nr_dfs].filename, PATH_MAX, "%s", orig);
+	(*dfs)[(*nr_dfs)++].reflink_ts = 0;
+
+bail:
+	closedir(dir);
 
+	if (ret) {
+		free(*dfs);
+		*dfs = NULL;
+		*nr_dfs = 0;
 	}
 
-	fd = open64(d_log.filename, open_ro_flags, FILE_MODE);
+	return ret;
+}
+
+/*
+ * A chunk whose latest record predates the reflink, or the original's
+ * chunks, have to match the record exactly. The table keeps no older
+ * records, so when the chunk was written again after the reflink any
+ * intact write of it from before the reflink passes.
+ */
+static int verify_dest_chunks(const char *filename, struct wu_table *wt,
+			      unsigned long chunk_no,
+			      unsigned long long reflink_ts, char *pattern)
+{
+	struct dest_write_unit dwu, ewu;
+	struct wu_entry we;
+	unsigned long i;
+	int fd, ret = 0;
+
+	fd = open64(filename, open_ro_flags, FILE_MODE);
 	if (fd < 0) {
-		ret = fd;
-		fd = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n",
-			d_log.filename, fd, strerror(fd));
-		goto bail;
+		ret = errno;
+		fprintf(stderr, "open file %s failed:%d:%s\n", filename, ret,
+			strerror(ret));
+		return -ret;
 	}
 
-	fprintf(stdout, "Verify file %s :", d_log.filename);
-
 	for (i = 0; i < chunk_no; i++) {
 
-		ret = pread(fd, chunk_pattern, CHUNK_SIZE, CHUNK_SIZE * i);
+		ret = pread(fd, pattern, CHUNK_SIZE, CHUNK_SIZE * i);
 		if (ret < 0) {
-			o_ret = ret;
 			ret = errno;
 			fprintf(stderr, "read failed:%d:%s\n", ret,
 				strerror(ret));
-			ret = o_ret;
-			goto bail;
+			ret = -ret;
+			break;
 		}
 
 		if (ret < CHUNK_SIZE) {
 			fprintf(stderr, "Short read happened, you may probably"
 				" set too big filesize for verfiy_test.\n");
-			return -1;
-		}
-
-		/*
-		dump_pattern(chunk_pattern, &dwu);
-		fprintf(stdout, "#%lu\t%llu\t%d\t%c\n", dwus[i].d_chunk_no,
-			dwus[i].d_timestamp, dwus[i].d_checksum,
-			dwus[i].d_char);
-		*/
-
-		/*
-		dump_pattern(chunk_pattern, &dwu);
-		fprintf(stdout, "#%lu\t%llu\t%d\t%c\n", dwu.d_chunk_no,
-			dwu.d_timestamp, dwu.d_checksum, dwu.d_char);
-		*/
-
-		if (!verify_chunk_pattern(chunk_pattern, &dwus[i])) {
-
-			dump_pattern(chunk_pattern, &dwu);
-			fprintf(stderr, "Inconsistent chunk found in file %s!\n"
-				"Expected:\tchunkno(%ld)\ttimestmp(%llu)\t"
-				"chksum(%d)\tchar(%c)\nFound   :\tchunkno"
-				"(%ld)\ttimestmp(%llu)\tchksum(%d)\tchar(%c)\n",
-				d_log.filename,
-				dwus[i].d_chunk_no, dwus[i].d_timestamp,
-				dwus[i].d_checksum, dwus[i].d_char,
-				dwu.d_chunk_no, dwu.d_timestamp,
-				dwu.d_checksum, dwu.d_char);
 			ret = -1;
-			goto bail;
-
+			break;
 		}
-	}
-
-	fprintf(stdout, "Pass\n");
-
-bail:
-	if (dwus)
-		free(dwus);
-
-	if (logfile)
-		fclose(logfile);
-
-	if (fd)
-		close(fd);
-
-	return ret;
-}
-
-int verify_dest_files(char *log, char *orig, unsigned long chunk_no)
-{
-	unsigned long record_index = 0, log_index = 0, i;
-	long log_nums;
-	int ret = 0;
-
-	struct dest_logs *logs = NULL;
-	FILE *logfile = NULL;
-	char arg1[100], arg2[100], arg3[100], arg4[100];
-
-	log_nums = get_verify_logs_num(log);
-	if (log_nums < 0) {
-		ret = log_nums;
-		goto bail;
-	}
-
-	logs = (struct dest_logs *)malloc(sizeof(struct dest_logs) * log_nums);
-
-	strncpy(logs[0].filename, orig, PATH_MAX);
 
-	logfile = fopen(log, "r");
-	if (!logfile) {
-		fprintf(stderr, "Error %d opening dest log: %s\n", errno,
-			strerror(errno));
-		ret = -EINVAL;
-		goto bail;
-	}
+		ret = 0;
 
-	while (!feof(logfile)) {
-
-		ret = fscanf(logfile, "%s\t%s\t%s\t%s\n", arg1, arg2,
-			     arg3, arg4);
-		if (ret != 4) {
-			fprintf(stderr, "input failure from dest log, ret "
-				"%d, %d %s\n", ret, errno, strerror(errno));
-			ret = -EINVAL;
-			goto bail;
+		memset(&ewu, 0, sizeof(struct dest_write_unit));
+		ewu.d_chunk_no = i;
+		if (wu_table_lookup_entry(wt, i, &we)) {
+			ewu.d_timestamp = we.we_timestamp;
+			ewu.d_checksum = we.we_checksum;
+			ewu.d_char = we.we_char;
 		}
 
-		if (strcmp(arg1, "Reflink:")) {
-			record_index++;
+		dump_pattern(pattern, &dwu);
+
+		if (!reflink_ts || ewu.d_timestamp < reflink_ts) {
+			if (verify_chunk_pattern(pattern, &ewu))
+				continue;
+		} else if (dwu.d_chunk_no == i &&
+			   dwu.d_timestamp < reflink_ts &&
+			   verify_chunk_pattern(pattern, &dwu)) {
 			continue;
-		} else {
-			log_index++;
-			strncpy(logs[log_index].filename, arg4, PATH_MAX);
-			logs[log_index].index = record_index;
-			/*
-			printf(" #%lu log: %s, index = %lu\n",log_index, arg4, record_index);
-			*/
 		}
-	}
-
-	logs[0].index = record_index;
 
-	for (i = 0; i < log_nums; i++) {
-		ret = verify_dest_file(log, logs[i], chunk_no);
-		if (ret < 0) {
-			ret = -1;
-			goto bail;
-		}
+		fprintf(stderr, "Inconsistent chunk found in file %s!\n"
+			"Expected:\tchunkno(%ld)\ttimestmp(%llu)\t"
+			"chksum(%d)\tchar(%c)\nFound   :\tchunkno"
+			"(%ld)\ttimestmp(%llu)\tchksum(%d)\tchar(%c)\n",
+			filename,
+			ewu.d_chunk_no, ewu.d_timestamp,
+			ewu.d_checksum, ewu.d_char,
+			dwu.d_chunk_no, dwu.d_timestamp,
+			dwu.d_checksum, dwu.d_char);
+		ret = -1;
+		break;
 	}
 
-bail:
-	if (logfile)
-		fclose(logfile);
-
-	if (logs)
-
-		free(logs);
+	close(fd);
 
 	return ret;
 }
 
-int set_semvalue(int sem_id, int val)
-{
-	union semun sem_union;
-
-	sem_union.val = val;
-	if (semctl(sem_id, 0, SETVAL, sem_union) == -1) {
-		perror("semctl");
-		return -1;
-	}
-
-	return 0;
-}
+struct dest_verify_worker {
+	struct wu_table *dv_wt;
+	struct dest_file *dv_dfs;
+	unsigned long dv_chunk_no;
+	unsigned long dv_first;		/* range of dv_dfs to verify */
+	unsigned long dv_last;
+	pthread_t dv_thread;
+	int dv_ret;
+};
 
-int semaphore_close(int sem_id)
+/*
+ * Workers share the table, lookups don't change it.
+ */
+static void *dest_verify_worker_fn(void *arg)
 {
+	struct dest_verify_worker *dv = (struct dest_verify_worker *)arg;
+	unsigned long i;
+	char *pattern = NULL;
 	int ret = 0;
 
-	ret = semctl(sem_id, 1, IPC_RMID);
-	if (ret < 0) {
-		ret = errno;
-		fprintf(stderr, "semctl failed, %s.\n", strerror(ret));
-		return -1;
+	/* aligned, the verify may well be reading through O_DIRECT */
+	pattern = (char *)o2test_dio_buf_get();
+	if (!pattern) {
+		ret = -ENOMEM;
+		goto out;
 	}
 
-	return ret;
-}
-
-int semaphore_p(int sem_id)
-{
-	struct sembuf sem_b;
-
-	sem_b.sem_num = 0;
-	sem_b.sem_op = -1; /* P() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_p failed\n");
-		return -1;
+	for (i = dv->dv_first; i < dv->dv_last; i++) {
+		ret = verify_dest_chunks(dv->dv_dfs[i].filename, dv->dv_wt,
+					 dv->dv_chunk_no,
+					 dv->dv_dfs[i].reflink_ts, pattern);
+		fprintf(stdout, "Verify file %s :%s\n",
+			dv->dv_dfs[i].filename, ret ? "Fail" : "Pass");
+		if (ret)
+			break;
 	}
 
-	return 0;
+out:
+	o2test_dio_buf_put(pattern);
+	dv->dv_ret = ret;
+
+	return NULL;
 }
 
-int semaphore_v(int sem_id)
+int verify_dest_files(struct wu_table *wt, char *orig, unsigned long chunk_no)
 {
-	struct sembuf sem_b;
-
-	sem_b.sem_num = 0;
-	sem_b.sem_op = 1; /* V() */
-	sem_b.sem_flg = SEM_UNDO;
-	if (semop(sem_id, &sem_b, 1) == -1) {
-		fprintf(stderr, "semaphore_v failed\n");
-		return -1;
-	}
+	struct dest_file *dfs;
+	struct dest_verify_worker *dvs = NULL;
+	unsigned long i, nr_dfs, nr_workers, per;
+	int ret;
 
-	return 0;
-}
+	ret = scan_dest_files(orig, &dfs, &nr_dfs);
+	if (ret)
+		return ret;
 
-int open_file(const char *filename, int flags)
-{
-	int fd, ret = 0;
+	nr_workers = dest_verify_threads;
+	if (nr_workers > nr_dfs)
+		nr_workers = nr_dfs;
 
-	fd = open64(filename, open_rw_flags, FILE_MODE);
-	if (fd < 0) {
-		ret = errno;
-		fprintf(stderr, "open file %s failed:%d:%s\n", filename, ret,
-			strerror(ret));
-		return -1;
+	dvs = (struct dest_verify_worker *)calloc(nr_workers, sizeof(*dvs));
+	if (!dvs) {
+		ret = -ENOMEM;
+		goto bail;
 	}
 
-	return fd;
-}
-
+	per = (nr_dfs + nr_workers - 1) / nr_workers;
 
-int punch_hole(int fd, uint64_t start, uint64_t len)
-{
-	int ret;
-	struct ocfs2_space_resv sr;
+	for (i = 0; i < nr_workers; i++) {
+		dvs[i].dv_wt = wt;
+		dvs[i].dv_dfs = dfs;
+		dvs[i].dv_chunk_no = chunk_no;
+		dvs[i].dv_first = i * per;
+		dvs[i].dv_last = (i + 1) * per;
+		if (dvs[i].dv_last > nr_dfs)
+			dvs[i].dv_last = nr_dfs;
+	}
 
-	memset(&sr, 0, sizeof(sr));
-	sr.l_whence = 0;
-	sr.l_start = start;
-	sr.l_len = len;
+	if (nr_workers == 1) {
+		dest_verify_worker_fn(&dvs[0]);
+	} else {
+		for (i = 0; i < nr_workers; i++) {
+			ret = pthread_create(&dvs[i].dv_thread, NULL,
+					     dest_verify_worker_fn, &dvs[i]);
+			if (ret) {
+				fprintf(stderr, "pthread_create failed:%d:%s\n",
+					ret, strerror(ret));
+				ret = -ret;
+				break;
+			}
+		}
 
-	ret = ioctl(fd, OCFS2_IOC_UNRESVSP64, &sr);
-	if (ret == -1) {
-		fprintf(stderr, "ioctl error %d: \"%s\"\n",
-			errno, strerror(errno));
-		return -1;
+		nr_workers = i;
+		for (i = 0; i < nr_workers; i++)
+			pthread_join(dvs[i].dv_thread, NULL);
 	}
 
-	return 0;
+	for (i = 0; i < nr_workers && !ret; i++)
+		if (dvs[i].dv_ret)
+			ret = -1;
+
+bail:
+	free(dvs);
+	free(dfs);
 
+	return ret;
 }
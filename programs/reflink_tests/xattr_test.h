@@ -33,6 +33,8 @@
 #include <signal.h>
 #include <time.h>
 
+#include "rand_ops.h"
+
 #define HOSTNAME_MAX_SZ         100
 #define MAX_FILENAME_SZ         255
 #define DEFAULT_ITER_NUMS       10
@@ -1,8 +1,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 
 #include <errno.h>
 #include <stdio.h>
@@ -10,57 +12,119 @@
 #include <string.h>
 #include <stdarg.h>
 
+#include "rand_ops.h"
+#include "lat_hist.h"
+#include "op_lat.h"
+
 //#define dprintf printf
-#define dprintf(str, ...) 
+#define dprintf(str, ...)
 
 static unsigned int seconds = 0;
 #define DEFAULT_BLKLEN 8102
 static unsigned int blklen = DEFAULT_BLKLEN;
+/* a write size range from -b min-max, 0 for the classic sizes */
+static unsigned int wsize_min = 0, wsize_max = 0;
+static unsigned int report_secs = 0;
+static int quiet = 0;
 
-static pid_t mypid, parent;
-static int die = 0;
-static int fd;
-static char *block;
+static pid_t mypid;
+static volatile sig_atomic_t die = 0;
 static int logfd = STDOUT_FILENO;
 #ifndef MAXHOSTNAMELEN
 #define MAXHOSTNAMELEN 256
 #endif
 static char hostn[MAXHOSTNAMELEN];
 
+#define NSEC_PER_SEC	1000000000ULL
+/* longest a paced thread sleeps before looking at die again */
+#define MAX_NAP_NSECS	(NSEC_PER_SEC / 10)
+
+struct wt_thread;
+
+/*
+ * One kind of torture, run by r_threads threads. r_rate is the ops/sec
+ * the role is paced at as a whole: 0 keeps the random sleeps of old
+ * between ops, below 0 runs flat out.
+ */
+struct role {
+	const char		*r_name;
+	int			r_open_flags;
+	char			r_fill;
+	unsigned int		r_sleep;	/* max usecs of a random sleep */
+	int			(*r_op)(struct wt_thread *wt);
+	unsigned int		r_threads;
+	double			r_rate;
+
+	/* what the reports have gathered up from the threads so far */
+	unsigned long long	r_ops;
+	unsigned long long	r_bytes;
+	struct lat_hist		r_lat;
+};
+
+/*
+ * The counters are only ever touched by the thread itself and by the
+ * reporter when it collects them, t_lock is never contended for long.
+ */
+struct wt_thread {
+	pthread_t		t_thread;
+	struct role		*t_role;
+	unsigned int		t_index;
+	unsigned long		t_stream;
+	int			t_fd;
+	char			*t_block;
+	unsigned long long	t_interval;	/* nsecs between ops if paced */
+	int			t_ret;
+
+	pthread_mutex_t		t_lock;
+	unsigned long long	t_ops;
+	unsigned long long	t_bytes;
+	struct lat_hist		t_lat;		/* usecs per op */
+};
+
+static struct wt_thread *threads;
+static unsigned int nr_threads;
+
 static void __logprint(const char *fmt, ...)
 {
 	int len;
-	static char str[4096];
+	char str[4096];
 	va_list ap;
 
 	va_start(ap, fmt);
 
 	len = vsnprintf(str, 4096, fmt, ap);
+	va_end(ap);
 	if (len == -1) {
 		len = errno;
 		fprintf(stderr, "%s: Can't log, error %d\n", hostn, len);
 		return;
 	}
+	if (len > 4095)
+		len = 4095;
 
 	write(logfd, str, len);
 }
 
-#define logprint(fmt, args...) __logprint("%s: [%u]: "fmt, hostn, mypid, args)
+#define logprint(wt, fmt, args...) do {					\
+	if (!quiet)							\
+		__logprint("%s: [%u.%s%u]: "fmt, hostn, mypid,		\
+			   (wt)->t_role->r_name, (wt)->t_index, args);	\
+} while (0)
 
-static unsigned long get_rand(unsigned long min, unsigned long max)
+static unsigned long long now_nsecs(void)
 {
-	if (min == 0 && max == 0)
-		return 0;
+	struct timespec ts;
 
-	return min + ((rand() % max) - min);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
 }
 
 static void random_sleep(unsigned int max_usecs)
 {
-	int r = rand();
 	unsigned int usec;
 
-	usec = r % max_usecs;
+	usec = get_rand(0, max_usecs - 1);
 
 	dprintf("%s:%u: sleep %u usec\n", hostn, mypid, usec);
 	usleep(usec);
@@ -70,75 +134,62 @@ static void signal_handler(int sig)
 {
 	dprintf("%s:%u: signal %d recieved\n", hostn, mypid, sig);
 	if (sig == SIGALRM)
-		logprint("Alarm fired! (%d)\n", sig);
+		__logprint("%s: [%u]: Alarm fired! (%d)\n", hostn, mypid, sig);
 
 	die = 1;
 }
 
-static int launch_child(char *fname, int open_flags, int (*newmain)(void))
+static void record_op(struct wt_thread *wt, unsigned long long start,
+		      unsigned long long bytes)
 {
-	pid_t pid;
-	int ret = 0;
+	unsigned long long usecs = (now_nsecs() - start) / 1000;
 
-	pid = fork();
-	if (!pid) {
-		fd = open(fname, open_flags);
-		if (fd == -1) {
-			ret = errno;
-			fprintf(stderr,
-				"%s: Error %d opening \"%s\"\n", hostn, 
-				ret, fname);
-			exit(ret);
-		}
+	pthread_mutex_lock(&wt->t_lock);
+	wt->t_ops++;
+	wt->t_bytes += bytes;
+	lat_hist_record(&wt->t_lat, usecs);
+	pthread_mutex_unlock(&wt->t_lock);
+}
 
-		mypid = getpid();
-		srand(mypid);
-		ret = newmain();
-		exit(ret);
-	}
-	if (pid == -1) {
-		ret = errno;
-		fprintf(stderr, "%s: could not fork: %d\n", hostn, ret);
-	}
+/* the classic sizes unless -b gave a range */
+static unsigned int write_len(unsigned int classic)
+{
+	if (!wsize_min)
+		return classic;
 
-	return ret;
+	return get_rand(wsize_min, wsize_max);
 }
 
-static int do_write(int fd, const char *buf, unsigned int len)
+static int do_write(struct wt_thread *wt, unsigned int len)
 {
 	int written, ret = 0;
+	unsigned long long start = now_nsecs();
 
-	written = write(fd, buf, len);
+	written = timed_write(wt->t_fd, wt->t_block, len);
 	if (written == -1) {
 		ret = errno;
-		fprintf(stderr, "%s:%d: append write failure %d len[%d]\n", 
+		fprintf(stderr, "%s:%d: append write failure %d len[%d]\n",
 			hostn, mypid, ret, len);
-	} else if (written < len)
+		return ret;
+	}
+
+	record_op(wt, start, written);
+
+	if (written < len)
 		fprintf(stderr, "%s:%d: short write! len = %u, written = %u\n",
 			hostn, mypid, len, written);
 
 	return ret;
 }
 
-static int append_writer(void)
+static int append_writer(struct wt_thread *wt)
 {
-	int ret = 0;
 	int len;
 
-	memset(block, 'a', blklen);
-
-	while (!die) {
-		len = get_rand(1, blklen);
-		logprint("append write len             : %d\n", len);
-
-		ret = do_write(fd, block, len);
-		if (ret)
-			break;
-
-		random_sleep(100000);
-	}
+	len = write_len(get_rand(1, blklen));
+	logprint(wt, "append write len             : %d\n", len);
 
-	return ret;
+	return do_write(wt, len);
 }
 
 static int get_i_size(int fd, unsigned long *size)
@@ -149,7 +200,7 @@ static int get_i_size(int fd, unsigned long *size)
 	ret = fstat(fd, &stat);
 	if (ret == -1) {
 		ret = errno;
-		fprintf(stderr, "%s:%d: stat failure %d\n", 
+		fprintf(stderr, "%s:%d: stat failure %d\n",
 		        hostn, mypid, ret);
 		return ret;
 	}
@@ -158,159 +209,437 @@ static int get_i_size(int fd, unsigned long *size)
 	return ret;
 }
 
-static int random_in_place_writer(void)
+static int random_in_place_writer(struct wt_thread *wt)
 {
 	int ret = 0;
 	unsigned long size;
+	unsigned int len = write_len(blklen);
 	off_t off;
 
-	memset(block, 'i', blklen);
-
-	while (!die) {
-		ret = get_i_size(fd, &size);
-		if (ret)
-			break;
-		off = 0;
-
-		if (size > blklen)
-			off = get_rand(0, size - blklen);
-
-		lseek(fd, off, SEEK_SET);
+	ret = get_i_size(wt->t_fd, &size);
+	if (ret)
+		return ret;
+	off = 0;
 
-		logprint("write in place offset        : %lu\n",
-			 (unsigned long) off);
+	if (size > len)
+		off = get_rand(0, size - len);
 
-		ret = do_write(fd, block, blklen);
-		if (ret)
-			break;
+	lseek(wt->t_fd, off, SEEK_SET);
 
-		random_sleep(100000);
-	}
+	logprint(wt, "write in place offset        : %lu\n",
+		 (unsigned long) off);
 
-	return ret;
+	return do_write(wt, len);
 }
 
-static int random_past_size_writer(void)
+static int random_past_size_writer(struct wt_thread *wt)
 {
-	int ret = 0;
+	unsigned int len = write_len(blklen);
 	off_t off;
 
-	memset(block, 'p', blklen);
+	off = get_rand(0, 3 * len);
 
-	while (!die) {
-		off = get_rand(0, 3 * blklen);
-
-		lseek(fd, off, SEEK_END);
-
-		logprint("write past i_size offset     : %lu\n",
-			 (unsigned long) off);
+	lseek(wt->t_fd, off, SEEK_END);
 
-		ret = do_write(fd, block, blklen);
-		if (ret)
-			break;
-
-		random_sleep(100000);
-	}
+	logprint(wt, "write past i_size offset     : %lu\n",
+		 (unsigned long) off);
 
-	return ret;
+	return do_write(wt, len);
 }
 
 /* Give us some leeway so that the other writers don't have to check
  * that the file size doesn't grow too large */
-#define MAX_TRUNCATE_SIZE (2147483647 - (100 * blklen))
+#define MAX_TRUNCATE_SIZE (2147483647 - (100 * (off_t)blklen))
 
-static int truncate_caller(int up)
+static int truncate_caller(struct wt_thread *wt, int up)
 {
 	int ret = 0;
 	unsigned long size;
+	unsigned long long start;
 	off_t len;
 	char *where = "down";
 
 	if (up)
 		where = " up ";
 
-	while (!die) {
-
-		do {
-			ret = get_i_size(fd, &size);
-			if (ret)
-				goto out;
+	ret = get_i_size(wt->t_fd, &size);
+	if (ret)
+		return ret;
 
-			len = get_rand(0, size / 3);
-			if (up)
-				len += size;
-		} while ((len > MAX_TRUNCATE_SIZE) && (len < 0));
+	len = get_rand(0, size / 3);
+	if (up)
+		len += size;
+	if (len > MAX_TRUNCATE_SIZE)
+		len = MAX_TRUNCATE_SIZE;
 
-		if (size && len) {
-			logprint("truncate %s to size        : %d\n",
-				 where, len);
+	if (size && len) {
+		logprint(wt, "truncate %s to size        : %ld\n",
+			 where, (long)len);
 
-			ret = ftruncate(fd, len);
-			if (ret == -1) {
-				ret = errno;
-				fprintf(stderr, "%s:%d: truncate error %d\n",
-					hostn, mypid, ret);
-				break;
-			}
+		start = now_nsecs();
+		ret = timed_ftruncate(wt->t_fd, len);
+		if (ret == -1) {
+			ret = errno;
+			fprintf(stderr, "%s:%d: truncate error %d\n",
+				hostn, mypid, ret);
+			return ret;
 		}
-
-		random_sleep(200000 + 200000 * up);
+		record_op(wt, start, 0);
 	}
 
-out:
 	return ret;
 }
 
-static int truncate_down(void)
+static int truncate_down(struct wt_thread *wt)
 {
-	return truncate_caller(0);
+	return truncate_caller(wt, 0);
 }
 
-static int truncate_up(void)
+static int truncate_up(struct wt_thread *wt)
 {
-	return truncate_caller(1);
+	return truncate_caller(wt, 1);
 }
 
-static int straddling_eof_writer(void)
+static int straddling_eof_writer(struct wt_thread *wt)
 {
 	int ret = 0;
 	unsigned long size;
+	unsigned int len = write_len(blklen);
 	off_t off;
 
-	memset(block, 's', blklen);
+	ret = get_i_size(wt->t_fd, &size);
+	if (ret)
+		return ret;
+	off = size;
+
+	if (off >= len)
+		off -= get_rand(0, len - 1);
+
+	lseek(wt->t_fd, off, SEEK_SET);
+
+	logprint(wt, " write straddling offset      : %lu\n",
+		 (unsigned long) off);
+
+	return do_write(wt, len);
+}
+
+static struct role roles[] = {
+	{ "append",	O_RDWR|O_APPEND, 'a', 100000, append_writer, 1 },
+	{ "inplace",	O_RDWR,		 'i', 100000, random_in_place_writer, 1 },
+	{ "pastsize",	O_RDWR,		 'p', 100000, random_past_size_writer, 1 },
+	{ "truncdown",	O_RDWR,		 0,   200000, truncate_down, 1 },
+	{ "truncup",	O_RDWR,		 0,   400000, truncate_up, 1 },
+	{ "straddle",	O_WRONLY,	 's', 100000, straddling_eof_writer, 1 },
+};
+
+#define NUM_ROLES	(sizeof(roles) / sizeof(roles[0]))
+
+/* keeps to the role's rate without bursting to catch up on a stall */
+static void pace(struct wt_thread *wt, unsigned long long *next)
+{
+	struct role *r = wt->t_role;
+	unsigned long long now, nap;
+	struct timespec ts;
+
+	if (!r->r_rate) {
+		random_sleep(r->r_sleep);
+		return;
+	}
+
+	if (r->r_rate < 0)
+		return;
+
+	now = now_nsecs();
+	*next += wt->t_interval;
+	if (now > *next + NSEC_PER_SEC)
+		*next = now;
+
+	while (!die && now < *next) {
+		nap = *next - now;
+		if (nap > MAX_NAP_NSECS)
+			nap = MAX_NAP_NSECS;
+		ts.tv_sec = nap / NSEC_PER_SEC;
+		ts.tv_nsec = nap % NSEC_PER_SEC;
+		nanosleep(&ts, NULL);
+		now = now_nsecs();
+	}
+}
+
+static void *role_thread(void *arg)
+{
+	struct wt_thread *wt = (struct wt_thread *)arg;
+	unsigned long long next = now_nsecs();
+	int ret;
+
+	o2test_rand_stream(wt->t_stream);
 
 	while (!die) {
-		ret = get_i_size(fd, &size);
-		if (ret)
+		ret = wt->t_role->r_op(wt);
+		if (ret) {
+			wt->t_ret = ret;
+			/* same as a child dying used to, stop the test */
+			die = 1;
 			break;
-		off = size;
+		}
+
+		pace(wt, &next);
+	}
 
-		if (off >= blklen)
-			off -= get_rand(0, blklen);
+	return NULL;
+}
 
-		lseek(fd, off, SEEK_SET);
+static int launch_threads(char *fname)
+{
+	struct wt_thread *wt;
+	struct role *r;
+	unsigned int i, j, n = 0, total = 0, max_len;
+	int ret;
 
-		logprint(" write straddling offset      : %lu\n",
-			 (unsigned long) off);
+	for (i = 0; i < NUM_ROLES; i++)
+		total += roles[i].r_threads;
 
-		ret = do_write(fd, block, blklen);
-		if (ret)
-			break;
+	if (!total) {
+		fprintf(stderr, "%s: No threads to run\n", hostn);
+		return EINVAL;
+	}
+
+	threads = (struct wt_thread *)calloc(total, sizeof(*threads));
+	if (!threads)
+		return ENOMEM;
+
+	max_len = wsize_min ? wsize_max : blklen;
+
+	for (i = 0; i < NUM_ROLES; i++) {
+		r = &roles[i];
+		lat_hist_init(&r->r_lat);
+
+		for (j = 0; j < r->r_threads; j++) {
+			wt = &threads[n];
+			wt->t_role = r;
+			wt->t_index = j;
+			wt->t_stream = n + 1;
+			if (r->r_rate > 0)
+				wt->t_interval = NSEC_PER_SEC *
+					r->r_threads / r->r_rate;
+			pthread_mutex_init(&wt->t_lock, NULL);
+			lat_hist_init(&wt->t_lat);
+
+			wt->t_block = (char *)malloc(max_len);
+			if (!wt->t_block) {
+				fprintf(stderr, "%s: Not enough memory to "
+					"allocate %u bytes\n", hostn, max_len);
+				ret = ENOMEM;
+				goto out_close;
+			}
+			memset(wt->t_block, r->r_fill, max_len);
+
+			wt->t_fd = timed_open(fname, r->r_open_flags, 0);
+			if (wt->t_fd == -1) {
+				ret = errno;
+				fprintf(stderr,
+					"%s: Error %d opening \"%s\"\n", hostn,
+					ret, fname);
+				goto out_close;
+			}
+			n++;
+		}
+	}
 
-		random_sleep(100000);
+	/* only threads actually started get joined and collected */
+	for (i = 0; i < n; i++) {
+		ret = pthread_create(&threads[i].t_thread, NULL, role_thread,
+				     &threads[i]);
+		if (ret) {
+			fprintf(stderr, "%s: could not start thread: %d\n",
+				hostn, ret);
+			die = 1;
+			return ret;
+		}
+		nr_threads++;
+	}
+
+	return 0;
+
+out_close:
+	/* threads[n] is the one that failed half way */
+	free(threads[n].t_block);
+	while (n--) {
+		close(threads[n].t_fd);
+		free(threads[n].t_block);
 	}
 
 	return ret;
 }
 
+static void print_stats(const char *when, double secs, struct role *r,
+			unsigned long long ops, unsigned long long bytes,
+			struct lat_hist *lh)
+{
+	__logprint("%s: [%u]: %s %8.1fs %-9s x%-3u %10llu ops %10.1f ops/s "
+		   "%8.2f MB/s usecs p50 %llu p99 %llu p999 %llu max %llu\n",
+		   hostn, mypid, when, secs, r->r_name, r->r_threads, ops,
+		   secs > 0 ? ops / secs : 0.0,
+		   secs > 0 ? bytes / secs / (1024 * 1024) : 0.0,
+		   (unsigned long long)lat_hist_percentile(lh, 50.0),
+		   (unsigned long long)lat_hist_percentile(lh, 99.0),
+		   (unsigned long long)lat_hist_percentile(lh, 99.9),
+		   (unsigned long long)(lh->lh_count ? lh->lh_max : 0));
+}
+
+/*
+ * Takes what every thread has done since the last call, prints it per
+ * role for the interval and adds it to the role's totals.
+ */
+static void collect_stats(double secs, int print)
+{
+	static struct lat_hist lh;
+	struct wt_thread *wt;
+	struct role *r;
+	unsigned long long ops, bytes;
+	unsigned int i, j;
+
+	for (i = 0; i < NUM_ROLES; i++) {
+		r = &roles[i];
+		if (!r->r_threads)
+			continue;
+
+		ops = bytes = 0;
+		lat_hist_init(&lh);
+
+		for (j = 0; j < nr_threads; j++) {
+			wt = &threads[j];
+			if (wt->t_role != r)
+				continue;
+
+			pthread_mutex_lock(&wt->t_lock);
+			ops += wt->t_ops;
+			bytes += wt->t_bytes;
+			lat_hist_merge(&lh, &wt->t_lat);
+			wt->t_ops = wt->t_bytes = 0;
+			lat_hist_init(&wt->t_lat);
+			pthread_mutex_unlock(&wt->t_lock);
+		}
+
+		r->r_ops += ops;
+		r->r_bytes += bytes;
+		lat_hist_merge(&r->r_lat, &lh);
+
+		if (print)
+			print_stats("interval", secs, r, ops, bytes, &lh);
+	}
+}
+
+static void run_reports(void)
+{
+	unsigned long long start = now_nsecs(), last = start, now;
+	struct timespec ts = { 0, MAX_NAP_NSECS };
+
+	while (!die) {
+		nanosleep(&ts, NULL);
+
+		now = now_nsecs();
+		if (report_secs &&
+		    now - last >= report_secs * NSEC_PER_SEC) {
+			collect_stats((now - last) / (double)NSEC_PER_SEC, 1);
+			last = now;
+		}
+	}
+}
+
 static void usage(void)
 {
 	fprintf(stderr,
-		"usage: write_torture [-s <seconds>] [-b <blocksize>] <path>\n"
+		"usage: write_torture [-s <seconds>] [-b <blocksize>] "
+		"[-t <role>=<threads>[@<rate>]]... [-i <secs>] [-q] "
+		"[--seed <seed>] <path>\n"
 		"<seconds> defaults to '0' (run forever)\n"
 		"<blocksize> defaults to 8092\n"
 		"For best results choose a <blocksize> value that is not a\n"
-		"multiple of the file system cluster size.\n");
+		"multiple of the file system cluster size.\n"
+		"<blocksize> may be a range, <min>-<max>, every write then\n"
+		"picks its size from it.\n"
+		"<role> is one of append, inplace, pastsize, truncdown, truncup\n"
+		"or straddle and runs in <threads> threads. Once one -t is\n"
+		"given only the roles named run. <rate> is the target ops/sec\n"
+		"for the role as a whole, or \"max\" to run flat out. Without\n"
+		"it the threads sleep a random while between ops, as they\n"
+		"always have.\n"
+		"-i prints ops, throughput and latency per role every <secs>,\n"
+		"totals are always printed at the end.\n"
+		"-q stops the per operation log lines.\n");
+}
+
+static int parse_role(char *arg)
+{
+	char *eq, *at, *end;
+	unsigned int i;
+	long count;
+	static int seen_one = 0;
+
+	eq = strchr(arg, '=');
+	if (!eq)
+		return EINVAL;
+	*eq = '\0';
+
+	for (i = 0; i < NUM_ROLES; i++) {
+		if (!strcmp(arg, roles[i].r_name))
+			break;
+	}
+	if (i == NUM_ROLES)
+		return EINVAL;
+
+	/* the first -t switches off every role not asked for */
+	if (!seen_one) {
+		unsigned int k;
+
+		for (k = 0; k < NUM_ROLES; k++)
+			roles[k].r_threads = 0;
+		seen_one = 1;
+	}
+
+	count = strtol(eq + 1, &end, 10);
+	if (end == eq + 1 || count < 0)
+		return EINVAL;
+	roles[i].r_threads = count;
+
+	at = end;
+	if (*at == '\0')
+		return 0;
+	if (*at != '@')
+		return EINVAL;
+
+	if (!strcmp(at + 1, "max")) {
+		roles[i].r_rate = -1;
+		return 0;
+	}
+
+	roles[i].r_rate = strtod(at + 1, &end);
+	if (end == at + 1 || *end != '\0' || roles[i].r_rate <= 0)
+		return EINVAL;
+
+	return 0;
+}
+
+static int parse_blocksize(char *arg)
+{
+	char *end;
+
+	blklen = strtoul(arg, &end, 10);
+	if (*end == '\0')
+		return blklen ? 0 : EINVAL;
+
+	if (*end != '-')
+		return EINVAL;
+
+	wsize_min = blklen;
+	wsize_max = strtoul(end + 1, &end, 10);
+	if (*end != '\0' || !wsize_min || wsize_max < wsize_min)
+		return EINVAL;
+
+	/* truncates and offsets still go by the biggest write */
+	blklen = wsize_max;
+
+	return 0;
 }
 
 static int parse_opts(int argc, char **argv, char **fname)
@@ -320,7 +649,7 @@ static int parse_opts(int argc, char **argv, char **fname)
 	*fname = NULL;
 
 	while (1) {
-		c = getopt(argc, argv, "s:b:");
+		c = getopt(argc, argv, "s:b:t:i:q");
 		if (c == -1)
 			break;
 
@@ -329,13 +658,24 @@ static int parse_opts(int argc, char **argv, char **fname)
 			seconds = atoi(optarg);
 			break;
 		case 'b':
-			blklen = atoi(optarg);
+			if (parse_blocksize(optarg))
+				return EINVAL;
+			break;
+		case 't':
+			if (parse_role(optarg))
+				return EINVAL;
+			break;
+		case 'i':
+			report_secs = atoi(optarg);
+			break;
+		case 'q':
+			quiet = 1;
 			break;
 		default:
 			return EINVAL;
 		}
 	}
- 
+
 	if (argc - optind != 1)
 		return EINVAL;
 
@@ -346,54 +686,50 @@ static int parse_opts(int argc, char **argv, char **fname)
 
 int main(int argc, char **argv)
 {
-	int ret = 0;
-	int status;
-	pid_t pid;
+	int ret = 0, fd;
+	unsigned int i;
+	unsigned long long start;
 	char *fname;
-	printf("will get hostname\n");
-        gethostname(hostn, MAXHOSTNAMELEN);
-	printf("got hostname\n");
 
+	gethostname(hostn, MAXHOSTNAMELEN);
 
 	if ((argc < 2) || (strcmp(argv[1],"-h") == 0)) {
 		usage();
 		return 1;
 	}
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (parse_opts(argc, argv, &fname)) {
 		usage();
 		return 1;
 	}
 
 	if (seconds)
-		printf("%s: Will bound the test at about %u seconds\n", 
+		printf("%s: Will bound the test at about %u seconds\n",
 			hostn, seconds);
-	if (blklen != DEFAULT_BLKLEN)
+	if (wsize_min)
+		printf("%s: Using write sizes of %u to %u bytes\n", hostn,
+		       wsize_min, wsize_max);
+	else if (blklen != DEFAULT_BLKLEN)
 		printf("%s: Using block size of %u bytes\n", hostn, blklen);
-
-	block = malloc(blklen);
-	if (!block) {
-		fprintf(stderr, "%s: Not enough memory to allocate %u bytes\n",
-			hostn, blklen);
-		return ENOMEM;
-	}
+	fflush(stdout);
 
 	/* prep the file */
 	fd = open(fname, O_RDWR|O_CREAT|O_TRUNC,
 		  S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
 	if (fd == -1) {
 		ret = errno;
-		fprintf(stderr, "%s: Error %d opening \"%s\"\n", 
+		fprintf(stderr, "%s: Error %d opening \"%s\"\n",
 		        hostn, ret, fname);
 		return ret;
 	}
 	close(fd);
 
-	parent = mypid = getpid();
+	mypid = getpid();
 
-	/* setup the parent. */
 	if (signal(SIGINT, signal_handler) == SIG_ERR) {
-		fprintf(stderr, "%s: Couldn't setup parent signal handler!\n",
+		fprintf(stderr, "%s: Couldn't setup signal handler!\n",
 		        hostn);
 		return 1;
 	}
@@ -404,87 +740,46 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	ret = launch_child(fname, O_RDWR|O_APPEND, append_writer);
-	if (!ret)
-		ret = launch_child(fname, O_RDWR, random_in_place_writer);
-	if (!ret)
-		ret = launch_child(fname, O_RDWR, random_past_size_writer);
-	if (!ret)
-		ret = launch_child(fname, O_RDWR, truncate_down);
-	if (!ret)
-		ret = launch_child(fname, O_RDWR, truncate_up);
-	if (!ret)
-		ret = launch_child(fname, O_WRONLY, straddling_eof_writer);
-	if (ret) {
-		fprintf(stderr, "%s: Error %d launching children\n", 
-		        hostn, ret);
-		goto kill_all;
-	}
-
 	if (seconds) {
 		if (signal(SIGALRM, signal_handler) == SIG_ERR) {
 			fprintf(stderr, "%s: Couldn't setup SIGALRM handler!\n",
 			        hostn);
-			goto kill_all;
-		}
-
-		ret = alarm(seconds);
-		if (ret) {
-			fprintf(stderr, "%s: alarm(2) returns %u\n", 
-				hostn, ret);
-			goto kill_all;
+			return 1;
 		}
 	}
 
-	while (1) {
-		status = 0;
-		pid = waitpid(-1, &status, WNOHANG);
-		if (die) {
-			dprintf("%s: die has been set, kill remaining "
-				"children\n", hostn);
-			break;
-		}
-		if (pid == -1) {
-			ret = errno;
-			if (ret != -ECHILD)
-				fprintf(stderr,
-					"%s: Error %d returned from wait\n", 
-					hostn, ret);
-			break;
-		}
+	start = now_nsecs();
 
-		if (!WIFEXITED(status)) {
-			fprintf(stderr, 
-			        "%s: Child %u dies abormally - stopping "
-				"test\n", hostn, pid);
-			if (WIFSIGNALED(status))
-				fprintf(stderr, 
-					"%s: It couldn't catch sig %d\n",
-					hostn, WTERMSIG(status));
-			break;
-		}
+	ret = launch_threads(fname);
+	if (ret) {
+		fprintf(stderr, "%s: Error %d launching threads\n",
+		        hostn, ret);
+		die = 1;
+	} else if (seconds) {
+		alarm(seconds);
+	}
 
-		if (pid)
-			dprintf("%s:child %u dies with status %d\n", 
-				hostn, pid, WEXITSTATUS(status));
+	run_reports();
 
-		if (WEXITSTATUS(status)) {
-			ret = WEXITSTATUS(status);
-			fprintf(stderr, "%s: Child %u dies with error %d - "
-				"stopping test\n", hostn, pid, ret);
-			break;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].t_thread, NULL);
+		if (threads[i].t_ret && !ret) {
+			ret = threads[i].t_ret;
+			fprintf(stderr, "%s: Thread %s%u died with error %d - "
+				"stopping test\n", hostn,
+				threads[i].t_role->r_name,
+				threads[i].t_index, ret);
 		}
-
-		/* check every half a second */
-		usleep(500000);
 	}
 
-kill_all:
-	/* Kill the remaining children */
-	if (ret != -ECHILD) {
-		kill(0, SIGINT);
-		dprintf("%s: Killed children\n", hostn);
+	collect_stats(0, 0);
+	for (i = 0; i < NUM_ROLES; i++) {
+		if (roles[i].r_threads)
+			print_stats("total   ",
+				    (now_nsecs() - start) / (double)NSEC_PER_SEC,
+				    &roles[i], roles[i].r_ops,
+				    roles[i].r_bytes, &roles[i].r_lat);
 	}
 
-	return ret == -ECHILD ? ret : 0;
+	return ret;
 }
@@ -21,6 +21,7 @@
 
 #include "xattr-test.h"
 #include <mpi.h>
+#include "mpi_rand.h"
 
 
 static char *prog;
@@ -68,7 +69,7 @@ static void usage(void)
 {
 	printf("usage: %s [-i <iterations>] [-x <EA_nums>] [-n <EA_namespace>] "
 	       "[-t <File_type>] [-l <EA_name_length>] [-s <EA_value_size>] "
-	       "[-o] [-k] [-r] <path> \n\n"
+	       "[-o] [-k] [-r] [--seed <seed>] <path> \n\n"
 	       "<iterations> defaults to %d.\n"
 	       "<EA_nums> defaults to %d.\n"
 	       "<EA_namespace> defaults to user,currently,can be user,system,"
@@ -80,6 +81,7 @@ static void usage(void)
 	       "[-k] keep the EA entries after test.\n"
 	       "[-r] Do test in a random way.\n"
 	       "[-o] Only do concurrent add test.\n"
+	       "<seed> replays the random names and values of an earlier run.\n"
 	       "<path> is required.\n"
 	       "Will rotate up to <iterations> times.\n"
 	       "In each pass, will create a series of files,"
@@ -127,6 +129,8 @@ static void setup(int argc, char *argv[])
 	else
 		prog++;
 
+	MPI_Seed_Setup(&argc, argv);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -72,7 +72,8 @@ static void usage(void)
 {
 	printf("usage: %s [-i <iterations>] [-x <EA_nums>] [-n <EA_namespace>] "
 	       "[-t <File_type>] [-l <EA_name_length>] [-s <EA_value_size>] "
-	       "[-m <Child_nums>] [-f <file_nums> ] [-r] [-k] <path>.\n\n"
+	       "[-m <Child_nums>] [-f <file_nums> ] [-r] [-k] [--seed <seed>] "
+	       "<path>.\n\n"
 	       "<iterations> defaults to %d.\n"
 	       "<EA_nums> defaults to %d.\n"
 	       "<EA_namespace> defaults to user,currently,can be user,system,"
@@ -87,6 +88,7 @@ static void usage(void)
 	       "directory and symlink.\n"
 	       "[-r] launch the random update/add/remove test.\n"
 	       "[-k] keep the EA entries after test.\n"
+	       "<seed> replays the random names and values of an earlier run.\n"
 	       "<path> is required.\n"
 	       "Will rotate up to <iterations> times.\n"
 	       "In each pass, will create a series of files,"
@@ -112,6 +114,8 @@ static void setup(int argc, char *argv[])
 	else
 		prog++;
 
+	o2test_seed_setup(&argc, argv, 0);
+
 	if (parse_opts(argc, argv))
 		usage();
 
@@ -386,6 +390,7 @@ static void one_round_run(enum FILE_TYPE ft, int round_no)
 
 			/*child try to create/modify file,add/update xattr*/
 			if (pid == 0) {
+				o2test_rand_stream(i + 1);
 				memset(filename, 0, MAX_FILENAME_SZ + 1);
 				snprintf(filename, MAX_FILENAME_SZ,
 					"%s/multiplefile_%s_test_round%d-%d-%d",
@@ -556,6 +561,7 @@ static void one_round_run(enum FILE_TYPE ft, int round_no)
 			}
 			/*Child*/
 			if (pid == 0) {
+				o2test_rand_stream(i + 1);
 				for (k = 0; k < XATTR_CHILD_UPDATE_TIMES; k++) {
 					for (j = 0; j < xattr_nums; j++) {
 						strcpy(xattr_name, xattr_name_list_set[j]);
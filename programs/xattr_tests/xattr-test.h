@@ -31,6 +31,8 @@
 #include <signal.h>
 #include <time.h>
 
+#include "rand_ops.h"
+
 #define HOSTNAME_MAX_SZ         100
 #define PATH_SZ                 100
 #define MAX_FILENAME_SZ         200